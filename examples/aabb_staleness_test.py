@@ -0,0 +1,53 @@
+#!/usr/bin/env python3
+
+#queries the closest points on a triangle mesh, reassigns V and then F from python with matrices of the same size (which are copied into the existing buffers) and queries again. The queries after each reassignment have to see the new triangles and not the ones the AABB tree was built on
+#doesn't need a viewer:
+#   ./aabb_staleness_test.py
+
+try:
+  import torch
+except ImportError:
+  pass
+from easypbr  import *
+import numpy as np
+import sys
+
+#two triangles, one in the plane z=0 and one far away in the plane z=10
+V=np.array([ [0,0,0], [1,0,0], [0,1,0],
+             [0,0,10], [1,0,10], [0,1,10] ], dtype=np.float64)
+F=np.array([ [0,1,2], [3,4,5] ], dtype=np.int32)
+mesh=Mesh()
+mesh.V=V
+mesh.F=F
+query=np.array([ [0.2, 0.2, 1.0] ])
+
+cloud=Mesh()
+cloud.V=query
+
+failed=False
+def check(name, expected_dist, expected_face):
+    global failed
+    dists, points, ids=mesh.closest_points(query)
+    if abs(dists[0]-expected_dist)>1e-5 or ids[0]!=expected_face:
+        print("FAILED:", name, "closest_points returned distance", dists[0], "on face", ids[0], "instead of", expected_dist, "on face", expected_face)
+        failed=True
+    D=cloud.compute_distance_to_mesh(mesh)
+    if abs(D[0,0]-expected_dist**2)>1e-5:
+        print("FAILED:", name, "compute_distance_to_mesh returned", D[0,0], "instead of", expected_dist**2)
+        failed=True
+
+check("first query", 1.0, 0) #builds the tree
+
+#move the first triangle up to z=3, same shape so only the version tells the tree is stale
+V_moved=V.copy()
+V_moved[0:3,2]=3.0
+mesh.V=V_moved
+check("after reassigning V", 2.0, 0)
+
+#swap the order of the faces, the closest one is now face 1
+mesh.F=F[::-1].copy()
+check("after reassigning F", 2.0, 1)
+
+if not failed:
+    print("ok: the AABB tree follows the reassigned V and F")
+sys.exit(1 if failed else 0)
@@ -0,0 +1,43 @@
+#!/usr/bin/env python3
+
+#renders a mesh from many random poses on a sphere around it, as one would do for generating a dataset, and prints how many images per second are rendered and written
+#it doesn't need a gpu, with the mesa software renderer it also runs on machines without one. The GL context is still created through a window so it needs an X display, xvfb-run provides a virtual one:
+#   LIBGL_ALWAYS_SOFTWARE=1 xvfb-run -a ./batch_render.py
+
+try:
+  import torch
+except ImportError:
+  pass
+from easypbr  import *
+import numpy as np
+
+config_file="./config/offscreen.cfg" #sets the use_offscreen flag
+nr_poses=1000
+output_path="./recordings/batch"
+
+view=Viewer.create(config_file)
+
+mesh=Mesh("./data/scan_the_world/masterpiece-goliath-ii.stl")
+mesh.model_matrix.rotate_axis_angle( [1.0, 0.0, 0.0], -90 )
+Scene.show(mesh,"mesh")
+view.update() #the first draw sets up the camera so that it sees the whole scene
+
+#cameras on a sphere around the point that the default camera looks at
+lookat=view.m_camera.lookat()
+radius=view.m_camera.dist_to_lookat()
+cameras=[]
+for i in range(nr_poses):
+    direction=np.random.randn(3)
+    direction/=np.linalg.norm(direction)
+    cam=view.m_camera.clone()
+    cam.set_position(lookat+direction*radius) #keeps looking at the lookat point
+    cameras.append(cam)
+
+recorder=view.m_recorder
+recorder.set_image_format("Ppm") #uncompressed, the fastest to write
+images_per_sec=recorder.render_poses(cameras, output_path)
+print("rendered and wrote ", nr_poses, " images at ", images_per_sec, " images/s")
+
+#keeping them in memory only measures the rendering and the downloads
+mats=recorder.render_poses_to_mats(cameras[:100])
+print("rendered to memory at ", recorder.last_batch_images_per_sec(), " images/s")
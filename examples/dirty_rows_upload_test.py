@@ -0,0 +1,56 @@
+#!/usr/bin/env python3
+
+#streams color updates of a random cloud like a per frame recoloring would do and checks that only the rows marked with set_dirty_rows are sent to the gpu
+#runs headless with the offscreen config and exits with an error if the uploaded bytes are not the expected ones:
+#   LIBGL_ALWAYS_SOFTWARE=1 ./dirty_rows_upload_test.py
+#this test hasn't been run yet: it was written in a tree that couldn't be built, so the expected bytes haven't been checked against a real upload either
+
+try:
+  import torch
+except ImportError:
+  pass
+from easypbr  import *
+import numpy as np
+import sys
+
+config_file="./config/offscreen.cfg" #sets the use_offscreen flag
+nr_points=100000
+nr_frames=20
+bytes_per_row=3*4 #colors are uploaded as 3 floats per vertex
+
+view=Viewer.create(config_file)
+view.m_packed_vertex_buffers=False #the packed format interleaves the colors with the positions and counts them as V
+
+rng=np.random.default_rng(0)
+cloud=Mesh()
+cloud.V=rng.uniform(-1.0, 1.0, (nr_points,3))
+cloud.C=rng.uniform(0.0, 1.0, (nr_points,3))
+cloud.m_vis.m_show_points=True
+cloud.m_vis.set_color_pervertcolor()
+Scene.show(cloud,"cloud")
+view.update()
+
+def check(name, got, expected):
+    if got!=expected:
+        print("FAILED:", name, "uploaded", got, "bytes but expected", expected)
+        sys.exit(1)
+
+#the first upload sends everything
+expected_C=nr_points*bytes_per_row
+expected_V=cloud.bytes_uploaded("V")
+check("first upload of C", cloud.bytes_uploaded("C"), expected_C)
+
+for i in range(nr_frames):
+    nr_rows=0 if i==0 else int(rng.integers(1, nr_points//10)) #an empty batch should upload nothing
+    row_start=int(rng.integers(0, nr_points-nr_rows))
+    C=cloud.C
+    C[row_start:row_start+nr_rows]=rng.uniform(0.0, 1.0, (nr_rows,3))
+    cloud.C=C
+    cloud.set_dirty_rows("C", row_start, nr_rows)
+    view.update()
+
+    expected_C+=nr_rows*bytes_per_row
+    check("C in frame "+str(i), cloud.bytes_uploaded("C"), expected_C)
+    check("V in frame "+str(i), cloud.bytes_uploaded("V"), expected_V)
+
+print("OK, uploaded", cloud.bytes_uploaded("C"), "bytes of colors in", nr_frames, "frames instead of", (nr_frames+1)*nr_points*bytes_per_row)
@@ -0,0 +1,113 @@
+#!/usr/bin/env python3
+
+#measures what the storage of the per vertex attributes costs: the load time and peak memory of reading a large binary ply cloud (positions, normals and colors) and, with --gpu, the time of uploading those attributes again
+#run it once with a build that has CORE_WITH_FLOAT_MESH off and once with it on and compare the two outputs. The type of the build is printed from the dtype of V. Every load runs in its own process so that the peak resident memory is only that of one load
+#the upload needs a gl context, it runs with the offscreen config so for a machine without a display:
+#   ./float_mesh_benchmark.py 20000000
+#   LIBGL_ALWAYS_SOFTWARE=1 xvfb-run ./float_mesh_benchmark.py 5000000 --gpu
+
+import numpy as np
+import subprocess
+import tempfile
+import time
+import os
+import sys
+
+nr_repeats=3
+config_file="./config/offscreen.cfg" #sets the use_offscreen flag
+
+def write_cloud(path, nr_points):
+    rng=np.random.default_rng(0)
+    vertex=np.empty(nr_points, dtype=[("x","<f4"),("y","<f4"),("z","<f4"), ("nx","<f4"),("ny","<f4"),("nz","<f4"), ("red","u1"),("green","u1"),("blue","u1")])
+    for name in ["x","y","z","nx","ny","nz"]:
+        vertex[name]=rng.standard_normal(nr_points, dtype=np.float32)
+    for name in ["red","green","blue"]:
+        vertex[name]=rng.integers(0, 256, nr_points, dtype=np.uint8)
+    header="ply\nformat binary_little_endian 1.0\nelement vertex "+str(nr_points)+"\n"
+    header+="property float x\nproperty float y\nproperty float z\n"
+    header+="property float nx\nproperty float ny\nproperty float nz\n"
+    header+="property uchar red\nproperty uchar green\nproperty uchar blue\n"
+    header+="end_header\n"
+    with open(path, "wb") as f:
+        f.write(header.encode("ascii"))
+        vertex.tofile(f)
+
+#runs in the child process, prints the time of the read, the nr of points, the dtype of V and the time of the uploads if asked for
+def child(path, load, gpu):
+    try:
+      import torch
+    except ImportError:
+      pass
+    from easypbr import Mesh, Viewer, Scene
+    view=Viewer.create(config_file) if gpu else None
+    mesh=Mesh()
+    if not load:
+        print(0.0, 0, "none", 0.0, 0)
+        return
+    start=time.time()
+    mesh.read_ply(path)
+    elapsed=time.time()-start
+
+    upload_time=0.0
+    upload_bytes=0
+    if gpu:
+        mesh.m_vis.m_show_points=True
+        Scene.show(mesh,"cloud")
+        view.update() #first upload allocates the buffers
+        times=[]
+        for i in range(nr_repeats):
+            for attrib in ["V","C","NV"]:
+                mesh.set_dirty(attrib)
+            start=time.time()
+            view.upload_single_mesh_to_gpu(mesh, False)
+            times.append(time.time()-start)
+        upload_time=min(times)
+        upload_bytes=sum(mesh.bytes_uploaded(attrib) for attrib in ["V","C","NV"])//(nr_repeats+1)
+    print(elapsed, mesh.V.shape[0], mesh.V.dtype, upload_time, upload_bytes)
+
+#returns the output of the child and the peak resident memory of its whole process in MB
+def run(path, load, gpu):
+    args=[sys.executable, os.path.abspath(__file__), "--child", path, "1" if load else "0", "1" if gpu else "0"]
+    proc=subprocess.Popen(args, stdout=subprocess.PIPE)
+    out=proc.stdout.read().decode().split()
+    _, status, rusage=os.wait4(proc.pid, 0)
+    if status!=0:
+        print("FAILED: the child exited with status", status)
+        sys.exit(1)
+    return float(out[0]), int(out[1]), out[2], float(out[3]), int(out[4]), rusage.ru_maxrss/1024.0 #ru_maxrss is in KB on linux
+
+if __name__ == "__main__":
+    if len(sys.argv)>1 and sys.argv[1]=="--child":
+        child(sys.argv[2], sys.argv[3]=="1", sys.argv[4]=="1")
+        sys.exit(0)
+
+    gpu="--gpu" in sys.argv
+    args=[a for a in sys.argv[1:] if a!="--gpu"]
+    nr_points=int(args[0]) if args else 20000000
+    path=os.path.join(tempfile.mkdtemp(), "cloud.ply")
+    write_cloud(path, nr_points)
+    print("cloud with", nr_points, "points, file of", os.path.getsize(path)/1024.0/1024.0, "MB")
+
+    #the memory of just importing the module (and creating the context), so that it can be subtracted
+    _, _, _, _, _, base_mb=run(path, False, gpu)
+
+    run(path, True, False) #warms the page cache
+    times=[]
+    upload_times=[]
+    peak_mb=0
+    for i in range(nr_repeats):
+        elapsed, nr_read, dtype, upload_time, upload_bytes, mb=run(path, True, gpu)
+        if nr_read!=nr_points:
+            print("FAILED: read", nr_read, "points instead of", nr_points)
+            sys.exit(1)
+        times.append(elapsed)
+        upload_times.append(upload_time)
+        peak_mb=max(peak_mb, mb)
+
+    #V, NV and C of 3 scalars each
+    expected_mb=nr_points*9*(4 if dtype=="float32" else 8)/1024.0/1024.0
+    print("attributes stored as", dtype, "so V, NV and C take", expected_mb, "MB")
+    print("read_ply in", min(times)*1000, "ms, peak memory", peak_mb-base_mb, "MB over the", base_mb, "MB of the base")
+    if gpu:
+        print("upload of V, C and NV in", min(upload_times)*1000, "ms,", upload_bytes/1024.0/1024.0, "MB per upload")
+    os.remove(path)
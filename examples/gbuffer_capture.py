@@ -0,0 +1,35 @@
+#!/usr/bin/env python3
+
+#renders a mesh offscreen from a few views and captures the whole gbuffer of each view into a single .npz with float32 arrays for color, albedo, normal, metalness_and_roughness, depth, depth_linear and ao
+#it also runs without a gpu with a software GL context:
+#   LIBGL_ALWAYS_SOFTWARE=1 ./gbuffer_capture.py
+
+try:
+  import torch
+except ImportError:
+  pass
+from easypbr  import *
+import numpy as np
+import os
+
+config_file="./config/offscreen.cfg" #sets the use_offscreen flag
+nr_views=8
+output_path="./recordings/gbuffer"
+
+view=Viewer.create(config_file)
+
+mesh=Mesh("./data/scan_the_world/masterpiece-goliath-ii.stl")
+mesh.model_matrix.rotate_axis_angle( [1.0, 0.0, 0.0], -90 )
+Scene.show(mesh,"mesh")
+
+recorder=view.m_recorder
+
+for i in range(nr_views):
+    view.m_camera.orbit_y(360.0/nr_views)
+    view.update()
+    recorder.capture_gbuffer(str(i)+".npz", output_path)
+recorder.flush() #waits for the downloads and the writes
+
+layers=np.load(os.path.join(output_path, "0.npz"))
+for name in layers.files:
+    print(name, layers[name].shape, layers[name].dtype, layers[name].min(), layers[name].max())
@@ -0,0 +1,51 @@
+#!/usr/bin/env python3
+
+#queries the neighbours of a cloud, reassigns V from python with a matrix of the same size (which is copied into the existing buffer) and queries again. The second query has to see the new points and not the ones the kd-tree was built on
+#doesn't need a viewer:
+#   ./kdtree_staleness_test.py
+
+try:
+  import torch
+except ImportError:
+  pass
+from easypbr  import *
+import numpy as np
+import sys
+
+nr_points=10000
+rng=np.random.default_rng(0)
+
+cloud=Mesh()
+cloud.V=rng.uniform(-1.0, 1.0, (nr_points,3))
+query=np.zeros((1,3))
+
+failed=False
+
+idx, dist=cloud.knn(query, 1) #builds the kd-tree
+expected=np.argmin(np.linalg.norm(cloud.V-query, axis=1))
+if idx[0,0]!=expected:
+    print("FAILED: the first query returned", idx[0,0], "but the closest point is", expected)
+    failed=True
+
+#same shape so the data pointer and the number of rows don't change, only the version tells the tree is stale
+new_V=rng.uniform(-1.0, 1.0, (nr_points,3))
+new_V[123]=[0.0, 0.0, 0.0]
+cloud.V=new_V
+idx, dist=cloud.knn(query, 1)
+if idx[0,0]!=123 or dist[0,0]>1e-6:
+    print("FAILED: after reassigning V the query returned", idx[0,0], "at distance", dist[0,0], "instead of 123 at distance 0")
+    failed=True
+
+#a second reassignment, this time from a modified copy of the current V, checked with the radius search
+V=cloud.V.copy()
+V[456]=[0.0, 0.0, 0.0]
+V[123]=[1.0, 1.0, 1.0]
+cloud.V=V
+idx, dist=cloud.radius_search(query, 1e-3)
+if idx[0,0]!=456:
+    print("FAILED: the radius search after reassigning V returned", idx[0,0], "instead of 456")
+    failed=True
+
+if not failed:
+    print("ok: the kd-tree follows the reassigned V")
+sys.exit(1 if failed else 0)
@@ -0,0 +1,89 @@
+#!/usr/bin/env python3
+
+#loads a missing file and some truncated files on the load pool and checks that each failure comes back as an exception from the future instead of aborting the process. A good file is loaded at the end to check that the pool still works
+#doesn't need a viewer:
+#   ./load_errors_test.py
+
+try:
+  import torch
+except ImportError:
+  pass
+from easypbr  import *
+import numpy as np
+import tempfile
+import os
+import sys
+
+tmp_dir=tempfile.mkdtemp()
+nr_verts=1000
+
+def write_ply(path, nr_verts_declared, verts, faces=None):
+    header="ply\nformat binary_little_endian 1.0\n"
+    header+="element vertex "+str(nr_verts_declared)+"\n"
+    header+="property float x\nproperty float y\nproperty float z\n"
+    if faces is not None:
+        header+="element face "+str(len(faces))+"\n"
+        header+="property list uchar int vertex_indices\n"
+    header+="end_header\n"
+    with open(path, "wb") as f:
+        f.write(header.encode("ascii"))
+        f.write(verts.astype("<f4").tobytes())
+        if faces is not None:
+            for face in faces:
+                f.write(np.uint8(3).tobytes())
+                f.write(face.astype("<i4").tobytes())
+
+def write_pcd(path, nr_points_declared, points):
+    header="VERSION .7\nFIELDS x y z\nSIZE 4 4 4\nTYPE F F F\nCOUNT 1 1 1\n"
+    header+="WIDTH "+str(nr_points_declared)+"\nHEIGHT 1\nVIEWPOINT 0 0 0 1 0 0 0\n"
+    header+="POINTS "+str(nr_points_declared)+"\nDATA binary\n"
+    with open(path, "wb") as f:
+        f.write(header.encode("ascii"))
+        f.write(points.astype("<f4").tobytes())
+
+rng=np.random.default_rng(0)
+verts=rng.uniform(-1.0, 1.0, (nr_verts,3))
+faces=rng.integers(0, nr_verts, (200,3))
+
+bad_files={}
+bad_files["missing"]=os.path.join(tmp_dir, "does_not_exist.ply")
+bad_files["truncated ply vertices"]=os.path.join(tmp_dir, "truncated_vertices.ply")
+write_ply(bad_files["truncated ply vertices"], nr_verts, verts[:nr_verts//2])
+bad_files["truncated ply faces"]=os.path.join(tmp_dir, "truncated_faces.ply")
+write_ply(bad_files["truncated ply faces"], nr_verts, verts, faces)
+with open(bad_files["truncated ply faces"], "r+b") as f:
+    f.truncate(os.path.getsize(bad_files["truncated ply faces"])-100)
+bad_files["truncated pcd"]=os.path.join(tmp_dir, "truncated.pcd")
+write_pcd(bad_files["truncated pcd"], nr_verts, verts[:nr_verts//2])
+bad_files["not a ply"]=os.path.join(tmp_dir, "garbage.ply")
+with open(bad_files["not a ply"], "wb") as f:
+    f.write(rng.bytes(4096))
+
+failed=False
+futures={name: Mesh.load_from_file_async(path) for name, path in bad_files.items()}
+for name, future in futures.items():
+    try:
+        future.get()
+        print("FAILED:", name, "loaded without an error")
+        failed=True
+    except RuntimeError as e:
+        print("ok:", name, "->", e)
+
+#the synchronous load reports the same errors
+try:
+    Mesh().load_from_file(bad_files["missing"], False)
+    print("FAILED: synchronous load of a missing file did not raise")
+    failed=True
+except RuntimeError as e:
+    print("ok: synchronous missing ->", e)
+
+good_path=os.path.join(tmp_dir, "good.ply")
+write_ply(good_path, nr_verts, verts, faces)
+mesh=Mesh.load_from_file_async(good_path).get()
+if mesh.V.shape[0]!=nr_verts or mesh.F.shape[0]!=len(faces):
+    print("FAILED: the good file loaded with", mesh.V.shape[0], "vertices and", mesh.F.shape[0], "faces")
+    failed=True
+else:
+    print("ok: the good file still loads after the failures")
+
+sys.exit(1 if failed else 0)
@@ -0,0 +1,50 @@
+#!/usr/bin/env python3
+
+#shows many small meshes to measure how the scene and the viewer scale with the number of meshes. Prints the time for adding them, for looking them up by name and for rendering
+
+try:
+  import torch
+except ImportError:
+  pass
+from easypbr  import *
+import time
+
+config_file="./config/primitives.cfg"
+
+nr_meshes=10000
+nr_lookups=100000
+nr_frames=100
+
+view=Viewer.create(config_file)
+Scene.set_floor_visible(False)
+
+side=int(nr_meshes**0.5)
+
+start=time.time()
+for i in range(nr_meshes):
+    box=Mesh()
+    box.create_box(0.5,0.5,0.5)
+    box.model_matrix.translate([ i%side, 0, i//side ])
+    Scene.show(box,"box_"+str(i))
+print("show ", nr_meshes, " meshes took ", time.time()-start, " s")
+
+#showing a mesh with a name that already exists replaces it
+start=time.time()
+for i in range(nr_meshes):
+    box=Mesh()
+    box.create_box(0.5,0.5,0.5)
+    box.model_matrix.translate([ i%side, 0, i//side ])
+    Scene.show(box,"box_"+str(i))
+print("replacing ", nr_meshes, " meshes took ", time.time()-start, " s")
+
+start=time.time()
+for i in range(nr_lookups):
+    mesh=Scene.get_mesh_with_name("box_"+str( (i*7919)%nr_meshes ))
+print(nr_lookups, " lookups by name took ", time.time()-start, " s")
+
+view.update() #first update uploads all the meshes to gpu
+start=time.time()
+for i in range(nr_frames):
+    view.update()
+elapsed=time.time()-start
+print(nr_frames, " frames took ", elapsed, " s, ", elapsed/nr_frames*1000, " ms per frame")
@@ -0,0 +1,34 @@
+#!/usr/bin/env python3
+
+#times the parallel recalculate_normals against the libigl one and checks that they give the same result. Also times compute_tangents
+
+try:
+  import torch
+except ImportError:
+  pass
+from easypbr  import *
+import numpy as np
+import time
+
+nr_repeats=5
+
+mesh=Mesh()
+mesh.create_sphere([0,0,0], 1)
+mesh.upsample(5, False) #every subdivision multiplies the nr of faces by 4
+print("mesh has ", mesh.V.shape[0], " vertices and ", mesh.F.shape[0], " faces")
+
+def time_it(func):
+    start=time.time()
+    for i in range(nr_repeats):
+        func()
+    return (time.time()-start)/nr_repeats*1000
+
+ms_igl=time_it( lambda: mesh.recalculate_normals(use_libigl=True) )
+NV_igl=mesh.NV.copy()
+NF_igl=mesh.NF.copy()
+ms_parallel=time_it( lambda: mesh.recalculate_normals() )
+print("recalculate_normals libigl ", ms_igl, " ms, parallel ", ms_parallel, " ms, speedup ", ms_igl/ms_parallel)
+print("max difference NV ", np.abs(mesh.NV-NV_igl).max(), " NF ", np.abs(mesh.NF-NF_igl).max())
+
+ms_tangents=time_it( lambda: mesh.compute_tangents() )
+print("compute_tangents ", ms_tangents, " ms")
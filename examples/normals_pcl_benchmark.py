@@ -0,0 +1,123 @@
+#!/usr/bin/env python3
+
+#times estimate_normals_from_neighbourhood on a large noisy wavy surface, as an unorganized cloud through the kd-tree and as an organized one through the window of pixels, and compares it with the normal estimation of pcl (through python-pcl) and open3d when they are installed
+#part of the points are set to zero or nan like the missing pixels of a depth map. They have to get a zero normal and the normals of the rest have to agree with the analytic ones of the surface. The size of the grid can be given as argument, the default makes 4M points:
+#   ./normals_pcl_benchmark.py 2000
+
+import numpy as np
+import time
+import sys
+
+nr_repeats=3
+radius=0.003
+max_nr_neighbours=30
+
+def make_surface(n):
+    rng=np.random.default_rng(0)
+    ys, xs=np.mgrid[0:n, 0:n]
+    xs=xs.ravel().astype(np.float64)/(n-1)
+    ys=ys.ravel().astype(np.float64)/(n-1)
+    zs=np.sin(xs*6.0)*np.cos(ys*6.0)*0.1 + 1.0 #shifted away from the origin so the sensor is on one side of it
+    points=np.stack([xs,ys,zs],1)
+    #analytic normals of z=f(x,y), pointing towards the origin
+    dzdx=0.6*np.cos(xs*6.0)*np.cos(ys*6.0)
+    dzdy=-0.6*np.sin(xs*6.0)*np.sin(ys*6.0)
+    normals=np.stack([dzdx, dzdy, -np.ones_like(xs)],1)
+    normals/=np.linalg.norm(normals, axis=1, keepdims=True)
+    points+=rng.normal(0, 1e-4, points.shape)
+    #missing points
+    missing=rng.random(n*n)<0.05
+    points[missing & (rng.random(n*n)<0.5)]=0.0
+    points[missing & ~np.all(points==0.0, axis=1)]=np.nan
+    return points, normals, missing
+
+def best_time(fn):
+    times=[]
+    for i in range(nr_repeats):
+        start=time.time()
+        out=fn()
+        times.append(time.time()-start)
+    return min(times), out
+
+#fraction of the valid points whose normal is within 10 degrees of the analytic one
+def accuracy(normals, expected, missing):
+    valid=~missing
+    cos=np.abs(np.sum(normals[valid]*expected[valid], axis=1))
+    return np.mean(cos>np.cos(np.radians(10.0)))
+
+failed=False
+def check_missing(name, normals, missing):
+    global failed
+    if np.any(normals[missing]!=0.0):
+        print("FAILED:", name, "gave a normal to", np.count_nonzero(np.any(normals[missing]!=0.0, axis=1)), "missing points")
+        failed=True
+
+if __name__ == "__main__":
+    try:
+      import torch
+    except ImportError:
+      pass
+    from easypbr import Mesh
+
+    n=int(sys.argv[1]) if len(sys.argv)>1 else 2000
+    points, expected, missing=make_surface(n)
+    print("surface with", points.shape[0], "points of which", np.count_nonzero(missing), "are missing")
+
+    results={}
+
+    cloud=Mesh()
+    cloud.V=points
+    def run_unorganized():
+        cloud.estimate_normals_from_neighbourhood(radius, max_nr_neighbours, False)
+        return np.array(cloud.NV)
+    elapsed, normals=best_time(run_unorganized)
+    check_missing("the kd-tree path", normals, missing)
+    results["easypbr kd-tree"]=(elapsed, accuracy(normals, expected, missing))
+
+    organized=Mesh()
+    organized.V=points
+    organized.m_width=n
+    organized.m_height=n
+    def run_organized():
+        organized.estimate_normals_from_neighbourhood(radius, 25, False)
+        return np.array(organized.NV)
+    elapsed, normals=best_time(run_organized)
+    check_missing("the organized path", normals, missing)
+    results["easypbr organized"]=(elapsed, accuracy(normals, expected, missing))
+
+    #the libraries get only the valid points since neither of them handles nan in its kd-tree
+    valid_points=points[~missing]
+    try:
+        import pcl
+        pcl_cloud=pcl.PointCloud(valid_points.astype(np.float32))
+        def run_pcl():
+            ne=pcl_cloud.make_NormalEstimation()
+            ne.set_SearchMethod(pcl_cloud.make_kdtree())
+            ne.set_RadiusSearch(radius)
+            return ne.compute().to_array()[:,0:3]
+        elapsed, valid_normals=best_time(run_pcl)
+        normals=np.zeros_like(points)
+        normals[~missing]=valid_normals
+        results["pcl"]=(elapsed, accuracy(normals, expected, missing))
+    except ImportError:
+        print("python-pcl is not installed, skipping it")
+    try:
+        import open3d as o3d
+        o3d_cloud=o3d.geometry.PointCloud(o3d.utility.Vector3dVector(valid_points))
+        def run_open3d():
+            o3d_cloud.estimate_normals(o3d.geometry.KDTreeSearchParamHybrid(radius=radius, max_nn=max_nr_neighbours))
+            return np.asarray(o3d_cloud.normals)
+        elapsed, valid_normals=best_time(run_open3d)
+        normals=np.zeros_like(points)
+        normals[~missing]=valid_normals
+        results["open3d"]=(elapsed, accuracy(normals, expected, missing))
+    except ImportError:
+        print("open3d is not installed, skipping it")
+
+    for name, (elapsed, acc) in results.items():
+        print(name, "in", elapsed*1000, "ms,", acc*100, "% of the normals within 10 degrees")
+        if acc<0.9:
+            print("FAILED:", name, "has too many wrong normals")
+            failed=True
+
+    sys.exit(1 if failed else 0)
@@ -0,0 +1,68 @@
+#!/usr/bin/env python3
+
+#writes layers of different types and channels with the NpzWriter that capture_gbuffer uses and reads them back with numpy.load, checking the names, shapes, dtypes and values. Also checks the vertical flip used for gl textures
+#doesn't need a viewer:
+#   ./npz_roundtrip_test.py
+
+try:
+  import torch
+except ImportError:
+  pass
+from easypbr  import *
+import numpy as np
+import tempfile
+import os
+import sys
+
+rng=np.random.default_rng(0)
+h=37 #odd sizes so that the rows are not aligned to anything
+w=53
+
+#from_numpy wraps the array without copying so they have to stay alive until they are added
+arrays={}
+arrays["depth"]=rng.random((h,w,1), dtype=np.float32)
+arrays["normal"]=rng.random((h,w,3), dtype=np.float32)
+arrays["color"]=rng.random((h,w,4), dtype=np.float32)
+arrays["labels"]=rng.integers(-1000, 1000, (h,w,1)).astype(np.int32)
+arrays["mask"]=rng.integers(0, 127, (h,w,3)).astype(np.int8) #from_numpy maps int8 to an 8 bit unsigned mat
+
+npz=NpzWriter()
+mats=[]
+for name, arr in arrays.items():
+    mat=Mat()
+    mat.from_numpy(arr)
+    mats.append(mat)
+    npz.add(name, mat)
+flipped_mat=Mat()
+flipped_mat.from_numpy(arrays["normal"])
+npz.add("normal_flipped", flipped_mat, flip_vertically=True)
+
+path=os.path.join(tempfile.mkdtemp(), "layers.npz")
+if not npz.write(path):
+    print("FAILED: could not write", path)
+    sys.exit(1)
+
+failed=False
+def check(name, got, expected):
+    global failed
+    if got.shape!=expected.shape or got.dtype!=expected.dtype or not np.array_equal(got, expected):
+        print("FAILED:", name, "read back as", got.shape, got.dtype, "but expected", expected.shape, expected.dtype)
+        failed=True
+    else:
+        print("ok:", name, got.shape, got.dtype)
+
+layers=np.load(path)
+expected_names=set(arrays.keys()) | {"normal_flipped"}
+if set(layers.files)!=expected_names:
+    print("FAILED: the file has the layers", sorted(layers.files), "instead of", sorted(expected_names))
+    failed=True
+
+#single channel layers are stored as (h,w)
+check("depth", layers["depth"], arrays["depth"][:,:,0])
+check("normal", layers["normal"], arrays["normal"])
+check("color", layers["color"], arrays["color"])
+check("labels", layers["labels"], arrays["labels"][:,:,0])
+check("mask", layers["mask"], arrays["mask"].view(np.uint8))
+check("normal_flipped", layers["normal_flipped"], arrays["normal"][::-1])
+
+sys.exit(1 if failed else 0)
@@ -0,0 +1,79 @@
+#!/usr/bin/env python3
+
+#writes a large synthetic obj grid with positions, texture coordinates and normals and times read_obj with one thread and with all of them. Also checks that the corners got welded back into one vertex per grid point
+#every read runs in its own process so that OMP_NUM_THREADS can be set. The size of the grid can be given as argument, the default makes about 8M faces:
+#   ./obj_load_benchmark.py 2000
+
+import numpy as np
+import subprocess
+import tempfile
+import time
+import os
+import sys
+
+nr_repeats=3
+
+def write_grid(path, n):
+    ys, xs=np.mgrid[0:n, 0:n]
+    xs=xs.ravel().astype(np.float64)/(n-1)
+    ys=ys.ravel().astype(np.float64)/(n-1)
+    zs=np.sin(xs*10.0)*np.cos(ys*10.0)*0.1
+    #two triangles per cell, the indices of obj start at 1. Position and texture coordinate share the index and there is a single normal
+    idx=np.arange(n*n).reshape(n,n)+1
+    a=idx[:-1,:-1].ravel()
+    b=idx[:-1,1:].ravel()
+    c=idx[1:,:-1].ravel()
+    d=idx[1:,1:].ravel()
+    faces=np.concatenate([np.stack([a,b,d],1), np.stack([a,d,c],1)])
+    with open(path, "w") as f:
+        np.savetxt(f, np.stack([xs,ys,zs],1), fmt="v %.6f %.6f %.6f")
+        np.savetxt(f, np.stack([xs,ys],1), fmt="vt %.6f %.6f")
+        f.write("vn 0 0 1\n")
+        np.savetxt(f, np.repeat(faces,2,axis=1), fmt="f %d/%d/1 %d/%d/1 %d/%d/1")
+    return n*n, faces.shape[0]
+
+#runs in the child process, prints the time it took to read the file and what was read
+def child(path):
+    try:
+      import torch
+    except ImportError:
+      pass
+    from easypbr import Mesh
+    mesh=Mesh()
+    start=time.time()
+    mesh.read_obj(path, True, True)
+    elapsed=time.time()-start
+    print(elapsed, mesh.V.shape[0], mesh.F.shape[0], mesh.UV.shape[0])
+
+def run(path, nr_threads):
+    env=dict(os.environ)
+    if nr_threads:
+        env["OMP_NUM_THREADS"]=str(nr_threads)
+    out=subprocess.run([sys.executable, os.path.abspath(__file__), "--child", path], env=env, stdout=subprocess.PIPE, check=True).stdout.decode().split()
+    return float(out[0]), int(out[1]), int(out[2]), int(out[3])
+
+if __name__ == "__main__":
+    if len(sys.argv)>1 and sys.argv[1]=="--child":
+        child(sys.argv[2])
+        sys.exit(0)
+
+    n=int(sys.argv[1]) if len(sys.argv)>1 else 2000
+    path=os.path.join(tempfile.mkdtemp(), "grid.obj")
+    nr_verts, nr_faces=write_grid(path, n)
+    print("grid with", nr_verts, "vertices and", nr_faces, "faces, file of", os.path.getsize(path)/1024.0/1024.0, "MB")
+
+    results={}
+    for name, nr_threads in [("1 thread", 1), ("all threads", None)]:
+        run(path, nr_threads) #warms the page cache
+        times=[]
+        for i in range(nr_repeats):
+            elapsed, nr_read_verts, nr_read_faces, nr_read_uv=run(path, nr_threads)
+            if nr_read_verts!=nr_verts or nr_read_faces!=nr_faces or nr_read_uv!=nr_verts:
+                print("FAILED: read", nr_read_verts, "vertices,", nr_read_faces, "faces and", nr_read_uv, "uvs instead of", nr_verts, nr_faces, nr_verts)
+                sys.exit(1)
+            times.append(elapsed)
+        results[name]=min(times)
+        print(name, "read_obj in", min(times)*1000, "ms,", nr_faces/min(times)/1e6, "M faces/s")
+
+    print("parallel speedup", results["1 thread"]/results["all threads"])
+    os.remove(path)
@@ -0,0 +1,92 @@
+#!/usr/bin/env python3
+
+#writes a large synthetic binary ply cloud (positions, normals and colors) and reports the load time and the peak memory of the memory mapped read_ply against the previous tinyply reader
+#every load runs in its own process so that the peak resident memory of one reader doesn't hide the other. The nr of points can be given as argument, the default makes a file of about 0.5GB:
+#   ./ply_load_benchmark.py 20000000
+
+import numpy as np
+import subprocess
+import tempfile
+import time
+import os
+import sys
+
+nr_repeats=3
+
+def write_cloud(path, nr_points):
+    rng=np.random.default_rng(0)
+    vertex=np.empty(nr_points, dtype=[("x","<f4"),("y","<f4"),("z","<f4"), ("nx","<f4"),("ny","<f4"),("nz","<f4"), ("red","u1"),("green","u1"),("blue","u1")])
+    for name in ["x","y","z","nx","ny","nz"]:
+        vertex[name]=rng.standard_normal(nr_points, dtype=np.float32)
+    for name in ["red","green","blue"]:
+        vertex[name]=rng.integers(0, 256, nr_points, dtype=np.uint8)
+    header="ply\nformat binary_little_endian 1.0\nelement vertex "+str(nr_points)+"\n"
+    header+="property float x\nproperty float y\nproperty float z\n"
+    header+="property float nx\nproperty float ny\nproperty float nz\n"
+    header+="property uchar red\nproperty uchar green\nproperty uchar blue\n"
+    header+="end_header\n"
+    with open(path, "wb") as f:
+        f.write(header.encode("ascii"))
+        vertex.tofile(f)
+
+#runs in the child process, prints the time it took to read the file
+def child(reader, path):
+    try:
+      import torch
+    except ImportError:
+      pass
+    from easypbr import Mesh
+    mesh=Mesh()
+    if reader=="none":
+        print(0.0, 0)
+        return
+    start=time.time()
+    if reader=="mmap":
+        mesh.read_ply(path)
+    else:
+        mesh.read_ply_tinyply(path)
+    elapsed=time.time()-start
+    print(elapsed, mesh.V.shape[0])
+
+#returns the time of the read and the peak resident memory of the whole process in MB
+def run(reader, path):
+    proc=subprocess.Popen([sys.executable, os.path.abspath(__file__), "--child", reader, path], stdout=subprocess.PIPE)
+    out=proc.stdout.read().decode().split()
+    _, status, rusage=os.wait4(proc.pid, 0)
+    if status!=0:
+        print("FAILED: the", reader, "reader exited with status", status)
+        sys.exit(1)
+    return float(out[0]), int(out[1]), rusage.ru_maxrss/1024.0 #ru_maxrss is in KB on linux
+
+if __name__ == "__main__":
+    if len(sys.argv)>1 and sys.argv[1]=="--child":
+        child(sys.argv[2], sys.argv[3])
+        sys.exit(0)
+
+    nr_points=int(sys.argv[1]) if len(sys.argv)>1 else 20000000
+    path=os.path.join(tempfile.mkdtemp(), "cloud.ply")
+    write_cloud(path, nr_points)
+    print("cloud with", nr_points, "points, file of", os.path.getsize(path)/1024.0/1024.0, "MB")
+
+    #the memory of just importing the module, so that it can be subtracted
+    _, _, base_mb=run("none", path)
+    print("process without loading anything peaks at", base_mb, "MB")
+
+    #the first read of each reader warms the page cache so both of them read the file from memory
+    results={}
+    for reader in ["tinyply", "mmap"]:
+        run(reader, path)
+        times=[]
+        peak_mb=0
+        for i in range(nr_repeats):
+            elapsed, nr_read, mb=run(reader, path)
+            if nr_read!=nr_points:
+                print("FAILED: the", reader, "reader read", nr_read, "points instead of", nr_points)
+                sys.exit(1)
+            times.append(elapsed)
+            peak_mb=max(peak_mb, mb)
+        results[reader]=(min(times), peak_mb)
+        print(reader, "read in", min(times)*1000, "ms, peak memory", peak_mb, "MB,", peak_mb-base_mb, "MB over the base")
+
+    print("speedup", results["tinyply"][0]/results["mmap"][0], "peak memory over the base reduced by", (results["tinyply"][1]-base_mb)/max(results["mmap"][1]-base_mb, 1e-3), "x")
+    os.remove(path)
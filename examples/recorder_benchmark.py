@@ -0,0 +1,42 @@
+#!/usr/bin/env python3
+
+#renders an orbit around a mesh offscreen and records it once as one png per frame and once streamed into a single video through ffmpeg. Prints how many frames per second each path sustains, including waiting for the last frame to be written
+
+try:
+  import torch
+except ImportError:
+  pass
+from easypbr  import *
+import time
+import os
+
+config_file="./config/offscreen.cfg" #sets the use_offscreen flag
+nr_frames=300
+output_path="./recordings/benchmark"
+
+view=Viewer.create(config_file)
+
+mesh=Mesh("./data/scan_the_world/masterpiece-goliath-ii.stl")
+mesh.model_matrix.rotate_axis_angle( [1.0, 0.0, 0.0], -90 )
+Scene.show(mesh,"mesh")
+
+recorder=view.m_recorder
+
+def record_orbit(use_video):
+    if use_video:
+        recorder.start_video(os.path.join(output_path, "orbit.mp4"), fps=30)
+    start=time.time()
+    for i in range(nr_frames):
+        view.m_camera.orbit_y(360.0/nr_frames)
+        view.update()
+        recorder.record(str(i)+".png", os.path.join(output_path, "pngs"))
+    if use_video:
+        recorder.stop_video()
+    else:
+        recorder.flush()
+    return nr_frames/(time.time()-start)
+
+fps_png=record_orbit(use_video=False)
+fps_video=record_orbit(use_video=True)
+print("png ", fps_png, " frames/s, video ", fps_video, " frames/s, speedup ", fps_video/fps_png)
+print("dropped frames ", recorder.nr_images_dropped())
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+#include <deque>
+#include <functional>
+
+#include "easy_gl/Texture2D.h"
+#include <opencv2/core/core.hpp>
+
+namespace easy_pbr{
+
+class MatPool;
+
+//downloads groups of textures from the gpu without stalling the pipeline. Every read() copies the textures into pixel buffer objects and puts a fence after them, the copy to the cpu only happens once the fence signals so that the gpu can keep rendering in the meantime. The reads are kept in a ring of slots so the pbos get reused between frames
+//All the functions have to be called from the thread that has the GL context
+class AsyncTextureReader: public std::enable_shared_from_this<AsyncTextureReader>{
+public:
+    //receives one mat for each of the textures passed to read(). The mats are upside down and in rgb(a) order, just like the texture. If a pool was given the mats come from it and can be released to it when they are not needed anymore
+    typedef std::function<void(std::vector<cv::Mat>& mats)> Callback;
+
+    template <class ...Args>
+    static std::shared_ptr<AsyncTextureReader> create( Args&& ...args ){
+        return std::shared_ptr<AsyncTextureReader>( new AsyncTextureReader(std::forward<Args>(args)...) );
+    }
+    ~AsyncTextureReader(); //finishes the pending reads and deletes the pbos
+
+    void read(const std::vector<gl::Texture2D*>& textures, Callback on_ready); //starts downloading the textures. If all the slots are busy it waits for the oldest one to finish first
+    int poll(); //runs the callbacks of the reads that finished, in the order they were started. Returns how many finished
+    void finish(); //waits for all the pending reads and runs their callbacks
+    int nr_pending() const { return m_in_flight.size(); }
+    int nr_slots() const { return m_slots.size(); }
+
+private:
+    AsyncTextureReader(const int nr_slots=3, const std::shared_ptr<MatPool>& mat_pool=nullptr);
+
+    struct Slot{
+        std::vector<GLuint> pbos;
+        std::vector<size_t> pbo_bytes; //allocated size of each pbo
+        std::vector<int> rows;
+        std::vector<int> cols;
+        std::vector<int> cv_types;
+        GLsync fence=0;
+        Callback callback;
+    };
+
+    void complete_oldest(); //copies the oldest slot into mats and runs its callback, waits for the fence if needed
+
+    std::vector<Slot> m_slots;
+    std::deque<int> m_in_flight; //idx of the slots that are being read, the oldest at the front
+    int m_next_slot;
+    std::shared_ptr<MatPool> m_mat_pool;
+};
+
+} //namespace easy_pbr
@@ -0,0 +1,161 @@
+#pragma once
+
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <stdexcept>
+
+#include <enum.h>
+
+namespace easy_pbr{
+
+//what a push does when the queue is full. Block waits for a consumer to make space, DropOldest discards the item that waited the longest and Grow ignores the capacity
+BETTER_ENUM(QueueFullPolicy, int, Block = 0, DropOldest, Grow )
+
+//multi producer multi consumer queue where the consumers sleep until there is work instead of polling. It also counts the items that were popped but not yet processed so that a producer can wait until everything it pushed is done
+template <class T>
+class BoundedQueue{
+public:
+    BoundedQueue(const size_t capacity, const QueueFullPolicy policy=QueueFullPolicy::Block):
+        m_capacity(capacity),
+        m_policy(policy)
+    {
+        if(capacity<1){
+            throw std::runtime_error("A BoundedQueue needs a capacity of at least 1");
+        }
+    }
+
+    BoundedQueue(const BoundedQueue&)=delete;
+    BoundedQueue& operator=(const BoundedQueue&)=delete;
+
+    //returns false if the queue is closed and the item was not added
+    bool push(T item){
+        std::unique_lock<std::mutex> lock(m_mutex);
+        if(m_policy==+QueueFullPolicy::Block){
+            m_cv_not_full.wait(lock, [this]{ return m_closed || m_policy!=+QueueFullPolicy::Block || m_items.size()<m_capacity; }); //the policy can change while we wait
+        }
+        if(m_closed){
+            return false;
+        }
+        if(m_policy==+QueueFullPolicy::DropOldest){
+            while(m_items.size()>=m_capacity){
+                m_items.pop_front();
+                m_nr_unfinished--;
+                m_nr_dropped++;
+            }
+        }
+        m_items.push_back(std::move(item));
+        m_nr_unfinished++;
+        lock.unlock();
+        m_cv_not_empty.notify_one();
+        return true;
+    }
+
+    //blocks until there is an item. Returns false once the queue is closed and empty so the consumer can exit. Every successful pop has to be followed by a task_done() after the item is processed
+    bool pop(T& item){
+        return pop(item, []{ return false; });
+    }
+
+    //same but also returns false, leaving the items for the other consumers, as soon as should_stop() is true. It's checked under the lock of the queue so after changing what it looks at call notify_consumers() to wake up the ones that are waiting
+    template <class StopPredicate>
+    bool pop(T& item, const StopPredicate& should_stop){
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_cv_not_empty.wait(lock, [this, &should_stop]{ return m_closed || !m_items.empty() || should_stop(); });
+        if(m_items.empty() || should_stop()){
+            return false;
+        }
+        item=std::move(m_items.front());
+        m_items.pop_front();
+        lock.unlock();
+        m_cv_not_full.notify_one();
+        return true;
+    }
+
+    void task_done(){
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_nr_unfinished--;
+        if(m_nr_unfinished==0){
+            m_cv_done.notify_all();
+        }
+    }
+
+    //blocks until every item that was pushed has been popped and processed (or dropped)
+    void wait_until_done(){
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_cv_done.wait(lock, [this]{ return m_nr_unfinished==0; });
+    }
+
+    //wakes up all the consumers, they still get the remaining items and after that pop returns false
+    void close(){
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_closed=true;
+        }
+        m_cv_not_empty.notify_all();
+        m_cv_not_full.notify_all();
+    }
+    void notify_consumers(){
+        {
+            std::lock_guard<std::mutex> lock(m_mutex); //a consumer that just checked its stop predicate is already waiting once we get the lock so it doesn't miss the notification
+        }
+        m_cv_not_empty.notify_all();
+    }
+    void reopen(){
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_closed=false;
+    }
+
+    void set_capacity(const size_t capacity){
+        if(capacity<1){
+            throw std::runtime_error("A BoundedQueue needs a capacity of at least 1");
+        }
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_capacity=capacity;
+        }
+        m_cv_not_full.notify_all();
+    }
+    void set_policy(const QueueFullPolicy policy){
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_policy=policy;
+        }
+        m_cv_not_full.notify_all();
+    }
+
+    size_t size(){
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_items.size();
+    }
+    size_t nr_unfinished(){ //queued plus the ones being processed
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_nr_unfinished;
+    }
+    size_t nr_dropped(){
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_nr_dropped;
+    }
+    size_t capacity(){
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_capacity;
+    }
+    QueueFullPolicy policy(){
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_policy;
+    }
+
+private:
+    std::deque<T> m_items;
+    size_t m_capacity;
+    QueueFullPolicy m_policy;
+    size_t m_nr_unfinished=0;
+    size_t m_nr_dropped=0;
+    bool m_closed=false;
+
+    std::mutex m_mutex;
+    std::condition_variable m_cv_not_empty;
+    std::condition_variable m_cv_not_full;
+    std::condition_variable m_cv_done;
+};
+
+} //namespace easy_pbr
@@ -7,6 +7,7 @@
 
 #include <any>
 #include <stdexcept>
+#include <utility>
 
 
 // DO NOT USE A IFDEF because other C++ libs may include this Frame.h without the compile definitions and therefore the Frame.h that was used to compile easypbr and the one included will be different leading to issues
@@ -67,6 +68,7 @@ public:
     std::string depth_path;
     std::string confidence_path;
     std::function<void(Frame& frame)> load_images; //function which when called, will read the paths and fill the corresponding mats
+    std::function<void(Frame& frame)> unload_callback; //gets called by unload_images after releasing the mats. The FrameLoader uses it to give the memory of the frame back to its cache budget
 
     std::string m_name;
     int cam_id; //id of the camera depending on how many cameras we have (it gos from 0 to 1 in the case of stereo)
@@ -105,14 +107,16 @@ public:
 
     //conversions that are useful for treating the data with pytorch for example
     cv::Mat depth2world_xyz_mat() const; //backprojects the depth to the world coodinates and returns a mat of the same size as the depth and with 3 channels cooresponding to the xyz positions in world coords
-    std::shared_ptr<Mesh> depth2world_xyz_mesh() const; //backprojects the depth to the world coodinates and point cloud with the XYZ points in world coordinates
+    std::shared_ptr<Mesh> depth2world_xyz_mesh(const bool remove_zero_depth=false) const; //backprojects the depth to the world coodinates and point cloud with the XYZ points in world coordinates. By default it's an organized cloud with zero for the pixels without depth, otherwise those are left out and the extra field "pixel_idx" says for each point the pixel y*width+x it came from
     std::shared_ptr<Mesh> pixels2dirs_mesh() const; //return a mesh where the V vertices represent directions in world coordiantes in which every pixel of this camera looks through
     std::shared_ptr<Mesh> pixels2_euler_angles_mesh() const; //return a mesh where the V vertices represent the euler angles that each ray through the pixel makes with the negative Z axis of the world
+    Eigen::Matrix<float, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> pixels2dirs() const; //same as pixels2dirs_mesh but returns directly a width*height x 3 float matrix. The rays of the camera are cached per K and image size so for a new pose they only get rotated
+    Eigen::Matrix<float, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> pixels2_euler_angles() const; //same as pixels2_euler_angles_mesh but returns directly a width*height x 3 float matrix
     std::shared_ptr<Mesh> pixels2coords() const; // return the 2D coords of the pixels in screen coordinates
-    std::shared_ptr<Mesh>  assign_color(std::shared_ptr<Mesh>& cloud) const; //grabs a point cloud in world coordinates and assings colors to the points by projecting it into the current color frame
+    std::shared_ptr<Mesh>  assign_color(std::shared_ptr<Mesh>& cloud, const bool check_occlusion=false, const float depth_tolerance=0.01) const; //grabs a point cloud in world coordinates and assings colors to the points by projecting it into the current color frame. Off by default to keep the old behaviour of coloring every projected point. With check_occlusion only the points that are at most depth_tolerance (relative) behind the closest point in their pixel get a color
     cv::Mat rgb_with_valid_depth(const Frame& frame_depth) const; //returns a color Mat which the color set to 0 for pixels that have no depth info
-    Eigen::MatrixXd  compute_uv(std::shared_ptr<Mesh>& cloud) const; //projects the cloud into the frame and returns the uv coordinates that index into the frame, The uv is in range [0,1] with the zero being top left (so like the opencv and not the opengl)
-    cv::Mat naive_splat(std::shared_ptr<Mesh>& cloud, Eigen::MatrixXf values); //project the cloud into the frame and also naively splats the values onto the nearest pixel. Doesn't do any Z buffering or weighting
+    Eigen::MatrixXd  compute_uv(std::shared_ptr<Mesh>& cloud, const bool check_occlusion=false, const float depth_tolerance=0.01) const; //projects the cloud into the frame and returns the uv coordinates that index into the frame, The uv is in range [0,1] with the zero being top left (so like the opencv and not the opengl)
+    std::pair<cv::Mat, cv::Mat> naive_splat(const std::shared_ptr<Mesh>& cloud, const Eigen::MatrixXf& values, const bool bilinear=false, const float depth_tolerance=0.01) const; //projects the cloud into the frame and splats the values (one row per point, any nr of columns) onto the nearest pixel or with bilinear weights onto the 4 around it. Only the points that are at most depth_tolerance (relative) behind the closest point in a pixel contribute to it. Returns a CV_32FC(values.cols()) image with the weighted average and a CV_8UC1 mask that is 255 where something got splatted
     Eigen::Vector3d unproject(const float x, const float y, const float depth); //gets a pixel in the 2d plane and unprojects it, putting it somewhere in 3d at a depth of 1
     Eigen::Vector2d project(const Eigen::Vector3d& point_world); //projects from world coordinates to img coordinates 
     cv::Mat draw_projected_line(const Eigen::Vector3d& p0_world, const Eigen::Vector3d p1_world, const int thickness=1); //gets two points describing a line in world coordinates, projects them into the image and then draws a line through them;
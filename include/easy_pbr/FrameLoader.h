@@ -0,0 +1,64 @@
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <future>
+#include <list>
+#include <vector>
+#include <unordered_map>
+
+namespace easy_pbr{
+
+class Frame;
+class ThreadPool;
+
+//loads the images of shell frames in a pool of worker threads. When a frame is requested, the next ones in the dataset get read ahead so iterating over the frames doesn't block on the disk. The loaded frames are kept in a LRU cache bounded by a byte budget so that the next epochs don't decode the same images again
+class FrameLoader: public std::enable_shared_from_this<FrameLoader>{
+public:
+    //https://stackoverflow.com/questions/29881107/creating-objects-only-as-shared-pointers-through-a-base-class-create-method
+    template <class ...Args>
+    static std::shared_ptr<FrameLoader> create( Args&& ...args ){
+        return std::shared_ptr<FrameLoader>( new FrameLoader(std::forward<Args>(args)...) );
+    }
+    ~FrameLoader(); //drops the queued loads and waits for the ones that are running
+
+    //returns a copy of the shell frame at idx with the images loaded. Blocks only if the frame is neither cached nor already read ahead. Calling unload_images on it gives its memory back to the budget
+    //the frame is the one kept in the cache, so all the callers that get the same idx while it's cached share the same object and modifying its images or poses is seen by all of them. Clone it before modifying it if that's not wanted
+    std::shared_ptr<Frame> get_frame(const int idx);
+    void prefetch(const int idx); //starts loading the frame at idx in the background if it's not cached already
+    void clear(); //drops all the frames from the cache
+
+    int nr_frames() const { return m_frames.size(); }
+    int nr_cached();
+    size_t cache_bytes(); //the bytes of the images of all the cached frames
+    size_t cache_budget_bytes() const { return m_cache_budget_bytes; }
+
+private:
+    FrameLoader(const std::vector<std::shared_ptr<Frame>>& frames, const int nr_threads=4, const int read_ahead=8, const float cache_budget_mb=2048);
+
+    struct CachedFrame{
+        std::shared_ptr<Frame> frame;
+        size_t bytes;
+        std::list<int>::iterator lru_it;
+    };
+
+    std::shared_future< std::shared_ptr<Frame> > schedule_load(const int idx); //needs m_mutex to be locked
+    std::shared_ptr<Frame> load(const int idx); //runs in the worker threads
+    void insert_in_cache(const int idx, const std::shared_ptr<Frame>& frame); //needs m_mutex to be locked
+    void remove_from_cache(const int idx, const Frame* frame); //called when the frame gets unloaded, only removes it if it's still the one cached at idx
+
+    std::vector<std::shared_ptr<Frame>> m_frames; //the shells
+    int m_read_ahead; //clamped in get_frame to the nr of frames that fit in the budget
+    size_t m_cache_budget_bytes;
+    bool m_warned_read_ahead;
+
+    std::mutex m_mutex;
+    std::unordered_map<int, CachedFrame> m_cache;
+    std::list<int> m_lru; //idx of the cached frames, the most recently used at the front
+    size_t m_cache_bytes;
+    std::unordered_map<int, std::shared_future< std::shared_ptr<Frame> > > m_pending; //frames that are being loaded
+
+    std::unique_ptr<ThreadPool> m_pool; //declared last so that it's destroyed first and the tasks still running can access the rest of the members
+};
+
+} //namespace easy_pbr
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <mutex>
+#include <vector>
+#include <opencv2/core/core.hpp>
+
+namespace easy_pbr{
+
+//reuses the memory of images that get downloaded and written every frame, like the ones of the Recorder, so that they don't allocate new images every frame
+class MatPool{
+public:
+    MatPool(const size_t max_pooled): m_max_pooled(max_pooled){}
+
+    //returns a free mat of this size and type or allocates a new one. The content is not initialized
+    cv::Mat acquire(const int rows, const int cols, const int type){
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            for(size_t i=0; i<m_free.size(); i++){
+                if(m_free[i].rows==rows && m_free[i].cols==cols && m_free[i].type()==type){
+                    cv::Mat mat=m_free[i];
+                    m_free[i]=m_free.back();
+                    m_free.pop_back();
+                    return mat;
+                }
+            }
+        }
+        return cv::Mat(rows, cols, type);
+    }
+
+    //gives the memory back to the pool, nobody else should be using the mat anymore
+    void release(cv::Mat& mat){
+        if(mat.empty()){
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if(m_free.size()<m_max_pooled){
+                m_free.push_back(mat);
+            }
+        }
+        mat=cv::Mat();
+    }
+
+private:
+    std::mutex m_mutex;
+    std::vector<cv::Mat> m_free;
+    size_t m_max_pooled;
+};
+
+} //namespace easy_pbr
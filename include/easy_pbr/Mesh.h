@@ -4,6 +4,12 @@
 #include<stdarg.h>
 #include <any>
 #include <stdexcept>
+#include <future>
+#include <functional>
+#include <mutex>
+#include <atomic>
+#include <array>
+#include <tuple>
 
 
 
@@ -25,14 +31,56 @@ namespace radu { namespace utils {
 
 namespace easy_pbr{
 
+//storage of the per vertex attributes (V, C, D, NV, UV, I and the tangents). By default they are double and column major like the rest of the matrices. Compiling with EASYPBR_WITH_FLOAT_MESH stores them as row major float instead, which is exactly the layout that MeshGL uploads to the GPU, so the resident memory is halved and the upload doesn't need a conversion
+#ifdef EASYPBR_WITH_FLOAT_MESH
+    typedef float MeshScalar;
+    typedef Eigen::Matrix<float, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> MeshMatrixX;
+#else
+    typedef double MeshScalar;
+    typedef Eigen::MatrixXd MeshMatrixX;
+#endif
+
 BETTER_ENUM(MeshColorType, int, Solid = 0, PerVertColor, Texture, SemanticPred, SemanticGT, NormalVector, Height, Intensity, UV, NormalViewCoords )
 BETTER_ENUM(ColorSchemeType, int, Plasma = 0, Viridis, Magma )
+//the matrices of a mesh that MeshGL keeps in gpu buffers. Used to mark only some of them as needing an upload
+BETTER_ENUM(MeshAttribute, int, V = 0, F, C, E, D, NF, NV, UV, V_tangent_u, V_length_v, L_pred, L_gt, I )
 
 
 class MeshGL; //we forward declare this so we can have from here a pointer to the gpu stuff
 class LabelMngr;
 class Mesh;
 class Viewer;
+class PointCloudStream;
+class ThreadPool;
+class MeshKDTree;
+class MeshAABB;
+struct PagedChunks;
+
+//which rows of an attribute changed since the last upload to the gpu. An empty range (row_end<=row_start) after a dirty flag means the whole matrix
+struct DirtyRows{
+    bool is_dirty=false;
+    int row_start=0;
+    int row_end=0; //exclusive
+    bool is_whole() const { return row_end<=row_start; }
+};
+
+//a mutex that can live in a copyable class. Copies get their own unlocked mutex
+struct CopyableMutex{
+    CopyableMutex(){}
+    CopyableMutex(const CopyableMutex&){}
+    CopyableMutex& operator=(const CopyableMutex&){ return *this; }
+    std::mutex mutex;
+};
+
+//an atomic counter that can live in a copyable class. Copies start from the value of the original
+struct CopyableCounter{
+    CopyableCounter(const uint64_t val=0): value(val){}
+    CopyableCounter(const CopyableCounter& other): value(other.value.load()){}
+    CopyableCounter& operator=(const CopyableCounter& other){ value.store(other.value.load()); return *this; }
+    uint64_t operator++(int){ return value.fetch_add(1); }
+    operator uint64_t() const { return value.load(); }
+    std::atomic<uint64_t> value;
+};
 
 
 struct VisOptions{
@@ -142,23 +190,25 @@ struct CvMatCpu {
 };
 
 //for matrices bookkeeping
-template <typename T>
+template <typename T, int Options=Eigen::ColMajor>
 struct DataBlob {
     public:
-        DataBlob(Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic>& data):
+        typedef Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic, Options> MatrixType;
+
+        DataBlob(MatrixType& data):
             m_data(data){
         }
 
-        Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic>& data(){return m_data;} //get a reference to the internal matrix
+        MatrixType& data(){return m_data;} //get a reference to the internal matrix
 
         void preallocate(size_t rows, size_t cols){
             m_data.resize(rows,cols);
             m_data.setZero();
             m_is_preallocated=true;
         }
-        void copy_in_first_empty_block(const Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic>& new_data){
+        void copy_in_first_empty_block(const MatrixType& new_data){
             //WARNING , cannot be used to append E and F because they also need to be reindexed
-            static_assert(std::is_same<T, double>::value, "We only allow appending to matrices that are of type double. If the matrix of type int it means it is E or F and therefore would need to be reindexed after appending which is no supported in the streaming API");
+            static_assert(std::is_floating_point<T>::value, "We only allow appending to matrices that are of type float or double. If the matrix of type int it means it is E or F and therefore would need to be reindexed after appending which is no supported in the streaming API");
             //other checks
             // CHECK(m_is_preallocated) << "Can only use this appening API when the data has been preallocated";
             // CHECK(m_data.cols()==new_data.cols()) << "Data cols and new_data cols do not coincide. m_data cols is " << m_data.cols() << " and new_data cols is " << new_data.cols();
@@ -200,7 +250,7 @@ struct DataBlob {
 
 
     private:
-        Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic>& m_data;
+        MatrixType& m_data;
         bool m_is_preallocated=false;
         size_t m_start_row_allocated=0;
         size_t m_end_row_allocated=0;
@@ -223,9 +273,10 @@ public:
     void clear(); //empties all vectors makes them have size (0,0)
     void set_all_matrices_to_zero();
     void assign_mesh_gpu(std::shared_ptr<MeshGL> mesh_gpu); //assigns the pointer to the gpu implementation of this mesh
-    bool load_from_file(const std::string file_path); //return sucess or failure
+    bool load_from_file(const std::string file_path, const bool use_cache=true); //return sucess or failure. Returns false for an unknown extension and throws a MeshIOError for a file that is missing, truncated or malformed. If the load cache is enabled, the processed mesh is read from the .epbr file created the last time this file was loaded, as long as the file did not change since
     void read_obj(const std::string file_path, bool load_vti=false, bool load_vni=false); //vti and vni which are the indices that the vertices have towards the textures and towards the normals. Check https://en.wikipedia.org/wiki/Wavefront_.obj_file about Vertex texture coordinate indices and Vertex normal indices
     void save_to_file(const std::string file_path);
+    void write_pcd(const std::string file_path, const std::string data_format="binary"); //data_format can be ascii, binary or binary_compressed
     bool is_empty()const;
     // void apply_transform(Eigen::Affine3d& trans, const bool transform_points_at_zero=false ); //transforms the vertices V and the normals. A more efficient way would be to just update the model matrix and let the GPU do it but I like having the V here and on the GPU in sync so I rather transform on CPU and then send all the data to GPU
     // void transform_model_matrix(const Eigen::Affine3d& trans); //updates the model matrix but does not change the vertex data V on the CPU
@@ -291,9 +342,9 @@ public:
     void set_marked_vertices_to_zero(const std::vector<bool>& mask, const bool keep); //useful for when the actual removal of verts will destroy the organized structure
     void remove_vertices_at_zero(); // zero is used to denote the invalid vertex, we can remove them and rebuild F, E and the rest of indices with this function
     void remove_unreferenced_verts();
-    Eigen::VectorXi remove_duplicate_vertices(); //return the inverse_indirection which is a vector of size original_mesh.V.rows(). Says for each original V where it's now indexed in the merged mesh
+    Eigen::VectorXi remove_duplicate_vertices(const double tolerance=1e-7); //merges the vertices that snap to the same cell of a grid with the given spacing and averages their attributes. Return the inverse_indirection which is a vector of size original_mesh.V.rows(). Says for each original V where it's now indexed in the merged mesh
     void undo_remove_duplicate_vertices(const std::shared_ptr<Mesh>& original_mesh, const Eigen::VectorXi& inverse_indirection );
-    void set_duplicate_verts_to_zero();
+    void set_duplicate_verts_to_zero(const double tolerance=1e-7); //instead of removing them the duplicates are set to zero so that an organized cloud keeps its layout
     void decimate(const int nr_target_faces);
     void upsample(const int nr_of_subdivisions, const bool smooth);
     void flip_winding(); //flips the winding number for the faces
@@ -304,7 +355,9 @@ public:
     // void rotate_x_axis(const float degrees);
     // void rotate_y_axis(const float degrees);
     void random_subsample(const float percentage_removal);
-    void recalculate_normals(); //recalculates NF and NV
+    Eigen::VectorXi voxel_grid_subsample(const float voxel_size); //merges the vertices in each voxel into one at their average position. Attributes are merged like in remove_duplicate_vertices and the inverse_indirection is returned the same way
+    void poisson_disk_subsample(const float radius); //keeps a subset of the vertices in which no two are closer than radius
+    void recalculate_normals(const bool use_libigl=false); //recalculates NF and NV with angle weighting. The default version runs in parallel, the libigl one is kept as a reference
     void flip_normals();
     void normalize_size(); //normalize the size of the mesh between [0,1]
     void normalize_position(); //calculate the bounding box of the object and put it at 0.0.0
@@ -325,13 +378,16 @@ public:
     Mesh interpolate(const Mesh& target_mesh, const float factor);
     float get_scale();
     void color_solid2pervert(); //makes the solid color into a per vert color by allocating a C vector. It is isefult when merging meshes of different colors.
-    void estimate_normals_from_neighbourhood(const float radius);
-    Eigen::MatrixXd compute_distance_to_mesh(const std::shared_ptr<Mesh>& target_mesh); //compute for each point in this cloud, the distance to another one, returns a D vector of distances which is of size Nx1 where N is the vertices in this mesh
+    void estimate_normals_from_neighbourhood(const float radius, const int max_nr_neighbours=-1, const bool orient_towards_cur_pose=true); //PCA over the vertices closer than radius, at most max_nr_neighbours of them. With radius<=0 it uses the max_nr_neighbours closest ones. Normals point towards the sensor at the origin of m_cur_pose, or the world origin. Organized clouds (m_width*m_height==V.rows()) take the neighbours from a window of pixels instead of a kd-tree. Points that are zero or nan are missing, they are never used as neighbours and get a zero normal
+    MeshMatrixX compute_distance_to_mesh(const std::shared_ptr<Mesh>& target_mesh); //compute for each point in this cloud, the squared distance to another one, returns a D vector of distances which is of size Nx1 where N is the vertices in this mesh
+    std::tuple<Eigen::VectorXd, Eigen::MatrixXd, Eigen::VectorXi> closest_points(const Eigen::MatrixXd& query_points); //for each query point the distance to the closest point on this mesh, the closest point and the face it lies on. Meshes without faces return the closest vertex and its index. Runs in parallel and the tree over this mesh is kept until V or F change
 
 
-    //nanoflann options for querying points in a certain radius or querying neighbiurs
-    int radius_search(const Eigen::Vector3d& query_point, const double radius); //returns touples of (index in V of the point, distance to it)
-    void ball_query(const Eigen::MatrixXd& query_points, const Eigen::MatrixXd& target_points, const float search_radius);
+    //neighbour queries against the vertices V. They use a kd-tree that gets built on the first query and is kept until V changes. The batch versions process the query points in parallel and return a pair of (indices in V, euclidean distances) with one row per query point, sorted by distance and padded with -1 and infinite distance
+    int radius_search(const Eigen::Vector3d& query_point, const double radius); //returns the nr of vertices closer than radius to the query point
+    std::pair<Eigen::MatrixXi, Eigen::MatrixXd> radius_search(const Eigen::MatrixXd& query_points, const double radius, const int max_nr_neighbours=-1); //all vertices closer than radius. The nr of columns is the largest nr of neighbours found, limited by max_nr_neighbours if it's positive
+    std::pair<Eigen::MatrixXi, Eigen::MatrixXd> knn(const Eigen::MatrixXd& query_points, const int k); //the k closest vertices
+    std::pair<Eigen::MatrixXi, Eigen::MatrixXd> ball_query(const Eigen::MatrixXd& query_points, const double radius, const int max_nr_neighbours); //similar to pytorch3d ball_query, at most max_nr_neighbours vertices closer than radius and the output always has max_nr_neighbours columns
 
     //some convenience functions and also useful for calling from python using pybind
     // void move_in_x(const float amount);
@@ -359,35 +415,46 @@ public:
     void set_smoothness_tex(const cv::Mat& mat, const int subsample=1);
     void set_normals_tex(const cv::Mat& mat, const int subsample=1);
     bool is_any_texture_dirty();
+    //finer grained alternative to m_is_dirty. Only the buffers of the attributes marked here get uploaded to the gpu and if only some rows are marked, only those get sent with a glBufferSubData
+    void set_dirty(const MeshAttribute attrib); //the whole matrix
+    void set_dirty(const std::string attrib_name); //same but with the name of the matrix, like "C" or "L_pred", easier to call from python
+    void set_dirty_rows(const MeshAttribute attrib, const int row_start, const int nr_rows); //consecutive calls grow the range so that it covers all of them. nr_rows of 0 does nothing
+    void set_dirty_rows(const std::string attrib_name, const int row_start, const int nr_rows);
+    bool is_dirty(const MeshAttribute attrib) const;
+    bool is_any_attribute_dirty() const;
+    const DirtyRows& dirty_rows(const MeshAttribute attrib) const;
+    void clear_dirty(); //clears m_is_dirty and all the per attribute flags, gets called by MeshGL after uploading
 
 
     friend std::ostream &operator<<(std::ostream&, const Mesh& m);
 
     bool m_is_dirty; // if it's dirty then we need to upload this data to the GPU
+    std::array<DirtyRows, MeshAttribute::_size_constant> m_dirty_attribs; //per attribute dirty flags, set them through set_dirty() and set_dirty_rows()
+    CopyableCounter m_geometry_version; //bumped whenever V or F change, the kd-tree and the AABB tree are rebuilt when it differs from the one they were built at. After modifying V or F in place call set_dirty(MeshAttribute::V) so that it gets bumped. Assigning V or F from python bumps it already. It's atomic since MeshGL bumps it from the render thread in clear_dirty() while queries may run on other threads
     bool m_is_shadowmap_dirty; // if it has moved through the m_model_matrix or if the V matrix or something like that has changed, then we need to update the shadow map
 
     VisOptions m_vis;
     bool m_force_vis_update; //sometimes we want the m_vis stored in the this MeshCore to go into the MeshGL, sometimes we don't. The default is to not propagate, setting this flag to true will force the update of m_vis inside the MeshGL
 
 
-    Eigen::MatrixXd V;
+    MeshMatrixX V;
     Eigen::MatrixXi F;
-    Eigen::MatrixXd C;
+    MeshMatrixX C;
     Eigen::MatrixXi E;
-    Eigen::MatrixXd D;  //distances of points to the sensor
+    MeshMatrixX D;  //distances of points to the sensor
     Eigen::MatrixXd NF; //normals of each face
-    Eigen::MatrixXd NV; //normals of each vertex
-    Eigen::MatrixXd UV; //UV for each vertex
-    Eigen::MatrixXd V_tangent_u; //for surfel rendering each vertex has a 2 vectors that are tangent defining the span of the elipsoid. For memory usage we don't store the 2 vectors directly because we alreayd have a normal vector, rather we store one tangent vector in full (vec3) and the other one we store only the norm of it because it's dirrection can be inferred as the cross product between the normal and the first tangent vector
-    Eigen::MatrixXd V_length_v;
+    MeshMatrixX NV; //normals of each vertex
+    MeshMatrixX UV; //UV for each vertex
+    MeshMatrixX V_tangent_u; //for surfel rendering each vertex has a 2 vectors that are tangent defining the span of the elipsoid. For memory usage we don't store the 2 vectors directly because we alreayd have a normal vector, rather we store one tangent vector in full (vec3) and the other one we store only the norm of it because it's dirrection can be inferred as the cross product between the normal and the first tangent vector
+    MeshMatrixX V_length_v;
     Eigen::MatrixXd V_bitangent_v;
     Eigen::MatrixXd S_pred; //predicted likelihood for each class per point, useful for semantic segmentation
     Eigen::MatrixXi L_pred; //predicted labels for each point, useful for semantic segmentation
     Eigen::MatrixXi L_gt; //ground truth labels for each point, useful for semantic segmentation
-    Eigen::MatrixXd I; //intensity value of each point in the cloud. Useful for laser scanner
+    MeshMatrixX I; //intensity value of each point in the cloud. Useful for laser scanner
     Eigen::MatrixXi VTI; //Vertex texture coordinate indices which is the coordinate that the vertices has towards the UV. check https://en.wikipedia.org/wiki/Wavefront_.obj_file
     Eigen::MatrixXi VNI; //Vertex normal indices which is the coordinate that the vertices has towards the NV. check https://en.wikipedia.org/wiki/Wavefront_.obj_file
-    DataBlob<double> V_blob;
+    DataBlob<MeshScalar, MeshMatrixX::Options> V_blob;
 
 
     int m_seg_label_pred; // for classification we will have a lable for the whole cloud
@@ -408,6 +475,7 @@ public:
     //oher stuff that may or may not be needed depending on the application
     uint64_t t; //timestamp or scan nr which will be monotonically increasing
     int id; //id number that can be used to identity meshes of the same type (vegation, people etc)
+    int scene_id; //assigned by the Scene when the mesh is added to it and kept when a mesh with the same name replaces it, -1 if the mesh was never added. Used by the viewer to associate the mesh with its MeshGL
     int m_height;
     int m_width;
     float m_view_direction; //direction in which the points have been removed from the velodyne cloud so that it can be unwrapped easier into 2D
@@ -415,6 +483,27 @@ public:
     Eigen::Vector2f m_min_max_y_for_plotting; //sometimes we want the min and max to be a bit different (controlable through the gui)
     std::string m_disk_path; //path that from disk that was used to load this mesh
 
+    //cache of the processed meshes that load_from_file writes so that loading the same file again doesn't need to parse it and recompute the normals and tangents
+    static bool m_load_cache_enabled; //false by default so that nothing gets written without asking. Better set also m_load_cache_dir so the dataset folders are not touched
+    static std::string m_load_cache_dir; //if empty the .epbr file is written beside the file that was loaded
+    static std::string load_cache_path(const std::string file_path); //path of the .epbr file for a certain mesh file
+    static void invalidate_load_cache(const std::string file_path); //deletes the .epbr file so the next load parses the file again
+
+    //asynchronous loading. The files get loaded by a pool of worker threads and the future becomes ready when the mesh is fully processed, including its normals and height range, so Scene::show_when_ready() has nothing left to compute on the render thread. The callback, if given, is called from the worker thread once the mesh is loaded. A file that is missing, truncated or malformed makes the future throw on get() instead of aborting the process
+    static std::shared_future<std::shared_ptr<Mesh>> load_from_file_async(const std::string file_path, const std::function<void(std::shared_ptr<Mesh>)> callback=nullptr);
+    static std::vector< std::shared_future<std::shared_ptr<Mesh>> > load_many(const std::vector<std::string>& file_paths);
+    static void set_load_nr_threads(const int nr_threads); //the loads that are already queued are finished by the old threads and this call blocks until they are all done, so better call it before queuing anything
+
+    //out of core point clouds. Only m_max_resident_chunks chunks of the binary ply or pcd file are kept in V, C and I and the rest are read from disk when they are needed. The viewer updates the resident chunks every frame based on the distance to the camera
+    //The chunks are read on the load pool and swapped into V, C and I by a later call to update_resident_chunks once they are ready, so the calls never wait for the disk. V, C and I should not be modified while the chunks are being read
+    void load_out_of_core(const std::string file_path, const int points_per_chunk=1000000, const int max_resident_chunks=32);
+    bool is_out_of_core() const;
+    int nr_chunks() const;
+    bool update_resident_chunks(const Eigen::Vector3d& position); //requests as resident the chunks closest to the position which is in the coordinates of the mesh. Returns true if V changed in this call
+    bool update_resident_chunks(const Eigen::Vector3d& region_min, const Eigen::Vector3d& region_max); //requests the chunks that intersect the box, the ones closest to its center first
+    void wait_for_resident_chunks(); //blocks until V, C and I hold the chunks of the last request
+    int m_max_resident_chunks;
+
 
     //identification
     std::string name;
@@ -445,6 +534,11 @@ public:
 
 
 
+    //the ply readers on their own, without the processing of load_from_file. They are public mostly so that examples/ply_load_benchmark.py can compare them
+    //We use this for reading ply files because the readPLY from libigl has a memory leak https://github.com/libigl/libigl/issues/919
+    void read_ply(const std::string file_path); //binary files are memory mapped and read in parallel, ascii ones go through tinyply
+    void read_ply_tinyply(const std::string file_path); //the reader used before the memory mapped one, everything goes through the buffers of tinyply
+
 private:
 
     std::string named(const std::string msg) const{
@@ -452,8 +546,30 @@ private:
     }
 
 
-    //We use this for reading ply files because the readPLY from libigl has a memory leak https://github.com/libigl/libigl/issues/919
-    void read_ply(const std::string file_path);
+    void read_pcd(const std::string file_path); //fields x,y,z, normal_*, rgb, intensity and label go into the corresponding matrices and the rest are stored as extra fields
+    bool read_load_cache(const std::string file_path_abs); //returns false if there is no valid cache for this file
+    void write_load_cache(const std::string file_path_abs);
+    Eigen::VectorXi merge_vertices(const std::vector<int>& representative, const bool average_positions); //merges each vertex into its representative vertex, averaging colors, normals, etc. and voting the labels. Returns the inverse_indirection
+    bool set_resident_chunks(const std::vector<int>& chunks); //reads the chunks that are not yet in V and drops the ones not in the list, right away. Returns true if something changed
+    bool request_resident_chunks(const std::vector<int>& chunks); //same but the reading happens on the load pool. Swaps in the previous request if it finished and returns true if that changed V
+    void page_chunks(PagedChunks& paged) const; //fills the matrices of paged with its chunks, copying the resident ones from V, C and I and reading the rest. Runs in the load pool
+    void swap_in_chunks(PagedChunks& paged);
+    bool swap_in_paged_chunks(const bool wait); //swaps in the chunks that are read in the background if they are ready, or waits for them
+
+    static std::shared_ptr<ThreadPool> load_pool(); //creates the pool the first time it's needed
+
+    static std::shared_ptr<ThreadPool> m_load_pool;
+    static std::mutex m_load_pool_mutex;
+    static int m_load_nr_threads;
+    std::shared_ptr<PointCloudStream> m_out_of_core_stream;
+    std::vector<int> m_resident_chunks; //the chunks stored in V in the order they are stored
+    std::vector<int> m_requested_chunks; //sorted chunks of the last request, they become resident once m_paging is swapped in
+    std::shared_future<std::shared_ptr<PagedChunks>> m_paging; //the read of chunks that is in flight, if any
+    std::shared_ptr<MeshKDTree> kdtree(); //returns the kd-tree over V, building it if V changed since the last time
+    std::shared_ptr<MeshKDTree> m_kdtree;
+    std::shared_ptr<MeshAABB> aabb(); //returns the AABB tree over the faces, building it if V or F changed since the last time
+    std::shared_ptr<MeshAABB> m_aabb;
+    CopyableMutex m_accel_mutex; //guards m_kdtree and m_aabb so that queries from several threads don't build them at the same time
     void write_ply(const std::string file_path);
 
     Eigen::Affine3d m_model_matrix;  //transform from object coordiantes to the world coordinates, esentially putting the model somewhere in the world.
@@ -3,6 +3,8 @@
 #include <memory>
 #include<stdarg.h>
 #include <stdexcept>
+#include <vector>
+#include <cstdint>
 
 
 //we add them first because they might contain torch and we need to include torch before we include loguru otherwise loguru doesnt work
@@ -24,6 +26,15 @@ namespace easy_pbr{
 //forward declarations
 class Mesh;
 
+//one vertex of the packed buffer. Takes 24 bytes instead of the 44 bytes of the separate float buffers for position, normal, uv and color
+struct PackedVertex{
+    float position[3];
+    int16_t normal[2]; //octahedral encoding, normalized to [-1,1] when read by the shader
+    uint16_t uv[2]; //half floats
+    uint8_t color[4]; //rgba, normalized to [0,1] when read by the shader
+};
+static_assert(sizeof(PackedVertex)==24, "PackedVertex is expected to have no padding");
+
 //in order to dissalow building on the stack and having only ptrs https://stackoverflow.com/a/17135547
 class MeshGL;
 
@@ -43,9 +54,22 @@ public:
 
 
     //GL functions
-    void upload_to_gpu();
+    void upload_to_gpu(); //uploads everything if m_core->m_is_dirty, otherwise only the attributes (or rows of them) that were marked with Mesh::set_dirty() and Mesh::set_dirty_rows()
+
+    //the packed format stores position, normal, uv and color interleaved in packed_buf (see PackedVertex) and uses 16 bit indices for F and E when the mesh has less than 65536 vertices
+    void set_packed(const bool packed);
+    bool is_packed() const;
+    //use this instead of vao.vertex_attribute() for meshes because with the packed format the V_buf, NV_buf, UV_buf and C_buf are not used and the attribute gets read instead from packed_buf with the corresponding stride and offset
+    void vertex_attribute(gl::Shader& shader, const std::string attrib_name, const gl::Buf& buf, const int size);
+    GLenum m_index_type; //type of the indices in F_buf and E_buf, needed for the glDrawElements
+
+    //nr of bytes sent to the gpu for each attribute since the creation of this MeshGL or the last reset, useful for checking that a streaming update only sends what changed
+    size_t bytes_uploaded(const std::string attrib_name) const;
+    size_t total_bytes_uploaded() const;
+    void reset_upload_counters();
 
     bool m_first_core_assignment;
+    int m_scene_id; //the scene_id under which the viewer indexes this meshgl, -1 if it's not indexed. The mesh core can get a new scene_id when it's removed and shown again so we can't rely on the one of the core
     bool m_sticky; //if it's set to true then this meshgl will not get automtically deleted even if the mesh core is not in the scene. Useful for when external code wants to push data to opengl but doesnt necessarally want to add the meshcore to the scene for visualization
 
     //GL buffers
@@ -63,6 +87,7 @@ public:
     gl::Buf L_pred_buf;
     gl::Buf L_gt_buf;
     gl::Buf I_buf;
+    gl::Buf packed_buf;
     //extra stuff. We store them as shared ptr because I don't want to deal with constructors and destructors when I insert into the map
     std::map<std::string, std::shared_ptr<gl::Buf>  > extra_array_buffers;
     std::map<std::string, std::shared_ptr<gl::Buf> > extra_element_array_buffers;
@@ -108,6 +133,13 @@ public:
     std::shared_ptr<Mesh> m_core;
 private:
     MeshGL();  // we put the constructor as private so as to dissalow creating Mesh on the stack because we want to only used shared ptr for it
+    void upload_packed(const bool upload_whole);
+
+    bool m_packed;
+    bool m_needs_full_upload; //set when a different core gets assigned because then the partial dirty flags refer to data we never uploaded
+    std::vector<size_t> m_buf_bytes; //size of the data currently stored in each buffer, indexed by MeshAttribute. A partial upload is possible only if it didn't change
+    std::vector<size_t> m_bytes_uploaded; //indexed by MeshAttribute. With the packed format the bytes of packed_buf are counted for V
+    size_t m_packed_buf_bytes;
 
 };
 
@@ -0,0 +1,308 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <type_traits>
+#include <sstream>
+#include <stdexcept>
+
+//eigen
+#include <Eigen/Core>
+#include <Eigen/Geometry>
+
+
+//low level helpers for reading mesh and point cloud files directly from a memory mapped buffer. They are used by Mesh::read_ply and the other readers that need to avoid the copies done by tinyply
+
+namespace easy_pbr{
+
+//thrown by the readers when a file is missing, truncated or malformed. Unlike a failed CHECK it doesn't abort the process, so a bad file only fails its own load: Mesh::load_from_file lets it through to the caller (a RuntimeError in python) and Mesh::load_from_file_async stores it in the future
+class MeshIOError: public std::runtime_error{
+public:
+    using std::runtime_error::runtime_error;
+};
+
+//collects the message streamed after CHECK_FILE and throws it as a MeshIOError at the end of the statement
+class MeshIOErrorThrower{
+public:
+    template <typename T>
+    MeshIOErrorThrower& operator<<(const T& val){ m_ss << val; return *this; }
+    ~MeshIOErrorThrower() noexcept(false){ throw MeshIOError(m_ss.str()); }
+private:
+    std::ostringstream m_ss;
+};
+
+//like CHECK but for problems with the content of a file, it throws a MeshIOError instead of aborting. It must not be used inside an omp parallel region since exceptions cannot leave it
+#define CHECK_FILE(condition) if(condition){} else ::easy_pbr::MeshIOErrorThrower() << "Check failed: " #condition " "
+
+//read only memory mapping of a whole file. The mapping is released when the object is destroyed. Throws a MeshIOError if the file cannot be opened
+class MappedFile{
+public:
+    MappedFile(const std::string& file_path);
+    ~MappedFile();
+    MappedFile(const MappedFile&)=delete;
+    MappedFile& operator=(const MappedFile&)=delete;
+
+    const char* data() const { return m_data; }
+    size_t size() const { return m_size; }
+    const std::string& path() const { return m_path; }
+
+private:
+    std::string m_path;
+    const char* m_data;
+    size_t m_size;
+};
+
+
+//types of the scalar properties that can appear in a ply or pcd file
+enum class ScalarType { Invalid=0, Int8, UInt8, Int16, UInt16, Int32, UInt32, Float32, Float64 };
+size_t scalar_type_size(const ScalarType type);
+ScalarType ply_type_from_string(const std::string& type_name); //accepts both the old names (uchar, float) and the new ones (uint8, float32)
+double scalar_type_max(const ScalarType type); //max value representable by an integer type. Used to normalize colors stored as integers
+
+//reads one scalar of a certain type from a unaligned position in memory and casts it to T
+template <typename T>
+inline T read_scalar(const char* ptr, const ScalarType type, const bool swap_endian=false){
+    char buf[8];
+    const size_t size=scalar_type_size(type);
+    std::memcpy(buf, ptr, size);
+    if(swap_endian){
+        for(size_t i=0; i<size/2; i++){
+            std::swap(buf[i], buf[size-1-i]);
+        }
+    }
+    switch(type){
+        case ScalarType::Int8: { int8_t v; std::memcpy(&v, buf, 1); return (T)v; }
+        case ScalarType::UInt8: { uint8_t v; std::memcpy(&v, buf, 1); return (T)v; }
+        case ScalarType::Int16: { int16_t v; std::memcpy(&v, buf, 2); return (T)v; }
+        case ScalarType::UInt16: { uint16_t v; std::memcpy(&v, buf, 2); return (T)v; }
+        case ScalarType::Int32: { int32_t v; std::memcpy(&v, buf, 4); return (T)v; }
+        case ScalarType::UInt32: { uint32_t v; std::memcpy(&v, buf, 4); return (T)v; }
+        case ScalarType::Float32: { float v; std::memcpy(&v, buf, 4); return (T)v; }
+        case ScalarType::Float64: { double v; std::memcpy(&v, buf, 8); return (T)v; }
+        default: return T(0);
+    }
+}
+
+//describes how to copy one property of an element into one column of a matrix. All the columns of an element are copied in one strided pass over the file
+struct ColumnCopy{
+    double* dst=nullptr; //start of the destination column
+    float* dst_float=nullptr; //used instead of dst when the destination is a float matrix
+    size_t dst_stride=1; //elements between two consecutive values of the column. It's 1 for column major matrices and the nr of columns for row major ones
+    size_t src_offset=0; //byte offset of the property inside the element
+    ScalarType type=ScalarType::Invalid;
+    double scale=1.0; //the value read gets multiplied by this, useful for normalizing colors
+};
+
+//points the copy to a column of a double or float matrix of any storage order
+template <typename MatrixType>
+inline void set_column_destination(ColumnCopy& copy, MatrixType& mat, const int col){
+    if constexpr (std::is_same<typename MatrixType::Scalar, float>::value){
+        copy.dst_float=mat.col(col).data();
+    }else{
+        copy.dst=mat.col(col).data();
+    }
+    copy.dst_stride=mat.col(col).innerStride();
+}
+
+//copies nr_elems elements from base where each element has stride bytes, into the columns described by the copies. Runs in parallel over the elements
+void copy_strided_columns(const char* base, const size_t nr_elems, const size_t stride, const std::vector<ColumnCopy>& copies, const bool swap_endian);
+
+
+
+//ply header. Describes the elements (vertex, face etc) and the properties of each of them
+struct PlyProperty{
+    std::string name;
+    ScalarType type=ScalarType::Invalid;
+    bool is_list=false;
+    ScalarType list_size_type=ScalarType::Invalid; //only used for list properties
+    size_t offset=0; //byte offset inside the element, only valid for the properties before the first list property
+};
+
+struct PlyElement{
+    std::string name;
+    size_t count=0;
+    std::vector<PlyProperty> properties;
+    bool has_list=false; //if the element has a list property, the size in bytes of the element is not known from the header
+    size_t stride=0; //size in bytes of one element, only valid if the element has no list property
+
+    int property_idx(const std::string& name) const; //return -1 if not found
+    int property_idx(const std::vector<std::string>& names) const; //returns the index of the first property from names that is found, or -1
+};
+
+struct PlyHeader{
+    enum class Format { Ascii, BinaryLittleEndian, BinaryBigEndian };
+    Format format=Format::Ascii;
+    std::vector<PlyElement> elements;
+    std::vector<std::string> comments;
+    size_t header_size=0; //nr of bytes of the header including the end_header line. The body of the file starts at this offset
+
+    int element_idx(const std::string& name) const; //returns -1 if not found
+    bool is_binary() const { return format!=Format::Ascii; }
+    bool needs_swap() const; //true if the endianness of the file does not match the one of this machine
+};
+
+PlyHeader parse_ply_header(const char* data, const size_t size);
+
+//in a binary ply computes for each element the byte offset where it starts in the file. Elements with list properties are walked to find their end
+std::vector<size_t> ply_element_offsets(const PlyHeader& header, const char* data, const size_t size);
+
+//reads the faces of a binary ply element which has a list property with the vertex indices. Polygons with more than 3 vertices are triangulated as a fan. Uses a fixed stride parallel path when all the polygons are triangles
+Eigen::MatrixXi read_ply_faces(const PlyHeader& header, const PlyElement& elem, const int list_idx, const char* elem_start, const char* data_end);
+
+
+
+//contents of an obj file. The faces are triangulated as fans and each corner stores the 0-based indices of the position, texcoord and normal it uses (-1 if it uses none)
+struct ObjData{
+    std::vector<double> positions; //x,y,z for each v line
+    std::vector<double> texcoords; //u,v for each vt line
+    std::vector<double> normals; //x,y,z for each vn line
+    std::vector<Eigen::Vector3i> corners; //v,vt,vn for each corner of each triangle
+};
+
+ObjData parse_obj(const char* data, const size_t size); //splits the file in line aligned chunks and parses them in parallel
+
+
+//binary cache of the already processed matrices of a mesh (.epbr). The header identifies the source file it was created from (path, size and modification time) and the options it was processed with, and is followed by a table of named matrices. The data of every matrix is stored column major, in the native byte order and 64 byte aligned so that it can be copied directly out of the memory mapped file
+struct EpbrSourceKey{
+    std::string path;
+    uint64_t size=0;
+    int64_t mtime_ns=0;
+    std::string options; //whatever else changes the result of the load, like the revision of the readers. A cache written with other options is not used
+};
+bool epbr_source_key(const std::string& path, EpbrSourceKey& key); //stats the file, returns false if it does not exist
+
+class EpbrWriter{
+public:
+    void add(const std::string& name, const Eigen::MatrixXd& mat); //the matrices are not copied so they need to stay alive until write() is called
+    void add(const std::string& name, const Eigen::MatrixXi& mat);
+    void add(const std::string& name, const Eigen::Matrix<float, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>& mat); //gets copied to column major when added
+    bool write(const std::string& file_path, const EpbrSourceKey& key) const; //writes to a temporary file and renames it so a reader never sees a half written cache. Returns false if the file could not be written
+
+private:
+    struct Entry{
+        std::string name;
+        ScalarType type;
+        uint64_t rows;
+        uint64_t cols;
+        const char* data;
+    };
+    std::vector<Entry> m_entries;
+    std::vector< std::shared_ptr<Eigen::MatrixXf> > m_owned; //column major copies of the row major matrices
+};
+
+class EpbrReader{
+public:
+    EpbrReader(const std::string& file_path);
+    bool is_valid_for(const EpbrSourceKey& key) const; //false if the file is corrupt, from another version, if the source file changed since it was written or if it was written with other options
+    bool has(const std::string& name) const;
+    std::vector<std::string> names() const; //of all the matrices in the cache
+    bool read(const std::string& name, Eigen::MatrixXd& mat) const; //returns false if the matrix is not in the cache. Float matrices can be read as double and the other way around, so a cache written by a build with EASYPBR_WITH_FLOAT_MESH can be read by one without it
+    bool read(const std::string& name, Eigen::MatrixXi& mat) const;
+    bool read(const std::string& name, Eigen::Matrix<float, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>& mat) const;
+
+private:
+    struct Entry{
+        std::string name;
+        ScalarType type;
+        uint64_t rows;
+        uint64_t cols;
+        uint64_t offset;
+    };
+    const Entry* find(const std::string& name, const ScalarType type) const;
+    template <typename MatrixType>
+    bool read_floating(const std::string& name, MatrixType& mat) const;
+
+    MappedFile m_file;
+    bool m_header_ok;
+    EpbrSourceKey m_key;
+    std::vector<Entry> m_entries;
+};
+
+
+
+//pcd header. The data of each point is stored as the fields one after another, each field having count scalars
+struct PcdField{
+    std::string name;
+    ScalarType type=ScalarType::Invalid;
+    int count=1;
+    size_t offset=0; //byte offset of the field inside a point for the binary format
+};
+
+struct PcdHeader{
+    enum class Format { Ascii, Binary, BinaryCompressed };
+    Format format=Format::Ascii;
+    std::vector<PcdField> fields;
+    size_t width=0;
+    size_t height=1;
+    size_t nr_points=0;
+    size_t point_size=0; //bytes of one point in the binary format
+    Eigen::Affine3d viewpoint=Eigen::Affine3d::Identity(); //acquisition pose, the points are transformed by it when loaded
+    size_t header_size=0; //nr of bytes of the header including the DATA line
+
+    int field_idx(const std::string& name) const; //returns -1 if not found
+};
+
+PcdHeader parse_pcd_header(const char* data, const size_t size);
+
+//gives access to the values of every field of a pcd independently of the data format. Binary data is used directly from the mapped memory, binary_compressed data is decompressed and ascii data is converted to the binary layout
+struct PcdData{
+    const char* base=nullptr;
+    std::vector<size_t> field_offsets; //for each field, byte offset of its value for the first point
+    std::vector<size_t> field_strides; //for each field, bytes between its values for two consecutive points
+    std::vector<char> storage; //owns the data for the ascii and compressed formats
+
+    const char* field_ptr(const size_t field_idx, const size_t point_idx) const { return base+field_offsets[field_idx]+point_idx*field_strides[field_idx]; }
+};
+PcdData read_pcd_data(const PcdHeader& header, const char* data, const size_t size);
+
+//writes the header and the points. The points are given in the binary layout described by the header (point_size bytes per point, fields one after another) and get converted to the format of the header
+void write_pcd_file(const std::string& file_path, const PcdHeader& header, const char* points);
+
+//lzf as used by the binary_compressed pcd format
+bool lzf_decompress(const char* in, const size_t in_len, char* out, const size_t out_len); //returns false if the data is corrupt or doesn't decompress to exactly out_len bytes
+std::vector<char> lzf_compress(const char* in, const size_t in_len);
+
+
+
+//random access reader of the points of a big binary ply or pcd file in chunks of a fixed number of points. The file is memory mapped and only the chunks that get requested are read, so the cloud can be much larger than the RAM
+class PointCloudStream{
+public:
+    PointCloudStream(const std::string& file_path, const size_t points_per_chunk);
+
+    size_t nr_points() const { return m_nr_points; }
+    size_t nr_chunks() const { return m_bounds.size(); }
+    size_t points_per_chunk() const { return m_points_per_chunk; }
+    size_t chunk_nr_points(const size_t chunk_idx) const; //all the chunks have points_per_chunk except the last one
+    bool has_color() const { return m_color_offsets[0]!=-1; }
+    bool has_intensity() const { return m_intensity_offset!=-1; }
+    const Eigen::AlignedBox3d& chunk_bounds(const size_t chunk_idx) const { return m_bounds[chunk_idx]; }
+
+    void read_chunk(const size_t chunk_idx, Eigen::MatrixXd& V, Eigen::MatrixXd& C, Eigen::MatrixXd& I) const; //C and I are left empty if the file doesn't have them. Thread safe
+
+private:
+    void compute_bounds(); //one pass over the positions of the whole file
+
+    MappedFile m_file;
+    const char* m_points_start;
+    size_t m_stride;
+    bool m_swap_endian;
+    size_t m_nr_points;
+    size_t m_points_per_chunk;
+    Eigen::Affine3d m_pose; //applied to the positions after reading them
+
+    int m_pos_offsets[3];
+    ScalarType m_pos_type;
+    int m_color_offsets[3]; //-1 if the file has no color
+    ScalarType m_color_type;
+    bool m_color_is_packed; //pcd files store the color as one float with the bytes of rgb packed inside
+    int m_intensity_offset; //-1 if the file has no intensity
+    ScalarType m_intensity_type;
+
+    std::vector<Eigen::AlignedBox3d> m_bounds;
+};
+
+
+} //namespace easy_pbr
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <opencv2/core/core.hpp>
+
+namespace easy_pbr{
+
+//writes several images as arrays of a single .npz file, the same that numpy.savez writes, so all the layers of a frame can be read in python with numpy.load(path)["name"]
+//The file is an uncompressed zip with one .npy per layer. Images of 1 channel become arrays of shape (h,w) and the others (h,w,c)
+class NpzWriter{
+public:
+    void add(const std::string& name, const cv::Mat& mat, const bool flip_vertically=false); //copies the mat so it can be reused right after. Flipping is useful for mats that come from gl textures which are upside down
+    bool write(const std::string& file_path); //writes first to a temporary file and renames it so that a reader never sees a partially written file. Returns false if it could not be written
+    void clear();
+    size_t nr_layers() const { return m_entries.size(); }
+
+private:
+    struct Entry{
+        std::string name; //including the .npy extension
+        std::string data; //the whole npy file, header and array
+        uint32_t crc;
+    };
+    std::vector<Entry> m_entries;
+};
+
+} //namespace easy_pbr
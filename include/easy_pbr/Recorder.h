@@ -5,27 +5,41 @@
 #include <thread>
 #include <memory>
 #include <unordered_map>
+#include <unordered_set>
+#include <atomic>
+#include <functional>
 #include "easy_gl/GBuffer.h"
+#include <Eigen/StdVector>
 
-#include "concurrentqueue.h"
+#include <enum.h>
+#include "easy_pbr/BoundedQueue.h"
+#include "easy_pbr/MatPool.h"
+#include "easy_pbr/AsyncTextureReader.h"
 
 namespace easy_pbr{
 
 class Viewer;
+class Camera;
 
 
 //stored a cv mat and the path where it should be written to disk
 struct MatWithFilePath{
     cv::Mat cv_mat;
     std::string file_path;
+    std::vector< std::pair<std::string, cv::Mat> > layers; //if there are layers they get written together as the arrays of a .npz file instead of the cv_mat
+    std::shared_ptr<void> batch_token; //shared by all the images of a render_poses batch and released once each of them is written or dropped, so render_poses knows when its own images are done
 };
 
+//format of the recorded images. Auto keeps the extension of the name that was passed to record(), the rest replace it. Ppm and Pfm are uncompressed and the fastest to write, Exr keeps float textures in float
+BETTER_ENUM(ImageFormat, int, Auto = 0, Png, Jpeg, Ppm, Pfm, Exr )
+
+
 class Recorder: public std::enable_shared_from_this<Recorder>
 {
 public:
-    Recorder(Viewer* view);
-    ~Recorder();
-    bool record(gl::Texture2D& tex, const std::string name,  const std::string path); //downloads the tex into a pbo and downlaod from the previous pbo into a cv which is queued for writing
+    Recorder(Viewer* view, const std::string config_file);
+    ~Recorder(); //waits for all the queued images to be written
+    bool record(gl::Texture2D& tex, const std::string name,  const std::string path); //downloads the tex into a pbo and downlaod from the previous pbo into a cv which is queued for writing. While a video is open the frames go into the video instead and name and path are ignored
     void write_without_buffering(gl::Texture2D& tex, const std::string name,  const std::string path); //writes the texture directly, without PBO buffering. useful for taking screenshots
     bool record(const std::string name,  const std::string path);
     void snapshot(const std::string name,  const std::string path);
@@ -41,6 +55,32 @@ public:
     void stop_recording();
     int nr_images_recorded();
     bool is_finished(); //returns true when the queue is empty and we finished writing everything
+    void flush(); //blocks until all the images queued so far are written to disk
+
+    void set_nr_writer_threads(const int nr_threads); //starts the new writers and retires the old ones once they finish the image they are writing. The queue stays open so record() can be called meanwhile from other threads and the queued images are written by the new writers
+    int nr_writer_threads();
+    void set_backpressure(const QueueFullPolicy policy, const int max_queued_images); //what to do when the writer threads cannot keep up and max_queued_images are waiting. Block stalls the render loop, DropOldest discards images and Grow queues them without limit
+    void set_backpressure(const std::string policy, const int max_queued_images); //same but with the name of the policy, easier to call from python
+    int nr_images_queued();
+    int nr_images_dropped();
+    void set_image_format(const ImageFormat format, const int png_compression=1, const int jpeg_quality=95); //png_compression goes from 0 (fastest) to 9 (smallest)
+    void set_image_format(const std::string format, const int png_compression=1, const int jpeg_quality=95);
+
+    //instead of one image per frame, record() can stream the frames into a single video by piping the raw pixels into an ffmpeg process. The frames are written by a single thread in the order they were recorded. The size of the video is given by the first frame, later frames of a different size are skipped
+    void start_video(const std::string file_path, const int fps=30, const std::string codec="libx264", const int crf=18); //crf is the constant rate factor of x264/x265/vpx/av1, lower means better quality and bigger files. It is not passed to codecs without one, like mpeg4 or rawvideo
+    void stop_video(); //writes the frames that are still queued and closes the video
+    bool is_recording_video();
+
+    //writes the final color, albedo, normals, metalness and roughness, depth, linear depth and ao (if ssao is enabled) of the last rendered frame as the float32 arrays of a single .npz. All of them have the height and width of the color, the ao is upsampled if ssao runs at a lower resolution. The textures are downloaded through pbos without stalling so the file gets written some frames later, flush() waits for it
+    void capture_gbuffer(const std::string name, const std::string path);
+    void poll_captures(); //gives the captures that finished downloading to the writer threads. The viewer calls it every frame
+    void release_gl_resources(); //finishes the downloads in flight and deletes the pbos. The viewer calls it when it gets destroyed since the recorder can be kept alive longer, for example from python, when there is no GL context anymore
+
+    //renders the scene from many poses as fast as possible, for example to generate a dataset. Every pose is drawn offscreen without the gui and without swapping the window and the downloads of the images are pipelined through a ring of pbos so the gpu doesn't wait for the cpu. Works the same with use_offscreen and a software GL context like mesa, though the context is still created through a window so it needs an X display, for example the virtual one of xvfb-run
+    float render_poses(const std::vector<std::shared_ptr<Camera>>& cameras, const std::string path); //queues the images for the writer threads as <idx>.png (or the extension of the image format) and waits for them to be written. Returns the images per second of this batch, including writing. Other images that were queued before are not waited for and not counted
+    float render_poses(const std::vector<Eigen::Matrix4f, Eigen::aligned_allocator<Eigen::Matrix4f>>& tf_world_cam_poses, const std::string path); //same but with the model matrices of the camera, the intrinsics are the ones of the current camera of the viewer
+    std::vector<cv::Mat> render_poses_to_mats(const std::vector<std::shared_ptr<Camera>>& cameras); //returns the images instead of writing them. They are top down and bgr(a) like the images that get written
+    float last_batch_images_per_sec(); //images per second of the last render_poses or render_poses_to_mats
 
 
     //objects
@@ -52,7 +92,15 @@ public:
     // std::string m_snapshot_name;
 
 private:
-    void write_to_file_threaded();
+    void init_params(const std::string config_file);
+    void enqueue(const MatWithFilePath& mat_with_file);
+    void write_to_file_threaded(const int generation); //exits when the queue is closed or when m_writer_generation moves past its generation
+    void start_writer_threads(const int nr_threads);
+    void stop_writer_threads(); //the threads finish writing what is queued before returning
+    void write_to_video_threaded();
+    void write_layers(MatWithFilePath& mat_with_file); //writes all the layers in one .npz
+    void render_batch(const std::vector<std::shared_ptr<Camera>>& cameras, const std::function<void(const int idx, cv::Mat& mat)>& on_image); //draws every camera and passes the image of each one, still as the gl texture, once it's downloaded
+    void create_folder_once(const std::string& folder);
 
 
     // gl::GBuffer m_framebuffer; //framebuffer in which we will draw, then we download it into a opencv mat in order to save it to disk
@@ -67,10 +115,33 @@ private:
 
 
     // //cv mats are buffered here and they await for the thread that writes them to file
-    moodycamel::ConcurrentQueue<MatWithFilePath> m_cv_mats_queue;
+    BoundedQueue<MatWithFilePath> m_cv_mats_queue;
     // std::unordered_map<std::string, int> m_times_written_for_tex; //how many times we have written a texture with a certain name
     std::vector<std::thread> m_writer_threads;
-    bool m_threads_are_running;
+    std::mutex m_writer_threads_mutex; //guards the starting and stopping of the writer threads
+    std::atomic<int> m_writer_generation; //bumped by set_nr_writer_threads so that the writers started before it exit
+    std::shared_ptr<MatPool> m_mat_pool;
+    std::atomic<int> m_image_format; //ImageFormat, atomic because the writer threads read it while python may set it
+    std::atomic<int> m_png_compression;
+    std::atomic<int> m_jpeg_quality;
+    std::mutex m_created_folders_mutex;
+    std::unordered_set<std::string> m_created_folders; //folders that we already know exist, so we don't ask the filesystem for every image
+
+    //video
+    BoundedQueue<cv::Mat> m_video_queue; //only one consumer so that the order of the frames is kept
+    std::thread m_video_thread;
+    bool m_is_recording_video;
+    std::string m_video_path;
+    int m_video_fps;
+    std::string m_video_codec;
+    int m_video_crf;
+
+    //gbuffer captures
+    std::shared_ptr<AsyncTextureReader> m_gbuffer_reader; //created with the first capture since it needs the GL context
+
+    //batch rendering
+    std::shared_ptr<AsyncTextureReader> m_batch_reader;
+    float m_last_batch_images_per_sec;
 
     bool m_is_recording;
     int m_nr_images_recorded;
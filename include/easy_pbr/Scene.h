@@ -5,6 +5,8 @@
 #include <vector>
 #include <memory>
 #include <mutex>
+#include <future>
+#include <unordered_map>
 
 namespace easy_pbr{
 
@@ -19,14 +21,21 @@ public:
     static void show_all();
     // static void show(const Mesh& mesh, const std::string name); //convenience function. adds to the scene and overwrites if it has the same name
     static void add_mesh(const std::shared_ptr<Mesh> mesh, const std::string name); //adds to the scene even if it has the same name
+    static void show_when_ready(const std::shared_future<std::shared_ptr<Mesh>> mesh_future, const std::string name); //the mesh gets shown, as with show(), once it finished loading. Does not block
+    static void show_ready_meshes(); //shows the meshes of show_when_ready that finished loading. Called by the viewer every frame
+    static int nr_pending_meshes();
     static void clear();
     static int nr_meshes();
     static int nr_vertices();
     static int nr_faces();
     static std::shared_ptr<Mesh> get_mesh_with_name(const std::string name);
     static std::shared_ptr<Mesh> get_mesh_with_idx(const unsigned int idx);
+    static std::shared_ptr<Mesh> get_mesh_with_id(const int scene_id);
     static int get_idx_for_name(const std::string name);
+    static int get_id_for_name(const std::string name);
     static bool does_mesh_with_name_exist(const std::string name);
+    static bool does_mesh_with_id_exist(const int scene_id);
+    static std::vector< std::shared_ptr<Mesh> > get_meshes(); //copy of all the meshes of the scene in order. Cheaper than calling get_mesh_with_idx for each one because it locks only once
     static void remove_meshes_starting_with_name(const std::string name_prefix); // check all the meshes and removed the ones that start with a certain name
     static void remove_mesh_with_idx(const unsigned int idx);
 
@@ -44,6 +53,16 @@ public:
 private:
     static std::vector< std::shared_ptr<Mesh> > m_meshes;
     static std::mutex m_mesh_mutex; // when adding a new mesh to the scene, we need to lock them so it can be thread safe
+    static std::vector< std::pair<std::shared_future<std::shared_ptr<Mesh>>, std::string> > m_pending_meshes; //meshes that are still loading and get shown once ready
+    static std::mutex m_pending_mutex;
+
+    //the lookups by name and id are done through these hash maps instead of going through all the meshes. A mesh that gets added receives a new scene_id while one that replaces another with the same name in show() takes over its id. The names should be changed only through show() because the index wouldn't know about it otherwise
+    static std::unordered_map<std::string, int> m_name2id; //if several meshes have the same name (through add_mesh) this points to the first one
+    static std::unordered_map<int, size_t> m_id2idx; //position in m_meshes
+    static int m_next_id;
+    static void rebuild_index(); //needs to be called with m_mesh_mutex locked whenever meshes are inserted or removed from m_meshes other than at the back
+    static void add_to_index(const size_t idx);
+    static void add_grid_floor(); //the first mesh that gets added also gets a grid for the ground, needs m_mesh_mutex locked
 
     static bool m_floor_visible; //storing if the user wants the floor visible or not. We store it here because the user might set it before we even added a floor
     static bool m_floor_metric; // is this is true. the floor will be metric in the sense that each square will have edge being one unit. If this is false, then the floor will be dynamic to the size of the scene
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <vector>
+#include <queue>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <stdexcept>
+
+namespace easy_pbr{
+
+//fixed number of worker threads that run the tasks in the order they were enqueued. Used for work that would otherwise block the render loop, like loading meshes from disk
+class ThreadPool{
+public:
+    ThreadPool(const int nr_threads){
+        if(nr_threads<1){
+            throw std::runtime_error("A ThreadPool needs at least one thread, you asked for " + std::to_string(nr_threads));
+        }
+        for(int i=0; i<nr_threads; i++){
+            m_workers.emplace_back( [this]{ worker_loop(); } );
+        }
+    }
+
+    //the tasks that are still queued get finished before the threads are joined so no future is left without a value
+    ~ThreadPool(){
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stopping=true;
+        }
+        m_cv.notify_all();
+        for(size_t i=0; i<m_workers.size(); i++){
+            m_workers[i].join();
+        }
+    }
+
+    ThreadPool(const ThreadPool&)=delete;
+    ThreadPool& operator=(const ThreadPool&)=delete;
+
+    template <class F>
+    auto enqueue(F&& func) -> std::future<decltype(func())>{
+        typedef decltype(func()) ReturnType;
+        auto task=std::make_shared< std::packaged_task<ReturnType()> >( std::forward<F>(func) );
+        std::future<ReturnType> future=task->get_future();
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if(m_stopping){
+                throw std::runtime_error("Cannot enqueue in a ThreadPool that is being destroyed");
+            }
+            m_tasks.emplace( [task]{ (*task)(); } );
+        }
+        m_cv.notify_one();
+        return future;
+    }
+
+    int nr_threads() const { return m_workers.size(); }
+    size_t nr_pending(){
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_tasks.size();
+    }
+
+    //drops the tasks that didn't start yet, their futures throw std::future_error with broken_promise. The running ones are not affected. Returns how many got dropped
+    size_t clear_pending(){
+        std::queue< std::function<void()> > dropped;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            dropped.swap(m_tasks);
+        }
+        return dropped.size(); //the tasks are destroyed outside of the lock because their captures may take a while to release
+    }
+
+private:
+    void worker_loop(){
+        while(true){
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_cv.wait(lock, [this]{ return m_stopping || !m_tasks.empty(); });
+                if(m_tasks.empty()){ //only happens when stopping
+                    return;
+                }
+                task=std::move(m_tasks.front());
+                m_tasks.pop();
+            }
+            task(); //exceptions end up in the future of the packaged task
+        }
+    }
+
+    std::vector<std::thread> m_workers;
+    std::queue< std::function<void()> > m_tasks;
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    bool m_stopping=false;
+};
+
+} //namespace easy_pbr
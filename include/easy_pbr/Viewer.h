@@ -2,6 +2,7 @@
 
 //c++
 #include <memory>
+#include <unordered_map>
 
 // #include "imgui.h"
 // #include "imgui_impl_glfw.h"
@@ -83,6 +84,7 @@ public:
     bool m_use_offscreen;
     float m_subsample_factor; // subsample factor for the whole viewer so that when it's fullscreen it's not using the full resolution of the screen
     bool m_render_uv_to_gbuffer; // usually we don't need to render the uv to the gbuffer but for some applications it's nice to have so we can enable it here and it will create a new render target in the gbuffer
+    bool m_packed_vertex_buffers; //upload the meshes with the position, normal, uv and color interleaved and quantized (see MeshGL::set_packed). Uses around half the gpu memory and upload bandwidth
     int m_ssao_downsample;
     int m_nr_samples;
     float m_kernel_radius;
@@ -193,7 +195,7 @@ public:
     // void print_pointers();
     // void set_position(const int i, Eigen::Vector3f&);
     // void check_position(const int i);
-    void write_gbuffer_to_folder();
+    void decode_gbuffer(); //decodes the normals, albedo, metalness and roughness and depth of m_gbuffer into the float textures of m_decoded_gbuffer so they can be downloaded without losing precision
 
 
     //rendering passes
@@ -249,6 +251,7 @@ public:
     gl::Shader m_blend_bg_shader;;
 
     gl::GBuffer m_gbuffer; //contains all the textures of a normal gbuffer. So normals, diffuse, depth etc.
+    gl::GBuffer m_decoded_gbuffer; //the gbuffer decoded into float textures by decode_gbuffer(). Normals in [-1,1], albedo, metalness_and_roughness, the depth as in the depth buffer and the linear depth along the camera axis
     gl::GBuffer m_composed_fbo; //contains the composed image between the foreground and background before tonemapping and gamma correction. Contains also the bright spots of the image
     // gl::Texture2D m_composed_tex; //after gbuffer composing the foreground with the background but before tonemapping and gamme correction. Is in half float
     // gl::Texture2D m_bloom_tex; //while composing we also write the colors corresponding to the bright areas. Is in half float
@@ -323,6 +326,7 @@ public:
     // float m_multichannel_start_x; //the start of the first line, defalt is 0 which means it start on the left
 
     std::vector< std::shared_ptr<MeshGL> > m_meshes_gl; //stored the gl meshes which will get updated if the meshes in the scene are dirty
+    std::unordered_map<int, std::shared_ptr<MeshGL> > m_id2mesh_gl; //the gl meshes of the meshes that are in the scene, indexed by their scene_id. Sticky meshes that are not in the scene are only in m_meshes_gl
 
 
     // Eigen::Matrix4f compute_mvp_matrix(const std::shared_ptr<MeshGL>& mesh);
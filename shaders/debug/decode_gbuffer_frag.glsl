@@ -7,12 +7,18 @@ layout(location=1) in vec2 uv_in;
 
 //out
 layout(location = 0) out vec3 normal_out;
-layout(location = 1) out vec3 metalness_and_roughness_out;
+layout(location = 1) out vec2 metalness_and_roughness_out;
 layout(location = 2) out float depth_out;
+layout(location = 3) out float depth_linear_out;
+layout(location = 4) out vec3 albedo_out;
 
 uniform sampler2D normals_encoded_tex;
+uniform sampler2D diffuse_tex;
 uniform sampler2D metalness_and_roughness_tex;
 uniform sampler2D depth_tex;
+uniform float projection_a;
+uniform float projection_b;
+uniform bool using_fat_gbuffer;
 
 
 //decode a normal stored in RG texture as explained in the CryEngine 3 talk "A bit more deferred" https://www.slideshare.net/guest11b095/a-bit-more-deferred-cry-engine3
@@ -30,7 +36,21 @@ uniform sampler2D depth_tex;
 
 //encode as xyz https://knarkowicz.wordpress.com/2014/04/16/octahedron-normal-vector-encoding/
 vec3 decode_normal(vec3 normal){
-    return normalize(normal * 2.0 - 1.0);
+    if (normal==vec3(0)){
+        return normal;
+    }
+
+    if(using_fat_gbuffer){
+        return normalize(normal);
+    }else{
+        return normalize(normal * 2.0 - 1.0);
+    }
+}
+
+float linear_depth(float depth_sample){
+    // according to the formula at the bottom of article https://mynameismjp.wordpress.com/2010/09/05/position-from-depth-3/
+    float linearDepth = projection_b / (depth_sample - projection_a);
+    return linearDepth;
 }
 
 void main(){
@@ -38,13 +58,20 @@ void main(){
     //normal
     vec3 normal_encoded=texture(normals_encoded_tex, uv_in).xyz;
     vec3 normal_decoded=decode_normal(normal_encoded);
-    normal_decoded= (normal_decoded+1.0)*0.5;
     vec2 metalnes_and_roughness=texture(metalness_and_roughness_tex, uv_in).xy;
+    vec4 color_with_weight = texture(diffuse_tex, uv_in);
+    if (color_with_weight.w!=0.0){ //normalize it in case we are doing some surfel splatting
+        color_with_weight.xyz/=color_with_weight.w;
+        metalnes_and_roughness/=color_with_weight.w;
+    }
     float depth = texture(depth_tex, uv_in).x;
 
-    normal_out = normal_decoded;
-    metalness_and_roughness_out = vec3(metalnes_and_roughness, 0.0);
+    //the normals are kept in [-1,1] and the depth in float so that nothing gets quantized. The background has no normal and a linear depth of 0
+    normal_out = depth==1.0 ? vec3(0.0) : normal_decoded;
+    metalness_and_roughness_out = metalnes_and_roughness;
+    albedo_out = color_with_weight.xyz;
     depth_out = depth;
+    depth_linear_out = depth==1.0 ? 0.0 : linear_depth(depth);
 
     //debug just put ones
     // normal_out = vec3(1.0);
@@ -49,24 +49,40 @@ vec3 colorize_height(float x){
     return color_scheme_height[x_int];
 }
 
+uniform bool normal_octahedral=false; //set when the mesh uses the packed vertex format, then the normal comes as 2 components in octahedral encoding
+
+//https://knarkowicz.wordpress.com/2014/04/16/octahedron-normal-vector-encoding/
+vec3 decode_normal(vec3 n){
+    if(!normal_octahedral){
+        return n;
+    }
+    vec3 v=vec3(n.xy, 1.0-abs(n.x)-abs(n.y));
+    if(v.z<0.0){
+        v.xy=(1.0-abs(v.yx)) * vec2(v.x>=0.0 ? 1.0 : -1.0, v.y>=0.0 ? 1.0 : -1.0);
+    }
+    return normalize(v);
+}
+
 void main(){
 
+    vec3 normal_decoded=decode_normal(normal);
+
 
    gl_Position = MVP*vec4(position, 1.0);
 
    //tbn matrix
-   vec3 bitangent = cross(normal, tangent);  //calculate the bitgent in the object coordinate system. The tangent and normal are also in the object coordinate system
+   vec3 bitangent = cross(normal_decoded, tangent);  //calculate the bitgent in the object coordinate system. The tangent and normal are also in the object coordinate system
 
    //get the tbn vectors from the model to the world coordinate system
    vec3 T = normalize(vec3(M * vec4(tangent,   0.0)));
    vec3 B = normalize(vec3(M * vec4(bitangent, 0.0)));
-   vec3 N = normalize(vec3(M * vec4(normal,    0.0)));
+   vec3 N = normalize(vec3(M * vec4(normal_decoded,    0.0)));
    mat3 TBN = mat3(T, B, N);
    TBN_out=TBN;
 
 
    //TODO normals also have to be rotated by the model matrix (at the moment it's only identity so its fine)
-   normal_out=normalize(vec3(M*vec4(normal,0.0))); //normals are not affected by translation so the homogenous component is 0
+   normal_out=normalize(vec3(M*vec4(normal_decoded,0.0))); //normals are not affected by translation so the homogenous component is 0
    position_cam_coords_out= vec3(MV*(vec4(position, 1.0))); //from object to world and from world to view
 //    normal_cam_coords_out=normalize(vec3(MV*vec4(normal, 0.0)));
 //    normal_cam_coords_out=normalize(vec3(MV*vec4(normal, 0.0)));
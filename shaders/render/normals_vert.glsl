@@ -16,10 +16,26 @@ layout(location = 1) out vec3 v_normal_out;
 // uniform mat4 MV; //project only into camera coordinate, but doesnt project onto the screen
 // uniform mat4 MVP;
 
+uniform bool normal_octahedral=false; //set when the mesh uses the packed vertex format, then the normal comes as 2 components in octahedral encoding
+
+//https://knarkowicz.wordpress.com/2014/04/16/octahedron-normal-vector-encoding/
+vec3 decode_normal(vec3 n){
+    if(!normal_octahedral){
+        return n;
+    }
+    vec3 v=vec3(n.xy, 1.0-abs(n.x)-abs(n.y));
+    if(v.z<0.0){
+        v.xy=(1.0-abs(v.yx)) * vec2(v.x>=0.0 ? 1.0 : -1.0, v.y>=0.0 ? 1.0 : -1.0);
+    }
+    return normalize(v);
+}
+
 void main(){
 
+    vec3 normal_decoded=decode_normal(normal);
+
     v_pos_out=position;
-    v_normal_out=normal;
+    v_normal_out=normal_decoded;
 
 
 }
@@ -45,8 +45,24 @@ vec3 colorize_height(float x){
     return color_scheme_height[x_int];
 }
 
+uniform bool normal_octahedral=false; //set when the mesh uses the packed vertex format, then the normal comes as 2 components in octahedral encoding
+
+//https://knarkowicz.wordpress.com/2014/04/16/octahedron-normal-vector-encoding/
+vec3 decode_normal(vec3 n){
+    if(!normal_octahedral){
+        return n;
+    }
+    vec3 v=vec3(n.xy, 1.0-abs(n.x)-abs(n.y));
+    if(v.z<0.0){
+        v.xy=(1.0-abs(v.yx)) * vec2(v.x>=0.0 ? 1.0 : -1.0, v.y>=0.0 ? 1.0 : -1.0);
+    }
+    return normalize(v);
+}
+
 void main(){
 
+    vec3 normal_decoded=decode_normal(normal);
+
     // bool enable_min_max_cap=true;
     // if (position.y> max_y || position.y<min_y){
         // gl_Position = MVP*vec4(vec3(0.0), 1.0);
@@ -78,7 +94,7 @@ void main(){
 //TODO normals also have to be rotated by the model matrix (at the moment it's only identity so its fine)
     position_cam_coords_out= vec3(MV*(vec4(position, 1.0))); //from object to world and from world to view
     if(has_normals){
-        normal_out=normalize(vec3(M*vec4(normal,0.0))); //normals are not affected by translation so the homogenous component is 0
+        normal_out=normalize(vec3(M*vec4(normal_decoded,0.0))); //normals are not affected by translation so the homogenous component is 0
     }else{
         normal_out=vec3(0,0,0);
     }
@@ -28,10 +28,26 @@ uniform vec3 solid_color;
 #define MAX_NR_CLASSES 255
 uniform vec3 color_scheme[MAX_NR_CLASSES];
 
+uniform bool normal_octahedral=false; //set when the mesh uses the packed vertex format, then the normal comes as 2 components in octahedral encoding
+
+//https://knarkowicz.wordpress.com/2014/04/16/octahedron-normal-vector-encoding/
+vec3 decode_normal(vec3 n){
+    if(!normal_octahedral){
+        return n;
+    }
+    vec3 v=vec3(n.xy, 1.0-abs(n.x)-abs(n.y));
+    if(v.z<0.0){
+        v.xy=(1.0-abs(v.yx)) * vec2(v.x>=0.0 ? 1.0 : -1.0, v.y>=0.0 ? 1.0 : -1.0);
+    }
+    return normalize(v);
+}
+
 void main(){
 
+    vec3 normal_decoded=decode_normal(normal);
+
     v_pos_out=position;
-    v_normal_out=normal;
+    v_normal_out=normal_decoded;
     tangent_u_out=tangent_u;
     lenght_v_out=lenght_v;
     // color_per_vertex_out=color_per_vertex;
@@ -47,7 +63,7 @@ void main(){
     }else if(color_type==4){ //semantic gt
         color_per_vertex_out=color_scheme[label_gt_per_vertex];
     }else if(color_type==5){ //normal vector
-        color_per_vertex_out=(normal+1.0)/2.0;
+        color_per_vertex_out=(normal_decoded+1.0)/2.0;
     }
     // }else if(color_type==6){ //SSAO CANNOT BE DONE HERE AS IT CAN ONLY BE DONE BY THE COMPOSE SHADER
         // color_per_vertex_out=vec3(0);
@@ -0,0 +1,177 @@
+#include "easy_pbr/AsyncTextureReader.h"
+
+//c++
+#include <cstring>
+
+//my stuff
+#include "easy_pbr/MatPool.h"
+#include "easy_gl/UtilsGL.h"
+
+//loguru
+#define LOGURU_REPLACE_GLOG 1
+#include <loguru.hpp>
+
+namespace easy_pbr{
+
+//the pixels are packed in the format of the texture with a type that opencv can hold. Half floats and depth get read as floats
+static void pack_format_of_tex(gl::Texture2D& tex, GLenum& format, GLenum& type, int& cv_type){
+    format=tex.format();
+    type=tex.type();
+
+    int channels=0;
+    switch(format){
+        case GL_RED: case GL_RED_INTEGER: case GL_DEPTH_COMPONENT: channels=1; break;
+        case GL_RG: case GL_RG_INTEGER: channels=2; break;
+        case GL_RGB: case GL_RGB_INTEGER: case GL_BGR: channels=3; break;
+        case GL_RGBA: case GL_RGBA_INTEGER: case GL_BGRA: channels=4; break;
+        default: LOG(FATAL) << "Reading textures of format " << gl::type2string(format) << " is not supported";
+    }
+
+    int depth=0;
+    if(format==GL_DEPTH_COMPONENT){
+        type=GL_FLOAT;
+    }
+    switch(type){
+        case GL_UNSIGNED_BYTE: depth=CV_8U; break;
+        case GL_BYTE: depth=CV_8S; break;
+        case GL_UNSIGNED_SHORT: depth=CV_16U; break;
+        case GL_SHORT: depth=CV_16S; break;
+        case GL_INT: case GL_UNSIGNED_INT: depth=CV_32S; break; //opencv has no unsigned int so they get stored with the same bits in a signed one
+        case GL_FLOAT: case GL_HALF_FLOAT: type=GL_FLOAT; depth=CV_32F; break;
+        default: LOG(FATAL) << "Reading textures of type " << gl::type2string(type) << " is not supported";
+    }
+
+    cv_type=CV_MAKETYPE(depth, channels);
+}
+
+AsyncTextureReader::AsyncTextureReader(const int nr_slots, const std::shared_ptr<MatPool>& mat_pool):
+    m_next_slot(0),
+    m_mat_pool(mat_pool)
+{
+    CHECK(nr_slots>0) << "The AsyncTextureReader needs at least one slot but got " << nr_slots;
+    m_slots.resize(nr_slots);
+}
+
+AsyncTextureReader::~AsyncTextureReader(){
+    finish();
+    for(size_t i=0; i<m_slots.size(); i++){
+        if(!m_slots[i].pbos.empty()){
+            glDeleteBuffers(m_slots[i].pbos.size(), m_slots[i].pbos.data());
+        }
+    }
+}
+
+void AsyncTextureReader::read(const std::vector<gl::Texture2D*>& textures, Callback on_ready){
+    CHECK(!textures.empty()) << "There are no textures to read";
+
+    poll();
+    //the slot we want to write into may still be in flight if all of them are busy
+    while((int)m_in_flight.size()>=(int)m_slots.size()){
+        complete_oldest();
+    }
+
+    Slot& slot=m_slots[m_next_slot];
+    if(slot.pbos.size()!=textures.size()){
+        if(!slot.pbos.empty()){
+            glDeleteBuffers(slot.pbos.size(), slot.pbos.data());
+        }
+        slot.pbos.resize(textures.size());
+        GL_C( glGenBuffers(slot.pbos.size(), slot.pbos.data()) );
+        slot.pbo_bytes.assign(textures.size(), 0);
+    }
+    slot.rows.resize(textures.size());
+    slot.cols.resize(textures.size());
+    slot.cv_types.resize(textures.size());
+
+    //rows of odd widths like the ones of a RGB8 texture would otherwise be padded to 4 bytes and would not be contiguous in the cv mat
+    GLint old_pack_alignment;
+    glGetIntegerv(GL_PACK_ALIGNMENT, &old_pack_alignment);
+    GL_C( glPixelStorei(GL_PACK_ALIGNMENT, 1) );
+
+    for(size_t i=0; i<textures.size(); i++){
+        gl::Texture2D& tex=*textures[i];
+        CHECK(tex.storage_initialized()) << "Texture " << i << " has no storage so it cannot be read";
+
+        GLenum format, type;
+        int cv_type;
+        pack_format_of_tex(tex, format, type, cv_type);
+        slot.rows[i]=tex.height();
+        slot.cols[i]=tex.width();
+        slot.cv_types[i]=cv_type;
+
+        const size_t bytes=(size_t)tex.width()*tex.height()*CV_ELEM_SIZE(cv_type);
+        GL_C( glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbos[i]) );
+        if(slot.pbo_bytes[i]!=bytes){
+            GL_C( glBufferData(GL_PIXEL_PACK_BUFFER, bytes, NULL, GL_STREAM_READ) );
+            slot.pbo_bytes[i]=bytes;
+        }
+        //with a pbo bound the download goes into the buffer and the call returns without waiting for the gpu
+        GL_C( glBindTexture(GL_TEXTURE_2D, tex.tex_id()) );
+        GL_C( glGetTexImage(GL_TEXTURE_2D, 0, format, type, 0) );
+    }
+    GL_C( glBindTexture(GL_TEXTURE_2D, 0) );
+    GL_C( glBindBuffer(GL_PIXEL_PACK_BUFFER, 0) );
+    GL_C( glPixelStorei(GL_PACK_ALIGNMENT, old_pack_alignment) );
+
+    slot.fence=glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    slot.callback=on_ready;
+    m_in_flight.push_back(m_next_slot);
+    m_next_slot=(m_next_slot+1)%m_slots.size();
+}
+
+int AsyncTextureReader::poll(){
+    int nr_completed=0;
+    while(!m_in_flight.empty()){
+        GLenum status=glClientWaitSync(m_slots[m_in_flight.front()].fence, 0, 0);
+        if(status!=GL_ALREADY_SIGNALED && status!=GL_CONDITION_SATISFIED){
+            break;
+        }
+        complete_oldest();
+        nr_completed++;
+    }
+    return nr_completed;
+}
+
+void AsyncTextureReader::finish(){
+    while(!m_in_flight.empty()){
+        complete_oldest();
+    }
+}
+
+void AsyncTextureReader::complete_oldest(){
+    CHECK(!m_in_flight.empty()) << "There are no pending reads";
+    Slot& slot=m_slots[m_in_flight.front()];
+    m_in_flight.pop_front();
+
+    //the first wait flushes the commands so the fence is guaranteed to signal eventually
+    GLenum status=glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+    while(status==GL_TIMEOUT_EXPIRED){
+        status=glClientWaitSync(slot.fence, 0, 1000000000);
+    }
+    CHECK(status!=GL_WAIT_FAILED) << "Waiting for the texture download failed";
+    glDeleteSync(slot.fence);
+    slot.fence=0;
+
+    std::vector<cv::Mat> mats(slot.pbos.size());
+    for(size_t i=0; i<slot.pbos.size(); i++){
+        if(m_mat_pool){
+            mats[i]=m_mat_pool->acquire(slot.rows[i], slot.cols[i], slot.cv_types[i]);
+        }else{
+            mats[i]=cv::Mat(slot.rows[i], slot.cols[i], slot.cv_types[i]);
+        }
+        GL_C( glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbos[i]) );
+        void* data=glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, slot.pbo_bytes[i], GL_MAP_READ_BIT);
+        CHECK(data) << "Could not map the pixel buffer of texture " << i;
+        std::memcpy(mats[i].data, data, slot.pbo_bytes[i]);
+        GL_C( glUnmapBuffer(GL_PIXEL_PACK_BUFFER) );
+    }
+    GL_C( glBindBuffer(GL_PIXEL_PACK_BUFFER, 0) );
+
+    Callback callback;
+    std::swap(callback, slot.callback); //the slot may get reused from within the callback
+    if(callback){
+        callback(mats);
+    }
+}
+
+} //namespace easy_pbr
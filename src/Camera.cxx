@@ -597,8 +597,8 @@ MeshSharedPtr Camera::create_frustum_mesh( const float scale_multiplier, const E
     }
     // std::cout << "frustrum_in_world_postw is " << frustrum_in_world_postw.rows() << " " << frustrum_in_world_postw.cols() << '\n';
 
-    frustum_mesh->V=frustum_in_world_postw.cast<double>();
-    frustum_mesh->C=frustum_vertex_color.cast<double>();
+    frustum_mesh->V=frustum_in_world_postw.cast<MeshScalar>();
+    frustum_mesh->C=frustum_vertex_color.cast<MeshScalar>();
     frustum_mesh->E=E;
     frustum_mesh->m_vis.m_show_mesh=false;
     frustum_mesh->m_vis.m_show_lines=true;
@@ -10,6 +10,12 @@
 
 #include "numerical_utils.h"
 
+#include <mutex>
+#include <deque>
+#include <numeric>
+#include <atomic>
+#include <limits>
+
 //loguru
 #define LOGURU_REPLACE_GLOG 1
 #include <loguru.hpp>
@@ -18,6 +24,170 @@
 
 namespace easy_pbr {
 
+//the rays K^-1*(x,y,1) in camera coordinates through every pixel, stored row by row. They only depend on K and the size of the image so all the frames of a camera can share them
+struct PixelRays{
+    Eigen::Matrix3f K;
+    int width;
+    int height;
+    Eigen::Matrix<float, Eigen::Dynamic, 3, Eigen::RowMajor> rays;
+    Eigen::Matrix<float, Eigen::Dynamic, 3, Eigen::RowMajor> dirs; //the same rays but normalized
+};
+
+static size_t pixel_rays_bytes(const PixelRays& pixel_rays){
+    return (pixel_rays.rays.size()+pixel_rays.dirs.size())*sizeof(float);
+}
+
+//the ray grids that were used most recently. For a stream of frames from the same camera, or from all the cameras of a rig, the rays get computed only once
+//The cache is bounded by memory instead of by a number of entries: a rig with many small cameras keeps all of them while a few big images already fill it. The most recent grid is always kept even if it's bigger than the budget
+static std::shared_ptr<const PixelRays> get_pixel_rays(const Eigen::Matrix3f& K, const int width, const int height){
+    static std::mutex cache_mutex;
+    static std::deque< std::shared_ptr<const PixelRays> > cache; //the most recently used at the front
+    static size_t cached_bytes=0;
+    const size_t max_cached_bytes=256*1024*1024; //24 bytes per pixel, so for example 10 cameras of 1MP
+
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    for(size_t i=0; i<cache.size(); i++){
+        if(cache[i]->width==width && cache[i]->height==height && cache[i]->K==K){
+            std::shared_ptr<const PixelRays> found=cache[i];
+            cache.erase(cache.begin()+i);
+            cache.push_front(found);
+            return found;
+        }
+    }
+
+    std::shared_ptr<PixelRays> pixel_rays=std::make_shared<PixelRays>();
+    pixel_rays->K=K;
+    pixel_rays->width=width;
+    pixel_rays->height=height;
+    pixel_rays->rays.resize((long)width*height, 3);
+    pixel_rays->dirs.resize((long)width*height, 3);
+    const Eigen::Matrix3d K_inv=K.cast<double>().inverse();
+    #pragma omp parallel for
+    for(int y=0; y<height; y++){
+        for(int x=0; x<width; x++){
+            //No need to do height-y because the tf_cam_world of the frame look like the one in the link https://docs.opencv.org/2.4/modules/calib3d/doc/camera_calibration_and_3d_reconstruction.html. So the X to the right, y towards bottom and Z towards the frame itself
+            const Eigen::Vector3d ray=K_inv*Eigen::Vector3d(x, y, 1.0);
+            pixel_rays->rays.row((long)y*width+x)=ray.transpose().cast<float>();
+            pixel_rays->dirs.row((long)y*width+x)=ray.normalized().transpose().cast<float>();
+        }
+    }
+
+    cache.push_front(pixel_rays);
+    cached_bytes+=pixel_rays_bytes(*pixel_rays);
+    while(cache.size()>1 && cached_bytes>max_cached_bytes){
+        cached_bytes-=pixel_rays_bytes(*cache.back());
+        cache.pop_back();
+    }
+    return pixel_rays;
+}
+
+//projection of a world space cloud into a frame together with the depth of the closest point that lands in every pixel. Used by the splatting and the color assignment to discard the points that are occluded by a surface closer to the camera
+struct CloudProjection{
+    Eigen::Matrix<float, Eigen::Dynamic, 3, Eigen::RowMajor> screen; //x and y in pixels and the depth along the Z axis of the camera
+    std::vector<char> valid; //the point is not zero, is in front of the camera and its nearest pixel is inside the image
+    std::vector<float> zbuffer; //width*height, infinity where no point landed
+    int width;
+    int height;
+
+    //the point is at most depth_tolerance (relative to the depth) behind the closest point that landed in the pixel
+    bool is_visible(const long point_idx, const int x, const int y, const float depth_tolerance) const{
+        return screen(point_idx,2) <= zbuffer[(long)y*width+x]*(1.0f+depth_tolerance);
+    }
+};
+
+static inline void atomic_min(std::atomic<float>& target, const float val){
+    float cur=target.load(std::memory_order_relaxed);
+    while(val<cur && !target.compare_exchange_weak(cur, val, std::memory_order_relaxed)){
+    }
+}
+
+//the pixels in which a point at x,y gets splatted and their weights. Nearest only uses the closest pixel, bilinear the 4 pixels around the point. Returns how many pixels are inside the image
+static inline int splat_footprint(const float x, const float y, const bool bilinear, const int width, const int height, int px[4], int py[4], float w[4]){
+    if(!bilinear){
+        px[0]=(int)std::floor(x+0.5f);
+        py[0]=(int)std::floor(y+0.5f);
+        w[0]=1.0f;
+        return (px[0]>=0 && px[0]<width && py[0]>=0 && py[0]<height) ? 1 : 0;
+    }
+
+    const int x0=(int)std::floor(x);
+    const int y0=(int)std::floor(y);
+    const float fx=x-x0;
+    const float fy=y-y0;
+    int nr_pixels=0;
+    for(int j=0; j<2; j++){
+        for(int i=0; i<2; i++){
+            const int cx=x0+i;
+            const int cy=y0+j;
+            const float cw=(i? fx : 1.0f-fx) * (j? fy : 1.0f-fy);
+            if(cw>0.0f && cx>=0 && cx<width && cy>=0 && cy<height){
+                px[nr_pixels]=cx;
+                py[nr_pixels]=cy;
+                w[nr_pixels]=cw;
+                nr_pixels++;
+            }
+        }
+    }
+    return nr_pixels;
+}
+
+//projects all the points in parallel and fills the depth buffer over the footprint of every point with an atomic min
+static CloudProjection project_cloud(const MeshMatrixX& V, const Eigen::Affine3f& tf_cam_world, const Eigen::Matrix3f& K, const int width, const int height, const bool bilinear){
+    CHECK(width>0) <<"Width of this frame was not assigned";
+    CHECK(height>0) <<"Height of this frame was not assigned";
+    CHECK(V.cols()==3) << "The cloud should have 3 columns but it has " << V.cols();
+
+    CloudProjection proj;
+    proj.width=width;
+    proj.height=height;
+    proj.screen.resize(V.rows(), 3);
+    proj.valid.resize(V.rows(), 0);
+
+    const long nr_pixels=(long)width*height;
+    std::unique_ptr< std::atomic<float>[] > zbuffer(new std::atomic<float>[nr_pixels]);
+    #pragma omp parallel for
+    for(long long i=0; i<nr_pixels; i++){
+        zbuffer[i].store(std::numeric_limits<float>::infinity(), std::memory_order_relaxed);
+    }
+
+    const Eigen::Matrix3d KR=K.cast<double>()*tf_cam_world.linear().cast<double>();
+    const Eigen::Vector3d Kt=K.cast<double>()*tf_cam_world.translation().cast<double>();
+    #pragma omp parallel for
+    for(long long i=0; i<V.rows(); i++){
+        if(V.row(i).isZero()){
+            continue;
+        }
+        const Eigen::Vector3d p=KR*Eigen::Vector3d(V(i,0), V(i,1), V(i,2)) + Kt;
+        if(p.z()<=0.0){
+            continue;
+        }
+        //No need to do height-y because the tf_cam_world of the frame look like the one in the link https://docs.opencv.org/2.4/modules/calib3d/doc/camera_calibration_and_3d_reconstruction.html. So the X to the right, y towards bottom and Z towards the frame itself. This is consistent with the uv space of opengl now
+        const float x=p.x()/p.z();
+        const float y=p.y()/p.z();
+        const float depth=p.z();
+        proj.screen.row(i) << x, y, depth;
+
+        int px[4], py[4];
+        float w[4];
+        if(splat_footprint(x, y, false, width, height, px, py, w)==0){
+            continue;
+        }
+        proj.valid[i]=1;
+        const int nr_footprint=splat_footprint(x, y, bilinear, width, height, px, py, w);
+        for(int k=0; k<nr_footprint; k++){
+            atomic_min(zbuffer[(long)py[k]*width+px[k]], depth);
+        }
+    }
+
+    proj.zbuffer.resize(nr_pixels);
+    #pragma omp parallel for
+    for(long long i=0; i<nr_pixels; i++){
+        proj.zbuffer[i]=zbuffer[i].load(std::memory_order_relaxed);
+    }
+
+    return proj;
+}
+
 Frame::Frame():
     m_rand_gen(new radu::utils::RandGenerator( int(time(NULL))  )) //we seed the generator with a random number otherwise all the new frames we create will start with the same seed
         {
@@ -84,7 +254,7 @@ std::shared_ptr<Mesh> Frame::create_frustum_mesh(float scale_multiplier, bool sh
     }
     // std::cout << "frustrum_in_world_postw is " << frustrum_in_world_postw.rows() << " " << frustrum_in_world_postw.cols() << '\n';
 
-    frustum_mesh->V=frustrum_in_world_postw.cast<double>();
+    frustum_mesh->V=frustrum_in_world_postw.cast<MeshScalar>();
     frustum_mesh->E=E;
     frustum_mesh->m_vis.m_show_mesh=false;
     frustum_mesh->m_vis.m_show_lines=true;
@@ -137,8 +307,8 @@ std::shared_ptr<Mesh> Frame::create_frustum_mesh(float scale_multiplier, bool sh
         0, 1, //bottom left
         1, 1; //bottom right
     frustum_mesh->F=F;
-    frustum_mesh->NV=NV;
-    frustum_mesh->UV=UV;
+    frustum_mesh->NV=NV.cast<MeshScalar>();
+    frustum_mesh->UV=UV.cast<MeshScalar>();
 
     //make also a mesh from the far face so that we can display a texture
     if(show_texture){
@@ -439,6 +609,10 @@ void Frame::unload_images(){
     if(!confidence.empty()) confidence.release(); CHECK(confidence.empty());
 
      is_shell=true;
+
+    if(unload_callback){
+        unload_callback(*this);
+    }
 }
 
 Frame Frame::remap(cv::Mat& rmap1, cv::Mat& rmap2){
@@ -476,71 +650,29 @@ cv::Mat Frame::depth2world_xyz_mat() const{
 
     cv::Mat mat_xyz = cv::Mat(depth.rows, depth.cols, CV_32FC3);
     mat_xyz=0.0;
-    Eigen::Affine3d tf_world_cam=tf_cam_world.inverse().cast<double>();
+    std::shared_ptr<const PixelRays> pixel_rays=get_pixel_rays(K, depth.cols, depth.rows);
+    const Eigen::Affine3f tf_world_cam=tf_cam_world.inverse();
+    const Eigen::Matrix3f R=tf_world_cam.linear();
+    const Eigen::Vector3f t=tf_world_cam.translation();
 
     //backproject the depth into the 3D world
+    #pragma omp parallel for
     for(int y=0; y<depth.rows; y++){
+        const float* depth_row=depth.ptr<float>(y);
+        cv::Vec3f* xyz_row=mat_xyz.ptr<cv::Vec3f>(y);
         for(int x=0; x<depth.cols; x++){
-            // int idx_insert= y*depth.cols + x;
-
-            float depth_val = depth.at<float>(y,x);
+            const float depth_val = depth_row[x];
             if(depth_val!=0.0){
-
-                Eigen::Vector3d point_2D;
-                //the point is not at x,y but at x, heght-1-y. That's because we got the depth from the depth map at x,y and we have to take into account that opencv mat has origin at the top left. However the camera coordinate system actually has origin at the bottom left (same as the origin of the uv space in opengl) So the point in screen coordinates will be at x, height-1-y
-                // point_2D << x, depth.rows-1-y, 1.0;
-                point_2D << x, y, 1.0;
-                Eigen::Vector3d point_3D_camera_coord= K.cast<double>().inverse() * point_2D;
-                point_3D_camera_coord*=depth_val;
-                Eigen::Vector3d point_3D_world_coord=tf_world_cam*point_3D_camera_coord;
-
-                mat_xyz.at<cv::Vec3f>(y, x) [0] = point_3D_world_coord.x();
-                mat_xyz.at<cv::Vec3f>(y, x) [1] = point_3D_world_coord.y();
-                mat_xyz.at<cv::Vec3f>(y, x) [2] = point_3D_world_coord.z();
-
-
-                // //attempt 2 doing it more like https://github.com/IntelRealSense/librealsense/blob/8594d09f092347a8b3d832d14e4fb631140620c5/src/gl/pointcloud-gl.cpp
-                // float focal1=K(0,0);
-                // float focal2=K(1,1);
-                // float principal_x=K(0,2);
-                // float principal_y=K(1,2);
-
-                // float x_val= (x-principal_x)/focal1;
-                // float y_val= (y-principal_y)/focal2;
-
-                // float coeffs1[5];
-                // // 0.15755560994148254, -0.4658984839916229, -0.0013873715652152896, -0.00021726528939325362, 0.41800209879875183
-                // coeffs1[0]=0.15755560994148254;
-                // coeffs1[1]=-0.4658984839916229;
-                // coeffs1[2]=-0.0013873715652152896;
-                // coeffs1[3]=-0.00021726528939325362;
-                // coeffs1[4]=0.41800209879875183;
-
-                // float r2  = x_val*x_val + y_val*y_val;
-                // float f = 1.0 + coeffs1[0]*r2 + coeffs1[1]*r2*r2 + coeffs1[4]*r2*r2*r2;
-                // float ux = x_val*f + 2.0*coeffs1[2]*x_val*y_val + coeffs1[3]*(r2 + 2.0*x_val*x_val);
-                // float uy = y_val*f + 2.0*coeffs1[3]*x_val*y_val + coeffs1[2]*(r2 + 2.0*y_val*y_val);
-                // x_val = ux;
-                // y_val = uy;
-
-                // Eigen::Vector3d point_3D_camera_coord;
-                // point_3D_camera_coord << x_val*depth_val, y_val*depth_val, depth_val;
-                // Eigen::Vector3d point_3D_world_coord=tf_world_cam*point_3D_camera_coord;
-                // mat_xyz.at<cv::Vec3f>(y, x) [0] = point_3D_world_coord.x();
-                // mat_xyz.at<cv::Vec3f>(y, x) [1] = point_3D_world_coord.y();
-                // mat_xyz.at<cv::Vec3f>(y, x) [2] = point_3D_world_coord.z();
-
-
+                const Eigen::Vector3f point_3D_world_coord= R*(pixel_rays->rays.row((long)y*depth.cols+x).transpose()*depth_val) + t;
+                xyz_row[x]=cv::Vec3f(point_3D_world_coord.x(), point_3D_world_coord.y(), point_3D_world_coord.z());
             }
-
         }
     }
 
     return mat_xyz;
-
 }
 
-std::shared_ptr<Mesh> Frame::depth2world_xyz_mesh() const{
+std::shared_ptr<Mesh> Frame::depth2world_xyz_mesh(const bool remove_zero_depth) const{
 
 
     CHECK(width!=-1) << "Width was not set";
@@ -549,37 +681,64 @@ std::shared_ptr<Mesh> Frame::depth2world_xyz_mesh() const{
     CHECK(depth.type()==CV_32FC1) << "We assume that the depth should be of type CV_32FC1 but it is " << radu::utils::type2string(depth.type() );
     CHECK(depth.data) << "There is no data for the depth image. Are you sure this frame contains depth image?";
 
-    cv::Mat depth_xyz=depth2world_xyz_mat();
-
-    //Make a series of point in sensor frame
-    Eigen::MatrixXd V;
-    // Eigen::MatrixXd D;
-    V.resize(depth_xyz.rows*depth_xyz.cols,3);
-    // D.resize(depth_xyz.rows*depth_xyz.cols,1);
-    V.setZero();
-    for(int y=0; y<depth_xyz.rows; y++){
-        for(int x=0; x<depth_xyz.cols; x++){
-            int idx_insert= y*depth_xyz.cols + x;
-            V.row(idx_insert) << depth_xyz.at<cv::Vec3f>(y, x) [0], depth_xyz.at<cv::Vec3f>(y, x) [1], depth_xyz.at<cv::Vec3f>(y, x) [2];
+    std::shared_ptr<const PixelRays> pixel_rays=get_pixel_rays(K, depth.cols, depth.rows);
+    const Eigen::Affine3f tf_world_cam=tf_cam_world.inverse();
+    const Eigen::Matrix3f R=tf_world_cam.linear();
+    const Eigen::Vector3f t=tf_world_cam.translation();
+
+    //where the points of each row of the depth start in V. If we keep all the pixels it's just y*cols, otherwise we count the valid pixels of each row first
+    std::vector<long> row_start(depth.rows+1, 0);
+    if(remove_zero_depth){
+        #pragma omp parallel for
+        for(int y=0; y<depth.rows; y++){
+            const float* depth_row=depth.ptr<float>(y);
+            long nr_valid=0;
+            for(int x=0; x<depth.cols; x++){
+                nr_valid+= depth_row[x]!=0.0;
+            }
+            row_start[y+1]=nr_valid;
+        }
+        std::partial_sum(row_start.begin(), row_start.end(), row_start.begin());
+    }else{
+        for(int y=0; y<=depth.rows; y++){
+            row_start[y]=(long)y*depth.cols;
         }
     }
 
-    // //puts it in camera frame
-    // V=V*K.cast<double>().inverse().transpose();
-    // // V=V.rowwise()*D.array();
-    // for(int i=0; i<V.rows(); i++){
-    //     V(i,0)=V(i,0)*D(i,0);
-    //     V(i,1)=V(i,1)*D(i,0);
-    //     V(i,2)=V(i,2)*D(i,0);
-    // }
-
+    MeshSharedPtr cloud=Mesh::create();
+    cloud->V.resize(row_start.back(),3);
+    Eigen::MatrixXi pixel_idx;
+    if(remove_zero_depth){
+        pixel_idx.resize(row_start.back(),1);
+    }
 
+    //backproject straight into V
+    #pragma omp parallel for
+    for(int y=0; y<depth.rows; y++){
+        const float* depth_row=depth.ptr<float>(y);
+        long idx_insert=row_start[y];
+        for(int x=0; x<depth.cols; x++){
+            const float depth_val = depth_row[x];
+            if(depth_val!=0.0){
+                const Eigen::Vector3f point_3D_world_coord= R*(pixel_rays->rays.row((long)y*depth.cols+x).transpose()*depth_val) + t;
+                cloud->V.row(idx_insert)=point_3D_world_coord.transpose().cast<MeshScalar>();
+                if(remove_zero_depth){
+                    pixel_idx(idx_insert,0)=y*depth.cols+x;
+                }
+                idx_insert++;
+            }else if(!remove_zero_depth){
+                cloud->V.row(idx_insert).setZero(); //zero marks the missing points of an organized cloud
+                idx_insert++;
+            }
+        }
+    }
 
-    MeshSharedPtr cloud=Mesh::create();
-    cloud->V=V;
-    // cloud->D=D;
-    cloud->m_width=depth_xyz.cols;
-    cloud->m_height=depth_xyz.rows;
+    if(remove_zero_depth){
+        cloud->add_extra_field("pixel_idx", pixel_idx); //for each point the index y*width+x of the pixel it came from
+    }else{
+        cloud->m_width=depth.cols;
+        cloud->m_height=depth.rows;
+    }
     cloud->m_vis.m_show_points=true;
 
 
@@ -587,37 +746,45 @@ std::shared_ptr<Mesh> Frame::depth2world_xyz_mesh() const{
 
 }
 
-std::shared_ptr<Mesh> Frame::pixels2dirs_mesh() const{
+Eigen::Matrix<float, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> Frame::pixels2dirs() const{
     CHECK(width>0) <<"Width of this frame was not assigned";
     CHECK(height>0) <<"Height of this frame was not assigned";
 
-    MeshSharedPtr directions_mesh=Mesh::create();
-    directions_mesh->V.resize(width*height, 3);
+    std::shared_ptr<const PixelRays> pixel_rays=get_pixel_rays(K, width, height);
+
+    //the directions in camera coordinates are cached so for a new pose we only need to rotate them. The translation of the camera cancels out for directions
+    const Eigen::Matrix3f R=tf_cam_world.linear().inverse();
+    Eigen::Matrix<float, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> dirs(pixel_rays->dirs.rows(), 3);
+    const long nr_pixels=pixel_rays->dirs.rows();
+    const long block_size=4096; //rotate in blocks so that each thread works on a vectorized product of many rows
+    #pragma omp parallel for
+    for(long long start=0; start<nr_pixels; start+=block_size){
+        const long nr_rows=std::min(block_size, nr_pixels-(long)start);
+        dirs.middleRows(start, nr_rows).noalias()=pixel_rays->dirs.middleRows(start, nr_rows)*R.transpose();
+    }
 
-    int idx_insert=0;
-    for(int y=0; y<height; y++){
-        for(int x=0; x<width; x++){
-            Eigen::Vector3f point_screen;
-            //the point is not at x,y but at x, heght-y. That's because we got the depth from the depth map at x,y and we have to take into account that opencv mat has origin at the top left. However the camera coordinate system actually has origin at the bottom left (same as the origin of the uv space in opengl) So the point in screen coordinates will be at x, height-y
-            // point_screen << x,height-1-y,1.0;
-            //No need to do height-y because the tf_cam_world of the frame look like the one in the link https://docs.opencv.org/2.4/modules/calib3d/doc/camera_calibration_and_3d_reconstruction.html. So the X to the right, y towards bottom and Z towards the frame itself. This is consistent with the uv space of opengl now
-            point_screen << x,y,1.0;
+    return dirs;
+}
 
-            Eigen::Vector3f point_cam_coords;
-            point_cam_coords=K.inverse()*point_screen;
+Eigen::Matrix<float, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> Frame::pixels2_euler_angles() const{
 
-            Eigen::Vector3f point_world_coords;
-            point_world_coords=tf_cam_world.inverse()*point_cam_coords;
+    Eigen::Matrix<float, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> dirs=pixels2dirs();
 
-            Eigen::Vector3f dir=(point_world_coords-tf_cam_world.inverse().translation()).normalized();
+    //the euler angles of the rotation that takes each direction to the negative Z axis of the world
+    #pragma omp parallel for
+    for(long long i=0; i<dirs.rows(); i++){
+        const Eigen::Quaterniond q = Eigen::Quaterniond::FromTwoVectors( Eigen::Vector3d(dirs.row(i).transpose().cast<double>()), -Eigen::Vector3d::UnitZ() );
+        const Eigen::Vector3d euler_angles= q.toRotationMatrix().eulerAngles(0,1,2);
+        dirs.row(i) = euler_angles.transpose().cast<float>();
+    }
 
-            // directions_mesh->V.row(idx_insert)= point_world_coords.cast<double>();
-            directions_mesh->V.row(idx_insert)= dir.cast<double>();
+    return dirs;
+}
 
-            idx_insert++;
+std::shared_ptr<Mesh> Frame::pixels2dirs_mesh() const{
 
-        }
-    }
+    MeshSharedPtr directions_mesh=Mesh::create();
+    directions_mesh->V=pixels2dirs().cast<MeshScalar>();
 
     directions_mesh->m_vis.m_show_points=true;
     directions_mesh->m_width=width;
@@ -643,7 +810,7 @@ std::shared_ptr<Mesh> Frame::pixels2coords() const{
             //No need to do height-y because the tf_cam_world of the frame look like the one in the link https://docs.opencv.org/2.4/modules/calib3d/doc/camera_calibration_and_3d_reconstruction.html. So the X to the right, y towards bottom and Z towards the frame itself. This is consistent with the uv space of opengl now
             point_screen << x,y,1.0;
 
-            points_mesh->V.row(idx_insert)= point_screen.cast<double>();
+            points_mesh->V.row(idx_insert)= point_screen.cast<MeshScalar>();
 
             idx_insert++;
 
@@ -659,37 +826,24 @@ std::shared_ptr<Mesh> Frame::pixels2coords() const{
 }
 
 std::shared_ptr<Mesh> Frame::pixels2_euler_angles_mesh() const{
-    CHECK(width>0) <<"Width of this frame was not assigned";
-    CHECK(height>0) <<"Height of this frame was not assigned";
 
-    std::shared_ptr<Mesh> dirs_mesh = pixels2dirs_mesh();
+    std::shared_ptr<Mesh> angles_mesh = Mesh::create();
+    angles_mesh->V=pixels2_euler_angles().cast<MeshScalar>();
 
+    angles_mesh->m_vis.m_show_points=true;
+    angles_mesh->m_width=width;
+    angles_mesh->m_height=height;
 
-    for(int i=0; i<dirs_mesh->V.rows(); i++){
-        Eigen::Quaterniond q = Eigen::Quaterniond::FromTwoVectors( dirs_mesh->V.row(i), -Eigen::Vector3d::UnitZ() );
-        Eigen::Matrix3d rot = q.toRotationMatrix();
-        Eigen::Vector3d euler_angles= rot.eulerAngles(0,1,2);
-        dirs_mesh->V.row(i) = euler_angles;
-    }
-
-    dirs_mesh->m_vis.m_show_points=true;
-    dirs_mesh->m_width=width;
-    dirs_mesh->m_height=height;
-
-    return dirs_mesh;
+    return angles_mesh;
 
 }
 
-std::shared_ptr<Mesh> Frame::assign_color(std::shared_ptr<Mesh>& cloud) const{
+std::shared_ptr<Mesh> Frame::assign_color(std::shared_ptr<Mesh>& cloud, const bool check_occlusion, const float depth_tolerance) const{
 
     //check that we can get rgb color
     CHECK(!rgb_8u.empty() || !rgb_32f.empty() ) << "There is no rgb data";
-    // bool rgb_8u_has_data;
-    // VLOG(1) << "rgb_8u" << rgb_8u.empty();
-    // VLOG(1) << "rgb_32f" << rgb_32f.empty();
     cv::Mat color_mat;
     if (rgb_32f.empty()){
-        // VLOG(1) << "rgb32f is empty";
         rgb_8u.convertTo(color_mat, CV_32FC3, 1.0/255.0);
     }else{
         color_mat=rgb_32f;
@@ -697,66 +851,38 @@ std::shared_ptr<Mesh> Frame::assign_color(std::shared_ptr<Mesh>& cloud) const{
 
     cloud->apply_model_matrix_to_cpu(false);
 
-    Eigen::MatrixXd V_transformed;
-    V_transformed.resize(cloud->V.rows(), cloud->V.cols());
-    V_transformed.setZero();
     cloud->C.resize(cloud->V.rows(), 3);
     cloud->C.setZero();
     cloud->UV.resize(cloud->V.rows(),2);
     cloud->UV.setZero();
 
+    //project in parallel and get the closest point in every pixel so that the points behind a surface don't get its color
+    CloudProjection proj=project_cloud(cloud->V, tf_cam_world, K, color_mat.cols, color_mat.rows, false);
 
-
-    // transform from world into this frame coords
-    // V_transformed=tf_cam_world*cloud.V;
-    Eigen::Affine3d trans=tf_cam_world.cast<double>();
-    int nr_valid=0;
-    for (int i = 0; i < cloud->V.rows(); i++) {
-        if(!cloud->V.row(i).isZero()){
-            V_transformed.row(i)=trans.linear()*cloud->V.row(i).transpose() + trans.translation();
-            nr_valid++;
+    #pragma omp parallel for
+    for (long long i = 0; i < cloud->V.rows(); i++) {
+        if(!proj.valid[i]){
+            continue;
+        }
+        const int x=(int)std::floor(proj.screen(i,0)+0.5f);
+        const int y=(int)std::floor(proj.screen(i,1)+0.5f);
+        if(check_occlusion && !proj.is_visible(i, x, y, depth_tolerance)){
+            continue;
         }
-    }
-
-
-    //project
-    V_transformed=V_transformed*K.cast<double>().transpose();
-    int nr_points_projected=0;
-    for (int i = 0; i < cloud->V.rows(); i++) {
-        if(!cloud->V.row(i).isZero()){
-            // VLOG(1)<< " before " <<  V_transformed.row(i);
-            V_transformed(i,0)/=V_transformed(i,2);
-            V_transformed(i,1)/=V_transformed(i,2);
-            // V_transformed(i,2)=1.0;
-            // VLOG(1)<< " after "<< V_transformed.row(i);
-
-            //V_transformed is now int he screen coordinates which has origin at the lower left as per normal UV coordinates of opengl. However Opencv considers the origin to be at the top left so we need the y to be height-1-V_transformed(i,1)
-            int x=V_transformed(i,0);
-            // int y=height-1-V_transformed(i,1);
-            //No need to do height-y because the tf_cam_world of the frame look like the one in the link https://docs.opencv.org/2.4/modules/calib3d/doc/camera_calibration_and_3d_reconstruction.html. So the X to the right, y towards bottom and Z towards the frame itself. This is consistent with the uv space of opengl now
-            int y=V_transformed(i,1);
-            // VLOG(1) << " x and y is " << x << " " << y;
-            // VLOG(1) << height << " rows is " << color_mat.rows;
-            // VLOG(1) << "K is " << K;
-            if(y<0 || y>=color_mat.rows || x<0 || x>color_mat.cols){
-                continue;
-            }
-            nr_points_projected++;
 
-            // // VLOG(1) << "accessing at y,x" << y << " " << x;
-            // // store Color in C as RGB
-            cloud->C(i,0)=color_mat.at<cv::Vec3f>(y, x) [ 2 ];
-            cloud->C(i,1)=color_mat.at<cv::Vec3f>(y, x) [ 1 ];
-            cloud->C(i,2)=color_mat.at<cv::Vec3f>(y, x) [ 0 ];
+        // store Color in C as RGB
+        const cv::Vec3f& color=color_mat.at<cv::Vec3f>(y, x);
+        cloud->C(i,0)=color[2];
+        cloud->C(i,1)=color[1];
+        cloud->C(i,2)=color[0];
 
-            cloud->UV(i,0) = V_transformed(i,0)/color_mat.cols;
-            cloud->UV(i,1) = V_transformed(i,1)/color_mat.rows;
-        }
+        cloud->UV(i,0) = proj.screen(i,0)/color_mat.cols;
+        cloud->UV(i,1) = proj.screen(i,1)/color_mat.rows;
     }
-    // VLOG(1) << "nr_points_projected" << nr_points_projected;
 
     cloud->m_vis.set_color_pervertcolor();
-    cloud->m_is_dirty=true;
+    cloud->set_dirty(MeshAttribute::C);
+    cloud->set_dirty(MeshAttribute::UV);
 
 
     return cloud;
@@ -799,89 +925,74 @@ cv::Mat Frame::rgb_with_valid_depth(const Frame& frame_depth) const{
 
 }
 
-Eigen::MatrixXd Frame::compute_uv(std::shared_ptr<Mesh>& cloud) const{
+Eigen::MatrixXd Frame::compute_uv(std::shared_ptr<Mesh>& cloud, const bool check_occlusion, const float depth_tolerance) const{
 
+    assign_color(cloud, check_occlusion, depth_tolerance);
 
-    //ATTEMPT 2
-    //check that we can get rgb color
-    CHECK(!rgb_8u.empty() || !rgb_32f.empty() ) << "There is no rgb data";
-    // bool rgb_8u_has_data;
-    // VLOG(1) << "rgb_8u" << rgb_8u.empty();
-    // VLOG(1) << "rgb_32f" << rgb_32f.empty();
-    cv::Mat color_mat;
-    if (rgb_32f.empty()){
-        // VLOG(1) << "rgb32f is empty";
-        rgb_8u.convertTo(color_mat, CV_32FC3, 1.0/255.0);
-    }else{
-        color_mat=rgb_32f;
-    }
-
-    cloud->apply_model_matrix_to_cpu(false);
-
-
-    Eigen::MatrixXd V_transformed;
-    V_transformed.resize(cloud->V.rows(), cloud->V.cols());
-    V_transformed.setZero();
-    cloud->C.resize(cloud->V.rows(), 3);
-    cloud->C.setZero();
-    cloud->UV.resize(cloud->V.rows(),2);
-    cloud->UV.setZero();
+    return cloud->UV.cast<double>();
 
+}
 
+std::pair<cv::Mat, cv::Mat> Frame::naive_splat(const std::shared_ptr<Mesh>& cloud, const Eigen::MatrixXf& values, const bool bilinear, const float depth_tolerance) const{
+    CHECK(values.rows()==cloud->V.rows()) << "We need one row of values for every point in the cloud. The cloud has " << cloud->V.rows() << " points but values has " << values.rows() << " rows";
+    CHECK(values.cols()>=1 && values.cols()<=CV_CN_MAX) << "The values can have between 1 and " << CV_CN_MAX << " columns but they have " << values.cols();
 
-    // transform from world into this frame coords
-    // V_transformed=tf_cam_world*cloud.V;
-    Eigen::Affine3d trans=tf_cam_world.cast<double>();
-    int nr_valid=0;
-    for (int i = 0; i < cloud->V.rows(); i++) {
-        if(!cloud->V.row(i).isZero()){
-            V_transformed.row(i)=trans.linear()*cloud->V.row(i).transpose() + trans.translation();
-            nr_valid++;
-        }
+    //the cloud is expected in world coordinates, so we take into account its model matrix without modifying it
+    MeshMatrixX V_world;
+    if(cloud->model_matrix().matrix().isIdentity()){
+        V_world=cloud->V;
+    }else{
+        V_world=( (cloud->V.cast<double>() * cloud->model_matrix().linear().transpose()).rowwise() + cloud->model_matrix().translation().transpose() ).cast<MeshScalar>();
     }
 
-
-    //project
-    V_transformed=V_transformed*K.cast<double>().transpose();
-    int nr_points_projected=0;
-    for (int i = 0; i < cloud->V.rows(); i++) {
-        if(!cloud->V.row(i).isZero()){
-            V_transformed(i,0)/=V_transformed(i,2);
-            V_transformed(i,1)/=V_transformed(i,2);
-            // V_transformed(i,2)=1.0;
-
-            //V_transformed is now int he screen coordinates which has origin at the lower left as per normal UV coordinates of opengl. However Opencv considers the origin to be at the top left so we need the y to be height-V_transformed(i,1)
-            int x=V_transformed(i,0);
-            // int y=height-1-V_transformed(i,1);
-            //No need to do height-y because the tf_cam_world of the frame look like the one in the link https://docs.opencv.org/2.4/modules/calib3d/doc/camera_calibration_and_3d_reconstruction.html. So the X to the right, y towards bottom and Z towards the frame itself. This is consistent with the uv space of opengl now
-            int y=V_transformed(i,1);
-            if(y<0 || y>=color_mat.rows || x<0 || x>color_mat.cols){
+    CloudProjection proj=project_cloud(V_world, tf_cam_world, K, width, height, bilinear);
+
+    //every visible point adds its weighted values to the pixels in its footprint
+    const int nr_channels=values.cols();
+    const long nr_pixels=(long)width*height;
+    std::vector<float> accum(nr_pixels*nr_channels, 0.0f);
+    std::vector<float> weights(nr_pixels, 0.0f);
+    #pragma omp parallel for
+    for(long long i=0; i<values.rows(); i++){
+        if(!proj.valid[i]){
+            continue;
+        }
+        int px[4], py[4];
+        float w[4];
+        const int nr_footprint=splat_footprint(proj.screen(i,0), proj.screen(i,1), bilinear, width, height, px, py, w);
+        for(int k=0; k<nr_footprint; k++){
+            if(!proj.is_visible(i, px[k], py[k], depth_tolerance)){
                 continue;
             }
-            nr_points_projected++;
-
-            // // VLOG(1) << "accessing at y,x" << y << " " << x;
-            // // store Color in C as RGB
-            cloud->C(i,0)=color_mat.at<cv::Vec3f>(y, x) [ 2 ];
-            cloud->C(i,1)=color_mat.at<cv::Vec3f>(y, x) [ 1 ];
-            cloud->C(i,2)=color_mat.at<cv::Vec3f>(y, x) [ 0 ];
-
-            cloud->UV(i,0) = V_transformed(i,0)/color_mat.cols;
-            cloud->UV(i,1) = V_transformed(i,1)/color_mat.rows;
+            const long pixel_idx=(long)py[k]*width+px[k];
+            for(int c=0; c<nr_channels; c++){
+                #pragma omp atomic
+                accum[pixel_idx*nr_channels+c]+=w[k]*values(i,c);
+            }
+            #pragma omp atomic
+            weights[pixel_idx]+=w[k];
         }
     }
-    // VLOG(1) << "nr_points_projected" << nr_points_projected;
-
-    cloud->m_vis.set_color_pervertcolor();
-
-
-    return cloud->UV;
 
+    //normalize by the weights
+    cv::Mat splatted(height, width, CV_32FC(nr_channels), cv::Scalar::all(0));
+    cv::Mat mask(height, width, CV_8UC1, cv::Scalar(0));
+    #pragma omp parallel for
+    for(int y=0; y<height; y++){
+        float* splatted_row=splatted.ptr<float>(y);
+        unsigned char* mask_row=mask.ptr<unsigned char>(y);
+        for(int x=0; x<width; x++){
+            const long pixel_idx=(long)y*width+x;
+            if(weights[pixel_idx]>0.0f){
+                for(int c=0; c<nr_channels; c++){
+                    splatted_row[x*nr_channels+c]=accum[pixel_idx*nr_channels+c]/weights[pixel_idx];
+                }
+                mask_row[x]=255;
+            }
+        }
+    }
 
-}
-
-cv::Mat Frame::naive_splat(std::shared_ptr<Mesh>& cloud, Eigen::MatrixXf values){
-
+    return std::make_pair(splatted, mask);
 }
 
 Eigen::Vector3d Frame::unproject(const float x, const float y, const float depth){
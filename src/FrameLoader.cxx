@@ -0,0 +1,189 @@
+#include "easy_pbr/FrameLoader.h"
+
+//c++
+#include <algorithm>
+#include <unordered_set>
+
+//my stuff
+#include "easy_pbr/Frame.h"
+#include "easy_pbr/ThreadPool.h"
+
+//loguru
+#define LOGURU_REPLACE_GLOG 1
+#include <loguru.hpp>
+
+namespace easy_pbr{
+
+//bytes of all the images of a frame. Mats that share memory, like rgb_8u and img_original_size usually do, are counted only once
+static size_t frame_bytes(const Frame& frame){
+    const cv::Mat* mats[]={ &frame.rgb_8u, &frame.rgb_32f, &frame.gray_8u, &frame.gray_32f, &frame.grad_x_32f, &frame.grad_y_32f, &frame.gray_with_gradients, &frame.thermal_16u, &frame.thermal_32f, &frame.thermal_vis_32f, &frame.normal_32f, &frame.img_original_size, &frame.mask, &frame.depth, &frame.confidence };
+    std::unordered_set<const unsigned char*> counted;
+    size_t bytes=0;
+    for(const cv::Mat* mat : mats){
+        if(!mat->empty() && counted.insert(mat->datastart).second){
+            bytes+=mat->dataend-mat->datastart;
+        }
+    }
+    return bytes;
+}
+
+FrameLoader::FrameLoader(const std::vector<std::shared_ptr<Frame>>& frames, const int nr_threads, const int read_ahead, const float cache_budget_mb):
+    m_frames(frames),
+    m_read_ahead(read_ahead),
+    m_cache_budget_bytes( (size_t)(cache_budget_mb*1024*1024) ),
+    m_cache_bytes(0),
+    m_warned_read_ahead(false)
+{
+    CHECK(nr_threads>0) << "The FrameLoader needs at least one thread but got " << nr_threads;
+    CHECK(read_ahead>=0) << "read_ahead should be positive but it is " << read_ahead;
+    for(size_t i=0; i<m_frames.size(); i++){
+        CHECK(m_frames[i]) << "Frame " << i << " is null";
+        CHECK(m_frames[i]->load_images) << "Frame " << i << " has no load_images function so the FrameLoader cannot load it";
+    }
+
+    m_pool.reset(new ThreadPool(nr_threads));
+}
+
+FrameLoader::~FrameLoader(){
+    //the frames that were only read ahead are not needed anymore so we only wait for the loads that already started, while the rest of the members are still alive
+    m_pool->clear_pending();
+    m_pool.reset();
+}
+
+std::shared_ptr<Frame> FrameLoader::get_frame(const int idx){
+    CHECK(idx>=0 && idx<(int)m_frames.size()) << "Frame idx " << idx << " is out of range for a dataset of " << m_frames.size() << " frames";
+
+    std::shared_ptr<Frame> cached_frame;
+    std::shared_future< std::shared_ptr<Frame> > future;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        auto it=m_cache.find(idx);
+        if(it!=m_cache.end()){
+            m_lru.splice(m_lru.begin(), m_lru, it->second.lru_it); //move to the front
+            cached_frame=it->second.frame;
+        }else{
+            future=schedule_load(idx);
+        }
+
+        //read ahead the next frames, wrapping around so that the start of the next epoch is also ready
+        int nr_ahead=std::min(m_read_ahead, (int)m_frames.size()-1);
+        //reading ahead more frames than the budget can hold would only evict them again before they are requested, so once the size of a frame is known the read ahead gets clamped to what fits next to the current one
+        if(!m_cache.empty() && m_cache_bytes>0){
+            const size_t frame_bytes_avg=std::max<size_t>(m_cache_bytes/m_cache.size(), 1);
+            const int max_ahead=std::max( (int)std::min<size_t>(m_cache_budget_bytes/frame_bytes_avg, m_frames.size()) - 1, 0);
+            if(nr_ahead>max_ahead){
+                if(!m_warned_read_ahead){
+                    LOG(WARNING) << "The cache budget of " << m_cache_budget_bytes/(1024*1024) << " MB only fits " << max_ahead+1 << " frames of about " << frame_bytes_avg/(1024*1024) << " MB so the read ahead is clamped from " << nr_ahead << " to " << max_ahead << " frames";
+                    m_warned_read_ahead=true;
+                }
+                nr_ahead=max_ahead;
+            }
+        }
+        for(int i=1; i<=nr_ahead; i++){
+            const int next_idx=(idx+i)%m_frames.size();
+            if(m_cache.find(next_idx)==m_cache.end()){
+                schedule_load(next_idx);
+            }
+        }
+    }
+
+    if(cached_frame){
+        return cached_frame;
+    }
+    return future.get(); //rethrows if load_images failed
+}
+
+void FrameLoader::prefetch(const int idx){
+    CHECK(idx>=0 && idx<(int)m_frames.size()) << "Frame idx " << idx << " is out of range for a dataset of " << m_frames.size() << " frames";
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if(m_cache.find(idx)==m_cache.end()){
+        schedule_load(idx);
+    }
+}
+
+void FrameLoader::clear(){
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_cache.clear();
+    m_lru.clear();
+    m_cache_bytes=0;
+}
+
+int FrameLoader::nr_cached(){
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_cache.size();
+}
+
+size_t FrameLoader::cache_bytes(){
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_cache_bytes;
+}
+
+std::shared_future< std::shared_ptr<Frame> > FrameLoader::schedule_load(const int idx){
+    auto it=m_pending.find(idx);
+    if(it!=m_pending.end()){
+        return it->second;
+    }
+
+    std::shared_future< std::shared_ptr<Frame> > future=m_pool->enqueue( [this, idx]{ return load(idx); } ).share();
+    m_pending[idx]=future;
+    return future;
+}
+
+std::shared_ptr<Frame> FrameLoader::load(const int idx){
+    //load into a copy so that the shell stays a shell and can be loaded again after it gets evicted
+    std::shared_ptr<Frame> frame=std::make_shared<Frame>(*m_frames[idx]);
+    try{
+        frame->load_images(*frame);
+    }catch(...){
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_pending.erase(idx); //the next request will try again
+        throw;
+    }
+    frame->is_shell=false;
+
+    //unloading the frame releases its bytes from the budget. The loader is captured weakly since the frame can outlive it
+    std::weak_ptr<FrameLoader> weak_loader=weak_from_this();
+    frame->unload_callback=[weak_loader, idx](Frame& unloaded_frame){
+        if(std::shared_ptr<FrameLoader> loader=weak_loader.lock()){
+            loader->remove_from_cache(idx, &unloaded_frame);
+        }
+    };
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_pending.erase(idx);
+    insert_in_cache(idx, frame);
+    return frame;
+}
+
+void FrameLoader::insert_in_cache(const int idx, const std::shared_ptr<Frame>& frame){
+    CachedFrame cached;
+    cached.frame=frame;
+    cached.bytes=frame_bytes(*frame);
+    m_lru.push_front(idx);
+    cached.lru_it=m_lru.begin();
+    m_cache[idx]=cached;
+    m_cache_bytes+=cached.bytes;
+
+    //evict the least recently used ones, but always keep the one just loaded even if it alone is over the budget. Frames that are still referenced from outside stay alive until they are released there
+    while(m_cache_bytes>m_cache_budget_bytes && m_lru.size()>1){
+        const int evict_idx=m_lru.back();
+        m_lru.pop_back();
+        m_cache_bytes-=m_cache[evict_idx].bytes;
+        m_cache.erase(evict_idx);
+    }
+}
+
+void FrameLoader::remove_from_cache(const int idx, const Frame* frame){
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it=m_cache.find(idx);
+    if(it==m_cache.end() || it->second.frame.get()!=frame){
+        return;
+    }
+    m_cache_bytes-=it->second.bytes;
+    m_lru.erase(it->second.lru_it);
+    m_cache.erase(it);
+}
+
+} //namespace easy_pbr
@@ -580,6 +580,7 @@ void Gui::draw_main_menu(){
 
         ImGui::Checkbox("Enable LightFollow", &m_view->m_lights_follow_camera);
         ImGui::Checkbox("Enable culling", &m_view->m_enable_culling);
+        ImGui::Checkbox("Packed vertex buffers", &m_view->m_packed_vertex_buffers);
         ImGui::SameLine(); help_marker("Hides the mesh faces that are pointing away from the viewer. Offers a mild increase in performance.");
         ImGui::Checkbox("Enable SSAO", &m_view->m_enable_ssao);
         ImGui::SameLine(); help_marker("Screen Space Ambient Occlusion. Darkens crevices and corners in the mesh in order to better show the details. It has a mild impact on performance.");
@@ -1155,7 +1156,7 @@ void Gui::draw_main_menu(){
                 int copy_idx = 0, numInside = 0;
                 for ( int idx = 0; idx < mesh->V.rows(); ++idx)
                 {
-                    const Eigen::Vector3d pt = mesh->model_matrix() * Eigen::Vector3d(mesh->V.row(idx).transpose());
+                    const Eigen::Vector3d pt = mesh->model_matrix() * Eigen::Vector3d(mesh->V.row(idx).transpose().cast<double>());
                     const bool insideTheBox = (minXYZ < pt.transpose().array()).all() && (pt.transpose().array() < maxXYZ).all();
                     numInside += insideTheBox;
                     if ( (removeOutside && insideTheBox) || (!removeOutside && !insideTheBox) )
@@ -1286,8 +1287,8 @@ void Gui::draw_main_menu(){
         // if (ImGui::Curve("Das editor", ImVec2(600, 200), 10, m_curve_points)){
             // curve changed
         // }
-        if (ImGui::Button("Write gbuffer to folder")){
-            m_view->write_gbuffer_to_folder();
+        if (ImGui::Button("Capture gbuffer")){
+            m_view->m_recorder->capture_gbuffer("gbuffer.npz", m_view->m_recording_path);
         }
     }
     if(m_show_debug_textures){
@@ -1739,7 +1740,7 @@ void Gui::draw_overlays(){
         //draw vert ids
         if(mesh->m_vis.m_is_visible && mesh->m_vis.m_show_vert_ids){
             for (int i = 0; i < mesh->V.rows(); ++i){
-                draw_overlay_text( mesh->V.row(i), mesh->model_matrix().cast<float>().matrix(), std::to_string(i), mesh->m_vis.m_label_color );
+                draw_overlay_text( mesh->V.row(i).transpose().cast<double>(), mesh->model_matrix().cast<float>().matrix(), std::to_string(i), mesh->m_vis.m_label_color );
             }
         }
         //draw vert coords in x,y,z format
@@ -1749,7 +1750,7 @@ void Gui::draw_overlays(){
                 std::stringstream stream;
                 stream << std::fixed << std::setprecision(3) << "(" << mesh->V(i,0) << ", " << mesh->V(i,1) << ", " << mesh->V(i,2) << ")";
                 std::string coord_string = stream.str();
-                draw_overlay_text( mesh->V.row(i), mesh->model_matrix().cast<float>().matrix(), coord_string, mesh->m_vis.m_label_color );
+                draw_overlay_text( mesh->V.row(i).transpose().cast<double>(), mesh->model_matrix().cast<float>().matrix(), coord_string, mesh->m_vis.m_label_color );
             }
         }
     }
@@ -2024,8 +2025,8 @@ void Gui::draw_trajectory( const std::string & trajectory_mesh_name, const std::
             interpE.emplace_back((Eigen::Vector2i() << interpV.size()-2,interpV.size()-1).finished());
 
             MeshSharedPtr interpolatedMesh = Mesh::create();
-            interpolatedMesh->V = vec2eigen(interpV);
-            interpolatedMesh->C = vec2eigen(interpC);
+            interpolatedMesh->V = vec2eigen(interpV).cast<MeshScalar>();
+            interpolatedMesh->C = vec2eigen(interpC).cast<MeshScalar>();
             interpolatedMesh->E = vec2eigen(interpE);
             trajectory_mesh->add(*interpolatedMesh);
         }
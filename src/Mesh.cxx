@@ -2,12 +2,23 @@
 
 //c++
 #include <iostream>
+#include <sstream>
 #include <algorithm>
-#include <unordered_map> //for deduplicating obj vertices
+#include <cstring>
+#include <limits>
+#include <numeric>
+#include <unordered_map>
+#include <atomic>
+
+#ifdef _OPENMP
+    #include <omp.h>
+#endif
 
 //my stuff
 // #include "MiscUtils.h"
 #include "easy_pbr/LabelMngr.h"
+#include "easy_pbr/MeshIO.h"
+#include "easy_pbr/ThreadPool.h"
 
 //libigl
 #include "igl/per_face_normals.h"
@@ -23,22 +34,11 @@
 #include <igl/remove_duplicates.h>
 #include <igl/facet_components.h>
 #include <igl/vertex_triangle_adjacency.h>
-#include <igl/remove_duplicate_vertices.h>
 #include <igl/connect_boundary_to_infinity.h>
 #include <igl/upsample.h>
 #include <igl/loop.h>
-#include <igl/point_mesh_squared_distance.h>
-
-#define TINYOBJLOADER_IMPLEMENTATION // define this in only *one* .cc
-#include "tiny_obj_loader.h"
+#include <igl/AABB.h>
 
-//for reading pcd files
-#ifdef EASYPBR_WITH_PCL
-    #include <pcl/io/pcd_io.h>
-    #include <pcl/point_types.h>
-    #include <pcl/features/normal_3d.h>
-    #include <pcl/kdtree/kdtree_flann.h>
-#endif
 
 #include "nanoflann.hpp"
 
@@ -61,15 +61,25 @@ namespace fs = boost::filesystem;
 
 namespace easy_pbr{
 
+//redeclared things here so we can use them from this file even though they are static
+bool Mesh::m_load_cache_enabled=false; //opt-in since it writes files next to the meshes or in m_load_cache_dir
+std::string Mesh::m_load_cache_dir="";
+std::shared_ptr<ThreadPool> Mesh::m_load_pool;
+std::mutex Mesh::m_load_pool_mutex;
+int Mesh::m_load_nr_threads=std::max(1, std::min(8, (int)std::thread::hardware_concurrency())); //loading is mostly bound by the disk so more threads than this rarely help
+
 Mesh::Mesh():
         id(0),
+        scene_id(-1),
         m_is_dirty(true),
+        m_geometry_version(0),
         m_is_shadowmap_dirty(true),
         m_model_matrix(Eigen::Affine3d::Identity()),
         m_cur_pose(Eigen::Affine3d::Identity()),
         m_width(0),
         m_height(0),
         m_view_direction(-1),
+        m_max_resident_chunks(32),
         m_force_vis_update(false),
         m_rand_gen(new RandGenerator()),
         m_is_preallocated(false),
@@ -152,21 +162,21 @@ void Mesh::add(Mesh& new_mesh) {
 
         Eigen::MatrixXi F_new(F.rows() + new_mesh.F.rows(), 3);
         F_new << F, (new_mesh.F.array() + V.rows());
-        Eigen::MatrixXd C_new(C.rows() + new_mesh.C.rows(), 3);
+        MeshMatrixX C_new(C.rows() + new_mesh.C.rows(), 3);
         C_new << C, new_mesh.C;
         Eigen::MatrixXi E_new(E.rows() + new_mesh.E.rows(), 2);
         E_new << E, (new_mesh.E.array() + V.rows());
-        Eigen::MatrixXd D_new(D.rows() + new_mesh.D.rows(), 1);
+        MeshMatrixX D_new(D.rows() + new_mesh.D.rows(), 1);
         D_new << D, new_mesh.D;
         Eigen::MatrixXd NF_new(NF.rows() + new_mesh.NF.rows(), 3);
         NF_new << NF, new_mesh.NF;
-        Eigen::MatrixXd NV_new(NV.rows() + new_mesh.NV.rows(), 3);
+        MeshMatrixX NV_new(NV.rows() + new_mesh.NV.rows(), 3);
         NV_new << NV, new_mesh.NV;
-        Eigen::MatrixXd UV_new(UV.rows() + new_mesh.UV.rows(), 2);
+        MeshMatrixX UV_new(UV.rows() + new_mesh.UV.rows(), 2);
         UV_new << UV, new_mesh.UV;
-        Eigen::MatrixXd V_tangent_u_new(V_tangent_u.rows() + new_mesh.V_tangent_u.rows(), 4);
+        MeshMatrixX V_tangent_u_new(V_tangent_u.rows() + new_mesh.V_tangent_u.rows(), 4);
         V_tangent_u_new << V_tangent_u, new_mesh.V_tangent_u;
-        Eigen::MatrixXd V_lenght_v_new(V_length_v.rows() + new_mesh.V_length_v.rows(), 4);
+        MeshMatrixX V_lenght_v_new(V_length_v.rows() + new_mesh.V_length_v.rows(), 4);
         V_lenght_v_new << V_length_v, new_mesh.V_length_v;
         Eigen::MatrixXd S_pred_new(S_pred.rows() + new_mesh.S_pred.rows(), std::max<int>(S_pred.rows(),new_mesh.S_pred.rows()));
         S_pred_new << S_pred, new_mesh.S_pred;
@@ -174,7 +184,7 @@ void Mesh::add(Mesh& new_mesh) {
         L_pred_new << L_pred, new_mesh.L_pred;
         Eigen::MatrixXi L_gt_new(L_gt.rows() + new_mesh.L_gt.rows(), 1);
         L_gt_new << L_gt, new_mesh.L_gt;
-        Eigen::MatrixXd I_new(I.rows() + new_mesh.I.rows(), 1);
+        MeshMatrixX I_new(I.rows() + new_mesh.I.rows(), 1);
         I_new << I, new_mesh.I;
 
 
@@ -200,25 +210,25 @@ void Mesh::add(Mesh& new_mesh) {
 
     }else{
 
-        Eigen::MatrixXd V_new(V.rows() + new_mesh.V.rows(), 3);
+        MeshMatrixX V_new(V.rows() + new_mesh.V.rows(), 3);
         V_new << V, new_mesh.V;
         Eigen::MatrixXi F_new(F.rows() + new_mesh.F.rows(), 3);
         F_new << F, (new_mesh.F.array() + V.rows());
-        Eigen::MatrixXd C_new(C.rows() + new_mesh.C.rows(), 3);
+        MeshMatrixX C_new(C.rows() + new_mesh.C.rows(), 3);
         C_new << C, new_mesh.C;
         Eigen::MatrixXi E_new(E.rows() + new_mesh.E.rows(), 2);
         E_new << E, (new_mesh.E.array() + V.rows());
-        Eigen::MatrixXd D_new(D.rows() + new_mesh.D.rows(), 1);
+        MeshMatrixX D_new(D.rows() + new_mesh.D.rows(), 1);
         D_new << D, new_mesh.D;
         Eigen::MatrixXd NF_new(NF.rows() + new_mesh.NF.rows(), 3);
         NF_new << NF, new_mesh.NF;
-        Eigen::MatrixXd NV_new(NV.rows() + new_mesh.NV.rows(), 3);
+        MeshMatrixX NV_new(NV.rows() + new_mesh.NV.rows(), 3);
         NV_new << NV, new_mesh.NV;
-        Eigen::MatrixXd UV_new(UV.rows() + new_mesh.UV.rows(), 2);
+        MeshMatrixX UV_new(UV.rows() + new_mesh.UV.rows(), 2);
         UV_new << UV, new_mesh.UV;
-        Eigen::MatrixXd V_tangent_u_new(V_tangent_u.rows() + new_mesh.V_tangent_u.rows(), 3);
+        MeshMatrixX V_tangent_u_new(V_tangent_u.rows() + new_mesh.V_tangent_u.rows(), 3);
         V_tangent_u_new << V_tangent_u, new_mesh.V_tangent_u;
-        Eigen::MatrixXd V_lenght_v_new(V_length_v.rows() + new_mesh.V_length_v.rows(), 1);
+        MeshMatrixX V_lenght_v_new(V_length_v.rows() + new_mesh.V_length_v.rows(), 1);
         V_lenght_v_new << V_length_v, new_mesh.V_length_v;
         Eigen::MatrixXd S_pred_new(S_pred.rows() + new_mesh.S_pred.rows(), std::max<int>(S_pred.rows(),new_mesh.S_pred.rows()));
         S_pred_new << S_pred, new_mesh.S_pred;
@@ -226,7 +236,7 @@ void Mesh::add(Mesh& new_mesh) {
         L_pred_new << L_pred, new_mesh.L_pred;
         Eigen::MatrixXi L_gt_new(L_gt.rows() + new_mesh.L_gt.rows(), 1);
         L_gt_new << L_gt, new_mesh.L_gt;
-        Eigen::MatrixXd I_new(I.rows() + new_mesh.I.rows(), 1);
+        MeshMatrixX I_new(I.rows() + new_mesh.I.rows(), 1);
         I_new << I, new_mesh.I;
 
 
@@ -247,6 +257,7 @@ void Mesh::add(Mesh& new_mesh) {
 
 
         m_is_dirty=true;
+        m_geometry_version++;
     }
 
     m_is_shadowmap_dirty=true;
@@ -293,19 +304,19 @@ void Mesh::add(const std::vector<std::shared_ptr<Mesh>>&  meshes){
     }
 
     //make the new ones
-    Eigen::MatrixXd V_new(nr_V_acumulated, 3);
+    MeshMatrixX V_new(nr_V_acumulated, 3);
     Eigen::MatrixXi F_new(nr_F_acumulated, 3);
-    Eigen::MatrixXd C_new(nr_C_acumulated, 3);
+    MeshMatrixX C_new(nr_C_acumulated, 3);
     Eigen::MatrixXi E_new(nr_E_acumulated, 2);
-    Eigen::MatrixXd D_new(nr_D_acumulated, 1);
+    MeshMatrixX D_new(nr_D_acumulated, 1);
     Eigen::MatrixXd NF_new(nr_NF_acumulated, 3);
-    Eigen::MatrixXd NV_new(nr_NV_acumulated, 3);
-    Eigen::MatrixXd UV_new(nr_UV_acumulated, 2);
-    Eigen::MatrixXd V_tangent_u_new(nr_V_tangent_u_acumulated, 3);
-    Eigen::MatrixXd V_lenght_v_new(nr_V_length_v_acumulated, 1);
+    MeshMatrixX NV_new(nr_NV_acumulated, 3);
+    MeshMatrixX UV_new(nr_UV_acumulated, 2);
+    MeshMatrixX V_tangent_u_new(nr_V_tangent_u_acumulated, 3);
+    MeshMatrixX V_lenght_v_new(nr_V_length_v_acumulated, 1);
     Eigen::MatrixXi L_pred_new(nr_L_pred_acumulated, 1);
     Eigen::MatrixXi L_gt_new(nr_L_gt_acumulated, 1);
-    Eigen::MatrixXd I_new(nr_I_acumulated, 1);
+    MeshMatrixX I_new(nr_I_acumulated, 1);
 
 
 
@@ -473,6 +484,7 @@ void Mesh::add(const std::vector<std::shared_ptr<Mesh>>&  meshes){
 
 
     m_is_dirty=true;
+    m_geometry_version++;
     m_is_shadowmap_dirty=true;
 
 }
@@ -520,6 +532,14 @@ void Mesh::add(const std::vector<std::shared_ptr<Mesh>>&  meshes){
 // }
 
 void Mesh::clear() {
+    //a background read of chunks uses the stream and the current V so it has to finish first
+    if(m_paging.valid()){
+        m_paging.wait();
+        m_paging=std::shared_future<std::shared_ptr<PagedChunks>>();
+    }
+    m_requested_chunks.clear();
+    m_out_of_core_stream.reset();
+    m_resident_chunks.clear();
     V.resize(0,0);
     F.resize(0,0);
     C.resize(0,0);
@@ -539,12 +559,13 @@ void Mesh::clear() {
     m_min_max_y_for_plotting.setZero();
 
     m_is_dirty=true;
+    m_geometry_version++;
     m_is_shadowmap_dirty=true;
 }
 
 
 void Mesh::clear_C() {
-    Eigen::MatrixXd C_empty;
+    MeshMatrixX C_empty;
     C = C_empty;
     m_is_dirty=true;
     m_is_shadowmap_dirty=true;
@@ -596,18 +617,21 @@ void Mesh::transform_vertices_cpu(const Eigen::Affine3d& trans, const bool trans
 
     m_cur_pose=trans*m_cur_pose;
 
+    const Eigen::Matrix<MeshScalar,3,3> linear=trans.linear().cast<MeshScalar>();
+    const Eigen::Matrix<MeshScalar,3,1> translation=trans.translation().cast<MeshScalar>();
     for (int i = 0; i < V.rows(); i++) {
         if(!V.row(i).isZero() || transform_points_at_zero){
-            V.row(i)=trans.linear()*V.row(i).transpose() + trans.translation();
+            V.row(i)=linear*V.row(i).transpose() + translation;
         }
     }
     if (NF.size())  NF.transpose() = (trans.linear() * NF.transpose());
-    if (NV.size())  NV.transpose() = (trans.linear() * NV.transpose());
+    if (NV.size())  NV.transpose() = (linear * NV.transpose());
 
     //we have to also rotat the tangent vector
-    if (V_tangent_u.size())  V_tangent_u.transpose() = (trans.linear() * V_tangent_u.transpose());
+    if (V_tangent_u.size())  V_tangent_u.transpose() = (linear * V_tangent_u.transpose());
 
     m_is_dirty=true;
+    m_geometry_version++;
     m_is_shadowmap_dirty=true;
 }
 
@@ -732,6 +756,7 @@ void Mesh::apply_model_matrix_to_cpu(const bool transform_points_at_zero){
 
 void Mesh::scale_mesh(const float scale){
     V=V*scale;
+    m_geometry_version++;
 }
 
 // void Mesh::set_model_matrix(const Eigen::VectorXd& xyz_q){
@@ -839,19 +864,103 @@ void Mesh::scale_mesh(const float scale){
 
 
 
-void Mesh::recalculate_normals(){
+//for each vertex, the corners (3*face_idx+corner) of the faces that touch it, in increasing order of the face. The corners of vertex v are corners[offsets[v]] up to corners[offsets[v+1]]
+//having them grouped per vertex lets us gather per vertex in parallel instead of scattering from the faces
+static void vertex_face_adjacency(const Eigen::MatrixXi& F, const int nr_verts, std::vector<int>& offsets, std::vector<int>& corners){
+    CHECK(F.cols()==3) << "The adjacency needs triangles but F has " << F.cols() << " columns";
+
+    offsets.assign(nr_verts+1, 0);
+    #pragma omp parallel for
+    for(long long f=0; f<F.rows(); f++){
+        for(int c=0; c<3; c++){
+            #pragma omp atomic
+            offsets[F(f,c)+1]++;
+        }
+    }
+    std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+
+    corners.resize(offsets.back());
+    std::vector<int> cursor(offsets.begin(), offsets.end()-1);
+    #pragma omp parallel for
+    for(long long f=0; f<F.rows(); f++){
+        for(int c=0; c<3; c++){
+            int pos;
+            #pragma omp atomic capture
+            pos=cursor[F(f,c)]++;
+            corners[pos]=f*3+c;
+        }
+    }
+
+    //the atomics don't keep the order so we sort the corners of each vertex. This way the sums over them are done in the same order as a serial loop over the faces and the results don't change from run to run
+    #pragma omp parallel for schedule(dynamic, 1024)
+    for(long long v=0; v<nr_verts; v++){
+        std::sort(corners.begin()+offsets[v], corners.begin()+offsets[v+1]);
+    }
+}
+
+//interior angle of face f at corner c. Computed from the squared edge lengths like igl::internal_angles so that the normals match the ones from libigl
+template <class Verts>
+static double corner_angle(const Verts& V, const Eigen::MatrixXi& F, const int f, const int c){
+    const int c1=(c+1)%3;
+    const int c2=(c+2)%3;
+    const Eigen::Vector3d v=V.row(F(f,c)).transpose().template cast<double>();
+    const Eigen::Vector3d v1=V.row(F(f,c1)).transpose().template cast<double>();
+    const Eigen::Vector3d v2=V.row(F(f,c2)).transpose().template cast<double>();
+    const double l_opposite=(v1-v2).squaredNorm();
+    const double l1=(v2-v).squaredNorm();
+    const double l2=(v-v1).squaredNorm();
+    const double denom=2*std::sqrt(l1*l2);
+    if(denom==0){
+        return 0; //degenerate face, its normal is zero anyway
+    }
+    const double x=(l1+l2-l_opposite)/denom;
+    return x<-1? M_PI : x>1? 0 : std::acos(x);
+}
+
+void Mesh::recalculate_normals(const bool use_libigl){
     if(!F.size()){
         return; // we have no faces so there will be no normals
     }
     CHECK(V.size()) << named("V is empty");
-    igl::per_face_normals(V,F,NF);
-    igl::per_vertex_normals(V,F, igl::PerVertexNormalsWeightingType::PER_VERTEX_NORMALS_WEIGHTING_TYPE_ANGLE, NF, NV);
+
+    if(use_libigl){
+        igl::per_face_normals(V,F,NF);
+        igl::per_vertex_normals(V,F, igl::PerVertexNormalsWeightingType::PER_VERTEX_NORMALS_WEIGHTING_TYPE_ANGLE, NF, NV);
+    }else{
+        //same as the libigl version, face normals and then the angle weighted average of them for each vertex, but both loops are parallel
+        NF.resize(F.rows(),3);
+        #pragma omp parallel for
+        for(long long f=0; f<F.rows(); f++){
+            const Eigen::Vector3d v0=V.row(F(f,0)).transpose().cast<double>();
+            const Eigen::Vector3d v1=V.row(F(f,1)).transpose().cast<double>();
+            const Eigen::Vector3d v2=V.row(F(f,2)).transpose().cast<double>();
+            Eigen::Vector3d n=(v1-v0).cross(v2-v0);
+            const double norm=n.norm();
+            NF.row(f)= norm==0? Eigen::RowVector3d::Zero() : Eigen::RowVector3d(n.transpose()/norm);
+        }
+
+        std::vector<int> offsets, corners;
+        vertex_face_adjacency(F, V.rows(), offsets, corners);
+
+        NV.resize(V.rows(),3);
+        #pragma omp parallel for schedule(dynamic, 1024)
+        for(long long v=0; v<V.rows(); v++){
+            Eigen::RowVector3d n=Eigen::RowVector3d::Zero();
+            for(int k=offsets[v]; k<offsets[v+1]; k++){
+                const int f=corners[k]/3;
+                const int c=corners[k]%3;
+                n+=corner_angle(V, F, f, c)*NF.row(f);
+            }
+            n.normalize(); //leaves it at zero for vertices that are not used by any face
+            NV.row(v)=n.cast<MeshScalar>();
+        }
+    }
     m_is_dirty=true;
     m_is_shadowmap_dirty=true;
 
 }
 
-bool Mesh::load_from_file(const std::string file_path){
+bool Mesh::load_from_file(const std::string file_path, const bool use_cache){
 
     std::string filepath_trim= radu::utils::trim_copy(file_path);
     std::string file_path_abs;
@@ -861,87 +970,38 @@ bool Mesh::load_from_file(const std::string file_path){
         file_path_abs=filepath_trim;
     }
 
+    //if the file didn't change since the last time we loaded it, we can take everything including normals and tangents from the cache
+    if(use_cache && m_load_cache_enabled && read_load_cache(file_path_abs)){
+        if(!F.size()){
+            m_vis.m_show_points=true;
+            m_vis.m_show_mesh=false;
+        }
+        if(C.size()){
+            m_vis.set_color_pervertcolor();
+        }
+        m_is_dirty=true;
+        m_geometry_version++;
+        m_is_shadowmap_dirty=true;
+        m_disk_path=file_path_abs;
+        return true;
+    }
+
     std::string file_ext = file_path_abs.substr(file_path_abs.find_last_of(".") + 1);
     trim(file_ext); //remove whitespaces from beggining and end
     if (file_ext == "off" || file_ext == "OFF") {
-        igl::readOFF(file_path_abs, V, F);
+        if(!igl::readOFF(file_path_abs, V, F)){
+            return false;
+        }
     } else if (file_ext == "ply" || file_ext == "PLY") {
         read_ply(file_path_abs);
     } else if (file_ext == "obj" || file_ext == "OBJ") {
         read_obj(file_path_abs);
     } else if (file_ext == "stl" || file_ext == "STL") {
-        igl::readSTL(file_path_abs, V, F, NV);
-    }else if (file_ext == "pcd") {
-        #ifdef EASYPBR_WITH_PCL
-            //read the cloud as general binary blob and then parse it to a certain type of point cloud http://pointclouds.org/documentation/tutorials/reading_pcd.php
-            pcl::PCLPointCloud2 cloud_blob;
-            Eigen::Vector4f origin = Eigen::Vector4f::Zero();
-            Eigen::Quaternionf orientation = Eigen::Quaternionf::Identity();
-            pcl::PCDReader p;
-            int pcd_version;
-            p.read (file_path_abs, cloud_blob, origin, orientation, pcd_version);
-            Eigen::Affine3f cloud_pose = Eigen::Affine3f::Identity();
-            cloud_pose.linear() = orientation.toRotationMatrix();
-            cloud_pose.translation() = origin.head<3>();
-            //pcl::io::loadPCDFile (file_path_abs, cloud_blob);
-
-            // VLOG(1) << " read pcl cloud with header: " << cloud_blob;
-
-            bool has_rgb=false;
-            bool has_intensity=false;
-            for(size_t i=0; i<cloud_blob.fields.size(); i++){
-                if(cloud_blob.fields[i].name=="rgb"){
-                    has_rgb=true;
-                }
-                if(cloud_blob.fields[i].name=="intensity"){
-                    has_intensity=true;
-                }
-            }
-
-            //depending on the fields, read as xyz, as xyzrgb or as xyzi, xyzrgbi
-            if(!has_rgb && !has_intensity){
-                pcl::PointCloud<pcl::PointXYZ>::Ptr cloud (new pcl::PointCloud<pcl::PointXYZ>);
-                pcl::fromPCLPointCloud2 (cloud_blob, *cloud); //* convert from pcl/PCLPointCloud2 to pcl::PointCloud<T>
-                V.resize(cloud->points.size(), 3);
-                for (size_t i = 0; i < cloud->points.size (); ++i){
-                    //V.row(i) << cloud->points[i].x, cloud->points[i].y, cloud->points[i].z;
-                    V.row(i) << (cloud_pose * cloud->points[i].getVector3fMap()).transpose().cast<double>();
-                }
-
-            }else if (has_rgb && !has_intensity){
-                pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud (new pcl::PointCloud<pcl::PointXYZRGB>);
-                pcl::fromPCLPointCloud2 (cloud_blob, *cloud); //* convert from pcl/PCLPointCloud2 to pcl::PointCloud<T>
-                V.resize(cloud->points.size(), 3);
-                C.resize(cloud->points.size(), 3);
-                for (size_t i = 0; i < cloud->points.size (); ++i){
-                    //V.row(i) << cloud->points[i].x, cloud->points[i].y, cloud->points[i].z;
-                    V.row(i) << (cloud_pose * cloud->points[i].getVector3fMap()).transpose().cast<double>();
-                    C.row(i) << (float)cloud->points[i].r/255.0 , (float)cloud->points[i].g/255.0, (float)cloud->points[i].b/255.0;
-                }
-
-            }else if (has_rgb && has_intensity){
-                LOG(FATAL) << "We do not support at the moment point cloud with both rgb and intensity. I would need to add a new point cloud type PointXYZRGBI for that.";
-
-            }else if (!has_rgb && has_intensity){
-                pcl::PointCloud<pcl::PointXYZI>::Ptr cloud (new pcl::PointCloud<pcl::PointXYZI>);
-                pcl::fromPCLPointCloud2 (cloud_blob, *cloud); //* convert from pcl/PCLPointCloud2 to pcl::PointCloud<T>
-                V.resize(cloud->points.size(), 3);
-                I.resize(cloud->points.size(), 1);
-                for (size_t i = 0; i < cloud->points.size (); ++i){
-                    //V.row(i) << cloud->points[i].x, cloud->points[i].y, cloud->points[i].z;
-                    V.row(i) << (cloud_pose * cloud->points[i].getVector3fMap()).transpose().cast<double>();
-                    I.row(i) << cloud->points[i].intensity;
-                }
-            }
-            LOG(INFO) << "CloudPose=[" << cloud_pose.matrix()<<"]";
-
-            //set the width and height from the pcd file
-            m_width=cloud_blob.width;
-            m_height=cloud_blob.height;
-        #else
-            LOG(FATAL) << "Not compiled with PCL so we cannot read pcd filed";
-        #endif
-
+        if(!igl::readSTL(file_path_abs, V, F, NV)){
+            return false;
+        }
+    }else if (file_ext == "pcd" || file_ext == "PCD") {
+        read_pcd(file_path_abs);
     }else{
         LOG(WARNING) << "Not a known extension of mesh file: " << file_path_abs;
         return false;
@@ -965,9 +1025,14 @@ bool Mesh::load_from_file(const std::string file_path){
     }
 
     recalculate_min_max_height();
+
+    if(use_cache && m_load_cache_enabled){
+        write_load_cache(file_path_abs);
+    }
     
 
     m_is_dirty=true;
+    m_geometry_version++;
     m_is_shadowmap_dirty=true;
 
     m_disk_path=file_path_abs;
@@ -976,6 +1041,413 @@ bool Mesh::load_from_file(const std::string file_path){
 
 }
 
+std::string Mesh::load_cache_path(const std::string file_path){
+    if(m_load_cache_dir.empty()){
+        return file_path+".epbr";
+    }
+    //all the caches are in the same folder so we add the hash of the full path to avoid clashes between files with the same name
+    std::stringstream ss;
+    ss << std::hex << std::hash<std::string>{}(file_path);
+    return (fs::path(m_load_cache_dir) / (fs::path(file_path).filename().string()+"_"+ss.str()+".epbr") ).string();
+}
+
+void Mesh::invalidate_load_cache(const std::string file_path){
+    std::string filepath_trim= radu::utils::trim_copy(file_path);
+    std::string file_path_abs;
+    if (fs::path( filepath_trim ).is_relative()){
+        file_path_abs=(fs::path(PROJECT_SOURCE_DIR) / filepath_trim).string();
+    }else{
+        file_path_abs=filepath_trim;
+    }
+    boost::system::error_code ec;
+    fs::remove(load_cache_path(file_path_abs), ec);
+}
+
+//bump it whenever the readers or the processing done in load_from_file change what ends up in the mesh, so that the caches written before are not used anymore
+static const int load_reader_revision=1;
+
+//the source key of the cache also holds what the result of the load depends on besides the file itself. A build with EASYPBR_WITH_FLOAT_MESH would otherwise hand its float precision matrices to a double build
+static bool load_cache_key(const std::string& file_path_abs, EpbrSourceKey& key){
+    if(!epbr_source_key(file_path_abs, key)){
+        return false;
+    }
+    key.options="reader_revision="+std::to_string(load_reader_revision)+" mesh_scalar_size="+std::to_string(sizeof(MeshScalar));
+    return true;
+}
+
+bool Mesh::read_load_cache(const std::string file_path_abs){
+    EpbrSourceKey key;
+    if(!load_cache_key(file_path_abs, key)){
+        return false;
+    }
+    std::string cache_path=load_cache_path(file_path_abs);
+    if(!fs::exists(cache_path)){
+        return false;
+    }
+
+    EpbrReader reader(cache_path);
+    if(!reader.is_valid_for(key)){
+        VLOG(1) << "Cache " << cache_path << " is outdated, loading " << file_path_abs << " from scratch";
+        return false;
+    }
+
+    //only the matrices that were non empty got written so everything is cleared first, otherwise what the mesh had before, like the labels or the extra fields of another file, would be mixed with the cached ones
+    clear();
+    VTI.resize(0,0);
+    VNI.resize(0,0);
+    extra_fields.clear();
+    m_width=0;
+    m_height=0;
+    reader.read("V", V);
+    reader.read("F", F);
+    reader.read("C", C);
+    reader.read("NF", NF);
+    reader.read("NV", NV);
+    reader.read("UV", UV);
+    reader.read("V_tangent_u", V_tangent_u);
+    reader.read("V_length_v", V_length_v);
+    reader.read("I", I);
+    reader.read("L_gt", L_gt);
+    Eigen::MatrixXi size;
+    if(reader.read("width_height", size)){
+        m_width=size(0);
+        m_height=size(1);
+    }
+    Eigen::MatrixXd min_max_y;
+    if(reader.read("min_max_y", min_max_y)){
+        m_min_max_y=min_max_y.cast<float>();
+        m_min_max_y_for_plotting=m_min_max_y;
+    }
+    //extra fields, like the additional fields of a pcd, are stored with a prefix in front of their name
+    const std::string extra_prefix="extra_field/";
+    std::vector<std::string> names=reader.names();
+    for(size_t i=0; i<names.size(); i++){
+        if(names[i].compare(0, extra_prefix.size(), extra_prefix)!=0){
+            continue;
+        }
+        const std::string field_name=names[i].substr(extra_prefix.size());
+        Eigen::MatrixXd field_d;
+        Eigen::MatrixXi field_i;
+        if(reader.read(names[i], field_i)){
+            add_extra_field(field_name, field_i);
+        }else if(reader.read(names[i], field_d)){
+            add_extra_field(field_name, field_d);
+        }
+    }
+
+    VLOG(1) << "Loaded " << file_path_abs << " from cache " << cache_path;
+    return true;
+}
+
+void Mesh::write_load_cache(const std::string file_path_abs){
+    EpbrSourceKey key;
+    if(!load_cache_key(file_path_abs, key)){
+        return;
+    }
+
+    //extra fields can hold anything but only matrices can be stored. If there is something else we rather parse the file every time than lose it on the next load
+    for(auto it=extra_fields.begin(); it!=extra_fields.end(); ++it){
+        if(it->second.type()!=typeid(Eigen::MatrixXd) && it->second.type()!=typeid(Eigen::MatrixXi)){
+            VLOG(1) << "Not writing the load cache for " << file_path_abs << " because the extra field " << it->first << " is not a MatrixXd or MatrixXi";
+            return;
+        }
+    }
+
+    EpbrWriter writer;
+    auto add_if_not_empty=[&](const std::string& name, auto& mat){
+        if(mat.size()){
+            writer.add(name, mat);
+        }
+    };
+    add_if_not_empty("V", V);
+    add_if_not_empty("F", F);
+    add_if_not_empty("C", C);
+    add_if_not_empty("NF", NF);
+    add_if_not_empty("NV", NV);
+    add_if_not_empty("UV", UV);
+    add_if_not_empty("V_tangent_u", V_tangent_u);
+    add_if_not_empty("V_length_v", V_length_v);
+    add_if_not_empty("I", I);
+    add_if_not_empty("L_gt", L_gt);
+    Eigen::MatrixXi size(2,1);
+    size << m_width, m_height;
+    writer.add("width_height", size);
+    Eigen::MatrixXd min_max_y=m_min_max_y.cast<double>();
+    writer.add("min_max_y", min_max_y);
+    for(auto it=extra_fields.begin(); it!=extra_fields.end(); ++it){
+        if(const Eigen::MatrixXd* field=std::any_cast<Eigen::MatrixXd>(&it->second)){
+            writer.add("extra_field/"+it->first, *field);
+        }else if(const Eigen::MatrixXi* field=std::any_cast<Eigen::MatrixXi>(&it->second)){
+            writer.add("extra_field/"+it->first, *field);
+        }
+    }
+
+    std::string cache_path=load_cache_path(file_path_abs);
+    if(!m_load_cache_dir.empty()){
+        boost::system::error_code ec;
+        fs::create_directories(m_load_cache_dir, ec);
+    }
+    //not being able to write the cache (like for a read only dataset folder) is not an error, we just parse the file every time
+    static std::atomic<bool> warned_once(false); //loads run in parallel on the load pool
+    if(!writer.write(cache_path, key) && !warned_once.exchange(true)){
+        LOG(WARNING) << "Could not write the load cache " << cache_path << ". Set Mesh.m_load_cache_dir to a writable folder to speed up the loading of meshes";
+    }
+}
+
+std::shared_ptr<ThreadPool> Mesh::load_pool(){
+    std::lock_guard<std::mutex> lock(m_load_pool_mutex);
+    if(!m_load_pool){
+        m_load_pool=std::make_shared<ThreadPool>(m_load_nr_threads);
+    }
+    return m_load_pool;
+}
+
+std::shared_future<std::shared_ptr<Mesh>> Mesh::load_from_file_async(const std::string file_path, const std::function<void(std::shared_ptr<Mesh>)> callback){
+    std::shared_ptr<ThreadPool> pool=load_pool();
+    return pool->enqueue( [file_path, callback](){
+        std::shared_ptr<Mesh> mesh=Mesh::create();
+        if(!mesh->load_from_file(file_path)){
+            throw std::runtime_error("Could not load mesh from " + file_path);
+        }
+        //whatever Scene::show() would compute for a mesh that lacks it is done here, before the future is ready, so that showing it doesn't do it on the render thread
+        if(mesh->F.size() && mesh->NV.rows()!=mesh->V.rows()){
+            mesh->recalculate_normals();
+        }
+        if(!mesh->is_empty() && mesh->m_min_max_y.isZero()){
+            mesh->recalculate_min_max_height();
+        }
+        if(callback){
+            callback(mesh);
+        }
+        return mesh;
+    }).share();
+}
+
+std::vector< std::shared_future<std::shared_ptr<Mesh>> > Mesh::load_many(const std::vector<std::string>& file_paths){
+    std::vector< std::shared_future<std::shared_ptr<Mesh>> > futures;
+    futures.reserve(file_paths.size());
+    for(size_t i=0; i<file_paths.size(); i++){
+        futures.push_back( load_from_file_async(file_paths[i]) );
+    }
+    return futures;
+}
+
+void Mesh::set_load_nr_threads(const int nr_threads){
+    CHECK(nr_threads>0) << "The nr of threads for loading should be positive but it is " << nr_threads;
+    std::shared_ptr<ThreadPool> old_pool;
+    {
+        std::lock_guard<std::mutex> lock(m_load_pool_mutex);
+        m_load_nr_threads=nr_threads;
+        old_pool.swap(m_load_pool); //the new pool gets created on the next load
+    }
+    //old_pool gets destroyed here and its destructor joins the old threads, so this waits for every load that was already queued on it, unless some load is still holding it
+}
+
+void Mesh::load_out_of_core(const std::string file_path, const int points_per_chunk, const int max_resident_chunks){
+    std::string filepath_trim= radu::utils::trim_copy(file_path);
+    std::string file_path_abs;
+    if (fs::path( filepath_trim ).is_relative()){
+        file_path_abs=(fs::path(PROJECT_SOURCE_DIR) / filepath_trim).string();
+    }else{
+        file_path_abs=filepath_trim;
+    }
+
+    clear();
+    m_resident_chunks.clear();
+    m_out_of_core_stream=std::make_shared<PointCloudStream>(file_path_abs, points_per_chunk);
+    m_max_resident_chunks=max_resident_chunks;
+    VLOG(1) << "Opened out of core cloud " << file_path_abs << " with " << m_out_of_core_stream->nr_points() << " points in " << m_out_of_core_stream->nr_chunks() << " chunks";
+
+    //the min max height is used for coloring so it should be of the whole cloud and not only of what is resident
+    Eigen::AlignedBox3d bounds;
+    for(int i=0; i<nr_chunks(); i++){
+        bounds.extend(m_out_of_core_stream->chunk_bounds(i));
+    }
+    if(!bounds.isEmpty()){
+        m_min_max_y << bounds.min().y(), bounds.max().y();
+        m_min_max_y_for_plotting=m_min_max_y;
+    }
+
+    //start with the first chunks of the file until something calls update_resident_chunks
+    std::vector<int> initial_chunks;
+    for(int i=0; i<std::min(nr_chunks(), m_max_resident_chunks); i++){
+        initial_chunks.push_back(i);
+    }
+    set_resident_chunks(initial_chunks);
+
+    m_vis.m_show_points=true;
+    m_vis.m_show_mesh=false;
+    if(C.size()){
+        m_vis.set_color_pervertcolor();
+    }
+    m_disk_path=file_path_abs;
+}
+
+bool Mesh::is_out_of_core() const{
+    return m_out_of_core_stream!=nullptr;
+}
+
+int Mesh::nr_chunks() const{
+    return m_out_of_core_stream? m_out_of_core_stream->nr_chunks() : 0;
+}
+
+bool Mesh::update_resident_chunks(const Eigen::Vector3d& position){
+    CHECK(is_out_of_core()) << named("The mesh was not loaded with load_out_of_core");
+
+    std::vector<std::pair<double,int>> dist_chunk(nr_chunks());
+    for(int i=0; i<nr_chunks(); i++){
+        dist_chunk[i]=std::make_pair( m_out_of_core_stream->chunk_bounds(i).exteriorDistance(position), i );
+    }
+    int nr_resident=std::min(nr_chunks(), m_max_resident_chunks);
+    std::partial_sort(dist_chunk.begin(), dist_chunk.begin()+nr_resident, dist_chunk.end());
+
+    std::vector<int> chunks(nr_resident);
+    for(int i=0; i<nr_resident; i++){
+        chunks[i]=dist_chunk[i].second;
+    }
+    return request_resident_chunks(chunks);
+}
+
+bool Mesh::update_resident_chunks(const Eigen::Vector3d& region_min, const Eigen::Vector3d& region_max){
+    CHECK(is_out_of_core()) << named("The mesh was not loaded with load_out_of_core");
+
+    Eigen::AlignedBox3d region(region_min, region_max);
+    Eigen::Vector3d center=region.center();
+    std::vector<std::pair<double,int>> dist_chunk;
+    for(int i=0; i<nr_chunks(); i++){
+        const Eigen::AlignedBox3d& bounds=m_out_of_core_stream->chunk_bounds(i);
+        if(bounds.intersects(region)){
+            dist_chunk.push_back( std::make_pair( bounds.exteriorDistance(center), i ) );
+        }
+    }
+    int nr_resident=std::min((int)dist_chunk.size(), m_max_resident_chunks);
+    std::partial_sort(dist_chunk.begin(), dist_chunk.begin()+nr_resident, dist_chunk.end());
+
+    std::vector<int> chunks(nr_resident);
+    for(int i=0; i<nr_resident; i++){
+        chunks[i]=dist_chunk[i].second;
+    }
+    return request_resident_chunks(chunks);
+}
+
+//the resident chunks of an out of core cloud as they are being read in the background. Once the read finishes they get swapped into V, C and I
+struct PagedChunks{
+    std::vector<int> chunks; //sorted
+    MeshMatrixX V;
+    MeshMatrixX C;
+    MeshMatrixX I;
+    int nr_read=0;
+};
+
+bool Mesh::request_resident_chunks(const std::vector<int>& chunks){
+    std::vector<int> new_chunks=chunks;
+    std::sort(new_chunks.begin(), new_chunks.end()); //keeps the points in file order which is usually also spatially coherent
+    m_requested_chunks=new_chunks;
+
+    bool changed=swap_in_paged_chunks(/*wait*/ false);
+
+    //only one read is in flight at a time. If the camera moves in the meantime the newest request gets read once the current one is swapped in
+    if(!m_paging.valid() && m_requested_chunks!=m_resident_chunks){
+        std::shared_ptr<Mesh> self=weak_from_this().lock();
+        if(!self){
+            //nothing keeps the mesh alive while the chunks are read so we page them in right away
+            return set_resident_chunks(new_chunks) || changed;
+        }
+        m_paging=load_pool()->enqueue( [self, new_chunks](){
+            std::shared_ptr<PagedChunks> paged=std::make_shared<PagedChunks>();
+            paged->chunks=new_chunks;
+            self->page_chunks(*paged);
+            return paged;
+        }).share();
+    }
+    return changed;
+}
+
+void Mesh::wait_for_resident_chunks(){
+    swap_in_paged_chunks(/*wait*/ true);
+    if(is_out_of_core() && !m_requested_chunks.empty() && m_requested_chunks!=m_resident_chunks){
+        set_resident_chunks(m_requested_chunks);
+    }
+}
+
+bool Mesh::set_resident_chunks(const std::vector<int>& chunks){
+    std::vector<int> new_chunks=chunks;
+    std::sort(new_chunks.begin(), new_chunks.end());
+    if(new_chunks==m_resident_chunks){
+        return false;
+    }
+
+    PagedChunks paged;
+    paged.chunks=new_chunks;
+    page_chunks(paged);
+    swap_in_chunks(paged);
+    return true;
+}
+
+void Mesh::page_chunks(PagedChunks& paged) const{
+    const std::vector<int>& new_chunks=paged.chunks;
+
+    //where does each of the currently resident chunks start in V
+    std::vector<int> old_start(m_resident_chunks.size()+1, 0);
+    for(size_t i=0; i<m_resident_chunks.size(); i++){
+        old_start[i+1]=old_start[i]+m_out_of_core_stream->chunk_nr_points(m_resident_chunks[i]);
+    }
+    int nr_points=0;
+    for(size_t i=0; i<new_chunks.size(); i++){
+        nr_points+=m_out_of_core_stream->chunk_nr_points(new_chunks[i]);
+    }
+
+    //the chunks that stay resident are copied from the current V and only the new ones are read from disk
+    paged.V.resize(nr_points,3);
+    paged.C.resize(m_out_of_core_stream->has_color()? nr_points : 0, 3);
+    paged.I.resize(m_out_of_core_stream->has_intensity()? nr_points : 0, 1);
+    int start=0;
+    for(size_t i=0; i<new_chunks.size(); i++){
+        const int chunk=new_chunks[i];
+        const int nr=m_out_of_core_stream->chunk_nr_points(chunk);
+        auto it=std::lower_bound(m_resident_chunks.begin(), m_resident_chunks.end(), chunk);
+        if(it!=m_resident_chunks.end() && *it==chunk){
+            int old_idx=it-m_resident_chunks.begin();
+            paged.V.middleRows(start, nr)=V.middleRows(old_start[old_idx], nr);
+            if(paged.C.size()) paged.C.middleRows(start, nr)=C.middleRows(old_start[old_idx], nr);
+            if(paged.I.size()) paged.I.middleRows(start, nr)=I.middleRows(old_start[old_idx], nr);
+        }else{
+            Eigen::MatrixXd V_chunk, C_chunk, I_chunk;
+            m_out_of_core_stream->read_chunk(chunk, V_chunk, C_chunk, I_chunk);
+            paged.V.middleRows(start, nr)=V_chunk.cast<MeshScalar>();
+            if(paged.C.size()) paged.C.middleRows(start, nr)=C_chunk.cast<MeshScalar>();
+            if(paged.I.size()) paged.I.middleRows(start, nr)=I_chunk.cast<MeshScalar>();
+            paged.nr_read++;
+        }
+        start+=nr;
+    }
+}
+
+void Mesh::swap_in_chunks(PagedChunks& paged){
+    V.swap(paged.V);
+    C.swap(paged.C);
+    I.swap(paged.I);
+    m_resident_chunks=paged.chunks;
+    VLOG(1) << named("Paged in ") << paged.nr_read << " chunks, " << m_resident_chunks.size() << " chunks are now resident";
+
+    m_is_dirty=true;
+    m_geometry_version++;
+    m_is_shadowmap_dirty=true;
+}
+
+bool Mesh::swap_in_paged_chunks(const bool wait){
+    if(!m_paging.valid()){
+        return false;
+    }
+    if(!wait && m_paging.wait_for(std::chrono::seconds(0))!=std::future_status::ready){
+        return false;
+    }
+    std::shared_ptr<PagedChunks> paged=m_paging.get();
+    m_paging=std::shared_future<std::shared_ptr<PagedChunks>>();
+    swap_in_chunks(*paged);
+    return true;
+}
+
 void Mesh::save_to_file(const std::string file_path){
 
     //in the case of surfels, surfels that don't actually have an extent should be removed from the mesh, so we just set the coresponsing vertex to 0.0.0
@@ -987,6 +1459,7 @@ void Mesh::save_to_file(const std::string file_path){
         }
     }
     m_is_dirty=true;
+    m_geometry_version++;
     m_is_shadowmap_dirty=true;
 
     remove_vertices_at_zero();
@@ -1008,6 +1481,8 @@ void Mesh::save_to_file(const std::string file_path){
         write_ply(file_path);
     }else if(file_ext == "obj" || file_ext == "OBJ"){
         igl::writeOBJ(file_path, V, F);
+    }else if(file_ext == "pcd" || file_ext == "PCD"){
+        write_pcd(file_path);
     }else{
         LOG(WARNING) << "Not known extension " << file_ext;
     }
@@ -1059,6 +1534,7 @@ void Mesh::remove_marked_vertices(const std::vector<bool>& mask, const bool keep
     E=filter_apply_indirection_return_mask(E_kept, V_indir, E);
 
     m_is_dirty=true;
+    m_geometry_version++;
     m_is_shadowmap_dirty=true;
 
 }
@@ -1089,6 +1565,7 @@ void Mesh::set_marked_vertices_to_zero(const std::vector<bool>& mask, const bool
     E=filter_apply_indirection_return_mask(E_kept, V_indir, E);
 
     m_is_dirty=true;
+    m_geometry_version++;
     m_is_shadowmap_dirty=true;
 
 
@@ -1105,6 +1582,7 @@ void Mesh::remove_vertices_at_zero(){
     remove_marked_vertices(is_vertex_zero, false);
 
     m_is_dirty=true;
+    m_geometry_version++;
     m_is_shadowmap_dirty=true;
 
 }
@@ -1122,72 +1600,324 @@ void Mesh::remove_unreferenced_verts(){
     remove_marked_vertices(is_vertex_referenced, true);
 
     m_is_dirty=true;
+    m_geometry_version++;
     m_is_shadowmap_dirty=true;
 
 }
 
-Eigen::VectorXi Mesh::remove_duplicate_vertices(){
+//cell of a regular grid in which a vertex falls, used for welding and for the voxel filters
+typedef std::array<long long,3> GridCell;
+struct GridCellHash{
+    size_t operator()(const GridCell& c) const{
+        return (size_t)( c[0]*73856093LL ^ c[1]*19349663LL ^ c[2]*83492791LL );
+    }
+};
 
-    Eigen::MatrixXd V_new;
-    Eigen::VectorXi indirection; //size of V_new , says for each point where the original one was in mesh.V
-    Eigen::VectorXi inverse_indirection; //size of mesh.V, says for each point where they ended up in the V_new array
+//round_to_nearest gives cells centered at the multiples of the cell size, like the snapping of igl::remove_duplicate_vertices. Otherwise they start at the multiples, like a voxel grid
+static GridCell grid_cell(const MeshMatrixX& V, const long long i, const double cell_size, const bool round_to_nearest){
+    if(round_to_nearest){
+        return GridCell{ std::llround(V(i,0)/cell_size), std::llround(V(i,1)/cell_size), std::llround(V(i,2)/cell_size) };
+    }else{
+        return GridCell{ (long long)std::floor(V(i,0)/cell_size), (long long)std::floor(V(i,1)/cell_size), (long long)std::floor(V(i,2)/cell_size) };
+    }
+}
 
-    igl::remove_duplicate_vertices(V, 1e-7, V_new, indirection, inverse_indirection);
+//groups the vertices by the cell of a grid they fall in. Returns for each vertex the index of the first vertex in the same cell, which is itself for the first one.
+//The vertices are split by the hash of their cell into parts that are processed in parallel, each part in the order of the vertices so the result doesn't depend on the nr of threads
+static std::vector<int> cell_representatives(const MeshMatrixX& V, const double cell_size, const bool round_to_nearest){
+    CHECK(cell_size>0) << "The size of the grid cells should be positive but it is " << cell_size;
 
-    std::vector<int> inverse_indirection_vec= eigen2vec(inverse_indirection);
+    auto cell_of=[&](const long long i){
+        return grid_cell(V, i, cell_size, round_to_nearest);
+    };
 
-    // VLOG(1) << "V is " << V.rows();
-    // VLOG(1) << "indirection has rows " << indirection.rows();
-    // VLOG(1) << "inverse_indirection has rows " << inverse_indirection.rows();
+    int nr_parts=1;
+    #ifdef _OPENMP
+        nr_parts=omp_get_max_threads()*4;
+    #endif
+    std::vector<int> part(V.rows());
+    #pragma omp parallel for
+    for(long long i=0; i<V.rows(); i++){
+        part[i]=GridCellHash()(cell_of(i))%nr_parts;
+    }
+    //vertices of each part, in increasing order
+    std::vector<int> part_offsets(nr_parts+1, 0);
+    for(long long i=0; i<V.rows(); i++){
+        part_offsets[part[i]+1]++;
+    }
+    std::partial_sum(part_offsets.begin(), part_offsets.end(), part_offsets.begin());
+    std::vector<int> part_verts(V.rows());
+    std::vector<int> cursor(part_offsets.begin(), part_offsets.end()-1);
+    for(long long i=0; i<V.rows(); i++){
+        part_verts[cursor[part[i]]++]=i;
+    }
 
-    F=filter_apply_indirection(inverse_indirection_vec, F);
-    E=filter_apply_indirection(inverse_indirection_vec, E);
+    std::vector<int> representative(V.rows());
+    #pragma omp parallel for schedule(dynamic,1)
+    for(int p=0; p<nr_parts; p++){
+        std::unordered_map<GridCell, int, GridCellHash> first_in_cell;
+        first_in_cell.reserve(part_offsets[p+1]-part_offsets[p]);
+        for(int k=part_offsets[p]; k<part_offsets[p+1]; k++){
+            const int i=part_verts[k];
+            auto it=first_in_cell.emplace(cell_of(i), i).first;
+            representative[i]=it->second;
+        }
+    }
+
+    return representative;
+}
 
-    //now that we merge the vertices we need to also somehow merge the vertex atributes, so merge the colors for examaple. UV cannot be merged since you would need to choose one or the other uv  coordinate, if you choose the wrong one you end up stretching the face all over the uv map
-    //We not efectivelly splat and acummulate the colors from the original mesh into the new mesh. So if V0 and v1 got merged together their colors would average on the new mesh
-    std::vector<int> nr_times_merged(V_new.rows(), 0); //stores for each new vertex, how many vertices it merged into itself
-    //get the nr of times merged
-    for (int i=0; i<V.rows(); i++){
-        int idx_new_mesh=inverse_indirection(i); //index saying for this old vertex, where it got merged into in the new mesh
-        nr_times_merged[idx_new_mesh]++;
+//groups the vertices by the index they have after merging. The original vertices that got merged into vertex v of the merged mesh are members[offsets[v]] up to members[offsets[v+1]], in increasing order
+static void merged_groups(const Eigen::VectorXi& inverse_indirection, const int nr_merged, std::vector<int>& offsets, std::vector<int>& members){
+    offsets.assign(nr_merged+1, 0);
+    for(long long i=0; i<inverse_indirection.size(); i++){
+        offsets[inverse_indirection(i)+1]++;
+    }
+    std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+    members.resize(inverse_indirection.size());
+    std::vector<int> cursor(offsets.begin(), offsets.end()-1);
+    for(long long i=0; i<inverse_indirection.size(); i++){
+        members[cursor[inverse_indirection(i)]++]=i;
     }
-    //calcualte the average color, Intensity and the other per-vertex things for the merged vertices
-    //COLOR
-    if (C.size()){
-        Eigen::MatrixXd C_new;
-        C_new.resize(V_new.rows(), 3);
-        C_new.setZero();
-        for (int i=0; i<V.rows(); i++){
-            int idx_new_mesh=inverse_indirection(i); //index saying for this old vertex, where it got merged into in the new mesh
-            Eigen::Vector3d original_color=C.row(i);
-            C_new.row(idx_new_mesh)+=original_color;
+}
+
+//average of the rows of each group
+template <class Matrix>
+static Matrix merge_average(const Matrix& attrib, const std::vector<int>& offsets, const std::vector<int>& members){
+    const int nr_merged=offsets.size()-1;
+    Matrix merged(nr_merged, attrib.cols());
+    #pragma omp parallel for
+    for(long long v=0; v<nr_merged; v++){
+        merged.row(v)=attrib.row(members[offsets[v]]);
+        for(int k=offsets[v]+1; k<offsets[v+1]; k++){
+            merged.row(v)+=attrib.row(members[k]);
         }
-        //renormalize the colors
-        for (int i=0; i<V_new.rows(); i++){
-            C_new.row(i).array()/=nr_times_merged[i];
+        merged.row(v)/=(typename Matrix::Scalar)(offsets[v+1]-offsets[v]);
+    }
+    return merged;
+}
+
+//the row of the first vertex of each group, for the attributes that cannot be averaged
+template <class Matrix>
+static Matrix merge_first(const Matrix& attrib, const std::vector<int>& offsets, const std::vector<int>& members){
+    const int nr_merged=offsets.size()-1;
+    Matrix merged(nr_merged, attrib.cols());
+    #pragma omp parallel for
+    for(long long v=0; v<nr_merged; v++){
+        merged.row(v)=attrib.row(members[offsets[v]]);
+    }
+    return merged;
+}
+
+//the label that appears the most in each group. In case of a tie the smallest label wins
+static Eigen::MatrixXi merge_majority_vote(const Eigen::MatrixXi& labels, const std::vector<int>& offsets, const std::vector<int>& members){
+    const int nr_merged=offsets.size()-1;
+    Eigen::MatrixXi merged(nr_merged, 1);
+    #pragma omp parallel
+    {
+        std::vector<int> group_labels;
+        #pragma omp for
+        for(long long v=0; v<nr_merged; v++){
+            group_labels.clear();
+            for(int k=offsets[v]; k<offsets[v+1]; k++){
+                group_labels.push_back(labels(members[k],0));
+            }
+            std::sort(group_labels.begin(), group_labels.end());
+            int best_label=group_labels[0];
+            int best_count=0;
+            for(size_t start=0; start<group_labels.size(); ){
+                size_t end=start;
+                while(end<group_labels.size() && group_labels[end]==group_labels[start]){
+                    end++;
+                }
+                if((int)(end-start)>best_count){
+                    best_count=end-start;
+                    best_label=group_labels[start];
+                }
+                start=end;
+            }
+            merged(v,0)=best_label;
         }
-        C=C_new;
     }
+    return merged;
+}
 
-    V=V_new;
+Eigen::VectorXi Mesh::remove_duplicate_vertices(const double tolerance){
+    CHECK(V.cols()==3) << named("V should be Nx3 but it is ") << V.rows() << "x" << V.cols();
+    CHECK(tolerance>0) << named("The tolerance for welding vertices should be positive but it is ") << tolerance;
+
+    //snapping to a grid, same as igl::remove_duplicate_vertices but with a hash map instead of sorting
+    Eigen::VectorXi inverse_indirection=merge_vertices( cell_representatives(V, tolerance, /*round_to_nearest*/ true), /*average_positions*/ false );
 
     m_is_dirty=true;
+    m_geometry_version++;
 
     return inverse_indirection;
 }
 
+Eigen::VectorXi Mesh::voxel_grid_subsample(const float voxel_size){
+    CHECK(V.cols()==3) << named("V should be Nx3 but it is ") << V.rows() << "x" << V.cols();
+    CHECK(voxel_size>0) << named("The voxel size should be positive but it is ") << voxel_size;
+
+    Eigen::VectorXi inverse_indirection=merge_vertices( cell_representatives(V, voxel_size, /*round_to_nearest*/ false), /*average_positions*/ true );
+
+    m_is_dirty=true;
+    m_geometry_version++;
+    m_is_shadowmap_dirty=true;
+
+    return inverse_indirection;
+}
+
+Eigen::VectorXi Mesh::merge_vertices(const std::vector<int>& representative, const bool average_positions){
+
+    //the merged vertices keep the order of the first vertex of each group
+    std::vector<int> new_idx(V.rows(), -1);
+    int nr_merged=0;
+    for(long long i=0; i<V.rows(); i++){
+        if(representative[i]==i){
+            new_idx[i]=nr_merged++;
+        }
+    }
+    Eigen::VectorXi inverse_indirection(V.rows()); //size of mesh.V, says for each point where they ended up in the V_new array
+    #pragma omp parallel for
+    for(long long i=0; i<V.rows(); i++){
+        inverse_indirection(i)=new_idx[representative[i]];
+    }
+    std::vector<int> inverse_indirection_vec= eigen2vec(inverse_indirection);
+
+    F=filter_apply_indirection(inverse_indirection_vec, F);
+    E=filter_apply_indirection(inverse_indirection_vec, E);
+
+    //now that we merge the vertices we need to also somehow merge the vertex atributes. Colors, intensities, distances and normals get averaged and labels get a majority vote.
+    //UV cannot be merged since you would need to choose one or the other uv  coordinate, if you choose the wrong one you end up stretching the face all over the uv map. So for them and the rest we keep the ones of the first vertex
+    std::vector<int> offsets, members;
+    merged_groups(inverse_indirection, nr_merged, offsets, members);
+    const long long nr_verts=V.rows();
+    auto is_per_vertex=[&](const long long rows){ return rows==nr_verts; };
+
+    if(is_per_vertex(C.rows())) C=merge_average(C, offsets, members);
+    if(is_per_vertex(I.rows())) I=merge_average(I, offsets, members);
+    if(is_per_vertex(D.rows())) D=merge_average(D, offsets, members);
+    if(is_per_vertex(NV.rows())){
+        NV=merge_average(NV, offsets, members);
+        NV.rowwise().normalize();
+    }
+    if(is_per_vertex(L_pred.rows())) L_pred=merge_majority_vote(L_pred, offsets, members);
+    if(is_per_vertex(L_gt.rows())) L_gt=merge_majority_vote(L_gt, offsets, members);
+    if(is_per_vertex(UV.rows())) UV=merge_first(UV, offsets, members);
+    if(is_per_vertex(S_pred.rows())) S_pred=merge_first(S_pred, offsets, members);
+    if(is_per_vertex(V_tangent_u.rows())) V_tangent_u=merge_first(V_tangent_u, offsets, members);
+    if(is_per_vertex(V_length_v.rows())) V_length_v=merge_first(V_length_v, offsets, members);
+    if(is_per_vertex(V_bitangent_v.rows())) V_bitangent_v=merge_first(V_bitangent_v, offsets, members);
+    V= average_positions? merge_average(V, offsets, members) : merge_first(V, offsets, members);
+
+    return inverse_indirection;
+}
+
+//dart throwing on a grid with cells of size radius, so the points that could be closer than radius to a point are in the 27 cells around it.
+//The cells are processed in 27 phases, in each phase the cells that are 3 cells apart from each other run in parallel. They don't share any neighbour so a cell only reads the samples of cells that are not being written at the same time
+void Mesh::poisson_disk_subsample(const float radius){
+    CHECK(V.cols()==3) << named("V should be Nx3 but it is ") << V.rows() << "x" << V.cols();
+    CHECK(radius>0) << named("The radius should be positive but it is ") << radius;
+
+    //dense ids for the cells and the points in each one
+    const std::vector<int> representative=cell_representatives(V, radius, /*round_to_nearest*/ false);
+    std::vector<int> cell_idx(V.rows(), -1);
+    std::vector<GridCell> cells;
+    std::unordered_map<GridCell, int, GridCellHash> cell2idx;
+    for(long long i=0; i<V.rows(); i++){
+        if(representative[i]==i){
+            cell_idx[i]=cells.size();
+            cells.push_back( grid_cell(V, i, radius, false) );
+            cell2idx[cells.back()]=cell_idx[i];
+        }
+    }
+    Eigen::VectorXi point2cell(V.rows());
+    #pragma omp parallel for
+    for(long long i=0; i<V.rows(); i++){
+        point2cell(i)=cell_idx[representative[i]];
+    }
+    std::vector<int> offsets, members;
+    merged_groups(point2cell, cells.size(), offsets, members);
+
+    //the points in each cell are tried in a pseudo random order which is the same in each run
+    auto order_key=[](const int i){
+        uint64_t z= (uint64_t)(i+1)*0x9E3779B97F4A7C15ull;
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        return z ^ (z >> 31);
+    };
+    #pragma omp parallel for schedule(dynamic, 256)
+    for(long long c=0; c<(long long)cells.size(); c++){
+        std::sort(members.begin()+offsets[c], members.begin()+offsets[c+1], [&](const int a, const int b){ return order_key(a)<order_key(b); });
+    }
+
+    std::vector< std::vector<int> > samples_in_cell(cells.size());
+    const double radius_sq=(double)radius*radius;
+    for(int phase=0; phase<27; phase++){
+        #pragma omp parallel for schedule(dynamic, 64)
+        for(long long c=0; c<(long long)cells.size(); c++){
+            const GridCell& cell=cells[c];
+            auto mod3=[](const long long x){ return (int)(((x%3)+3)%3); };
+            if(mod3(cell[0])+3*mod3(cell[1])+9*mod3(cell[2])!=phase){
+                continue;
+            }
+            //samples already accepted around this cell
+            std::vector<int> neighbour_cells;
+            for(int dz=-1; dz<=1; dz++) for(int dy=-1; dy<=1; dy++) for(int dx=-1; dx<=1; dx++){
+                auto it=cell2idx.find( GridCell{cell[0]+dx, cell[1]+dy, cell[2]+dz} );
+                if(it!=cell2idx.end() && it->second!=c){
+                    neighbour_cells.push_back(it->second);
+                }
+            }
+            for(int k=offsets[c]; k<offsets[c+1]; k++){
+                const int i=members[k];
+                auto is_far=[&](const std::vector<int>& samples){
+                    for(size_t s=0; s<samples.size(); s++){
+                        if( (V.row(i)-V.row(samples[s])).cast<double>().squaredNorm()<radius_sq ){
+                            return false;
+                        }
+                    }
+                    return true;
+                };
+                bool accepted=is_far(samples_in_cell[c]);
+                for(size_t n=0; n<neighbour_cells.size() && accepted; n++){
+                    accepted=is_far(samples_in_cell[neighbour_cells[n]]);
+                }
+                if(accepted){
+                    samples_in_cell[c].push_back(i);
+                }
+            }
+        }
+    }
+
+    std::vector<bool> is_vertex_kept(V.rows(), false);
+    for(size_t c=0; c<samples_in_cell.size(); c++){
+        for(size_t s=0; s<samples_in_cell[c].size(); s++){
+            is_vertex_kept[samples_in_cell[c][s]]=true;
+        }
+    }
+    remove_marked_vertices(is_vertex_kept, /*keep*/ true);
+}
+
 void Mesh::undo_remove_duplicate_vertices(const std::shared_ptr<Mesh>& original_mesh, const Eigen::VectorXi& inverse_indirection ){
 
     CHECK(inverse_indirection.size()==original_mesh->V.rows()) << "The inverse_indirection has to have the same size as the original mesh vertices. Indirection is " << inverse_indirection.size() << " original mesh V is " << original_mesh->V.rows();
 
     //check the position that the vertices now have in the merged mesh and copy them
-    Eigen::MatrixXd V_undone=original_mesh->V;
-    for (int i=0; i<V_undone.rows(); i++){
+    //the normals also come from the merged mesh since they are usually recomputed after merging
+    MeshMatrixX V_undone=original_mesh->V;
+    MeshMatrixX NV_undone;
+    const bool has_merged_normals= NV.rows()==V.rows() && NV.size();
+    if(has_merged_normals) NV_undone.resize(V_undone.rows(), 3);
+    #pragma omp parallel for
+    for (long long i=0; i<V_undone.rows(); i++){
         int idx_merged_mesh=inverse_indirection(i);
-        Eigen::Vector3d merged_point=V.row(idx_merged_mesh);
-        V_undone.row(i)=merged_point;
+        V_undone.row(i)=V.row(idx_merged_mesh);
+        if(has_merged_normals) NV_undone.row(i)=NV.row(idx_merged_mesh);
     }
     V=V_undone;
+    if(has_merged_normals) NV=NV_undone;
 
 
     //original indices
@@ -1195,24 +1925,38 @@ void Mesh::undo_remove_duplicate_vertices(const std::shared_ptr<Mesh>& original_
     if(original_mesh->E.size()) E=original_mesh->E;
     //copy rest of atributes that got merged in the removing of duplicates
     if(original_mesh->C.size()) C=original_mesh->C;
+    if(original_mesh->I.size()) I=original_mesh->I;
+    if(original_mesh->D.size()) D=original_mesh->D;
+    if(original_mesh->NV.size() && !has_merged_normals) NV=original_mesh->NV;
+    if(original_mesh->L_pred.size()) L_pred=original_mesh->L_pred;
+    if(original_mesh->L_gt.size()) L_gt=original_mesh->L_gt;
+    if(original_mesh->UV.size()) UV=original_mesh->UV;
+    if(original_mesh->S_pred.size()) S_pred=original_mesh->S_pred;
+    if(original_mesh->V_tangent_u.size()) V_tangent_u=original_mesh->V_tangent_u;
+    if(original_mesh->V_length_v.size()) V_length_v=original_mesh->V_length_v;
+    if(original_mesh->V_bitangent_v.size()) V_bitangent_v=original_mesh->V_bitangent_v;
     m_is_dirty=true;
+    m_geometry_version++;
 
 }
 
 //instead of removing the duplicate verts, we sometimes just want them set to zero so they don't interfere with the organized datastrucutre of a velodyne cloud
-void Mesh::set_duplicate_verts_to_zero(){
-    LOG(FATAL) << "Function is not completed, at the moment it doesnt do anything";
+//the first vertex of each group of duplicates is kept and the others are zeroed, like the points that are missing from the cloud
+void Mesh::set_duplicate_verts_to_zero(const double tolerance){
+    CHECK(V.cols()==3) << named("V should be Nx3 but it is ") << V.rows() << "x" << V.cols();
+    CHECK(tolerance>0) << named("The tolerance for welding vertices should be positive but it is ") << tolerance;
 
-    Eigen::MatrixXd V_new;
-    Eigen::MatrixXi indirection; //size of mesh.V, says for each point where they ended up in the V_new array
-    Eigen::MatrixXi inverse_indirection; // size of V_new , says for each point where the original one was in mesh.V
-
-    igl::remove_duplicate_vertices(V, 1e-7, V_new, indirection, inverse_indirection);
-
-    VLOG(1) << "size of indirection is" <<indirection.rows();
-    VLOG(1) << "size of inverse_indirection is" <<inverse_indirection.rows();
+    const std::vector<int> representative=cell_representatives(V, tolerance, /*round_to_nearest*/ true);
 
+    #pragma omp parallel for
+    for(long long i=0; i<V.rows(); i++){
+        if(representative[i]!=i){
+            V.row(i).setZero();
+        }
+    }
 
+    set_dirty(MeshAttribute::V);
+    m_is_shadowmap_dirty=true;
 }
 
 //to go from worldROS to worldGL we rotate90 degrees
@@ -1225,6 +1969,7 @@ void Mesh::rotate_90_x_axis(){
     transform_vertices_cpu(tf_worldGL_worldROS);
 
     m_is_dirty=true;
+    m_geometry_version++;
     m_is_shadowmap_dirty=true;
 }
 
@@ -1239,6 +1984,7 @@ void Mesh::worldGL2worldROS(){
     transform_vertices_cpu(tf_worldROS_worldGL);
 
     m_is_dirty=true;
+    m_geometry_version++;
     m_is_shadowmap_dirty=true;
 }
 
@@ -1252,6 +1998,7 @@ void Mesh::worldROS2worldGL(){
     transform_vertices_cpu(tf_worldGL_worldROS);
 
     m_is_dirty=true;
+    m_geometry_version++;
     m_is_shadowmap_dirty=true;
 }
 
@@ -1299,6 +2046,7 @@ void Mesh::random_subsample(const float percentage_removal){
     remove_marked_vertices(is_vertex_to_be_removed, false);
 
     m_is_dirty=true;
+    m_geometry_version++;
     m_is_shadowmap_dirty=true;
 
 }
@@ -1348,6 +2096,7 @@ void Mesh::decimate(const int nr_target_faces){
     recalculate_normals(); //we completely changed the V and F so we might as well just recompute NV and NF
 
     m_is_dirty=true;
+    m_geometry_version++;
     m_is_shadowmap_dirty=true;
 }
 
@@ -1410,7 +2159,7 @@ bool Mesh::compute_non_manifold_edges(std::vector<bool>& is_face_non_manifold, s
 
 
 void Mesh::upsample(const int nr_of_subdivisions, const bool smooth){
-    Eigen::MatrixXd new_V;
+    MeshMatrixX new_V;
     Eigen::MatrixXi new_F;
 
     if(smooth){
@@ -1425,6 +2174,7 @@ void Mesh::upsample(const int nr_of_subdivisions, const bool smooth){
     recalculate_normals();
 
     m_is_dirty=true;
+    m_geometry_version++;
     m_is_shadowmap_dirty=true;
 
 }
@@ -1452,18 +2202,19 @@ void Mesh::flip_normals(){
 void Mesh::normalize_size(){
     CHECK(V.size()) << name << "We cannot normalize_size an empty cloud";
 
-    Eigen::VectorXd max= V.colwise().maxCoeff();
-    Eigen::VectorXd min= V.colwise().minCoeff();
+    Eigen::VectorXd max= V.colwise().maxCoeff().cast<double>();
+    Eigen::VectorXd min= V.colwise().minCoeff().cast<double>();
     // double size_diff=(max-min).norm();
     float scale= get_scale();
     V.array()/=scale;
+    m_geometry_version++;
 }
 
 void Mesh::normalize_position(){
     CHECK(V.size()) << name << "We cannot normalize_position an empty cloud";
 
-    Eigen::Vector3d max= V.colwise().maxCoeff();
-    Eigen::Vector3d min= V.colwise().minCoeff();
+    Eigen::Vector3d max= V.colwise().maxCoeff().cast<double>();
+    Eigen::Vector3d min= V.colwise().minCoeff().cast<double>();
     Eigen::Vector3d mid=(max+min)/2.0;
     Eigen::Affine3d tf;
     tf.setIdentity();
@@ -1530,15 +2281,17 @@ void Mesh::random_stretch(const float stretch_strength){
     V.col(0)*=stretch_factor_x;
     V.col(1)*=stretch_factor_y;
     V.col(2)*=stretch_factor_z;
+    m_geometry_version++;
 }
 void Mesh::random_noise(const float noise_stddev){
-    Eigen::MatrixXd noise=V;
+    MeshMatrixX noise=V;
     for(int i=0; i<noise.rows(); i++){
         for(int j=0; j<noise.cols(); j++){
             noise(i,j)=m_rand_gen->rand_normal_float(0.0, noise_stddev);
         }
     }
     V+=noise;
+    m_geometry_version++;
 }
 
 
@@ -1690,9 +2443,9 @@ void Mesh::create_box(const float w, const float h, const float l){
     std::vector<Eigen::VectorXi> faces;
     std::vector<Eigen::VectorXi> edges;
     for(int i=0; i<F.rows(); i++){
-        Eigen::VectorXd p1=V.row( F(i,0) );
-        Eigen::VectorXd p2=V.row( F(i,2) );
-        Eigen::VectorXd p3=V.row( F(i,1) );
+        Eigen::VectorXd p1=V.row( F(i,0) ).cast<double>();
+        Eigen::VectorXd p2=V.row( F(i,2) ).cast<double>();
+        Eigen::VectorXd p3=V.row( F(i,1) ).cast<double>();
         points.push_back(p1);
         points.push_back(p2);
         points.push_back(p3);
@@ -1726,7 +2479,7 @@ void Mesh::create_box(const float w, const float h, const float l){
 
     }
 
-    V=radu::utils::vec2eigen(points);
+    V=radu::utils::vec2eigen(points).cast<MeshScalar>();
     F=radu::utils::vec2eigen(faces);
     E=radu::utils::vec2eigen(edges);
 
@@ -1873,7 +2626,7 @@ void Mesh::create_sphere(const Eigen::Vector3d& center, const double radius){
     // V/= 0.0751893; //normalize by the radius of this sphere that we loaded so not we have a radius of 1.0
     for (int i = 0; i < V.rows(); i++) {
         // V.row(i) =V.row(i)*radius+center;
-        V.row(i) = Eigen::Vector3d(V.row(i))*radius+center;
+        V.row(i) = (V.row(i).transpose().cast<double>()*radius+center).cast<MeshScalar>();
     }
 }
 
@@ -1892,7 +2645,7 @@ void Mesh::create_cylinder(const Eigen::Vector3d& main_axis, const double height
     //if the origin is at the bottom, then we move the primtive
     if(origin_at_bottom){
         for (int i = 0; i < V.rows(); i++) {
-            Eigen::Vector3d point = V.row(i);
+            Eigen::Vector3d point = V.row(i).cast<double>();
             V.row(i) << point.x(), point.y()+0.5, point.z();
         }
     }
@@ -1900,7 +2653,7 @@ void Mesh::create_cylinder(const Eigen::Vector3d& main_axis, const double height
 
     //change the height and radius
     for (int i = 0; i < V.rows(); i++) {
-        Eigen::Vector3d point = V.row(i);
+        Eigen::Vector3d point = V.row(i).cast<double>();
         V.row(i) << point.x()*radius, point.y()*height, point.z()*radius;
     }
 
@@ -1934,7 +2687,7 @@ void Mesh::create_cylinder(const Eigen::Vector3d& main_axis, const double height
 void Mesh::create_line_strip_from_points(const std::vector<Eigen::Vector3d>& points_vec){
     CHECK(points_vec.size()>=2 ) << "We need at least 2 points to create line_strip";
 
-    V=vec2eigen(points_vec);
+    V=vec2eigen(points_vec).cast<MeshScalar>();
     E.resize(points_vec.size()-1, 2);
     for(size_t i=0; i<points_vec.size()-1; i++){
         E.row(i) << i, i+1; 
@@ -2051,8 +2804,8 @@ void Mesh::color_from_mat(const cv::Mat& mat){
 }
 
 Eigen::Vector3d Mesh::centroid(){
-    Eigen::Vector3d min_point = V.colwise().minCoeff();
-    Eigen::Vector3d max_point = V.colwise().maxCoeff();
+    Eigen::Vector3d min_point = V.colwise().minCoeff().cast<double>();
+    Eigen::Vector3d max_point = V.colwise().maxCoeff().cast<double>();
     Eigen::Vector3d centroid = (0.5*(min_point + max_point)).eval();
 
     return centroid;
@@ -2066,16 +2819,16 @@ Eigen::VectorXi Mesh::fix_oversplit_due_to_blender_uv(){
     Eigen::MatrixXd V_UV(V.rows(),5);
 
 
-    V_UV.block(0,0,V.rows(),3)=V;
-    V_UV.block(0,3,V.rows(),2)=UV;
+    V_UV.block(0,0,V.rows(),3)=V.cast<double>();
+    V_UV.block(0,3,V.rows(),2)=UV.cast<double>();
 
     Eigen::MatrixXd V_UV_merged;
     Eigen::MatrixXi F_merged;
     Eigen::VectorXi I; //size of V_original and it maps to where each vertex ended up in the merged vertices
     igl::remove_duplicates(V_UV, F ,V_UV_merged,F_merged,I,1e-14);
 
-    V=V_UV_merged.block(0,0,V_UV_merged.rows(),3);
-    UV=V_UV_merged.block(0,3,V_UV_merged.rows(),2);
+    V=V_UV_merged.block(0,0,V_UV_merged.rows(),3).cast<MeshScalar>();
+    UV=V_UV_merged.block(0,3,V_UV_merged.rows(),2).cast<MeshScalar>();
     F=F_merged;
 
     return I;
@@ -2126,7 +2879,7 @@ void Mesh::color_connected_components(){
     for (int i = 0; i < F.rows(); i++) {
         for (size_t v = 0; v < 3; v++) {
             int idx_v=F(i,v);
-            C.row(idx_v)=C_per_f.row(i);
+            C.row(idx_v)=C_per_f.row(i).cast<MeshScalar>();
         }
     }
 
@@ -2177,9 +2930,9 @@ void Mesh::apply_D(){
     for (int i = 0; i < V.rows(); ++i) {
         if (!V.row(i).isZero()){
             //get a direction going from the origin to the vertex
-            Eigen::Vector3d dir_normalized = (Eigen::Vector3d(V.row(i)) - origin).normalized();
+            Eigen::Vector3d dir_normalized = (V.row(i).transpose().cast<double>() - origin).normalized();
             //move along that direction with spedsize (D(i)) and then add the origin to get the position back in world coordinatees
-            V.row(i) = dir_normalized*D(i) + origin;
+            V.row(i) = (dir_normalized*D(i) + origin).cast<MeshScalar>();
         }
 
     }
@@ -2215,7 +2968,7 @@ void Mesh::to_image(Eigen::Affine3d tf_world_vel) {
     Eigen::Affine3d tf_alg_world = tf_alg_vel * tf_world_vel.inverse(); //now goes from world to the velodyne frame and then from the velodyne to the algorithm frame
     for (int i = 0; i < V.rows(); i++) {
         if(!V.row(i).isZero()){
-            V_alg_frame.row(i)=tf_alg_world.linear()*V.row(i).transpose() + tf_alg_world.translation();  //mapping from the current frame to the algorithm one
+            V_alg_frame.row(i)=tf_alg_world.linear()*V.row(i).transpose().cast<double>() + tf_alg_world.translation();  //mapping from the current frame to the algorithm one
         }
     }
 
@@ -2282,7 +3035,7 @@ void Mesh::to_mesh(Eigen::Affine3d tf_world_vel) {
 
     for (int i = 0; i < V.rows(); i++) {
         if(!V.row(i).isZero()){
-            V.row(i)=tf_world_alg.linear()*V.row(i).transpose() + tf_world_alg.translation();  //mapping from the current frame to the algorithm one
+            V.row(i)=(tf_world_alg.linear()*V.row(i).transpose().cast<double>() + tf_world_alg.translation()).cast<MeshScalar>();  //mapping from the current frame to the algorithm one
         }
     }
 
@@ -2290,14 +3043,14 @@ void Mesh::to_mesh(Eigen::Affine3d tf_world_vel) {
 
 
 void Mesh::to_3D(){
-  Eigen::MatrixXd V_new(V.rows(),3);
+  MeshMatrixX V_new(V.rows(),3);
   V_new.setZero();
   V_new.leftCols(2)=V;
   V=V_new;
 }
 
 void Mesh::to_2D(){
-    Eigen::MatrixXd V_new(V.rows(),2);
+    MeshMatrixX V_new(V.rows(),2);
     V_new=V.leftCols(2);
     V=V_new;
 }
@@ -2325,7 +3078,7 @@ void Mesh::restrict_around_azimuthal_angle(const float angle, const float range)
     Eigen::Affine3d tf_alg_world = tf_alg_vel * m_cur_pose.inverse(); //now goes from world to the velodyne frame and then from the velodyne to the algorithm frame
     for (int i = 0; i < V.rows(); i++) {
         if(!V.row(i).isZero()){
-            V_alg_frame.row(i)=tf_alg_world.linear()*V.row(i).transpose() + tf_alg_world.translation();  //mapping from the current frame to the algorithm one
+            V_alg_frame.row(i)=tf_alg_world.linear()*V.row(i).transpose().cast<double>() + tf_alg_world.translation();  //mapping from the current frame to the algorithm one
         }
     }
 
@@ -2377,28 +3130,22 @@ void Mesh::compute_tangents(const float tangent_length){
     V_length_v.setOnes();
     V_bitangent.setZero();
 
-    Eigen::VectorXi degree_vertices;
-    degree_vertices.resize(V.rows());
-    degree_vertices.setZero();
-
     //if we have UV per vertex then we can calculate a tangent that is aligned with the U direction
     //code from http://www.opengl-tutorial.org/intermediate-tutorials/tutorial-13-normal-mapping/
     //more explanation in https://learnopengl.com/Advanced-Lighting/Normal-Mapping
     if(UV.size() && F.size()){
         //compute the tangent for each triangle and then average for each vertex
-        for(int f=0; f<F.rows(); f++){
-            //increase the degree for the vertices we touch
-            degree_vertices(F(f,0))++;
-            degree_vertices(F(f,1))++;
-            degree_vertices(F(f,2))++;
-
-            Eigen::Vector3d v0 = V.row(F(f,0));
-            Eigen::Vector3d v1 = V.row(F(f,1));
-            Eigen::Vector3d v2 = V.row(F(f,2));
-
-            Eigen::Vector2d uv0 = UV.row(F(f,0));
-            Eigen::Vector2d uv1 = UV.row(F(f,1));
-            Eigen::Vector2d uv2 = UV.row(F(f,2));
+        Eigen::MatrixXd F_tangent(F.rows(),3);
+        Eigen::MatrixXd F_bitangent(F.rows(),3);
+        #pragma omp parallel for
+        for(long long f=0; f<F.rows(); f++){
+            Eigen::Vector3d v0 = V.row(F(f,0)).cast<double>();
+            Eigen::Vector3d v1 = V.row(F(f,1)).cast<double>();
+            Eigen::Vector3d v2 = V.row(F(f,2)).cast<double>();
+
+            Eigen::Vector2d uv0 = UV.row(F(f,0)).cast<double>();
+            Eigen::Vector2d uv1 = UV.row(F(f,1)).cast<double>();
+            Eigen::Vector2d uv2 = UV.row(F(f,2)).cast<double>();
 
              // Edges of the triangle : position delta
             Eigen::Vector3d deltaPos1 = v1-v0;
@@ -2412,30 +3159,31 @@ void Mesh::compute_tangents(const float tangent_length){
             Eigen::Vector3d tangent = (deltaPos1 * deltaUV2.y()   - deltaPos2 * deltaUV1.y() )*r;
             Eigen::Vector3d  bitangent = (deltaPos2 * deltaUV1.x()   - deltaPos1 * deltaUV2.x() )*r;
 
-            V_tangent_u.row(F(f,0)) += tangent;
-            V_tangent_u.row(F(f,1)) += tangent;
-            V_tangent_u.row(F(f,2)) += tangent;
-            V_bitangent.row(F(f,0)) += bitangent;
-            V_bitangent.row(F(f,1)) += bitangent;
-            V_bitangent.row(F(f,2)) += bitangent;
-        }
-
-        //average the tangent and bitangent per vector and then normalize then
-        // V_tangent_u = V_tangent_u.array()/ degree_vertices.array();
-        // V_bitangent = V_bitangent.array()/ degree_vertices.array();
-        for(int i=0; i<V.rows(); i++){
-            V_tangent_u.row(i) = V_tangent_u.row(i)/degree_vertices(i);
-            V_bitangent.row(i) = V_bitangent.row(i)/degree_vertices(i);
+            F_tangent.row(f) = tangent;
+            F_bitangent.row(f) = bitangent;
         }
-        V_tangent_u.rowwise().normalize();
-        V_bitangent.rowwise().normalize();
 
+        //gather from the faces of each vertex, which are in the same order as the faces so the sums are the same as when scattering from a loop over the faces
+        std::vector<int> offsets, corners;
+        vertex_face_adjacency(F, V.rows(), offsets, corners);
+
+        //average the tangent and bitangent per vector and then normalize then. Compute the normal as the cross between the tangent and bitangnet
+        #pragma omp parallel for schedule(dynamic, 1024)
+        for(long long i=0; i<V.rows(); i++){
+            for(int k=offsets[i]; k<offsets[i+1]; k++){
+                const int f=corners[k]/3;
+                V_tangent_u.row(i) += F_tangent.row(f).cast<MeshScalar>();
+                V_bitangent.row(i) += F_bitangent.row(f);
+            }
+            const int degree=offsets[i+1]-offsets[i];
+            V_tangent_u.row(i) = V_tangent_u.row(i)/degree;
+            V_bitangent.row(i) = V_bitangent.row(i)/degree;
+            V_tangent_u.row(i).normalize();
+            V_bitangent.row(i).normalize();
 
-        //compute the normal as the cross between the tangent and bitangnet
-        for(int i=0; i<V.rows(); i++){
-            Eigen::Vector3d T = V_tangent_u.row(i);
+            Eigen::Vector3d T = V_tangent_u.row(i).cast<double>();
             Eigen::Vector3d B = V_bitangent.row(i);
-            NV.row(i) = T.cross( B );
+            NV.row(i) = T.cross( B ).cast<MeshScalar>();
         }
 
     }else{
@@ -2445,28 +3193,39 @@ void Mesh::compute_tangents(const float tangent_length){
 
         Eigen::Matrix3d basis;
         basis.setIdentity();
-        int cur_template_idx=0;
-
-        for (int i = 0; i < NV.rows(); i++){
-            Eigen::Vector3d n = NV.row(i);
-
-            //if the normal and the vector we are going to do the cross product with are almost the same then we won't get a tangent
-            float diff=0.0;
-            float eps=0.001;
-            Eigen::Vector3d vec;
-            do {
-                vec = basis.col(cur_template_idx);
-                diff = (n-vec).norm();
+        const float eps=0.001;
+
+        //if the normal and the vector we are going to do the cross product with are almost the same then we won't get a tangent so we move to the next template vector and keep using it for the following normals.
+        //the template vector therefore depends on all the previous normals. Only a few normals are close to one of the axes so we find them in parallel and then do the cheap serial pass over which template is used for each vertex
+        std::vector<int8_t> close_to_axis(NV.rows(), -1);
+        #pragma omp parallel for
+        for (long long i = 0; i < NV.rows(); i++){
+            Eigen::Vector3d n = NV.row(i).cast<double>();
+            for(int axis=0; axis<3; axis++){
+                float diff = (n-basis.col(axis)).norm();
                 if(diff<eps){
-                    cur_template_idx +=1;
-                    cur_template_idx=cur_template_idx%3;
+                    close_to_axis[i]=axis;
                 }
-            } while (diff<eps);
+            }
+        }
+        std::vector<int8_t> template_idx(NV.rows());
+        int cur_template_idx=0;
+        for (long long i = 0; i < NV.rows(); i++){
+            if(close_to_axis[i]==cur_template_idx){
+                cur_template_idx=(cur_template_idx+1)%3;
+            }
+            template_idx[i]=cur_template_idx;
+        }
+
+        #pragma omp parallel for
+        for (long long i = 0; i < NV.rows(); i++){
+            Eigen::Vector3d n = NV.row(i).cast<double>();
+            Eigen::Vector3d vec = basis.col(template_idx[i]);
 
             //cross product to get the tangent
 
             Eigen::Vector3d tangent = n.cross(vec).normalized();
-            V_tangent_u.row(i) = tangent*tangent_length;
+            V_tangent_u.row(i) = (tangent*tangent_length).cast<MeshScalar>();
             V_length_v(i,0) = tangent_length;
             V_bitangent.row(i)=  n.cross(tangent).normalized();
         }
@@ -2487,7 +3246,7 @@ void Mesh::as_uv_mesh_paralel_to_axis(const int axis, const float size_modifier)
 
     CHECK(V.rows()==UV.rows()) << "Showing the UVs require to have the same number of uvs as vertices. V.rows is " << V.rows() << " UV.rows is " << UV.rows();
 
-    Eigen::MatrixXd new_V=V;
+    MeshMatrixX new_V=V;
     new_V.setZero();
     if(axis==0){ //we put it aligned to the X axis, so it will span in the  X-Z plane (the floor)
         new_V.col(0)=UV.col(0);
@@ -2510,6 +3269,7 @@ void Mesh::as_uv_mesh_paralel_to_axis(const int axis, const float size_modifier)
     V=new_V;
 
     m_is_dirty=true;
+    m_geometry_version++;
     m_is_shadowmap_dirty=true;
 
 
@@ -2545,8 +3305,8 @@ float Mesh::get_scale(){
     // max_point.resize(3);
     // min_point.setConstant(std::numeric_limits<float>::max());
     // max_point.setConstant(std::numeric_limits<float>::lowest());
-    Eigen::VectorXd min_point = V.colwise().minCoeff();
-    Eigen::VectorXd max_point = V.colwise().maxCoeff();
+    Eigen::VectorXd min_point = V.colwise().minCoeff().cast<double>();
+    Eigen::VectorXd max_point = V.colwise().maxCoeff().cast<double>();
 
     Eigen::VectorXd centroid = (0.5*(min_point + max_point)).eval();
 
@@ -2572,64 +3332,11 @@ void Mesh::color_solid2pervert(){
     C.resize(V.rows(),3);
 
     for(int i=0; i<V.rows(); i++){
-        C.row(i)=m_vis.m_solid_color.cast<double>();
+        C.row(i)=m_vis.m_solid_color.cast<MeshScalar>();
     }
 
 }
 
-void Mesh::estimate_normals_from_neighbourhood(const float radius){
-    #ifdef EASYPBR_WITH_PCL
-        CHECK(V.size()) << "We have no vertices";
-
-        //https://pointclouds.org/documentation/tutorials/normal_estimation.html
-        pcl::PointCloud<pcl::PointXYZ>::Ptr cloud (new pcl::PointCloud<pcl::PointXYZ>);
-
-    //   ... read, pass in or create a point cloud ...
-        for(int i=0; i<V.rows(); i++){
-            pcl::PointXYZ p;
-            p.x=V(i,0);
-            p.y=V(i,1);
-            p.z=V(i,2);
-            cloud->points.push_back(p);
-        }
-
-        // Create the normal estimation class, and pass the input dataset to it
-        pcl::NormalEstimation<pcl::PointXYZ, pcl::Normal> ne;
-        ne.setInputCloud (cloud);
-
-        // Create an empty kdtree representation, and pass it to the normal estimation object.
-        // Its content will be filled inside the object, based on the given input dataset (as no other search surface is given).
-        pcl::search::KdTree<pcl::PointXYZ>::Ptr tree (new pcl::search::KdTree<pcl::PointXYZ> ());
-        // pcl::KdTree<pcl::PointXYZ>::Ptr tree (new pcl::KdTree<pcl::PointXYZ> ());
-        ne.setSearchMethod (tree);
-
-        // Output datasets
-        pcl::PointCloud<pcl::Normal>::Ptr cloud_normals (new pcl::PointCloud<pcl::Normal>);
-
-        // Use all neighbors in a sphere of radius 3cm
-        ne.setRadiusSearch (radius);
-
-        // Compute the features
-        ne.compute (*cloud_normals);
-
-        NV.resize(cloud_normals->points.size(),3);
-        for(size_t i=0; i<cloud_normals->points.size(); i++){
-            pcl::Normal p=cloud_normals->points[i];
-            NV(i,0)=p.normal_x;
-            NV(i,1)=p.normal_y;
-            NV(i,2)=p.normal_z;
-            // p.x=V(i,0);
-            // p.y=V(i,1);
-            // p.z=V(i,2);
-            // cloud.push_back(p);
-        }
-
-
-    #else 
-        LOG(WARNING) << "estimate_normals_from_neighbourhood not available because easy_pbr was not compiled with PCL";
-    #endif
-}
-
 float Mesh::min_y(){
     return m_min_max_y_for_plotting(0);
 }
@@ -2638,108 +3345,323 @@ float Mesh::max_y(){
 }
 
 
-// std::vector<std::pair<long int,double> > Mesh::radius_search(const Eigen::Vector3d& query_point, const double radius){
-int Mesh::radius_search(const Eigen::Vector3d& query_point, const double radius){
-    //follows https://github.com/jlblancoc/nanoflann/blob/master/examples/matrix_example.cpp
-    // typedef nanoflann::KDTreeEigenMatrixAdaptor<Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic>> my_kd_tree_t;
-
-
-    // my_kd_tree_t mat_index(3, std::cref(V), 10 /* max leaf */);
-    // mat_index.index->buildIndex();
+//kd-tree over the vertices of a mesh. It reads the points directly from V so it has to be rebuilt whenever V is modified or reallocated
+//follows https://github.com/jlblancoc/nanoflann/blob/master/examples/pointcloud_adaptor_example.cpp
+class MeshKDTree{
+public:
+    typedef nanoflann::KDTreeSingleIndexAdaptor< nanoflann::L2_Simple_Adaptor<MeshScalar, MeshKDTree>, MeshKDTree, 3 > Index;
 
-    // std::vector<std::pair<long int,double> >   ret_matches;
-    // nanoflann::SearchParams params;
-    // //params.sorted = false;
+    MeshKDTree(const MeshMatrixX& points, const uint64_t geometry_version):
+        m_points(points),
+        m_data(points.data()),
+        m_rows(points.rows()),
+        m_geometry_version(geometry_version)
+        {
+        m_index.reset( new Index(3, *this, nanoflann::KDTreeSingleIndexAdaptorParams(10 /* max leaf */) ) );
+        m_index->buildIndex();
+    }
 
-    // std::vector<double> query_pt(3);
+    //a copied mesh shares the shared_ptr to the tree of the original one so we also check that it's the same matrix. Checking the pointer catches a V that was reassigned without bumping the version
+    bool is_valid_for(const MeshMatrixX& points, const uint64_t geometry_version) const{
+        return &points==&m_points && points.data()==m_data && points.rows()==m_rows && geometry_version==m_geometry_version;
+    }
 
-    // const size_t nr_matches = mat_index.index->radiusSearch(query_point.data(), radius, ret_matches, params);
+    //neighbours of a single point sorted by distance. They are pairs of (index, squared distance)
+    void radius_search(const MeshScalar* query_pt, const double radius, const int max_nr_neighbours, std::vector<std::pair<size_t,MeshScalar> >& neighbours) const{
+        const MeshScalar radius_sq=radius*radius; //nanoflann works with squared distances for L2
+        m_index->radiusSearch(query_pt, radius_sq, neighbours, nanoflann::SearchParams());
+        if(max_nr_neighbours>0 && (int)neighbours.size()>max_nr_neighbours){
+            neighbours.resize(max_nr_neighbours);
+        }
+    }
 
-    // VLOG(1)<< "Found nr of matches: " << nr_matches;
+    void knn(const MeshScalar* query_pt, const int k, std::vector<std::pair<size_t,MeshScalar> >& neighbours) const{
+        std::vector<size_t> ret_indexes(k);
+        std::vector<MeshScalar> out_dists_sqr(k);
+        nanoflann::KNNResultSet<MeshScalar> result_set(k);
+        result_set.init(&ret_indexes[0], &out_dists_sqr[0]);
+        m_index->findNeighbors(result_set, query_pt, nanoflann::SearchParams(10));
+        neighbours.resize(result_set.size());
+        for(size_t j=0; j<neighbours.size(); j++){
+            neighbours[j]=std::make_pair(ret_indexes[j], out_dists_sqr[j]);
+        }
+    }
 
+    //runs the query for each row of query_points in parallel and returns the matrices of indices and euclidean distances, padded with -1 and infinity
+    std::pair<Eigen::MatrixXi, Eigen::MatrixXd> batch_query(const Eigen::MatrixXd& query_points, const double radius, const int max_nr_neighbours, const bool pad_to_max) const{
+        CHECK(query_points.cols()==3) << "The query points should be Nx3 but they are " << query_points.rows() << "x" << query_points.cols();
+        std::vector< std::vector<std::pair<size_t,MeshScalar> > > neighbours(query_points.rows());
+        #pragma omp parallel for schedule(dynamic, 64)
+        for(long long i=0; i<query_points.rows(); i++){
+            const MeshScalar query_pt[3]={ (MeshScalar)query_points(i,0), (MeshScalar)query_points(i,1), (MeshScalar)query_points(i,2) };
+            if(radius>0){
+                radius_search(query_pt, radius, max_nr_neighbours, neighbours[i]);
+            }else{
+                knn(query_pt, max_nr_neighbours, neighbours[i]);
+            }
+        }
 
+        size_t nr_cols= pad_to_max? max_nr_neighbours : 0;
+        for(size_t i=0; i<neighbours.size(); i++){
+            nr_cols=std::max(nr_cols, neighbours[i].size());
+        }
 
+        Eigen::MatrixXi indices;
+        Eigen::MatrixXd dists;
+        indices.setConstant(query_points.rows(), nr_cols, -1);
+        dists.setConstant(query_points.rows(), nr_cols, std::numeric_limits<double>::infinity());
+        #pragma omp parallel for
+        for(long long i=0; i<query_points.rows(); i++){
+            for(size_t j=0; j<neighbours[i].size(); j++){
+                indices(i,j)=neighbours[i][j].first;
+                dists(i,j)=std::sqrt((double)neighbours[i][j].second);
+            }
+        }
+        return std::make_pair(indices, dists);
+    }
 
+    inline size_t kdtree_get_point_count() const { return m_points.rows(); }
+    inline MeshScalar kdtree_get_pt(const size_t idx, const size_t dim) const { return m_points(idx,dim); }
+    template <class BBOX> bool kdtree_get_bbox(BBOX& /*bb*/) const { return false; }
+
+private:
+    const MeshMatrixX& m_points;
+    const MeshScalar* m_data;
+    Eigen::Index m_rows;
+    uint64_t m_geometry_version;
+    std::unique_ptr<Index> m_index;
+};
+
+std::shared_ptr<MeshKDTree> Mesh::kdtree(){
+    CHECK(V.rows()) << named("Cannot search for neighbours in a mesh without vertices");
+    CHECK(V.cols()==3) << named("Neighbour queries need V to be Nx3 but it is ") << V.rows() << "x" << V.cols();
+    std::lock_guard<std::mutex> lock(m_accel_mutex.mutex);
+    const uint64_t geometry_version=m_geometry_version; //read once, the render thread may bump it meanwhile and the tree should remember the version it was checked against
+    if(!m_kdtree || !m_kdtree->is_valid_for(V, geometry_version)){
+        m_kdtree=std::make_shared<MeshKDTree>(V, geometry_version); //we make a new one instead of rebuilding the old one because copies of this mesh and queries running in other threads may still hold it
+    }
+    return m_kdtree;
+}
 
-    //brute force
-    int nr_matches_brute=0;
-    for(int i=0; i<V.rows(); i++){
-        Eigen::Vector3d p = Eigen::Vector3d(V.row(i));
-        double dist = (p-query_point).norm();
-        if(dist<radius){
-            nr_matches_brute++;
-        }
+//AABB tree over the faces of a mesh for closest point queries. Like the kd-tree it's kept until V or F change. The tree only stores the boxes and gets V and F again for each query
+class MeshAABB{
+public:
+    MeshAABB(const MeshMatrixX& V, const Eigen::MatrixXi& F, const uint64_t geometry_version):
+        m_V_data(V.data()),
+        m_V_rows(V.rows()),
+        m_F_data(F.data()),
+        m_F_rows(F.rows()),
+        m_geometry_version(geometry_version)
+        {
+        m_tree.init(V,F);
     }
-    // VLOG(1)<< "Found nr of matches brute: " << nr_matches_brute;
 
+    bool is_valid_for(const MeshMatrixX& V, const Eigen::MatrixXi& F, const uint64_t geometry_version) const{
+        return V.data()==m_V_data && V.rows()==m_V_rows && F.data()==m_F_data && F.rows()==m_F_rows && geometry_version==m_geometry_version;
+    }
 
+    igl::AABB<MeshMatrixX,3> m_tree;
+
+private:
+    const MeshScalar* m_V_data;
+    Eigen::Index m_V_rows;
+    const int* m_F_data;
+    Eigen::Index m_F_rows;
+    uint64_t m_geometry_version;
+};
+
+std::shared_ptr<MeshAABB> Mesh::aabb(){
+    CHECK(V.rows()) << named("Cannot search for closest points in a mesh without vertices");
+    CHECK(F.cols()==3) << named("Closest point queries need triangles but F has ") << F.cols() << " columns";
+    std::lock_guard<std::mutex> lock(m_accel_mutex.mutex);
+    const uint64_t geometry_version=m_geometry_version; //read once like in kdtree()
+    if(!m_aabb || !m_aabb->is_valid_for(V, F, geometry_version)){
+        m_aabb=std::make_shared<MeshAABB>(V, F, geometry_version);
+    }
+    return m_aabb;
+}
 
+int Mesh::radius_search(const Eigen::Vector3d& query_point, const double radius){
+    const MeshScalar query_pt[3]={ (MeshScalar)query_point.x(), (MeshScalar)query_point.y(), (MeshScalar)query_point.z() };
+    std::vector<std::pair<size_t,MeshScalar> > neighbours;
+    kdtree()->radius_search(query_pt, radius, -1, neighbours);
+    return neighbours.size();
+}
 
-    return nr_matches_brute;
+std::pair<Eigen::MatrixXi, Eigen::MatrixXd> Mesh::radius_search(const Eigen::MatrixXd& query_points, const double radius, const int max_nr_neighbours){
+    CHECK(radius>0) << named("The radius should be positive but it is ") << radius;
+    return kdtree()->batch_query(query_points, radius, max_nr_neighbours, /*pad_to_max*/ false);
+}
 
-    // return ret_matches;
+std::pair<Eigen::MatrixXi, Eigen::MatrixXd> Mesh::knn(const Eigen::MatrixXd& query_points, const int k){
+    CHECK(k>0) << named("k should be positive but it is ") << k;
+    return kdtree()->batch_query(query_points, /*radius*/ -1, k, /*pad_to_max*/ true);
 }
 
 //similar to https://pytorch3d.readthedocs.io/en/latest/modules/ops.html
-//based on https://github.com/jlblancoc/nanoflann/blob/master/examples/pointcloud_kdd_radius.cpp
-//based also on https://github.com/jlblancoc/nanoflann/blob/master/examples/matrix_example.cpp
-void Mesh::ball_query(const Eigen::MatrixXd& query_points, const Eigen::MatrixXd& target_points, const float search_radius){
-
-    LOG(FATAL) << "not finished";
+std::pair<Eigen::MatrixXi, Eigen::MatrixXd> Mesh::ball_query(const Eigen::MatrixXd& query_points, const double radius, const int max_nr_neighbours){
+    CHECK(radius>0) << named("The radius should be positive but it is ") << radius;
+    CHECK(max_nr_neighbours>0) << named("max_nr_neighbours should be positive but it is ") << max_nr_neighbours;
+    return kdtree()->batch_query(query_points, radius, max_nr_neighbours, /*pad_to_max*/ true);
+}
 
+//normal of a set of points as the direction of least variance, flipped to point towards the viewpoint. Returns zero if there are not enough points
+template <class Points>
+static Eigen::Vector3d pca_normal(const Points& points, const std::vector<size_t>& neighbours, const Eigen::Vector3d& point, const Eigen::Vector3d& viewpoint){
+    if(neighbours.size()<3){
+        return Eigen::Vector3d::Zero();
+    }
+    Eigen::Vector3d mean=Eigen::Vector3d::Zero();
+    for(size_t j=0; j<neighbours.size(); j++){
+        mean+=points.row(neighbours[j]).transpose().template cast<double>();
+    }
+    mean/=neighbours.size();
+    Eigen::Matrix3d cov=Eigen::Matrix3d::Zero();
+    for(size_t j=0; j<neighbours.size(); j++){
+        Eigen::Vector3d d=points.row(neighbours[j]).transpose().template cast<double>() - mean;
+        cov.noalias()+=d*d.transpose();
+    }
+    Eigen::SelfAdjointEigenSolver<Eigen::Matrix3d> solver;
+    solver.computeDirect(cov);
+    Eigen::Vector3d normal=solver.eigenvectors().col(0); //eigenvalues are sorted in increasing order
+    if(normal.dot(viewpoint-point)<0){
+        normal=-normal;
+    }
+    return normal;
+}
 
+void Mesh::estimate_normals_from_neighbourhood(const float radius, const int max_nr_neighbours, const bool orient_towards_cur_pose){
+    CHECK(V.size()) << named("We have no vertices");
+    CHECK(radius>0 || max_nr_neighbours>0) << named("We need either a radius or a nr of neighbours to estimate the normals but got radius ") << radius << " and max_nr_neighbours " << max_nr_neighbours;
 
+    const Eigen::Vector3d viewpoint= orient_towards_cur_pose? Eigen::Vector3d(m_cur_pose.translation()) : Eigen::Vector3d::Zero();
+    const double radius_sq=radius*radius;
+    auto is_valid=[&](const long long idx){
+        return !V.row(idx).isZero() && V.row(idx).allFinite(); //organized clouds mark missing points with zero or nan
+    };
 
-    typedef nanoflann::KDTreeEigenMatrixAdaptor<Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic>>
-      my_kd_tree_t;
-    my_kd_tree_t mat_index(3, std::cref(target_points), 10 /* max leaf */);
-    mat_index.index->buildIndex();
+    Eigen::MatrixXd normals(V.rows(),3);
+    normals.setZero();
 
+    if(m_width>0 && m_height>0 && (long long)m_width*m_height==V.rows()){
+        //organized cloud, the neighbours are the valid pixels in a window around each point. This avoids building a tree and is much faster but it's only correct as long as the window covers the neighbourhood we want
+        const int half_window= max_nr_neighbours>0? std::max(1, (int)std::ceil( (std::sqrt((double)max_nr_neighbours)-1)/2 ) ) : 2;
+        #pragma omp parallel for schedule(dynamic, 256)
+        for(long long idx=0; idx<V.rows(); idx++){
+            if(!is_valid(idx)){
+                continue;
+            }
+            const int y=idx/m_width;
+            const int x=idx%m_width;
+            const Eigen::Vector3d point=V.row(idx).transpose().cast<double>();
+            std::vector<size_t> neighbours;
+            neighbours.reserve( (2*half_window+1)*(2*half_window+1) );
+            for(int ny=std::max(0,y-half_window); ny<=std::min(m_height-1,y+half_window); ny++){
+                for(int nx=std::max(0,x-half_window); nx<=std::min(m_width-1,x+half_window); nx++){
+                    const long long nidx=(long long)ny*m_width+nx;
+                    if(!is_valid(nidx)){
+                        continue;
+                    }
+                    if(radius>0 && (V.row(nidx).transpose().cast<double>()-point).squaredNorm()>=radius_sq){
+                        continue;
+                    }
+                    neighbours.push_back(nidx);
+                }
+            }
+            normals.row(idx)=pca_normal(V, neighbours, point, viewpoint);
+        }
+    }else{
+        //missing points (zero or nan) would show up as neighbours of the real points close to the origin and nan also breaks the splits of the tree, so if there are any the tree is built only over the valid points and is not kept since it doesn't cover all of V
+        std::vector<long long> valid_idxs;
+        valid_idxs.reserve(V.rows());
+        for(long long idx=0; idx<V.rows(); idx++){
+            if(is_valid(idx)){
+                valid_idxs.push_back(idx);
+            }
+        }
+        MeshMatrixX valid_points;
+        const MeshMatrixX* points=&V;
+        std::shared_ptr<MeshKDTree> tree;
+        if((long long)valid_idxs.size()==V.rows()){
+            tree=kdtree();
+        }else if(!valid_idxs.empty()){
+            valid_points.resize(valid_idxs.size(),3);
+            for(size_t i=0; i<valid_idxs.size(); i++){
+                valid_points.row(i)=V.row(valid_idxs[i]);
+            }
+            points=&valid_points;
+            tree=std::make_shared<MeshKDTree>(valid_points, /*geometry_version*/ 0);
+        }
 
-    const size_t num_results = 3;
-    //initialize a big matrix containing for each query point, the indices of the points in the ball
-    Eigen::MatrixXi full_indices;
-    //initialize a big matrix containing for each query point, the distance towards the points in the ball
-    Eigen::MatrixXd full_dists;
+        #pragma omp parallel for schedule(dynamic, 256)
+        for(long long i=0; i<(long long)valid_idxs.size(); i++){
+            const Eigen::Vector3d point=points->row(i).transpose().cast<double>();
+            const MeshScalar query_pt[3]={ (*points)(i,0), (*points)(i,1), (*points)(i,2) };
+            std::vector<std::pair<size_t,MeshScalar> > neighbours_dists;
+            if(radius>0){
+                tree->radius_search(query_pt, radius, max_nr_neighbours, neighbours_dists);
+            }else{
+                tree->knn(query_pt, max_nr_neighbours, neighbours_dists);
+            }
+            std::vector<size_t> neighbours(neighbours_dists.size());
+            for(size_t j=0; j<neighbours_dists.size(); j++){
+                neighbours[j]=neighbours_dists[j].first;
+            }
+            normals.row(valid_idxs[i])=pca_normal(*points, neighbours, point, viewpoint);
+        }
+    }
 
+    NV=normals.cast<MeshScalar>();
+    set_dirty(MeshAttribute::NV);
+    m_is_shadowmap_dirty=true;
+}
 
-    // do a knn search
-    for (int i=0; i<query_points.rows(); i++){
-        //initialize the returned values from the knn
-        std::vector<size_t> ret_indexes(num_results);
-        std::vector<double> out_dists_sqr(num_results);
-        nanoflann::KNNResultSet<double> resultSet(num_results);
-        resultSet.init(&ret_indexes[0], &out_dists_sqr[0]);
+std::tuple<Eigen::VectorXd, Eigen::MatrixXd, Eigen::VectorXi> Mesh::closest_points(const Eigen::MatrixXd& query_points){
+    CHECK(query_points.cols()==3) << named("The query points should be Nx3 but they are ") << query_points.rows() << "x" << query_points.cols();
 
+    Eigen::VectorXd dists(query_points.rows());
+    Eigen::MatrixXd points(query_points.rows(), 3);
+    Eigen::VectorXi ids(query_points.rows());
 
-        std::vector<double> query_pt(3);
-        query_pt[0]=query_points(i,0);
-        query_pt[1]=query_points(i,1);
-        query_pt[2]=query_points(i,2);
-        mat_index.index->findNeighbors(resultSet, &query_pt[0], nanoflann::SearchParams(10));
+    if(F.size()){
+        std::shared_ptr<MeshAABB> tree=aabb();
+        #pragma omp parallel for schedule(dynamic, 256)
+        for(long long i=0; i<query_points.rows(); i++){
+            const Eigen::Matrix<MeshScalar,1,3> query=query_points.row(i).cast<MeshScalar>();
+            Eigen::Matrix<MeshScalar,1,3> closest;
+            int face_idx=-1;
+            const double dist_sq=tree->m_tree.squared_distance(V, F, query, face_idx, closest);
+            dists(i)=std::sqrt(dist_sq);
+            points.row(i)=closest.cast<double>();
+            ids(i)=face_idx;
+        }
+    }else{
+        //only points so we just need the closest vertex
+        std::shared_ptr<MeshKDTree> tree=kdtree();
+        #pragma omp parallel for schedule(dynamic, 256)
+        for(long long i=0; i<query_points.rows(); i++){
+            const MeshScalar query_pt[3]={ (MeshScalar)query_points(i,0), (MeshScalar)query_points(i,1), (MeshScalar)query_points(i,2) };
+            std::vector<std::pair<size_t,MeshScalar> > neighbours;
+            tree->knn(query_pt, 1, neighbours);
+            const int vertex_idx=neighbours[0].first;
+            dists(i)=std::sqrt((double)neighbours[0].second);
+            points.row(i)=V.row(vertex_idx).cast<double>();
+            ids(i)=vertex_idx;
+        }
     }
 
-
+    return std::make_tuple(dists, points, ids);
 }
 
-Eigen::MatrixXd Mesh::compute_distance_to_mesh(const MeshSharedPtr& target_mesh){
-    //we use the point_mesh_squared_distance.h
-    //it computes the distances to a mesh, so if the target mesh doesnt have F then we make F for each vertex, a degenerate triangle with [0,0,0]
-    Eigen::MatrixXi F=target_mesh->F;
-    if (!F.size()){
-        F.resize(target_mesh->V.rows(),3);
-        for(int i=0; i<target_mesh->V.rows(); i++){
-            F.row(i) << i,i,i;
-        }
-    }
-
-    //compute the distance
-    Eigen::MatrixXi indices_closest;
+MeshMatrixX Mesh::compute_distance_to_mesh(const MeshSharedPtr& target_mesh){
+    //the target keeps the tree it builds so comparing many clouds against the same target only builds it once
+    Eigen::VectorXd dists;
     Eigen::MatrixXd closest_points;
-    igl::point_mesh_squared_distance(
-        V, target_mesh->V, F,
-        D, indices_closest, closest_points
-    );
+    Eigen::VectorXi closest_ids;
+    std::tie(dists, closest_points, closest_ids)=target_mesh->closest_points(V.cast<double>());
+
+    D=dists.array().square().matrix().cast<MeshScalar>(); //it always returned the squared distance as igl::point_mesh_squared_distance did
+    set_dirty(MeshAttribute::D);
 
     return D;
 }
@@ -2865,6 +3787,77 @@ bool Mesh::is_any_texture_dirty(){
 
 }
 
+void Mesh::set_dirty(const MeshAttribute attrib){
+    DirtyRows& dirty=m_dirty_attribs[attrib._to_integral()];
+    dirty.is_dirty=true;
+    dirty.row_start=0;
+    dirty.row_end=0;
+    if(attrib==+MeshAttribute::V || attrib==+MeshAttribute::F){
+        m_geometry_version++;
+    }
+}
+
+void Mesh::set_dirty(const std::string attrib_name){
+    set_dirty( MeshAttribute::_from_string(attrib_name.c_str()) );
+}
+
+void Mesh::set_dirty_rows(const MeshAttribute attrib, const int row_start, const int nr_rows){
+    CHECK(row_start>=0) << "row_start should be positive but it is " << row_start;
+    CHECK(nr_rows>=0) << "nr_rows should be positive but it is " << nr_rows;
+    if(nr_rows==0){
+        return; //nothing changed, this way callers streaming in batches don't need to check for empty ones
+    }
+
+    if(attrib==+MeshAttribute::V || attrib==+MeshAttribute::F){
+        m_geometry_version++;
+    }
+
+    DirtyRows& dirty=m_dirty_attribs[attrib._to_integral()];
+    if(dirty.is_dirty && dirty.is_whole()){
+        return; //the whole matrix is already going to be uploaded
+    }
+    if(!dirty.is_dirty){
+        dirty.is_dirty=true;
+        dirty.row_start=row_start;
+        dirty.row_end=row_start+nr_rows;
+    }else{
+        dirty.row_start=std::min(dirty.row_start, row_start);
+        dirty.row_end=std::max(dirty.row_end, row_start+nr_rows);
+    }
+}
+
+void Mesh::set_dirty_rows(const std::string attrib_name, const int row_start, const int nr_rows){
+    set_dirty_rows( MeshAttribute::_from_string(attrib_name.c_str()), row_start, nr_rows );
+}
+
+bool Mesh::is_dirty(const MeshAttribute attrib) const{
+    return m_is_dirty || m_dirty_attribs[attrib._to_integral()].is_dirty;
+}
+
+bool Mesh::is_any_attribute_dirty() const{
+    for(size_t i=0; i<m_dirty_attribs.size(); i++){
+        if(m_dirty_attribs[i].is_dirty){
+            return true;
+        }
+    }
+    return false;
+}
+
+const DirtyRows& Mesh::dirty_rows(const MeshAttribute attrib) const{
+    return m_dirty_attribs[attrib._to_integral()];
+}
+
+void Mesh::clear_dirty(){
+    //code that predates the per attribute flags only sets m_is_dirty after changing V, so we take the upload as the point where the geometry may have changed
+    if(m_is_dirty){
+        m_geometry_version++;
+    }
+    m_is_dirty=false;
+    for(size_t i=0; i<m_dirty_attribs.size(); i++){
+        m_dirty_attribs[i]=DirtyRows();
+    }
+}
+
 
 
 
@@ -2884,10 +3877,86 @@ bool Mesh::is_any_texture_dirty(){
 // void MeshCore::read_ply(const std::string file_path, std::initializer_list<std::pair<std::reference_wrapper<Eigen::MatrixXd>, std::initializer_list<std::string> >> matrix2properties_list){
 void Mesh::read_ply(const std::string file_path){
 
+    //we memory map the file and read the properties directly from it into the matrices, without going through the intermediate buffers of tinyply
+    MappedFile file(file_path);
+    PlyHeader header=parse_ply_header(file.data(), file.size());
+    if(!header.is_binary()){
+        read_ply_tinyply(file_path); //ascii files are usually small so tinyply is fast enough for them
+        return;
+    }
+    const bool swap_endian=header.needs_swap();
+    const char* data_end=file.data()+file.size();
+    std::vector<size_t> elem_offsets=ply_element_offsets(header, file.data(), file.size());
+
+    //vertices
+    int vertex_elem_idx=header.element_idx("vertex");
+    CHECK_FILE(vertex_elem_idx!=-1) << "The ply file has no vertex element: " << file_path;
+    const PlyElement& vertex_elem=header.elements[vertex_elem_idx];
+    CHECK_FILE(!vertex_elem.has_list) << "We do not support vertices with list properties: " << file_path;
+    const char* vertex_start=file.data()+elem_offsets[vertex_elem_idx];
+    const size_t nr_verts=vertex_elem.count;
+    CHECK_FILE(vertex_start+nr_verts*vertex_elem.stride<=data_end) << "The ply file is truncated, it has less vertices than declared in the header: " << file_path;
+
+    //resolve once from the header which property goes into which column of which matrix
+    std::vector<ColumnCopy> copies;
+    auto request_columns=[&](auto& mat, const std::vector< std::vector<std::string> >& names_per_col, const bool normalize){
+        std::vector<int> prop_idxs;
+        for(size_t c=0; c<names_per_col.size(); c++){
+            int idx=vertex_elem.property_idx(names_per_col[c]);
+            if(idx==-1){
+                return false;
+            }
+            prop_idxs.push_back(idx);
+        }
+        mat.resize(nr_verts, names_per_col.size());
+        for(size_t c=0; c<prop_idxs.size(); c++){
+            const PlyProperty& prop=vertex_elem.properties[prop_idxs[c]];
+            ColumnCopy copy;
+            set_column_destination(copy, mat, c);
+            copy.src_offset=prop.offset;
+            copy.type=prop.type;
+            copy.scale= normalize? 1.0/scalar_type_max(prop.type) : 1.0; //colors stored as uchar get mapped to [0,1]
+            copies.push_back(copy);
+        }
+        return true;
+    };
+    bool has_vertices=request_columns(V, { {"x"}, {"y"}, {"z"} }, false);
+    CHECK_FILE(has_vertices) << "The ply file has no x,y,z properties for the vertices: " << file_path;
+    request_columns(NV, { {"nx"}, {"ny"}, {"nz"} }, false);
+    request_columns(UV, { {"u","s","texture_u"}, {"v","t","texture_v"} }, false);
+    bool has_color=request_columns(C, { {"red","r"}, {"green","g"}, {"blue","b"} }, true);
+    request_columns(I, { {"intensity","scalar_intensity"} }, false);
+
+    //one strided pass over the vertices that fills all the matrices at the same time
+    copy_strided_columns(vertex_start, nr_verts, vertex_elem.stride, copies, swap_endian);
+
+    //faces
+    bool has_faces=false;
+    int face_elem_idx=header.element_idx("face");
+    if(face_elem_idx!=-1 && header.elements[face_elem_idx].count!=0){
+        const PlyElement& face_elem=header.elements[face_elem_idx];
+        int list_idx=face_elem.property_idx( std::vector<std::string>{"vertex_indices","vertex_index"} );
+        CHECK_FILE(list_idx!=-1) << "The faces of the ply file have no vertex_indices property: " << file_path;
+        F=read_ply_faces(header, face_elem, list_idx, file.data()+elem_offsets[face_elem_idx], data_end);
+        has_faces=true;
+    }
+
+    //set some sensible visualization values
+    if (!has_faces){
+        m_vis.m_show_mesh=false;
+    }
+    if(has_color){
+        m_vis.set_color_pervertcolor();
+    }
+
+}
+
+void Mesh::read_ply_tinyply(const std::string file_path){
+
 
     //open file
     std::ifstream ss(file_path, std::ios::binary);
-    CHECK(ss.is_open()) << "Failed to open " << file_path;
+    CHECK_FILE(ss.is_open()) << "Failed to open " << file_path;
     tinyply::PlyFile file;
     file.parse_header(ss);
 
@@ -2899,7 +3968,7 @@ void Mesh::read_ply(const std::string file_path){
     // known to exist in the header prior to reading the data. For brevity of this sample, properties
     // like vertex position are hard-coded:
     try { vertices = file.request_properties_from_element("vertex", { "x", "y", "z" }, 3); }
-    catch (const std::exception & e) { LOG(FATAL) <<  e.what();  }
+    catch (const std::exception & e) { throw MeshIOError(std::string(e.what())+" in "+file_path); }
 
     bool has_vertex_normals=true;
     try { normals = file.request_properties_from_element("vertex", { "nx", "ny", "nz" }, 3); }
@@ -2951,39 +4020,39 @@ void Mesh::read_ply(const std::string file_path){
     //vertices
     if (vertices->t == tinyply::Type::FLOAT32) {
         Eigen::Map<RowMatrixXf> mf( (float*)vertices->buffer.get(), vertices->count, 3);
-        V=mf.cast<double>();
+        V=mf.cast<MeshScalar>();
     }else if(vertices->t == tinyply::Type::FLOAT64){
         Eigen::Map<RowMatrixXd> mf( (double*)vertices->buffer.get(), vertices->count, 3);
-        V=mf.cast<double>();
-    }else{ LOG(FATAL) <<" vertex parsing other than float and double not implemented yet"; }
+        V=mf.cast<MeshScalar>();
+    }else{ throw MeshIOError("vertex parsing other than float and double not implemented yet"); }
     //normals
     if (has_vertex_normals) {
         if (normals->t == tinyply::Type::FLOAT32) {
             Eigen::Map<RowMatrixXf> mf( (float*)normals->buffer.get(), normals->count, 3);
-            NV=mf.cast<double>();
+            NV=mf.cast<MeshScalar>();
         }else if(normals->t == tinyply::Type::FLOAT64){
             Eigen::Map<RowMatrixXd> mf( (double*)normals->buffer.get(), vertices->count, 3);
-            NV=mf.cast<double>();
-        }else{ LOG(FATAL) <<"normals parsing other than float not implemented yet"; }
+            NV=mf.cast<MeshScalar>();
+        }else{ throw MeshIOError("normals parsing other than float not implemented yet"); }
     }
     // texcoords
     if (has_texcoords){
         if (texcoords->t == tinyply::Type::FLOAT32) {
             Eigen::Map<RowMatrixXf> mf( (float*)texcoords->buffer.get(), texcoords->count, 2);
-            UV=mf.cast<double>();
-        }else{ LOG(FATAL) <<"texcoords parsing other than float not implemented yet"; }
+            UV=mf.cast<MeshScalar>();
+        }else{ throw MeshIOError("texcoords parsing other than float not implemented yet"); }
     }
     //color
     if (has_color){
         if (color->t == tinyply::Type::UINT8) {
             Eigen::Map<RowMatrixXuc> mf( (unsigned char*)color->buffer.get(), color->count, 3);
-            C=mf.cast<double>();
+            C=mf.cast<MeshScalar>();
             C=C.array()/255.0;
             // C=C.array();
         }else if (color->t == tinyply::Type::FLOAT32) {
             Eigen::Map<RowMatrixXf> mf( (float*)color->buffer.get(), color->count, 3);
-            C=mf.cast<double>();
-        }else{ LOG(FATAL) <<"color parsing other than unsigned char and float not implemented yet"; }
+            C=mf.cast<MeshScalar>();
+        }else{ throw MeshIOError("color parsing other than unsigned char and float not implemented yet"); }
     }
     //faces
     if (has_faces){
@@ -2993,7 +4062,7 @@ void Mesh::read_ply(const std::string file_path){
         }else if (faces->t == tinyply::Type::UINT32) {
             Eigen::Map<RowMatrixXi> mf( (unsigned int*)faces->buffer.get(), faces->count, 3);
             F=mf.cast<int>();
-        }else{ LOG(FATAL) <<"We assume that the faces are integers or unsigned integers but for some reason they are not"; }
+        }else{ throw MeshIOError("We assume that the faces are integers or unsigned integers but for some reason they are not"); }
     }
 
     //set some sensible visualization values
@@ -3069,153 +4138,286 @@ void Mesh::write_ply(const std::string file_path){
     ply_file.write(outstream_binary, true);
 }
 
-void Mesh::read_obj(const std::string file_path,  bool load_vti, bool load_vni){
-
-    struct Vertex{
-        Eigen::Vector3d pos=Eigen::Vector3d::Zero();
-        Eigen::Vector3d normal=Eigen::Vector3d::Zero();
-        Eigen::Vector2d tex_coord=Eigen::Vector2d::Zero();
-        Eigen::Vector3d color=Eigen::Vector3d::Zero();
-        bool operator==(const Vertex& other) const {
-            return pos == other.pos && normal==other.normal && tex_coord == other.tex_coord && color == other.color ;
-        }
+void Mesh::read_pcd(const std::string file_path){
+    MappedFile file(file_path);
+    PcdHeader header=parse_pcd_header(file.data(), file.size());
+    PcdData data=read_pcd_data(header, file.data(), file.size());
+    const long long nr_points=header.nr_points;
+
+    //decide for every field where it goes. Everything gets copied in one parallel pass over the points afterwards
+    struct FieldCopy{
+        int field_idx;
+        int component;
+        double* dst;
+        int* dst_int;
+        double scale;
+        float* dst_float;
+        size_t dst_stride;
     };
-    //has function for vertex
-    struct HashVertex{
-        std::size_t operator()(Vertex const& vertex) const noexcept{
-            return ((MatrixHash<Eigen::Vector3d>{}(vertex.pos) ^
-                   (MatrixHash<Eigen::Vector3d>{}(vertex.normal) << 1)) >> 1) ^
-                   (MatrixHash<Eigen::Vector2d>{}(vertex.tex_coord) << 1);
+    std::vector<FieldCopy> copies;
+    auto request_columns=[&](const std::vector<std::string>& names, auto& mat){
+        std::vector<int> idxs;
+        for(size_t i=0; i<names.size(); i++){
+            int idx=header.field_idx(names[i]);
+            if(idx==-1){
+                return false;
+            }
+            idxs.push_back(idx);
+        }
+        mat.resize(nr_points, names.size());
+        for(size_t i=0; i<idxs.size(); i++){
+            typedef typename std::decay<decltype(mat)>::type::Scalar Scalar;
+            FieldCopy copy{idxs[i], 0, nullptr, nullptr, 1.0, nullptr, (size_t)mat.col(i).innerStride()};
+            if constexpr (std::is_same<Scalar, int>::value){
+                copy.dst_int=mat.col(i).data();
+            }else if constexpr (std::is_same<Scalar, float>::value){
+                copy.dst_float=mat.col(i).data();
+            }else{
+                copy.dst=mat.col(i).data();
+            }
+            copies.push_back(copy);
         }
+        return true;
     };
+    request_columns({"x","y","z"}, V);
+    CHECK_FILE(V.rows()==nr_points) << "The pcd file " << file_path << " has no x, y and z fields";
+    request_columns({"normal_x","normal_y","normal_z"}, NV);
+    request_columns({"intensity"}, I);
+    request_columns({"label"}, L_gt);
+
+    //color is usually packed as the bytes of one float or uint field, but some writers use one field per channel
+    int packed_rgb_idx=header.field_idx("rgb");
+    if(packed_rgb_idx==-1){
+        packed_rgb_idx=header.field_idx("rgba");
+    }
+    if(packed_rgb_idx!=-1){
+        C.resize(nr_points, 3);
+    }else if(request_columns({"r","g","b"}, C)){
+        for(size_t i=copies.size()-3; i<copies.size(); i++){
+            copies[i].scale=1.0/scalar_type_max(header.fields[copies[i].field_idx].type);
+        }
+    }
 
+    //the rest of the fields are kept as extra fields of the mesh with a column per component
+    const std::vector<std::string> known_fields={"x","y","z","normal_x","normal_y","normal_z","intensity","label","rgb","rgba","r","g","b","_"};
+    std::vector<std::pair<std::string,Eigen::MatrixXd>> other_fields;
+    for(size_t f=0; f<header.fields.size(); f++){
+        if(std::find(known_fields.begin(), known_fields.end(), header.fields[f].name)!=known_fields.end()){
+            continue;
+        }
+        other_fields.push_back( std::make_pair(header.fields[f].name, Eigen::MatrixXd(nr_points, header.fields[f].count)) );
+    }
+    for(size_t i=0; i<other_fields.size(); i++){
+        int idx=header.field_idx(other_fields[i].first);
+        for(int c=0; c<other_fields[i].second.cols(); c++){
+            copies.push_back( {idx, c, other_fields[i].second.col(c).data(), nullptr, 1.0, nullptr, 1} );
+        }
+    }
 
+    const Eigen::Affine3d viewpoint=header.viewpoint;
+    const bool transform_points=!viewpoint.matrix().isIdentity();
+    #pragma omp parallel for schedule(static)
+    for(long long i=0; i<nr_points; i++){
+        for(size_t c=0; c<copies.size(); c++){
+            const FieldCopy& copy=copies[c];
+            const PcdField& field=header.fields[copy.field_idx];
+            const char* ptr=data.field_ptr(copy.field_idx, i)+copy.component*scalar_type_size(field.type);
+            if(copy.dst_int){
+                copy.dst_int[i*copy.dst_stride]=read_scalar<int>(ptr, field.type);
+            }else if(copy.dst_float){
+                copy.dst_float[i*copy.dst_stride]=read_scalar<double>(ptr, field.type)*copy.scale;
+            }else{
+                copy.dst[i*copy.dst_stride]=read_scalar<double>(ptr, field.type)*copy.scale;
+            }
+        }
+        if(packed_rgb_idx!=-1){
+            uint32_t rgb;
+            std::memcpy(&rgb, data.field_ptr(packed_rgb_idx, i), sizeof(rgb));
+            C(i,0)=((rgb>>16)&0xff)/255.0;
+            C(i,1)=((rgb>>8)&0xff)/255.0;
+            C(i,2)=(rgb&0xff)/255.0;
+        }
+        if(transform_points){
+            V.row(i)=(viewpoint*Eigen::Vector3d(V.row(i).transpose().cast<double>())).cast<MeshScalar>();
+            if(NV.size()){
+                NV.row(i)=(viewpoint.linear()*Eigen::Vector3d(NV.row(i).transpose().cast<double>())).cast<MeshScalar>();
+            }
+        }
+    }
 
-    //attempt 2
-    tinyobj::attrib_t attrib;
-    std::vector<tinyobj::shape_t> shapes;
-    std::vector<tinyobj::material_t> materials;
-    std::string warn, err;
-
-    VLOG(1) << "read obj with path " << file_path;
-    bool ret = tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, file_path.c_str());
-
-    LOG_IF(WARNING, shapes.size()!=1) << "Warning when loading obj with path " << file_path << " " << warn;
-    LOG_IF(FATAL, !err.empty()) << "Failed to load obj with path " << file_path << " " << err;
-    LOG_IF(FATAL, !ret) << "Failed to load obj with path: " << file_path;
+    for(size_t i=0; i<other_fields.size(); i++){
+        add_extra_field(other_fields[i].first, other_fields[i].second);
+    }
 
-    //check if it has normals, tex coords or color
-    bool has_normals, has_tex_coords, has_colors;
-    has_normals=attrib.normals.size()!=0;
-    has_tex_coords=attrib.texcoords.size()!=0;
-    // has_colors=attrib.colors.size()!=0;
-    has_colors=false; //For some reason tinyobj always reads a color of 1,1,1 even though there is no coler in the obj file..
-    // VLOG(1) << "atrib colors is " << attrib.colors.size();
+    //set the width and height from the pcd file
+    m_width=header.width;
+    m_height=header.height;
+}
 
+void Mesh::write_pcd(const std::string file_path, const std::string data_format){
+    PcdHeader header;
+    if(data_format=="ascii") header.format=PcdHeader::Format::Ascii;
+    else if(data_format=="binary") header.format=PcdHeader::Format::Binary;
+    else if(data_format=="binary_compressed") header.format=PcdHeader::Format::BinaryCompressed;
+    else LOG(FATAL) << "Unknown pcd data format " << data_format << ". Valid ones are ascii, binary and binary_compressed";
+
+    auto add_field=[&](const std::string& name, const ScalarType type){
+        PcdField field;
+        field.name=name;
+        field.type=type;
+        field.offset=header.point_size;
+        header.fields.push_back(field);
+        header.point_size+=scalar_type_size(type);
+    };
+    add_field("x", ScalarType::Float32);
+    add_field("y", ScalarType::Float32);
+    add_field("z", ScalarType::Float32);
+    const bool has_normals=NV.rows()==V.rows() && NV.size();
+    const bool has_color=C.rows()==V.rows() && C.size();
+    const bool has_intensity=I.rows()==V.rows() && I.size();
+    const bool has_labels=L_gt.rows()==V.rows() && L_gt.size();
+    if(has_normals){
+        add_field("normal_x", ScalarType::Float32);
+        add_field("normal_y", ScalarType::Float32);
+        add_field("normal_z", ScalarType::Float32);
+    }
+    if(has_color) add_field("rgb", ScalarType::Float32);
+    if(has_intensity) add_field("intensity", ScalarType::Float32);
+    if(has_labels) add_field("label", ScalarType::UInt32);
+
+    //if the cloud is still organized we keep the width and height so the readers can use the structure
+    header.nr_points=V.rows();
+    if(m_width>0 && m_height>0 && (long)m_width*m_height==V.rows()){
+        header.width=m_width;
+        header.height=m_height;
+    }else{
+        header.width=V.rows();
+        header.height=1;
+    }
 
+    //pack the points in one parallel pass
+    std::vector<char> points(header.nr_points*header.point_size);
+    #pragma omp parallel for schedule(static)
+    for(long long i=0; i<V.rows(); i++){
+        char* dst=points.data()+i*header.point_size;
+        auto put_float=[&](const double val){
+            float v=val;
+            std::memcpy(dst, &v, sizeof(v));
+            dst+=sizeof(v);
+        };
+        put_float(V(i,0)); put_float(V(i,1)); put_float(V(i,2));
+        if(has_normals){
+            put_float(NV(i,0)); put_float(NV(i,1)); put_float(NV(i,2));
+        }
+        if(has_color){
+            uint32_t r=std::clamp(C(i,0)*255.0+0.5, 0.0, 255.0);
+            uint32_t g=std::clamp(C(i,1)*255.0+0.5, 0.0, 255.0);
+            uint32_t b=std::clamp(C(i,2)*255.0+0.5, 0.0, 255.0);
+            uint32_t rgb=(r<<16) | (g<<8) | b;
+            std::memcpy(dst, &rgb, sizeof(rgb));
+            dst+=sizeof(rgb);
+        }
+        if(has_intensity){
+            put_float(I(i,0));
+        }
+        if(has_labels){
+            uint32_t label=L_gt(i,0);
+            std::memcpy(dst, &label, sizeof(label));
+            dst+=sizeof(label);
+        }
+    }
 
-    std::vector<Vertex> vertices;
-    std::unordered_map<Vertex, uint32_t, HashVertex> unique_vertices = {};
-    std::vector<int> indices;
-    std::vector<int> vti;
-    std::vector<int> vni;
+    write_pcd_file(file_path, header, points.data());
+}
 
-    // if (!check_uniqueness){ //if we don't check for uniqunes we push the vertices in whichever order they appear in the obj and not in the order to which faces reference them
-        // vertices.resize( attrib.vertices.size()/3 );
-    // }
+void Mesh::read_obj(const std::string file_path,  bool load_vti, bool load_vni){
 
-    for (const auto& shape : shapes) {
-        for (const auto& index : shape.mesh.indices) {
-            Vertex vertex = {};
-            // VLOG(1) << "index has texoocrds index " << index.texcoord_index;
-
-            vertex.pos = {
-                attrib.vertices[3 * index.vertex_index + 0],
-                attrib.vertices[3 * index.vertex_index + 1],
-                attrib.vertices[3 * index.vertex_index + 2]
-            };
-
-            if(has_normals){
-            vertex.normal = {
-                attrib.normals[3 * index.normal_index + 0],
-                attrib.normals[3 * index.normal_index + 1],
-                attrib.normals[3 * index.normal_index + 2]
-            };
-            }
+    VLOG(1) << "read obj with path " << file_path;
+    ObjData obj;
+    {
+        MappedFile file(file_path);
+        obj=parse_obj(file.data(), file.size());
+    }
 
-            if (has_tex_coords){
-                vertex.tex_coord = {
-                    attrib.texcoords[2 * index.texcoord_index + 0],
-                    attrib.texcoords[2 * index.texcoord_index + 1]
-                };
-            }
+    //check if it has normals, tex coords or color
+    bool has_normals, has_tex_coords;
+    has_normals=obj.normals.size()!=0;
+    has_tex_coords=obj.texcoords.size()!=0;
+    //colors written after the vertex positions are not standard obj so we ignore them
+    const int nr_positions=obj.positions.size()/3;
+    const int nr_normals=obj.normals.size()/3;
+    const int nr_texcoords=obj.texcoords.size()/2;
+
+    //points only obj
+    if(obj.corners.empty()){
+        V=Eigen::Map< Eigen::Matrix<double,Eigen::Dynamic,3,Eigen::RowMajor> >(obj.positions.data(), nr_positions, 3).cast<MeshScalar>();
+        if(has_normals && nr_normals==nr_positions){
+            NV=Eigen::Map< Eigen::Matrix<double,Eigen::Dynamic,3,Eigen::RowMajor> >(obj.normals.data(), nr_normals, 3).cast<MeshScalar>();
+        }
+        return;
+    }
 
-            // //there is no index for the color so we use the vertex_index
-            // if (has_colors){
-            //     vertex.color = {
-            //         attrib.colors[3 * index.vertex_index + 0],
-            //         attrib.colors[3 * index.vertex_index + 1],
-            //         attrib.colors[3 * index.vertex_index + 2]
-            //     };
-            // }
-
-            //push the vertex only if it's the first one we references
-            // if (check_uniqueness){
-                if (unique_vertices.count(vertex) == 0) {
-                    unique_vertices[vertex] = static_cast<uint32_t>(vertices.size());
-                    vertices.push_back(vertex);
-                }
-                indices.push_back(unique_vertices[vertex]);
-            // }else{
-                // vertices[index.vertex_index]=vertex;
-                // indices.push_back(index.vertex_index);
-            // }
-
-            if(load_vti){
-                // vti.push_back(index.texcoord_index);
-                vti.push_back(indices[indices.size()-1] );
-            }
-            if(load_vni){
-                // vni.push_back(index.normal_index);
-                // vni.push_back(index.normal_index);
-                vni.push_back(indices[indices.size()-1] );
-            }
 
-            // vertices.push_back(vertex);
-            // indices.push_back(indices.size());
+    //weld the corners that use the same position, texcoord and normal into one vertex. Instead of hashing the attribute values we compare the indices from the file, each position keeps a small list of the texcoord/normal combinations it was used with
+    //the vertices are created in the order in which the faces reference them for the first time
+    struct Variant{
+        int v;
+        int vt;
+        int vn;
+        int next; //next variant of the same position, -1 if this is the last one
+    };
+    std::vector<int> first_variant(nr_positions, -1);
+    std::vector<Variant> variants;
+    variants.reserve(nr_positions);
+    std::vector<int> indices(obj.corners.size());
+    for(size_t c=0; c<obj.corners.size(); c++){
+        const Eigen::Vector3i& corner=obj.corners[c];
+        CHECK_FILE(corner(0)>=0 && corner(0)<nr_positions) << "Face references a vertex that does not exist " << corner(0)+1 << " in obj with path " << file_path;
+        int* link=&first_variant[corner(0)];
+        while(*link!=-1 && (variants[*link].vt!=corner(1) || variants[*link].vn!=corner(2)) ){
+            link=&variants[*link].next;
+        }
+        if(*link==-1){
+            *link=variants.size();
+            variants.push_back( {corner(0), corner(1), corner(2), -1} );
         }
+        indices[c]=*link;
     }
 
     //push the vertices into  V, NV and so on
-    V.resize(vertices.size(),3);
-    if (has_normals) { NV.resize(vertices.size(),3); };
-    if (has_tex_coords) { UV.resize(vertices.size(),2); };
-    if (has_colors) { C.resize(vertices.size(),3); };
-
-    for(size_t i=0; i<vertices.size(); i++){
-        V.row(i) = vertices[i].pos;
-        if (has_normals) { NV.row(i) = vertices[i].normal; }
-        if (has_tex_coords) { UV.row(i) = vertices[i].tex_coord; }
-        if (has_colors) { C.row(i) = vertices[i].color; }
+    const int nr_verts=variants.size();
+    V.resize(nr_verts,3);
+    if (has_normals) { NV.resize(nr_verts,3); };
+    if (has_tex_coords) { UV.resize(nr_verts,2); };
+
+    #pragma omp parallel for
+    for(int i=0; i<nr_verts; i++){
+        const Variant& var=variants[i];
+        V.row(i) << obj.positions[3*var.v+0], obj.positions[3*var.v+1], obj.positions[3*var.v+2];
+        if (has_normals) {
+            if(var.vn>=0 && var.vn<nr_normals){
+                NV.row(i) << obj.normals[3*var.vn+0], obj.normals[3*var.vn+1], obj.normals[3*var.vn+2];
+            }else{
+                NV.row(i).setZero();
+            }
+        }
+        if (has_tex_coords) {
+            if(var.vt>=0 && var.vt<nr_texcoords){
+                UV.row(i) << obj.texcoords[2*var.vt+0], obj.texcoords[2*var.vt+1];
+            }else{
+                UV.row(i).setZero();
+            }
+        }
     }
 
-    F.resize(indices.size()/3, 3);
-    for(size_t i=0; i<indices.size()/3; i++){
-        F.row(i) << indices[3*i+0], indices[3*i+1], indices[3*i+2];
-    }
+    F=Eigen::Map< Eigen::Matrix<int,Eigen::Dynamic,3,Eigen::RowMajor> >(indices.data(), indices.size()/3, 3);
 
-    //vti and vni
+    //vti and vni index the welded vertices, the same as F
     if (load_vti){
-        VTI.resize(vti.size()/3, 3);
-        for(size_t i=0; i<vti.size()/3; i++){
-            VTI.row(i) << vti[3*i+0], vti[3*i+1], vti[3*i+2];
-        }
+        VTI=F;
     }
     if (load_vni){
-        VNI.resize(vni.size()/3, 3);
-        for(size_t i=0; i<vni.size()/3; i++){
-            VNI.row(i) << vni[3*i+0], vni[3*i+1], vni[3*i+2];
-        }
+        VNI=F;
     }
 
 
@@ -3,6 +3,10 @@
 //c++
 #include <iostream>
 #include <algorithm>
+#include <type_traits>
+#include <cstddef>
+#include <limits>
+#include <cmath>
 
 #include "easy_gl/UtilsGL.h"
 
@@ -13,7 +17,9 @@
 namespace easy_pbr{
 
 MeshGL::MeshGL():
+    m_index_type(GL_UNSIGNED_INT),
     m_first_core_assignment(true),
+    m_scene_id(-1),
     m_sticky(false),
     V_buf("V_buf"),
     F_buf("F_buf"),
@@ -29,7 +35,12 @@ MeshGL::MeshGL():
     // m_thermal_tex(new gl::Texture2D("thermal_tex")),
     // m_thermal_colored_tex(new gl::Texture2D("thermal_colored_tex")),
     // m_cur_tex_ptr(m_rgb_tex),
-    m_core(new Mesh)
+    m_core(new Mesh),
+    m_packed(false),
+    m_needs_full_upload(true),
+    m_buf_bytes(MeshAttribute::_size(), 0),
+    m_bytes_uploaded(MeshAttribute::_size(), 0),
+    m_packed_buf_bytes(0)
     {
 
     //Set the parameters for the buffers
@@ -46,6 +57,7 @@ MeshGL::MeshGL():
     L_pred_buf.set_target(GL_ARRAY_BUFFER);
     L_gt_buf.set_target(GL_ARRAY_BUFFER);
     I_buf.set_target(GL_ARRAY_BUFFER);
+    packed_buf.set_target(GL_ARRAY_BUFFER);
 
 
     // V_buf.set_type(GL_FLOAT);
@@ -77,6 +89,10 @@ MeshGL::MeshGL():
 
 void MeshGL::assign_core(std::shared_ptr<Mesh> mesh_core){
 
+    if(mesh_core!=m_core){
+        m_needs_full_upload=true;
+    }
+
     // bool visualization_changed= m_core->m_vis!=mesh_core->m_vis;
 
     if(m_first_core_assignment || mesh_core->m_force_vis_update ){
@@ -96,13 +112,106 @@ void MeshGL::sanity_check() const{
 }
 
 
+//uploads the rows of mat marked in dirty into buf, converted to the type that the shaders expect and row major. When the whole matrix is dirty or its size changed since the last upload, the buffer gets reallocated with glBufferData, otherwise only the dirty rows are sent with glBufferSubData. Matrices that are already stored with the right type and layout (the per vertex attributes with EASYPBR_WITH_FLOAT_MESH) are uploaded without a temporary copy. Returns the nr of bytes uploaded
+template <typename GLScalar, typename MatrixType>
+static size_t upload_attribute(gl::Buf& buf, size_t& buf_bytes, const MatrixType& mat, const bool upload_whole, const DirtyRows& dirty){
+    typedef Eigen::Matrix<GLScalar,Eigen::Dynamic,Eigen::Dynamic,Eigen::RowMajor> RowMatrixGL;
+    constexpr bool no_conversion=std::is_same<MatrixType, RowMatrixGL>::value;
+
+    const size_t total_bytes=mat.size()*sizeof(GLScalar);
+    if(upload_whole || dirty.is_whole() || total_bytes!=buf_bytes){
+        if constexpr (no_conversion){
+            buf.upload_data(total_bytes, mat.data(), GL_DYNAMIC_DRAW);
+        }else{
+            RowMatrixGL mat_gl=mat.template cast<GLScalar>();
+            buf.upload_data(total_bytes, mat_gl.data(), GL_DYNAMIC_DRAW);
+        }
+        buf_bytes=total_bytes;
+        return total_bytes;
+    }
+
+    //partial upload
+    const int row_start=std::min<int>(dirty.row_start, mat.rows());
+    const int row_end=std::min<int>(dirty.row_end, mat.rows());
+    if(row_end<=row_start){
+        return 0;
+    }
+    const size_t row_bytes=mat.cols()*sizeof(GLScalar);
+    const size_t offset=row_start*row_bytes;
+    const size_t nr_bytes=(row_end-row_start)*row_bytes;
+    if constexpr (no_conversion){
+        buf.upload_sub_data(offset, nr_bytes, mat.data()+row_start*mat.cols());
+    }else{
+        RowMatrixGL rows_gl=mat.middleRows(row_start, row_end-row_start).template cast<GLScalar>();
+        buf.upload_sub_data(offset, nr_bytes, rows_gl.data());
+    }
+    return nr_bytes;
+}
+
+//https://knarkowicz.wordpress.com/2014/04/16/octahedron-normal-vector-encoding/ The decoding is in the vertex shaders
+static Eigen::Vector2f encode_octahedral(const Eigen::Vector3f& normal){
+    const float l1_norm=normal.cwiseAbs().sum();
+    if(l1_norm==0.0f){
+        return Eigen::Vector2f::Zero();
+    }
+    Eigen::Vector3f n=normal/l1_norm;
+    if(n.z()<0.0f){
+        const float x=n.x();
+        const float y=n.y();
+        n.x()=(1.0f-std::fabs(y)) * (x>=0.0f ? 1.0f : -1.0f);
+        n.y()=(1.0f-std::fabs(x)) * (y>=0.0f ? 1.0f : -1.0f);
+    }
+    return n.head<2>();
+}
+
+//writes the rows [row_start, row_end) of the position, normal, uv and color of the mesh into the packed vertices. Attributes that the mesh doesn't have are left at zero
+static void pack_vertices(const Mesh& mesh, const int row_start, const int row_end, std::vector<PackedVertex>& packed){
+    const int nr_rows=row_end-row_start;
+    packed.resize(nr_rows);
+    const int nr_pos_cols=std::min<int>(mesh.V.cols(), 3);
+    const bool has_normals=mesh.NV.rows()==mesh.V.rows() && mesh.NV.cols()==3;
+    const bool has_uv=mesh.UV.rows()==mesh.V.rows() && mesh.UV.cols()==2;
+    const bool has_color=mesh.C.rows()==mesh.V.rows() && mesh.C.cols()==3;
+
+    #pragma omp parallel for
+    for(long long i=0; i<nr_rows; i++){
+        const int row=row_start+i;
+        PackedVertex& vert=packed[i];
+        vert=PackedVertex();
+
+        for(int c=0; c<nr_pos_cols; c++){
+            vert.position[c]=mesh.V(row,c);
+        }
+        if(has_normals){
+            const Eigen::Vector2f oct=encode_octahedral( mesh.NV.row(row).transpose().cast<float>() );
+            vert.normal[0]=std::lround( std::min(std::max(oct.x(), -1.0f), 1.0f)*32767.0f );
+            vert.normal[1]=std::lround( std::min(std::max(oct.y(), -1.0f), 1.0f)*32767.0f );
+        }
+        if(has_uv){
+            vert.uv[0]=Eigen::half( (float)mesh.UV(row,0) ).x;
+            vert.uv[1]=Eigen::half( (float)mesh.UV(row,1) ).x;
+        }
+        if(has_color){
+            for(int c=0; c<3; c++){
+                vert.color[c]=std::lround( std::min(std::max((float)mesh.C(row,c), 0.0f), 1.0f)*255.0f );
+            }
+            vert.color[3]=255;
+        }
+    }
+}
+
 void MeshGL::upload_to_gpu(){
 
+    //16 bit indices are enough for small meshes. Changing the index type requires uploading again all of F and E
+    const GLenum index_type= (m_packed && m_core->V.rows()<65536) ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+    if(index_type!=m_index_type){
+        m_index_type=index_type;
+        m_needs_full_upload=true;
+    }
+
+    //everything gets uploaded when the whole mesh is dirty, otherwise only the attributes that were marked as dirty
+    const bool upload_whole=m_core->m_is_dirty || m_needs_full_upload;
 
-    // Temporary copy of the content of each VBO. need to make it float and row major
-    typedef Eigen::Matrix<float,Eigen::Dynamic,Eigen::Dynamic,Eigen::RowMajor> RowMatrixXf;
-    typedef Eigen::Matrix<unsigned,Eigen::Dynamic,Eigen::Dynamic,Eigen::RowMajor> RowMatrixXi;
-    RowMatrixXf V_f=m_core->V.cast<float>();
     //in order to support alos V vector with only 2 columns, we create a V_f with 3 and the z component will be set to 0. We do this because all the shaders support only positions which are vec3
     // RowMatrixXf V_f;
     // if(m_core->V.cols() ==3){
@@ -116,36 +225,63 @@ void MeshGL::upload_to_gpu(){
     //     LOG(FATAL) << "Cannot render a mesh with nr of coordinates per point different than 2 or 3. This mesh has V.cols()= " <<m_core->V.cols();
     // }
 
-
-
-    RowMatrixXi F_i=m_core->F.cast<unsigned>();
-    RowMatrixXf C_f=m_core->C.cast<float>();
-    RowMatrixXi E_i=m_core->E.cast<unsigned>();
-    RowMatrixXf D_f=m_core->D.cast<float>();
-    RowMatrixXf NF_f=m_core->NF.cast<float>();
-    RowMatrixXf NV_f=m_core->NV.cast<float>();
-    RowMatrixXf UV_f=m_core->UV.cast<float>();
-    RowMatrixXf V_tangent_u_f=m_core->V_tangent_u.cast<float>();
-    RowMatrixXf V_lenght_v_f=m_core->V_length_v.cast<float>();
-    RowMatrixXi L_pred_i=m_core->L_pred.cast<unsigned>();
-    RowMatrixXi L_gt_i=m_core->L_gt.cast<unsigned>();
-    RowMatrixXf I_f=m_core->I.cast<float>();
-
-
-
-    V_buf.upload_data(V_f.size()*sizeof(float), V_f.data(), GL_DYNAMIC_DRAW);
-    F_buf.upload_data(F_i.size()*sizeof(unsigned), F_i.data(), GL_DYNAMIC_DRAW);
-    C_buf.upload_data(C_f.size()*sizeof(float), C_f.data(), GL_DYNAMIC_DRAW);
-    E_buf.upload_data(E_i.size()*sizeof(unsigned), E_i.data(), GL_DYNAMIC_DRAW);
-    D_buf.upload_data(D_f.size()*sizeof(float), D_f.data(), GL_DYNAMIC_DRAW);
-    NF_buf.upload_data(NF_f.size()*sizeof(float), NF_f.data(), GL_DYNAMIC_DRAW);
-    NV_buf.upload_data(NV_f.size()*sizeof(float), NV_f.data(), GL_DYNAMIC_DRAW);
-    UV_buf.upload_data(UV_f.size()*sizeof(float), UV_f.data(), GL_DYNAMIC_DRAW);
-    V_tangent_u_buf.upload_data(V_tangent_u_f.size()*sizeof(float), V_tangent_u_f.data(), GL_DYNAMIC_DRAW);
-    V_lenght_v_buf.upload_data(V_lenght_v_f.size()*sizeof(float), V_lenght_v_f.data(), GL_DYNAMIC_DRAW);
-    L_pred_buf.upload_data(L_pred_i.size()*sizeof(unsigned), L_pred_i.data(), GL_DYNAMIC_DRAW);
-    L_gt_buf.upload_data(L_gt_i.size()*sizeof(unsigned), L_gt_i.data(), GL_DYNAMIC_DRAW);
-    I_buf.upload_data(I_f.size()*sizeof(float), I_f.data(), GL_DYNAMIC_DRAW);
+    auto upload_float=[&](const MeshAttribute attrib, gl::Buf& buf, const auto& mat){
+        const int idx=attrib._to_integral();
+        if(upload_whole || m_core->dirty_rows(attrib).is_dirty){
+            m_bytes_uploaded[idx]+=upload_attribute<float>(buf, m_buf_bytes[idx], mat, upload_whole, m_core->dirty_rows(attrib));
+        }
+    };
+    auto upload_unsigned=[&](const MeshAttribute attrib, gl::Buf& buf, const auto& mat){
+        const int idx=attrib._to_integral();
+        if(upload_whole || m_core->dirty_rows(attrib).is_dirty){
+            m_bytes_uploaded[idx]+=upload_attribute<unsigned>(buf, m_buf_bytes[idx], mat, upload_whole, m_core->dirty_rows(attrib));
+        }
+    };
+
+    auto upload_indices=[&](const MeshAttribute attrib, gl::Buf& buf, const auto& mat){
+        const int idx=attrib._to_integral();
+        if(upload_whole || m_core->dirty_rows(attrib).is_dirty){
+            if(m_index_type==GL_UNSIGNED_SHORT){
+                m_bytes_uploaded[idx]+=upload_attribute<uint16_t>(buf, m_buf_bytes[idx], mat, upload_whole, m_core->dirty_rows(attrib));
+            }else{
+                m_bytes_uploaded[idx]+=upload_attribute<unsigned>(buf, m_buf_bytes[idx], mat, upload_whole, m_core->dirty_rows(attrib));
+            }
+        }
+    };
+
+    if(m_packed){
+        upload_packed(upload_whole);
+        //the separate buffers are not used with the packed format so we release their memory
+        if(upload_whole){
+            gl::Buf* unused_bufs[4]={&V_buf, &C_buf, &NV_buf, &UV_buf};
+            const MeshAttribute unused_attribs[4]={MeshAttribute::V, MeshAttribute::C, MeshAttribute::NV, MeshAttribute::UV};
+            for(int i=0; i<4; i++){
+                if(m_buf_bytes[unused_attribs[i]._to_integral()]!=0){
+                    unused_bufs[i]->upload_data(0, nullptr, GL_DYNAMIC_DRAW);
+                    m_buf_bytes[unused_attribs[i]._to_integral()]=0;
+                }
+            }
+        }
+    }else{
+        if(upload_whole && m_packed_buf_bytes!=0){
+            packed_buf.upload_data(0, nullptr, GL_DYNAMIC_DRAW);
+            m_packed_buf_bytes=0;
+        }
+        upload_float(MeshAttribute::V, V_buf, m_core->V);
+        upload_float(MeshAttribute::C, C_buf, m_core->C);
+        upload_float(MeshAttribute::NV, NV_buf, m_core->NV);
+        upload_float(MeshAttribute::UV, UV_buf, m_core->UV);
+    }
+    upload_indices(MeshAttribute::F, F_buf, m_core->F);
+    upload_indices(MeshAttribute::E, E_buf, m_core->E);
+    upload_float(MeshAttribute::D, D_buf, m_core->D);
+    upload_float(MeshAttribute::NF, NF_buf, m_core->NF);
+    upload_float(MeshAttribute::V_tangent_u, V_tangent_u_buf, m_core->V_tangent_u);
+    upload_float(MeshAttribute::V_length_v, V_lenght_v_buf, m_core->V_length_v);
+    upload_unsigned(MeshAttribute::L_pred, L_pred_buf, m_core->L_pred);
+    upload_unsigned(MeshAttribute::L_gt, L_gt_buf, m_core->L_gt);
+    upload_float(MeshAttribute::I, I_buf, m_core->I);
+    m_needs_full_upload=false;
 
     // if(m_core->m_rgb_tex_cpu.data){
         // GL_C(m_rgb_tex->upload_from_cv_mat(m_core->m_rgb_tex_cpu) );
@@ -173,7 +309,110 @@ void MeshGL::upload_to_gpu(){
         m_normals_tex.generate_mipmap_full();
     }
 
-    m_core->m_is_dirty=false;
+    m_core->clear_dirty();
+}
+
+void MeshGL::upload_packed(const bool upload_whole){
+    const MeshAttribute packed_attribs[4]={MeshAttribute::V, MeshAttribute::NV, MeshAttribute::UV, MeshAttribute::C};
+
+    //the packed buffer gets updated if any of its attributes changed, for the union of their dirty rows
+    bool is_dirty=upload_whole;
+    bool whole=upload_whole;
+    int row_start=std::numeric_limits<int>::max();
+    int row_end=0;
+    for(int i=0; i<4; i++){
+        const DirtyRows& dirty=m_core->dirty_rows(packed_attribs[i]);
+        if(!dirty.is_dirty){
+            continue;
+        }
+        is_dirty=true;
+        if(dirty.is_whole()){
+            whole=true;
+        }else{
+            row_start=std::min(row_start, dirty.row_start);
+            row_end=std::max(row_end, dirty.row_end);
+        }
+    }
+    if(!is_dirty){
+        return;
+    }
+
+    std::vector<PackedVertex> packed;
+    const size_t total_bytes=m_core->V.rows()*sizeof(PackedVertex);
+    if(whole || total_bytes!=m_packed_buf_bytes){
+        pack_vertices(*m_core, 0, m_core->V.rows(), packed);
+        packed_buf.upload_data(total_bytes, packed.data(), GL_DYNAMIC_DRAW);
+        m_packed_buf_bytes=total_bytes;
+        m_bytes_uploaded[MeshAttribute::V]+=total_bytes;
+        return;
+    }
+
+    //partial upload
+    row_end=std::min<int>(row_end, m_core->V.rows());
+    if(row_end<=row_start){
+        return;
+    }
+    pack_vertices(*m_core, row_start, row_end, packed);
+    const size_t nr_bytes=packed.size()*sizeof(PackedVertex);
+    packed_buf.upload_sub_data(row_start*sizeof(PackedVertex), nr_bytes, packed.data());
+    m_bytes_uploaded[MeshAttribute::V]+=nr_bytes;
+}
+
+void MeshGL::set_packed(const bool packed){
+    if(packed!=m_packed){
+        m_packed=packed;
+        m_needs_full_upload=true;
+    }
+}
+
+bool MeshGL::is_packed() const{
+    return m_packed;
+}
+
+void MeshGL::vertex_attribute(gl::Shader& shader, const std::string attrib_name, const gl::Buf& buf, const int size){
+    const bool is_packed_attrib= &buf==&V_buf || &buf==&NV_buf || &buf==&UV_buf || &buf==&C_buf;
+    if(!m_packed || !is_packed_attrib){
+        vao.vertex_attribute(shader, attrib_name, buf, size);
+        if(&buf==&NV_buf){
+            shader.uniform_bool(false, "normal_octahedral");
+        }
+        return;
+    }
+
+    GLint location=glGetAttribLocation(shader.prog_id(), attrib_name.c_str());
+    if(location==-1){
+        return; //the shader doesn't use this attribute
+    }
+    const GLsizei stride=sizeof(PackedVertex);
+    vao.bind();
+    packed_buf.bind();
+    if(&buf==&V_buf){
+        GL_C( glVertexAttribPointer(location, 3, GL_FLOAT, GL_FALSE, stride, (void*)offsetof(PackedVertex, position)) );
+    }else if(&buf==&NV_buf){
+        GL_C( glVertexAttribPointer(location, 2, GL_SHORT, GL_TRUE, stride, (void*)offsetof(PackedVertex, normal)) );
+        shader.uniform_bool(true, "normal_octahedral");
+    }else if(&buf==&UV_buf){
+        GL_C( glVertexAttribPointer(location, 2, GL_HALF_FLOAT, GL_FALSE, stride, (void*)offsetof(PackedVertex, uv)) );
+    }else{
+        GL_C( glVertexAttribPointer(location, 3, GL_UNSIGNED_BYTE, GL_TRUE, stride, (void*)offsetof(PackedVertex, color)) );
+    }
+    GL_C( glEnableVertexAttribArray(location) );
+}
+
+size_t MeshGL::bytes_uploaded(const std::string attrib_name) const{
+    return m_bytes_uploaded[ MeshAttribute::_from_string(attrib_name.c_str())._to_integral() ];
+}
+
+size_t MeshGL::total_bytes_uploaded() const{
+    size_t total=0;
+    for(size_t i=0; i<m_bytes_uploaded.size(); i++){
+        total+=m_bytes_uploaded[i];
+    }
+    return total;
+}
+
+void MeshGL::reset_upload_counters(){
+    std::fill(m_bytes_uploaded.begin(), m_bytes_uploaded.end(), 0);
 }
 
 
@@ -0,0 +1,1454 @@
+#include "easy_pbr/MeshIO.h"
+
+//c++
+#include <iostream>
+#include <sstream>
+#include <limits>
+#include <cmath>
+#include <cctype>
+#include <algorithm>
+#include <fstream>
+#include <cstdio>
+#include <atomic>
+#include <cerrno>
+
+#ifdef _OPENMP
+    #include <omp.h>
+#endif
+
+//posix for the memory mapping
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+//loguru
+#define LOGURU_REPLACE_GLOG 1
+#include <loguru.hpp>
+
+
+namespace easy_pbr{
+
+MappedFile::MappedFile(const std::string& file_path):
+    m_path(file_path),
+    m_data(nullptr),
+    m_size(0)
+    {
+
+    int fd = open(file_path.c_str(), O_RDONLY);
+    CHECK_FILE(fd!=-1) << "Failed to open " << file_path << ": " << std::strerror(errno);
+
+    struct stat sb;
+    if(fstat(fd, &sb)==-1){
+        close(fd);
+        throw MeshIOError("Failed to stat "+file_path);
+    }
+    m_size=sb.st_size;
+
+    if(m_size!=0){
+        void* addr=mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if(addr==MAP_FAILED){
+            close(fd);
+            throw MeshIOError("Failed to mmap "+file_path);
+        }
+        madvise(addr, m_size, MADV_SEQUENTIAL); //the readers go through the file in big contiguous chunks so aggressive read-ahead helps
+        m_data=(const char*)addr;
+    }
+
+    close(fd); //the mapping stays valid after closing the descriptor
+}
+
+MappedFile::~MappedFile(){
+    if(m_data){
+        munmap((void*)m_data, m_size);
+    }
+}
+
+
+size_t scalar_type_size(const ScalarType type){
+    switch(type){
+        case ScalarType::Int8: return 1;
+        case ScalarType::UInt8: return 1;
+        case ScalarType::Int16: return 2;
+        case ScalarType::UInt16: return 2;
+        case ScalarType::Int32: return 4;
+        case ScalarType::UInt32: return 4;
+        case ScalarType::Float32: return 4;
+        case ScalarType::Float64: return 8;
+        default: return 0;
+    }
+}
+
+ScalarType ply_type_from_string(const std::string& type_name){
+    if(type_name=="char" || type_name=="int8") return ScalarType::Int8;
+    if(type_name=="uchar" || type_name=="uint8") return ScalarType::UInt8;
+    if(type_name=="short" || type_name=="int16") return ScalarType::Int16;
+    if(type_name=="ushort" || type_name=="uint16") return ScalarType::UInt16;
+    if(type_name=="int" || type_name=="int32") return ScalarType::Int32;
+    if(type_name=="uint" || type_name=="uint32") return ScalarType::UInt32;
+    if(type_name=="float" || type_name=="float32") return ScalarType::Float32;
+    if(type_name=="double" || type_name=="float64") return ScalarType::Float64;
+    return ScalarType::Invalid;
+}
+
+double scalar_type_max(const ScalarType type){
+    switch(type){
+        case ScalarType::Int8: return std::numeric_limits<int8_t>::max();
+        case ScalarType::UInt8: return std::numeric_limits<uint8_t>::max();
+        case ScalarType::Int16: return std::numeric_limits<int16_t>::max();
+        case ScalarType::UInt16: return std::numeric_limits<uint16_t>::max();
+        case ScalarType::Int32: return std::numeric_limits<int32_t>::max();
+        case ScalarType::UInt32: return std::numeric_limits<uint32_t>::max();
+        default: return 1.0; //floats are assumed to be already normalized
+    }
+}
+
+void copy_strided_columns(const char* base, const size_t nr_elems, const size_t stride, const std::vector<ColumnCopy>& copies, const bool swap_endian){
+    if(copies.empty()){
+        return;
+    }
+
+    #pragma omp parallel for schedule(static)
+    for(long long i=0; i<(long long)nr_elems; i++){
+        const char* elem=base+i*stride;
+        for(size_t c=0; c<copies.size(); c++){
+            const ColumnCopy& copy=copies[c];
+            const double val=read_scalar<double>(elem+copy.src_offset, copy.type, swap_endian)*copy.scale;
+            if(copy.dst){
+                copy.dst[i*copy.dst_stride]=val;
+            }else{
+                copy.dst_float[i*copy.dst_stride]=val;
+            }
+        }
+    }
+}
+
+
+
+
+int PlyElement::property_idx(const std::string& name) const{
+    for(size_t i=0; i<properties.size(); i++){
+        if(properties[i].name==name){
+            return i;
+        }
+    }
+    return -1;
+}
+
+int PlyElement::property_idx(const std::vector<std::string>& names) const{
+    for(size_t i=0; i<names.size(); i++){
+        int idx=property_idx(names[i]);
+        if(idx!=-1){
+            return idx;
+        }
+    }
+    return -1;
+}
+
+int PlyHeader::element_idx(const std::string& name) const{
+    for(size_t i=0; i<elements.size(); i++){
+        if(elements[i].name==name){
+            return i;
+        }
+    }
+    return -1;
+}
+
+bool PlyHeader::needs_swap() const{
+    const uint16_t one=1;
+    bool machine_is_little_endian= *((const uint8_t*)&one)==1;
+    if(format==Format::BinaryLittleEndian) return !machine_is_little_endian;
+    if(format==Format::BinaryBigEndian) return machine_is_little_endian;
+    return false;
+}
+
+PlyHeader parse_ply_header(const char* data, const size_t size){
+    PlyHeader header;
+
+    //find the end of the header
+    const std::string end_marker="end_header";
+    std::string data_start(data, std::min<size_t>(size, 1<<20)); //headers are small, we don't need to look through the whole file
+    size_t end_pos=data_start.find(end_marker);
+    CHECK_FILE(end_pos!=std::string::npos) << "Could not find end_header in the ply file";
+    size_t body_start=data_start.find('\n', end_pos);
+    CHECK_FILE(body_start!=std::string::npos) << "The ply header is not followed by a new line";
+    header.header_size=body_start+1;
+
+    std::istringstream ss(data_start.substr(0, end_pos));
+    std::string line;
+    std::getline(ss, line);
+    CHECK_FILE(line.compare(0,3,"ply")==0) << "File is not a ply, it does not start with the magic word ply";
+
+    while(std::getline(ss, line)){
+        if(!line.empty() && line.back()=='\r') line.pop_back(); //some writers use windows line endings
+        std::istringstream ls(line);
+        std::string keyword;
+        ls >> keyword;
+        if(keyword=="format"){
+            std::string format;
+            ls >> format;
+            if(format=="ascii") header.format=PlyHeader::Format::Ascii;
+            else if(format=="binary_little_endian") header.format=PlyHeader::Format::BinaryLittleEndian;
+            else if(format=="binary_big_endian") header.format=PlyHeader::Format::BinaryBigEndian;
+            else throw MeshIOError("Unknown ply format "+format);
+        }else if(keyword=="comment" || keyword=="obj_info"){
+            header.comments.push_back(line);
+        }else if(keyword=="element"){
+            PlyElement elem;
+            ls >> elem.name >> elem.count;
+            header.elements.push_back(elem);
+        }else if(keyword=="property"){
+            CHECK_FILE(!header.elements.empty()) << "Found a ply property before any element";
+            PlyElement& elem=header.elements.back();
+            PlyProperty prop;
+            std::string type_name;
+            ls >> type_name;
+            if(type_name=="list"){
+                std::string size_type_name, item_type_name;
+                ls >> size_type_name >> item_type_name >> prop.name;
+                prop.is_list=true;
+                prop.list_size_type=ply_type_from_string(size_type_name);
+                prop.type=ply_type_from_string(item_type_name);
+                CHECK_FILE(prop.list_size_type!=ScalarType::Invalid) << "Unknown ply type " << size_type_name;
+                elem.has_list=true;
+            }else{
+                ls >> prop.name;
+                prop.type=ply_type_from_string(type_name);
+                if(!elem.has_list){
+                    prop.offset=elem.stride;
+                    elem.stride+=scalar_type_size(prop.type);
+                }
+            }
+            CHECK_FILE(prop.type!=ScalarType::Invalid) << "Unknown ply type " << type_name;
+            elem.properties.push_back(prop);
+        }
+    }
+
+    return header;
+}
+
+//walks an element with list properties and return how many bytes it spans
+static size_t walk_ply_element(const PlyElement& elem, const char* start, const char* data_end, const bool swap_endian){
+    const char* ptr=start;
+    for(size_t i=0; i<elem.count; i++){
+        for(size_t p=0; p<elem.properties.size(); p++){
+            const PlyProperty& prop=elem.properties[p];
+            if(prop.is_list){
+                CHECK_FILE(ptr+scalar_type_size(prop.list_size_type)<=data_end) << "Ply file is truncated inside the element " << elem.name;
+                size_t nr_items=read_scalar<size_t>(ptr, prop.list_size_type, swap_endian);
+                ptr+=scalar_type_size(prop.list_size_type) + nr_items*scalar_type_size(prop.type);
+            }else{
+                ptr+=scalar_type_size(prop.type);
+            }
+        }
+    }
+    CHECK_FILE(ptr<=data_end) << "Ply file is truncated inside the element " << elem.name;
+    return ptr-start;
+}
+
+std::vector<size_t> ply_element_offsets(const PlyHeader& header, const char* data, const size_t size){
+    CHECK(header.is_binary()) << "Element offsets can only be computed for binary ply files";
+
+    std::vector<size_t> offsets(header.elements.size(), 0);
+    size_t cur_offset=header.header_size;
+    for(size_t i=0; i<header.elements.size(); i++){
+        offsets[i]=cur_offset;
+        const PlyElement& elem=header.elements[i];
+        if(elem.has_list){
+            if(i==header.elements.size()-1){
+                break; //no need to walk the last element since nothing comes after it, the reader of the lists checks the bounds as it goes
+            }
+            cur_offset+=walk_ply_element(elem, data+cur_offset, data+size, header.needs_swap());
+        }else{
+            //the readers of fixed size elements index straight into the mapping so the whole element has to be in the file
+            CHECK_FILE(cur_offset+elem.count*elem.stride<=size) << "Ply file is truncated inside the element " << elem.name << ", it needs " << elem.count*elem.stride << " bytes but only " << size-std::min(cur_offset,size) << " are left";
+            cur_offset+=elem.count*elem.stride;
+        }
+    }
+
+    return offsets;
+}
+
+Eigen::MatrixXi read_ply_faces(const PlyHeader& header, const PlyElement& elem, const int list_idx, const char* elem_start, const char* data_end){
+    CHECK(list_idx>=0 && list_idx<(int)elem.properties.size()) << "Invalid list property index for element " << elem.name;
+    const bool swap=header.needs_swap();
+    const PlyProperty& list_prop=elem.properties[list_idx];
+    CHECK(list_prop.is_list) << "The property " << list_prop.name << " of element " << elem.name << " is not a list";
+
+    //if all the polygons are triangles, every element has the same stride and we can read them in parallel
+    bool only_one_list=true;
+    size_t tri_stride=0;
+    size_t list_offset=0;
+    for(size_t p=0; p<elem.properties.size(); p++){
+        const PlyProperty& prop=elem.properties[p];
+        if((int)p==list_idx){
+            list_offset=tri_stride;
+            tri_stride+=scalar_type_size(prop.list_size_type) + 3*scalar_type_size(prop.type);
+        }else if(prop.is_list){
+            only_one_list=false;
+        }else{
+            tri_stride+=scalar_type_size(prop.type);
+        }
+    }
+    const size_t size_bytes=scalar_type_size(list_prop.list_size_type);
+    const size_t idx_bytes=scalar_type_size(list_prop.type);
+
+    bool all_triangles= only_one_list && elem_start+elem.count*tri_stride<=data_end;
+    if(all_triangles){
+        #pragma omp parallel for reduction(&&:all_triangles)
+        for(long long f=0; f<(long long)elem.count; f++){
+            all_triangles= all_triangles && read_scalar<int>(elem_start+f*tri_stride+list_offset, list_prop.list_size_type, swap)==3;
+        }
+    }
+
+    Eigen::MatrixXi F;
+    if(all_triangles){
+        F.resize(elem.count, 3);
+        #pragma omp parallel for schedule(static)
+        for(long long f=0; f<(long long)elem.count; f++){
+            const char* indices=elem_start+f*tri_stride+list_offset+size_bytes;
+            F(f,0)=read_scalar<int>(indices, list_prop.type, swap);
+            F(f,1)=read_scalar<int>(indices+idx_bytes, list_prop.type, swap);
+            F(f,2)=read_scalar<int>(indices+2*idx_bytes, list_prop.type, swap);
+        }
+    }else{
+        //general polygons, walk the element sequentially and triangulate each polygon as a fan
+        std::vector<int> tris;
+        tris.reserve(elem.count*3);
+        const char* ptr=elem_start;
+        for(size_t f=0; f<elem.count; f++){
+            for(size_t p=0; p<elem.properties.size(); p++){
+                const PlyProperty& prop=elem.properties[p];
+                if(!prop.is_list){
+                    ptr+=scalar_type_size(prop.type);
+                    continue;
+                }
+                CHECK_FILE(ptr+scalar_type_size(prop.list_size_type)<=data_end) << "Ply file is truncated inside the element " << elem.name;
+                int nr_items=read_scalar<int>(ptr, prop.list_size_type, swap);
+                ptr+=scalar_type_size(prop.list_size_type);
+                CHECK_FILE(ptr+nr_items*scalar_type_size(prop.type)<=data_end) << "Ply file is truncated inside the element " << elem.name;
+                if((int)p==list_idx){
+                    int first=read_scalar<int>(ptr, prop.type, swap);
+                    for(int k=1; k+1<nr_items; k++){
+                        tris.push_back(first);
+                        tris.push_back(read_scalar<int>(ptr+k*idx_bytes, prop.type, swap));
+                        tris.push_back(read_scalar<int>(ptr+(k+1)*idx_bytes, prop.type, swap));
+                    }
+                }
+                ptr+=nr_items*scalar_type_size(prop.type);
+            }
+        }
+        F.resize(tris.size()/3, 3);
+        for(size_t i=0; i<tris.size()/3; i++){
+            F.row(i) << tris[3*i+0], tris[3*i+1], tris[3*i+2];
+        }
+    }
+
+    return F;
+}
+
+
+
+
+//ascii parsing for obj and pcd. The numbers are parsed by hand because strtod is locale dependent and needs null terminated strings, which a memory mapped file does not provide
+static inline const char* skip_blanks(const char* p, const char* end){
+    while(p<end && (*p==' ' || *p=='\t')){
+        p++;
+    }
+    return p;
+}
+
+//case insensitive check for a word like nan or inf at p
+static inline bool starts_with_word(const char* p, const char* end, const char* word){
+    for(; *word; word++, p++){
+        if(p>=end || std::tolower((unsigned char)*p)!=*word){
+            return false;
+        }
+    }
+    return true;
+}
+
+//parses nan, inf and infinity like strtod does, p is after the sign. Returns nullptr if there is none of them
+static inline const char* parse_ascii_nonfinite(const char* p, const char* end, double& out){
+    if(starts_with_word(p, end, "nan")){
+        out=std::numeric_limits<double>::quiet_NaN();
+        p+=3;
+        if(p<end && *p=='('){ //nan(chars) is also valid
+            const char* close=(const char*)memchr(p, ')', end-p);
+            if(close){
+                p=close+1;
+            }
+        }
+        return p;
+    }
+    if(starts_with_word(p, end, "infinity")){
+        out=std::numeric_limits<double>::infinity();
+        return p+8;
+    }
+    if(starts_with_word(p, end, "inf")){
+        out=std::numeric_limits<double>::infinity();
+        return p+3;
+    }
+    return nullptr;
+}
+
+static inline const char* parse_ascii_double(const char* p, const char* end, double& out){
+    bool negative=false;
+    if(p<end && (*p=='-' || *p=='+')){
+        negative= *p=='-';
+        p++;
+    }
+    //some exporters write nan or inf for degenerate normals or uvs, strtod accepted them so we do too
+    if(p<end && !(*p>='0' && *p<='9') && *p!='.'){
+        double nonfinite;
+        const char* after=parse_ascii_nonfinite(p, end, nonfinite);
+        if(after){
+            out= negative? -nonfinite : nonfinite;
+            return after;
+        }
+    }
+    uint64_t mantissa=0;
+    int nr_digits=0;
+    int exponent=0;
+    while(p<end && *p>='0' && *p<='9'){
+        if(nr_digits<18){
+            mantissa=mantissa*10+(*p-'0');
+            nr_digits++;
+        }else{
+            exponent++; //digits that don't fit in the mantissa only change the magnitude
+        }
+        p++;
+    }
+    if(p<end && *p=='.'){
+        p++;
+        while(p<end && *p>='0' && *p<='9'){
+            if(nr_digits<18){
+                mantissa=mantissa*10+(*p-'0');
+                nr_digits++;
+                exponent--;
+            }
+            p++;
+        }
+    }
+    if(p<end && (*p=='e' || *p=='E')){
+        p++;
+        bool exp_negative=false;
+        if(p<end && (*p=='-' || *p=='+')){
+            exp_negative= *p=='-';
+            p++;
+        }
+        int exp_val=0;
+        while(p<end && *p>='0' && *p<='9'){
+            exp_val=exp_val*10+(*p-'0');
+            p++;
+        }
+        exponent+= exp_negative? -exp_val : exp_val;
+    }
+
+    static const double pow10[]={1e0,1e1,1e2,1e3,1e4,1e5,1e6,1e7,1e8,1e9,1e10,1e11,1e12,1e13,1e14,1e15,1e16,1e17,1e18,1e19,1e20,1e21,1e22};
+    double val=(double)mantissa;
+    if(exponent>=0 && exponent<=22){
+        val*=pow10[exponent];
+    }else if(exponent<0 && exponent>=-22){
+        val/=pow10[-exponent];
+    }else{
+        val*=std::pow(10.0, exponent);
+    }
+    out= negative? -val : val;
+    return p;
+}
+
+static inline const char* parse_obj_int(const char* p, const char* end, int& out, bool& found){
+    bool negative=false;
+    if(p<end && (*p=='-' || *p=='+')){
+        negative= *p=='-';
+        p++;
+    }
+    int val=0;
+    found=false;
+    while(p<end && *p>='0' && *p<='9'){
+        val=val*10+(*p-'0');
+        found=true;
+        p++;
+    }
+    out= negative? -val : val;
+    return p;
+}
+
+namespace{
+//everything parsed from a contiguous range of lines
+struct ObjChunk{
+    std::vector<double> positions;
+    std::vector<double> texcoords;
+    std::vector<double> normals;
+    std::vector<Eigen::Vector3i> corners;
+    //indices that are relative (negative in the file) get resolved against the counts local to this chunk, so they still need the offset of the chunk added. We store which ones
+    std::vector< std::pair<size_t,int> > relative_indices; //corner idx and component
+};
+
+//converts a 1-based or negative obj index into a 0-based index relative to the start of the chunk
+inline int resolve_obj_idx(const int idx, const size_t local_count, bool& is_relative){
+    is_relative= idx<0;
+    return idx<0? (int)local_count+idx : idx-1;
+}
+
+void parse_obj_chunk(const char* p, const char* end, ObjChunk& chunk){
+    std::vector<Eigen::Vector3i> polygon;
+    std::vector<Eigen::Vector3i> polygon_relative; //for each corner of the polygon, 1 for the components that are relative
+    while(p<end){
+        const char* line_end=(const char*)memchr(p, '\n', end-p);
+        if(!line_end){
+            line_end=end;
+        }
+        p=skip_blanks(p, line_end);
+
+        if(line_end-p>=2 && p[0]=='v' && (p[1]==' ' || p[1]=='\t')){
+            double x=0, y=0, z=0;
+            p=parse_ascii_double(skip_blanks(p+2, line_end), line_end, x);
+            p=parse_ascii_double(skip_blanks(p, line_end), line_end, y);
+            p=parse_ascii_double(skip_blanks(p, line_end), line_end, z);
+            chunk.positions.push_back(x);
+            chunk.positions.push_back(y);
+            chunk.positions.push_back(z);
+        }else if(line_end-p>=3 && p[0]=='v' && p[1]=='t' && (p[2]==' ' || p[2]=='\t')){
+            double u=0, v=0;
+            p=parse_ascii_double(skip_blanks(p+3, line_end), line_end, u);
+            p=parse_ascii_double(skip_blanks(p, line_end), line_end, v);
+            chunk.texcoords.push_back(u);
+            chunk.texcoords.push_back(v);
+        }else if(line_end-p>=3 && p[0]=='v' && p[1]=='n' && (p[2]==' ' || p[2]=='\t')){
+            double x=0, y=0, z=0;
+            p=parse_ascii_double(skip_blanks(p+3, line_end), line_end, x);
+            p=parse_ascii_double(skip_blanks(p, line_end), line_end, y);
+            p=parse_ascii_double(skip_blanks(p, line_end), line_end, z);
+            chunk.normals.push_back(x);
+            chunk.normals.push_back(y);
+            chunk.normals.push_back(z);
+        }else if(line_end-p>=2 && p[0]=='f' && (p[1]==' ' || p[1]=='\t')){
+            polygon.clear();
+            polygon_relative.clear();
+            p=skip_blanks(p+2, line_end);
+            while(p<line_end && *p!='\r' && *p!='#'){
+                Eigen::Vector3i corner(-1,-1,-1);
+                Eigen::Vector3i relative(0,0,0);
+                int idx; bool found, is_relative;
+                p=parse_obj_int(p, line_end, idx, found);
+                if(!found){
+                    break;
+                }
+                corner(0)=resolve_obj_idx(idx, chunk.positions.size()/3, is_relative);
+                relative(0)=is_relative;
+                if(p<line_end && *p=='/'){
+                    p++;
+                    p=parse_obj_int(p, line_end, idx, found);
+                    if(found){
+                        corner(1)=resolve_obj_idx(idx, chunk.texcoords.size()/2, is_relative);
+                        relative(1)=is_relative;
+                    }
+                    if(p<line_end && *p=='/'){
+                        p++;
+                        p=parse_obj_int(p, line_end, idx, found);
+                        if(found){
+                            corner(2)=resolve_obj_idx(idx, chunk.normals.size()/3, is_relative);
+                            relative(2)=is_relative;
+                        }
+                    }
+                }
+                polygon.push_back(corner);
+                polygon_relative.push_back(relative);
+                p=skip_blanks(p, line_end);
+            }
+            //triangulate as a fan
+            for(int k=1; k+1<(int)polygon.size(); k++){
+                const int tri[3]={0, k, k+1};
+                for(int c=0; c<3; c++){
+                    chunk.corners.push_back(polygon[tri[c]]);
+                    for(int comp=0; comp<3; comp++){
+                        if(polygon_relative[tri[c]](comp)){
+                            chunk.relative_indices.push_back( std::make_pair(chunk.corners.size()-1, comp) );
+                        }
+                    }
+                }
+            }
+        }
+        //everything else (comments, groups, materials, smoothing groups, lines) is ignored
+
+        p=line_end+1;
+    }
+}
+} //anonymous namespace
+
+ObjData parse_obj(const char* data, const size_t size){
+
+    //split the file in chunks that start at the beggining of a line
+    int nr_chunks=1;
+    #ifdef _OPENMP
+        nr_chunks=omp_get_max_threads()*4;
+    #endif
+    const size_t min_chunk_size=1<<20;
+    nr_chunks=std::max<int>(1, std::min<size_t>(nr_chunks, size/min_chunk_size));
+    std::vector<size_t> chunk_starts(nr_chunks+1, size);
+    chunk_starts[0]=0;
+    for(int i=1; i<nr_chunks; i++){
+        size_t pos=std::max(chunk_starts[i-1], i*(size/nr_chunks));
+        const char* newline= pos<size? (const char*)memchr(data+pos, '\n', size-pos) : nullptr;
+        chunk_starts[i]= newline? newline-data+1 : size;
+    }
+
+    std::vector<ObjChunk> chunks(nr_chunks);
+    #pragma omp parallel for schedule(dynamic,1)
+    for(int i=0; i<nr_chunks; i++){
+        parse_obj_chunk(data+chunk_starts[i], data+chunk_starts[i+1], chunks[i]);
+    }
+
+    //the indices are local to each chunk so we need to know how many v, vt and vn were defined before each chunk
+    std::vector<size_t> pos_offset(nr_chunks+1,0), tex_offset(nr_chunks+1,0), normal_offset(nr_chunks+1,0), corner_offset(nr_chunks+1,0);
+    for(int i=0; i<nr_chunks; i++){
+        pos_offset[i+1]=pos_offset[i]+chunks[i].positions.size();
+        tex_offset[i+1]=tex_offset[i]+chunks[i].texcoords.size();
+        normal_offset[i+1]=normal_offset[i]+chunks[i].normals.size();
+        corner_offset[i+1]=corner_offset[i]+chunks[i].corners.size();
+    }
+
+    ObjData obj;
+    obj.positions.resize(pos_offset[nr_chunks]);
+    obj.texcoords.resize(tex_offset[nr_chunks]);
+    obj.normals.resize(normal_offset[nr_chunks]);
+    obj.corners.resize(corner_offset[nr_chunks]);
+    #pragma omp parallel for schedule(dynamic,1)
+    for(int i=0; i<nr_chunks; i++){
+        ObjChunk& chunk=chunks[i];
+        std::copy(chunk.positions.begin(), chunk.positions.end(), obj.positions.begin()+pos_offset[i]);
+        std::copy(chunk.texcoords.begin(), chunk.texcoords.end(), obj.texcoords.begin()+tex_offset[i]);
+        std::copy(chunk.normals.begin(), chunk.normals.end(), obj.normals.begin()+normal_offset[i]);
+        for(size_t r=0; r<chunk.relative_indices.size(); r++){
+            const std::pair<size_t,int>& rel=chunk.relative_indices[r];
+            chunk.corners[rel.first](rel.second)+= rel.second==0? pos_offset[i]/3 : (rel.second==1? tex_offset[i]/2 : normal_offset[i]/3);
+        }
+        //absolute indices are already global, relative ones got fixed above
+        std::copy(chunk.corners.begin(), chunk.corners.end(), obj.corners.begin()+corner_offset[i]);
+    }
+
+    return obj;
+}
+
+
+
+
+//epbr cache
+static const char epbr_magic[8]={'E','P','B','R','M','S','H','\0'};
+static const uint32_t epbr_version=2; //2 added the options to the source key
+static const uint32_t epbr_byte_order_mark=0x01020304;
+static const size_t epbr_alignment=64;
+
+static inline size_t align_up(const size_t val, const size_t alignment){
+    return (val+alignment-1)/alignment*alignment;
+}
+
+template <typename T>
+static inline void append_pod(std::string& buf, const T val){
+    buf.append((const char*)&val, sizeof(T));
+}
+
+bool epbr_source_key(const std::string& path, EpbrSourceKey& key){
+    struct stat sb;
+    if(stat(path.c_str(), &sb)!=0){
+        return false;
+    }
+    key.path=path;
+    key.size=sb.st_size;
+    key.mtime_ns=(int64_t)sb.st_mtim.tv_sec*1000000000LL + sb.st_mtim.tv_nsec;
+    return true;
+}
+
+void EpbrWriter::add(const std::string& name, const Eigen::MatrixXd& mat){
+    m_entries.push_back( {name, ScalarType::Float64, (uint64_t)mat.rows(), (uint64_t)mat.cols(), (const char*)mat.data()} );
+}
+
+void EpbrWriter::add(const std::string& name, const Eigen::MatrixXi& mat){
+    static_assert(sizeof(int)==4, "The cache stores the int matrices as int32");
+    m_entries.push_back( {name, ScalarType::Int32, (uint64_t)mat.rows(), (uint64_t)mat.cols(), (const char*)mat.data()} );
+}
+
+void EpbrWriter::add(const std::string& name, const Eigen::Matrix<float, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>& mat){
+    std::shared_ptr<Eigen::MatrixXf> col_major=std::make_shared<Eigen::MatrixXf>(mat);
+    m_owned.push_back(col_major);
+    m_entries.push_back( {name, ScalarType::Float32, (uint64_t)mat.rows(), (uint64_t)mat.cols(), (const char*)col_major->data()} );
+}
+
+bool EpbrWriter::write(const std::string& file_path, const EpbrSourceKey& key) const{
+
+    //the size of the header is known before the offsets so we can compute them in one go
+    size_t header_size=sizeof(epbr_magic)+3*sizeof(uint32_t)+sizeof(uint64_t)+sizeof(int64_t)+sizeof(uint32_t)+key.path.size()+sizeof(uint32_t)+key.options.size();
+    for(size_t i=0; i<m_entries.size(); i++){
+        header_size+=sizeof(uint32_t)+m_entries[i].name.size()+sizeof(uint32_t)+3*sizeof(uint64_t);
+    }
+
+    std::vector<uint64_t> offsets(m_entries.size());
+    size_t cur_offset=align_up(header_size, epbr_alignment);
+    for(size_t i=0; i<m_entries.size(); i++){
+        offsets[i]=cur_offset;
+        cur_offset=align_up(cur_offset + m_entries[i].rows*m_entries[i].cols*scalar_type_size(m_entries[i].type), epbr_alignment);
+    }
+
+    std::string header;
+    header.reserve(header_size);
+    header.append(epbr_magic, sizeof(epbr_magic));
+    append_pod<uint32_t>(header, epbr_version);
+    append_pod<uint32_t>(header, epbr_byte_order_mark);
+    append_pod<uint32_t>(header, m_entries.size());
+    append_pod<uint64_t>(header, key.size);
+    append_pod<int64_t>(header, key.mtime_ns);
+    append_pod<uint32_t>(header, key.path.size());
+    header.append(key.path);
+    append_pod<uint32_t>(header, key.options.size());
+    header.append(key.options);
+    for(size_t i=0; i<m_entries.size(); i++){
+        const Entry& e=m_entries[i];
+        append_pod<uint32_t>(header, e.name.size());
+        header.append(e.name);
+        append_pod<uint32_t>(header, (uint32_t)e.type);
+        append_pod<uint64_t>(header, e.rows);
+        append_pod<uint64_t>(header, e.cols);
+        append_pod<uint64_t>(header, offsets[i]);
+    }
+
+    //the pid alone is not enough because several threads of the load pool may write the cache of the same file at the same time
+    static std::atomic<uint64_t> nr_tmp_files(0);
+    const std::string tmp_path=file_path+".tmp"+std::to_string(getpid())+"_"+std::to_string(nr_tmp_files++);
+    {
+        std::ofstream file(tmp_path, std::ios::out | std::ios::binary | std::ios::trunc);
+        if(!file.is_open()){
+            return false;
+        }
+        const char zeros[epbr_alignment]={0};
+        file.write(header.data(), header.size());
+        size_t written=header.size();
+        for(size_t i=0; i<m_entries.size(); i++){
+            file.write(zeros, offsets[i]-written);
+            const size_t nr_bytes=m_entries[i].rows*m_entries[i].cols*scalar_type_size(m_entries[i].type);
+            file.write(m_entries[i].data, nr_bytes);
+            written=offsets[i]+nr_bytes;
+        }
+        file.write(zeros, cur_offset-written);
+        if(!file.good()){
+            file.close();
+            std::remove(tmp_path.c_str());
+            return false;
+        }
+    }
+
+    if(std::rename(tmp_path.c_str(), file_path.c_str())!=0){
+        std::remove(tmp_path.c_str());
+        return false;
+    }
+    return true;
+}
+
+
+EpbrReader::EpbrReader(const std::string& file_path):
+    m_file(file_path),
+    m_header_ok(false)
+    {
+
+    //parse the header and check that all the matrices lie inside the file, anything that doesn't look right makes the cache invalid
+    const char* ptr=m_file.data();
+    const char* end=m_file.data()+m_file.size();
+    auto read_bytes=[&](void* dst, const size_t nr_bytes){
+        if(ptr==nullptr || (size_t)(end-ptr)<nr_bytes){
+            return false;
+        }
+        std::memcpy(dst, ptr, nr_bytes);
+        ptr+=nr_bytes;
+        return true;
+    };
+    auto read_string=[&](std::string& str){
+        uint32_t len=0;
+        if(!read_bytes(&len, sizeof(len)) || (size_t)(end-ptr)<len){
+            return false;
+        }
+        str.assign(ptr, len);
+        ptr+=len;
+        return true;
+    };
+
+    char magic[sizeof(epbr_magic)];
+    uint32_t version=0, byte_order_mark=0, nr_entries=0;
+    if(!read_bytes(magic, sizeof(magic)) || std::memcmp(magic, epbr_magic, sizeof(magic))!=0) return;
+    if(!read_bytes(&version, sizeof(version)) || version!=epbr_version) return;
+    if(!read_bytes(&byte_order_mark, sizeof(byte_order_mark)) || byte_order_mark!=epbr_byte_order_mark) return;
+    if(!read_bytes(&nr_entries, sizeof(nr_entries))) return;
+    if(!read_bytes(&m_key.size, sizeof(m_key.size))) return;
+    if(!read_bytes(&m_key.mtime_ns, sizeof(m_key.mtime_ns))) return;
+    if(!read_string(m_key.path)) return;
+    if(!read_string(m_key.options)) return;
+    for(uint32_t i=0; i<nr_entries; i++){
+        Entry e;
+        uint32_t type=0;
+        if(!read_string(e.name)) return;
+        if(!read_bytes(&type, sizeof(type))) return;
+        if(!read_bytes(&e.rows, sizeof(e.rows))) return;
+        if(!read_bytes(&e.cols, sizeof(e.cols))) return;
+        if(!read_bytes(&e.offset, sizeof(e.offset))) return;
+        e.type=(ScalarType)type;
+        if(e.offset+e.rows*e.cols*scalar_type_size(e.type) > m_file.size()) return;
+        m_entries.push_back(e);
+    }
+    m_header_ok=true;
+}
+
+bool EpbrReader::is_valid_for(const EpbrSourceKey& key) const{
+    return m_header_ok && m_key.path==key.path && m_key.size==key.size && m_key.mtime_ns==key.mtime_ns && m_key.options==key.options;
+}
+
+const EpbrReader::Entry* EpbrReader::find(const std::string& name, const ScalarType type) const{
+    for(size_t i=0; i<m_entries.size(); i++){
+        if(m_entries[i].name==name && m_entries[i].type==type){
+            return &m_entries[i];
+        }
+    }
+    return nullptr;
+}
+
+bool EpbrReader::has(const std::string& name) const{
+    for(size_t i=0; i<m_entries.size(); i++){
+        if(m_entries[i].name==name){
+            return true;
+        }
+    }
+    return false;
+}
+
+std::vector<std::string> EpbrReader::names() const{
+    std::vector<std::string> names;
+    for(size_t i=0; i<m_entries.size(); i++){
+        names.push_back(m_entries[i].name);
+    }
+    return names;
+}
+
+template <typename MatrixType>
+bool EpbrReader::read_floating(const std::string& name, MatrixType& mat) const{
+    //the data is column major so it gets mapped like that and eigen does the conversion to the layout and type of mat
+    if(const Entry* e=find(name, ScalarType::Float64)){
+        mat=Eigen::Map<const Eigen::MatrixXd>( (const double*)(m_file.data()+e->offset), e->rows, e->cols ).cast<typename MatrixType::Scalar>();
+        return true;
+    }
+    if(const Entry* e=find(name, ScalarType::Float32)){
+        mat=Eigen::Map<const Eigen::MatrixXf>( (const float*)(m_file.data()+e->offset), e->rows, e->cols ).cast<typename MatrixType::Scalar>();
+        return true;
+    }
+    return false;
+}
+
+bool EpbrReader::read(const std::string& name, Eigen::MatrixXd& mat) const{
+    return read_floating(name, mat);
+}
+
+bool EpbrReader::read(const std::string& name, Eigen::Matrix<float, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>& mat) const{
+    return read_floating(name, mat);
+}
+
+bool EpbrReader::read(const std::string& name, Eigen::MatrixXi& mat) const{
+    const Entry* e=find(name, ScalarType::Int32);
+    if(!e){
+        return false;
+    }
+    mat.resize(e->rows, e->cols);
+    std::memcpy(mat.data(), m_file.data()+e->offset, e->rows*e->cols*sizeof(int));
+    return true;
+}
+
+
+
+
+
+//pcd
+int PcdHeader::field_idx(const std::string& name) const{
+    for(size_t i=0; i<fields.size(); i++){
+        if(fields[i].name==name){
+            return i;
+        }
+    }
+    return -1;
+}
+
+static ScalarType pcd_type(const char type, const int size){
+    if(type=='F' && size==4) return ScalarType::Float32;
+    if(type=='F' && size==8) return ScalarType::Float64;
+    if(type=='I' && size==1) return ScalarType::Int8;
+    if(type=='I' && size==2) return ScalarType::Int16;
+    if(type=='I' && size==4) return ScalarType::Int32;
+    if(type=='U' && size==1) return ScalarType::UInt8;
+    if(type=='U' && size==2) return ScalarType::UInt16;
+    if(type=='U' && size==4) return ScalarType::UInt32;
+    return ScalarType::Invalid;
+}
+
+PcdHeader parse_pcd_header(const char* data, const size_t size){
+    PcdHeader header;
+
+    std::vector<int> sizes;
+    std::vector<char> types;
+    std::vector<int> counts;
+    bool found_data=false;
+    const char* p=data;
+    const char* end=data+size;
+    while(p<end && !found_data){
+        const char* line_end=(const char*)memchr(p, '\n', end-p);
+        CHECK_FILE(line_end) << "The pcd header is not followed by any data";
+        std::string line(p, line_end);
+        p=line_end+1;
+        if(!line.empty() && line.back()=='\r') line.pop_back();
+        if(line.empty() || line[0]=='#'){
+            continue;
+        }
+
+        std::istringstream ls(line);
+        std::string keyword;
+        ls >> keyword;
+        if(keyword=="VERSION"){
+            //all the versions we care about (0.7) have the same layout
+        }else if(keyword=="FIELDS" || keyword=="COLUMNS"){
+            std::string name;
+            while(ls >> name){
+                PcdField field;
+                field.name=name;
+                header.fields.push_back(field);
+            }
+        }else if(keyword=="SIZE"){
+            int val;
+            while(ls >> val) sizes.push_back(val);
+        }else if(keyword=="TYPE"){
+            char val;
+            while(ls >> val) types.push_back(val);
+        }else if(keyword=="COUNT"){
+            int val;
+            while(ls >> val) counts.push_back(val);
+        }else if(keyword=="WIDTH"){
+            ls >> header.width;
+        }else if(keyword=="HEIGHT"){
+            ls >> header.height;
+        }else if(keyword=="VIEWPOINT"){
+            double tx, ty, tz, qw, qx, qy, qz;
+            ls >> tx >> ty >> tz >> qw >> qx >> qy >> qz;
+            header.viewpoint.setIdentity();
+            header.viewpoint.linear()=Eigen::Quaterniond(qw, qx, qy, qz).normalized().toRotationMatrix();
+            header.viewpoint.translation() << tx, ty, tz;
+        }else if(keyword=="POINTS"){
+            ls >> header.nr_points;
+        }else if(keyword=="DATA"){
+            std::string format;
+            ls >> format;
+            if(format=="ascii") header.format=PcdHeader::Format::Ascii;
+            else if(format=="binary") header.format=PcdHeader::Format::Binary;
+            else if(format=="binary_compressed") header.format=PcdHeader::Format::BinaryCompressed;
+            else throw MeshIOError("Unknown pcd data format "+format);
+            found_data=true;
+        }else{
+            LOG(WARNING) << "Unknown line in the pcd header: " << line;
+        }
+    }
+    CHECK_FILE(found_data) << "The pcd header has no DATA line";
+    header.header_size=p-data;
+
+    CHECK_FILE(sizes.size()==header.fields.size() && types.size()==header.fields.size()) << "The pcd header has " << header.fields.size() << " fields but " << sizes.size() << " sizes and " << types.size() << " types";
+    CHECK_FILE(counts.empty() || counts.size()==header.fields.size()) << "The pcd header has " << header.fields.size() << " fields but " << counts.size() << " counts";
+    for(size_t i=0; i<header.fields.size(); i++){
+        PcdField& field=header.fields[i];
+        field.type=pcd_type(types[i], sizes[i]);
+        CHECK_FILE(field.type!=ScalarType::Invalid) << "Unknown pcd type " << types[i] << " with size " << sizes[i] << " for field " << field.name;
+        field.count= counts.empty()? 1 : counts[i];
+        field.offset=header.point_size;
+        header.point_size+=sizes[i]*field.count;
+    }
+    if(header.nr_points==0){
+        header.nr_points=header.width*header.height;
+    }
+
+    return header;
+}
+
+
+
+
+//point cloud stream
+PointCloudStream::PointCloudStream(const std::string& file_path, const size_t points_per_chunk):
+    m_file(file_path),
+    m_points_start(nullptr),
+    m_stride(0),
+    m_swap_endian(false),
+    m_nr_points(0),
+    m_points_per_chunk(points_per_chunk),
+    m_pose(Eigen::Affine3d::Identity()),
+    m_pos_type(ScalarType::Invalid),
+    m_color_type(ScalarType::Invalid),
+    m_color_is_packed(false),
+    m_intensity_offset(-1),
+    m_intensity_type(ScalarType::Invalid)
+    {
+
+    CHECK(points_per_chunk>0) << "points_per_chunk should be positive";
+    m_color_offsets[0]=m_color_offsets[1]=m_color_offsets[2]=-1;
+
+    std::string file_ext = file_path.substr(file_path.find_last_of(".") + 1);
+    std::transform(file_ext.begin(), file_ext.end(), file_ext.begin(), ::tolower);
+
+    if(file_ext=="ply"){
+        PlyHeader header=parse_ply_header(m_file.data(), m_file.size());
+        CHECK_FILE(header.is_binary()) << "Only binary ply files can be streamed, " << file_path << " is ascii";
+        int elem_idx=header.element_idx("vertex");
+        CHECK_FILE(elem_idx!=-1) << "The ply file " << file_path << " has no vertex element";
+        const PlyElement& elem=header.elements[elem_idx];
+        CHECK_FILE(!elem.has_list) << "The vertex element of " << file_path << " has a list property so the points don't have a fixed size";
+        std::vector<size_t> offsets=ply_element_offsets(header, m_file.data(), m_file.size());
+        CHECK_FILE(offsets[elem_idx]+elem.count*elem.stride<=m_file.size()) << "The ply file " << file_path << " is smaller than its header says";
+        m_points_start=m_file.data()+offsets[elem_idx];
+        m_stride=elem.stride;
+        m_swap_endian=header.needs_swap();
+        m_nr_points=elem.count;
+
+        //all the coordinates need to have the same type so we can read them in one go
+        const char* pos_names[3]={"x","y","z"};
+        for(int i=0; i<3; i++){
+            int idx=elem.property_idx(pos_names[i]);
+            CHECK_FILE(idx!=-1) << "The ply file " << file_path << " has no property " << pos_names[i];
+            CHECK_FILE(i==0 || elem.properties[idx].type==m_pos_type) << "The coordinates of the ply file " << file_path << " have different types, they can only be streamed when x, y and z have the same one";
+            m_pos_offsets[i]=elem.properties[idx].offset;
+            m_pos_type=elem.properties[idx].type;
+        }
+        //same for the colors
+        const std::vector<std::string> color_names[3]={ {"red","r"}, {"green","g"}, {"blue","b"} };
+        for(int i=0; i<3; i++){
+            int idx=elem.property_idx(color_names[i]);
+            if(idx==-1){
+                m_color_offsets[0]=-1;
+                break;
+            }
+            CHECK_FILE(i==0 || elem.properties[idx].type==m_color_type) << "The colors of the ply file " << file_path << " have different types, they can only be streamed when red, green and blue have the same one";
+            m_color_offsets[i]=elem.properties[idx].offset;
+            m_color_type=elem.properties[idx].type;
+        }
+        int intensity_idx=elem.property_idx( std::vector<std::string>{"intensity","scalar_intensity"} );
+        if(intensity_idx!=-1){
+            m_intensity_offset=elem.properties[intensity_idx].offset;
+            m_intensity_type=elem.properties[intensity_idx].type;
+        }
+
+    }else if(file_ext=="pcd"){
+        PcdHeader header=parse_pcd_header(m_file.data(), m_file.size());
+        CHECK_FILE(header.format==PcdHeader::Format::Binary) << "Only pcd files with DATA binary can be streamed. Ascii and binary_compressed files need to be loaded whole, " << file_path;
+        CHECK_FILE(header.header_size+header.nr_points*header.point_size<=m_file.size()) << "The pcd file " << file_path << " is smaller than its header says";
+        m_points_start=m_file.data()+header.header_size;
+        m_stride=header.point_size;
+        m_nr_points=header.nr_points;
+        m_pose=header.viewpoint;
+
+        const char* pos_names[3]={"x","y","z"};
+        for(int i=0; i<3; i++){
+            int idx=header.field_idx(pos_names[i]);
+            CHECK_FILE(idx!=-1) << "The pcd file " << file_path << " has no field " << pos_names[i];
+            CHECK_FILE(i==0 || header.fields[idx].type==m_pos_type) << "The coordinates of the pcd file " << file_path << " have different types, they can only be streamed when x, y and z have the same one";
+            m_pos_offsets[i]=header.fields[idx].offset;
+            m_pos_type=header.fields[idx].type;
+        }
+        int rgb_idx=header.field_idx("rgb");
+        if(rgb_idx==-1){
+            rgb_idx=header.field_idx("rgba");
+        }
+        if(rgb_idx!=-1){
+            m_color_offsets[0]=m_color_offsets[1]=m_color_offsets[2]=header.fields[rgb_idx].offset;
+            m_color_is_packed=true;
+        }
+        int intensity_idx=header.field_idx("intensity");
+        if(intensity_idx!=-1){
+            m_intensity_offset=header.fields[intensity_idx].offset;
+            m_intensity_type=header.fields[intensity_idx].type;
+        }
+
+    }else{
+        throw MeshIOError("Only ply and pcd files can be streamed, not "+file_path);
+    }
+
+    compute_bounds();
+}
+
+size_t PointCloudStream::chunk_nr_points(const size_t chunk_idx) const{
+    size_t start=chunk_idx*m_points_per_chunk;
+    return std::min(m_points_per_chunk, m_nr_points-start);
+}
+
+void PointCloudStream::compute_bounds(){
+    size_t nr_chunks=(m_nr_points+m_points_per_chunk-1)/m_points_per_chunk;
+    m_bounds.resize(nr_chunks);
+
+    #pragma omp parallel for schedule(dynamic,1)
+    for(long long c=0; c<(long long)nr_chunks; c++){
+        Eigen::AlignedBox3d box;
+        const char* base=m_points_start+c*m_points_per_chunk*m_stride;
+        size_t nr=chunk_nr_points(c);
+        for(size_t i=0; i<nr; i++){
+            const char* elem=base+i*m_stride;
+            Eigen::Vector3d pos( read_scalar<double>(elem+m_pos_offsets[0], m_pos_type, m_swap_endian),
+                                 read_scalar<double>(elem+m_pos_offsets[1], m_pos_type, m_swap_endian),
+                                 read_scalar<double>(elem+m_pos_offsets[2], m_pos_type, m_swap_endian) );
+            box.extend(m_pose*pos);
+        }
+        m_bounds[c]=box;
+    }
+}
+
+void PointCloudStream::read_chunk(const size_t chunk_idx, Eigen::MatrixXd& V, Eigen::MatrixXd& C, Eigen::MatrixXd& I) const{
+    CHECK(chunk_idx<nr_chunks()) << "Chunk " << chunk_idx << " is out of range, we have " << nr_chunks() << " chunks";
+
+    const char* base=m_points_start+chunk_idx*m_points_per_chunk*m_stride;
+    const long long nr=chunk_nr_points(chunk_idx);
+    V.resize(nr,3);
+    C.resize(has_color()? nr : 0, 3);
+    I.resize(has_intensity()? nr : 0, 1);
+    const double color_scale= m_color_is_packed? 1.0/255.0 : 1.0/scalar_type_max(m_color_type);
+
+    #pragma omp parallel for schedule(static)
+    for(long long i=0; i<nr; i++){
+        const char* elem=base+i*m_stride;
+        Eigen::Vector3d pos( read_scalar<double>(elem+m_pos_offsets[0], m_pos_type, m_swap_endian),
+                             read_scalar<double>(elem+m_pos_offsets[1], m_pos_type, m_swap_endian),
+                             read_scalar<double>(elem+m_pos_offsets[2], m_pos_type, m_swap_endian) );
+        V.row(i)=m_pose*pos;
+
+        if(m_color_offsets[0]!=-1){
+            if(m_color_is_packed){
+                uint32_t rgb;
+                std::memcpy(&rgb, elem+m_color_offsets[0], sizeof(rgb));
+                C(i,0)=((rgb>>16)&0xff)*color_scale;
+                C(i,1)=((rgb>>8)&0xff)*color_scale;
+                C(i,2)=(rgb&0xff)*color_scale;
+            }else{
+                for(int k=0; k<3; k++){
+                    C(i,k)=read_scalar<double>(elem+m_color_offsets[k], m_color_type, m_swap_endian)*color_scale;
+                }
+            }
+        }
+        if(m_intensity_offset!=-1){
+            I(i,0)=read_scalar<double>(elem+m_intensity_offset, m_intensity_type, m_swap_endian);
+        }
+    }
+}
+
+
+
+
+
+//lzf
+bool lzf_decompress(const char* in_data, const size_t in_len, char* out_data, const size_t out_len){
+    const uint8_t* in=(const uint8_t*)in_data;
+    uint8_t* out=(uint8_t*)out_data;
+    size_t ip=0;
+    size_t op=0;
+    while(ip<in_len){
+        size_t ctrl=in[ip++];
+        if(ctrl<32){ //literal run of ctrl+1 bytes
+            ctrl++;
+            if(op+ctrl>out_len || ip+ctrl>in_len){
+                return false;
+            }
+            std::memcpy(out+op, in+ip, ctrl);
+            op+=ctrl;
+            ip+=ctrl;
+        }else{ //back reference
+            size_t len=ctrl>>5;
+            if(len==7){
+                if(ip>=in_len) return false;
+                len+=in[ip++];
+            }
+            if(ip>=in_len) return false;
+            const size_t back=((ctrl&0x1f)<<8) + in[ip++] + 1;
+            len+=2;
+            if(back>op || op+len>out_len){
+                return false;
+            }
+            //the reference can overlap with what we are writing so we copy byte by byte
+            for(size_t i=0; i<len; i++, op++){
+                out[op]=out[op-back];
+            }
+        }
+    }
+    return op==out_len;
+}
+
+std::vector<char> lzf_compress(const char* in_data, const size_t in_len){
+    const uint8_t* in=(const uint8_t*)in_data;
+    const int hash_log=14;
+    const size_t max_offset=1<<13;
+    const size_t max_ref_len=(7+255)+2;
+    std::vector<uint32_t> hash_table(1<<hash_log, 0); //position+1 of the last occurence of each 3 byte sequence, 0 for none
+
+    std::vector<char> out;
+    out.reserve(in_len+in_len/16+64);
+    size_t lit_start=out.size();
+    out.push_back(0);
+    int lit=0;
+    auto push_literal=[&](const uint8_t val){
+        out.push_back(val);
+        lit++;
+        if(lit==32){
+            out[lit_start]=lit-1;
+            lit_start=out.size();
+            out.push_back(0);
+            lit=0;
+        }
+    };
+
+    size_t ip=0;
+    while(ip+2<in_len){
+        const uint32_t seq=(in[ip]<<16) | (in[ip+1]<<8) | in[ip+2];
+        const size_t h=((seq*2654435761u)>>(32-hash_log)) & ((1<<hash_log)-1);
+        const size_t ref_plus_one=hash_table[h];
+        hash_table[h]=ip+1;
+        if(ref_plus_one){
+            const size_t ref=ref_plus_one-1;
+            const size_t off=ip-ref-1;
+            if(off<max_offset && in[ref]==in[ip] && in[ref+1]==in[ip+1] && in[ref+2]==in[ip+2]){
+                const size_t max_len=std::min(in_len-ip, max_ref_len);
+                size_t len=3;
+                while(len<max_len && in[ref+len]==in[ip+len]){
+                    len++;
+                }
+                //close the current literal run
+                if(lit==0){
+                    out.pop_back();
+                }else{
+                    out[lit_start]=lit-1;
+                }
+                const size_t l=len-2;
+                if(l<7){
+                    out.push_back( (off>>8) + (l<<5) );
+                }else{
+                    out.push_back( (off>>8) + (7<<5) );
+                    out.push_back( l-7 );
+                }
+                out.push_back( off&0xff );
+                //the positions inside the match also go in the hash table otherwise repetitive data would only find stale references
+                for(size_t k=ip+1; k<ip+len && k+2<in_len; k++){
+                    const uint32_t seq_k=(in[k]<<16) | (in[k+1]<<8) | in[k+2];
+                    hash_table[((seq_k*2654435761u)>>(32-hash_log)) & ((1<<hash_log)-1)]=k+1;
+                }
+                ip+=len;
+                lit_start=out.size();
+                out.push_back(0);
+                lit=0;
+                continue;
+            }
+        }
+        push_literal(in[ip++]);
+    }
+    while(ip<in_len){
+        push_literal(in[ip++]);
+    }
+    if(lit==0){
+        out.pop_back();
+    }else{
+        out[lit_start]=lit-1;
+    }
+    return out;
+}
+
+
+
+
+//pcd data
+static inline const char* parse_pcd_value(const char* p, const char* end, double& out){
+    if(p<end && (*p=='n' || *p=='N')){ //nan is used for invalid points of organized clouds
+        out=std::numeric_limits<double>::quiet_NaN();
+        while(p<end && *p!=' ' && *p!='\t' && *p!='\r' && *p!='\n') p++;
+        return p;
+    }
+    return parse_ascii_double(p, end, out);
+}
+
+template <typename T>
+static inline void write_as(char* ptr, const double val){
+    T v=(T)val;
+    std::memcpy(ptr, &v, sizeof(T));
+}
+
+static void write_scalar(char* ptr, const ScalarType type, const double val){
+    switch(type){
+        case ScalarType::Int8: write_as<int8_t>(ptr, val); break;
+        case ScalarType::UInt8: write_as<uint8_t>(ptr, val); break;
+        case ScalarType::Int16: write_as<int16_t>(ptr, val); break;
+        case ScalarType::UInt16: write_as<uint16_t>(ptr, val); break;
+        case ScalarType::Int32: write_as<int32_t>(ptr, val); break;
+        case ScalarType::UInt32: write_as<uint32_t>(ptr, val); break;
+        case ScalarType::Float32: write_as<float>(ptr, val); break;
+        case ScalarType::Float64: write_as<double>(ptr, val); break;
+        default: break;
+    }
+}
+
+PcdData read_pcd_data(const PcdHeader& header, const char* data, const size_t size){
+    PcdData pcd;
+    const size_t nr_fields=header.fields.size();
+    const size_t nr_points=header.nr_points;
+    pcd.field_offsets.resize(nr_fields);
+    pcd.field_strides.resize(nr_fields);
+
+    if(header.format==PcdHeader::Format::Binary){
+        CHECK_FILE(header.header_size+nr_points*header.point_size<=size) << "The pcd file is smaller than its header says";
+        pcd.base=data+header.header_size;
+        for(size_t f=0; f<nr_fields; f++){
+            pcd.field_offsets[f]=header.fields[f].offset;
+            pcd.field_strides[f]=header.point_size;
+        }
+
+    }else if(header.format==PcdHeader::Format::BinaryCompressed){
+        //the data is a compressed size and uncompressed size followed by the lzf data. Once uncompressed, the values are stored per field and not per point (xxxyyyzzz)
+        CHECK_FILE(header.header_size+8<=size) << "The pcd file is too small to contain compressed data";
+        uint32_t compressed_size, uncompressed_size;
+        std::memcpy(&compressed_size, data+header.header_size, 4);
+        std::memcpy(&uncompressed_size, data+header.header_size+4, 4);
+        CHECK_FILE(header.header_size+8+compressed_size<=size) << "The pcd file is smaller than the compressed data it says it has";
+        CHECK_FILE(uncompressed_size==nr_points*header.point_size) << "The pcd compressed data decompresses to " << uncompressed_size << " bytes but the header describes " << nr_points*header.point_size;
+        pcd.storage.resize(uncompressed_size);
+        if(uncompressed_size!=0){
+            CHECK_FILE(lzf_decompress(data+header.header_size+8, compressed_size, pcd.storage.data(), uncompressed_size)) << "Failed to decompress the pcd data";
+        }
+        pcd.base=pcd.storage.data();
+        size_t offset=0;
+        for(size_t f=0; f<nr_fields; f++){
+            const size_t field_size=scalar_type_size(header.fields[f].type)*header.fields[f].count;
+            pcd.field_offsets[f]=offset;
+            pcd.field_strides[f]=field_size;
+            offset+=field_size*nr_points;
+        }
+
+    }else{
+        //find where each line starts and then parse the points in parallel into the binary layout
+        std::vector<const char*> line_starts;
+        line_starts.reserve(nr_points);
+        const char* p=data+header.header_size;
+        const char* end=data+size;
+        while(p<end && line_starts.size()<nr_points){
+            const char* line_end=(const char*)memchr(p, '\n', end-p);
+            if(!line_end) line_end=end;
+            const char* first=skip_blanks(p, line_end);
+            if(first<line_end && *first!='\r'){ //skip empty lines
+                line_starts.push_back(p);
+            }
+            p=line_end+1;
+        }
+        CHECK_FILE(line_starts.size()==nr_points) << "The pcd file has " << line_starts.size() << " points but the header says " << nr_points;
+
+        pcd.storage.resize(nr_points*header.point_size);
+        pcd.base=pcd.storage.data();
+        for(size_t f=0; f<nr_fields; f++){
+            pcd.field_offsets[f]=header.fields[f].offset;
+            pcd.field_strides[f]=header.point_size;
+        }
+        #pragma omp parallel for schedule(static)
+        for(long long i=0; i<(long long)nr_points; i++){
+            const char* p=line_starts[i];
+            char* dst=pcd.storage.data()+i*header.point_size;
+            for(size_t f=0; f<nr_fields; f++){
+                const PcdField& field=header.fields[f];
+                const size_t type_size=scalar_type_size(field.type);
+                for(int c=0; c<field.count; c++){
+                    double val=0;
+                    p=parse_pcd_value(skip_blanks(p, end), end, val);
+                    write_scalar(dst+field.offset+c*type_size, field.type, val);
+                }
+            }
+        }
+    }
+
+    return pcd;
+}
+
+void write_pcd_file(const std::string& file_path, const PcdHeader& header, const char* points){
+    std::ofstream file(file_path, std::ios::out | std::ios::binary | std::ios::trunc);
+    CHECK(file.is_open()) << "Failed to open for writing " << file_path;
+
+    const Eigen::Quaterniond q(header.viewpoint.linear());
+    const Eigen::Vector3d t=header.viewpoint.translation();
+    std::stringstream ss;
+    ss << "# .PCD v0.7 - Point Cloud Data file format\n";
+    ss << "VERSION 0.7\n";
+    ss << "FIELDS";
+    for(size_t f=0; f<header.fields.size(); f++) ss << " " << header.fields[f].name;
+    ss << "\nSIZE";
+    for(size_t f=0; f<header.fields.size(); f++) ss << " " << scalar_type_size(header.fields[f].type);
+    ss << "\nTYPE";
+    for(size_t f=0; f<header.fields.size(); f++){
+        ScalarType type=header.fields[f].type;
+        ss << " " << (type==ScalarType::Float32 || type==ScalarType::Float64 ? 'F' : (type==ScalarType::Int8 || type==ScalarType::Int16 || type==ScalarType::Int32 ? 'I' : 'U') );
+    }
+    ss << "\nCOUNT";
+    for(size_t f=0; f<header.fields.size(); f++) ss << " " << header.fields[f].count;
+    ss << "\nWIDTH " << header.width;
+    ss << "\nHEIGHT " << header.height;
+    ss << "\nVIEWPOINT " << t.x() << " " << t.y() << " " << t.z() << " " << q.w() << " " << q.x() << " " << q.y() << " " << q.z();
+    ss << "\nPOINTS " << header.nr_points;
+    ss << "\nDATA " << (header.format==PcdHeader::Format::Ascii? "ascii" : (header.format==PcdHeader::Format::Binary? "binary" : "binary_compressed")) << "\n";
+    file << ss.str();
+
+    const size_t nr_points=header.nr_points;
+    if(header.format==PcdHeader::Format::Binary){
+        file.write(points, nr_points*header.point_size);
+
+    }else if(header.format==PcdHeader::Format::BinaryCompressed){
+        //store the values per field which compresses a lot better
+        std::vector<char> soa(nr_points*header.point_size);
+        size_t offset=0;
+        for(size_t f=0; f<header.fields.size(); f++){
+            const size_t field_size=scalar_type_size(header.fields[f].type)*header.fields[f].count;
+            char* dst=soa.data()+offset;
+            const size_t field_offset=header.fields[f].offset;
+            #pragma omp parallel for schedule(static)
+            for(long long i=0; i<(long long)nr_points; i++){
+                std::memcpy(dst+i*field_size, points+i*header.point_size+field_offset, field_size);
+            }
+            offset+=field_size*nr_points;
+        }
+        std::vector<char> compressed=lzf_compress(soa.data(), soa.size());
+        uint32_t compressed_size=compressed.size();
+        uint32_t uncompressed_size=soa.size();
+        file.write((const char*)&compressed_size, 4);
+        file.write((const char*)&uncompressed_size, 4);
+        file.write(compressed.data(), compressed.size());
+
+    }else{
+        //format the lines in parallel and then write them in order
+        std::vector<std::string> lines(nr_points);
+        #pragma omp parallel for schedule(static)
+        for(long long i=0; i<(long long)nr_points; i++){
+            const char* point=points+i*header.point_size;
+            std::string& line=lines[i];
+            char buf[64];
+            for(size_t f=0; f<header.fields.size(); f++){
+                const PcdField& field=header.fields[f];
+                const size_t type_size=scalar_type_size(field.type);
+                for(int c=0; c<field.count; c++){
+                    const double val=read_scalar<double>(point+field.offset+c*type_size, field.type);
+                    if(field.type==ScalarType::Float32){
+                        snprintf(buf, sizeof(buf), "%.9g", val); //enough digits for the float to survive the round trip, this matters for the packed rgb
+                    }else if(field.type==ScalarType::Float64){
+                        snprintf(buf, sizeof(buf), "%.17g", val);
+                    }else{
+                        snprintf(buf, sizeof(buf), "%lld", (long long)val);
+                    }
+                    if(!line.empty()) line+=' ';
+                    line+=buf;
+                }
+            }
+            line+='\n';
+        }
+        for(size_t i=0; i<lines.size(); i++){
+            file << lines[i];
+        }
+    }
+
+    CHECK(file.good()) << "Failed to write " << file_path;
+}
+
+
+} //namespace easy_pbr
@@ -0,0 +1,176 @@
+#include "easy_pbr/NpzWriter.h"
+
+//c++
+#include <fstream>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <atomic>
+#include <unistd.h>
+
+//loguru
+#define LOGURU_REPLACE_GLOG 1
+#include <loguru.hpp>
+
+namespace easy_pbr{
+
+template <typename T>
+static inline void append_pod(std::string& buf, const T val){
+    buf.append((const char*)&val, sizeof(T));
+}
+
+static uint32_t crc32(const char* data, const size_t size){
+    static uint32_t table[256];
+    static bool table_initialized=[]{
+        for(uint32_t i=0; i<256; i++){
+            uint32_t c=i;
+            for(int k=0; k<8; k++){
+                c= (c&1) ? 0xEDB88320u^(c>>1) : c>>1;
+            }
+            table[i]=c;
+        }
+        return true;
+    }();
+    (void)table_initialized;
+
+    uint32_t crc=0xFFFFFFFFu;
+    for(size_t i=0; i<size; i++){
+        crc=table[(crc^(unsigned char)data[i])&0xFF]^(crc>>8);
+    }
+    return crc^0xFFFFFFFFu;
+}
+
+//numpy dtype of each opencv depth, the data is written in the byte order of the machine which is little endian on anything we run on
+static std::string npy_descr(const int depth){
+    switch(depth){
+        case CV_8U: return "|u1";
+        case CV_8S: return "|i1";
+        case CV_16U: return "<u2";
+        case CV_16S: return "<i2";
+        case CV_32S: return "<i4";
+        case CV_32F: return "<f4";
+        case CV_64F: return "<f8";
+        default: LOG(FATAL) << "Mat depth " << depth << " has no numpy dtype";
+    }
+    return "";
+}
+
+void NpzWriter::add(const std::string& name, const cv::Mat& mat, const bool flip_vertically){
+    CHECK(!mat.empty()) << "Layer " << name << " is empty";
+
+    std::string shape="("+std::to_string(mat.rows)+", "+std::to_string(mat.cols);
+    shape+= mat.channels()==1 ? ")" : ", "+std::to_string(mat.channels())+")";
+    std::string header="{'descr': '"+npy_descr(mat.depth())+"', 'fortran_order': False, 'shape': "+shape+", }";
+    //magic, version and header length take 10 bytes and the whole header is padded with spaces to a multiple of 64 and ends in a newline
+    const size_t unpadded=10+header.size()+1;
+    header.append( (64-unpadded%64)%64, ' ');
+    header.push_back('\n');
+
+    const size_t row_bytes=mat.cols*mat.elemSize();
+    Entry entry;
+    entry.name=name+".npy";
+    entry.data.reserve(10+header.size()+row_bytes*mat.rows);
+    entry.data.append("\x93NUMPY", 6);
+    entry.data.push_back(1);
+    entry.data.push_back(0);
+    append_pod<uint16_t>(entry.data, header.size());
+    entry.data.append(header);
+    for(int y=0; y<mat.rows; y++){
+        entry.data.append( (const char*)mat.ptr(flip_vertically ? mat.rows-1-y : y), row_bytes);
+    }
+    entry.crc=crc32(entry.data.data(), entry.data.size());
+    m_entries.push_back(std::move(entry));
+}
+
+bool NpzWriter::write(const std::string& file_path){
+    //the zip is written without compression and with the zip32 limits which is what numpy.savez also does for files below 4GB
+    const uint16_t version=20;
+    const uint16_t dos_date=0x21; //1980-01-01, the time of the files doesn't matter
+    std::string central_dir;
+    size_t offset=0;
+
+    static std::atomic<uint64_t> nr_tmp_files(0); //so that several threads writing the same path don't share the temporary file
+    const std::string tmp_path=file_path+".tmp"+std::to_string(getpid())+"_"+std::to_string(nr_tmp_files++);
+    {
+        std::ofstream file(tmp_path, std::ios::out | std::ios::binary | std::ios::trunc);
+        if(!file.is_open()){
+            return false;
+        }
+        for(size_t i=0; i<m_entries.size(); i++){
+            const Entry& e=m_entries[i];
+            if(offset+30+e.name.size()+e.data.size()>std::numeric_limits<uint32_t>::max()){ //30 bytes of local header
+                LOG(WARNING) << "The layers are too big for a npz file without zip64 " << file_path;
+                file.close();
+                std::remove(tmp_path.c_str());
+                return false;
+            }
+
+            std::string local_header;
+            append_pod<uint32_t>(local_header, 0x04034b50);
+            append_pod<uint16_t>(local_header, version);
+            append_pod<uint16_t>(local_header, 0); //flags
+            append_pod<uint16_t>(local_header, 0); //stored, no compression
+            append_pod<uint16_t>(local_header, 0); //time
+            append_pod<uint16_t>(local_header, dos_date);
+            append_pod<uint32_t>(local_header, e.crc);
+            append_pod<uint32_t>(local_header, e.data.size()); //compressed size
+            append_pod<uint32_t>(local_header, e.data.size());
+            append_pod<uint16_t>(local_header, e.name.size());
+            append_pod<uint16_t>(local_header, 0); //extra field length
+            local_header.append(e.name);
+
+            append_pod<uint32_t>(central_dir, 0x02014b50);
+            append_pod<uint16_t>(central_dir, version); //made by
+            append_pod<uint16_t>(central_dir, version); //needed to extract
+            append_pod<uint16_t>(central_dir, 0);
+            append_pod<uint16_t>(central_dir, 0);
+            append_pod<uint16_t>(central_dir, 0);
+            append_pod<uint16_t>(central_dir, dos_date);
+            append_pod<uint32_t>(central_dir, e.crc);
+            append_pod<uint32_t>(central_dir, e.data.size());
+            append_pod<uint32_t>(central_dir, e.data.size());
+            append_pod<uint16_t>(central_dir, e.name.size());
+            append_pod<uint16_t>(central_dir, 0); //extra field length
+            append_pod<uint16_t>(central_dir, 0); //comment length
+            append_pod<uint16_t>(central_dir, 0); //disk number
+            append_pod<uint16_t>(central_dir, 0); //internal attributes
+            append_pod<uint32_t>(central_dir, 0); //external attributes
+            append_pod<uint32_t>(central_dir, offset); //of the local header
+            central_dir.append(e.name);
+
+            file.write(local_header.data(), local_header.size());
+            file.write(e.data.data(), e.data.size());
+            offset+=local_header.size()+e.data.size();
+        }
+
+        std::string end_of_central_dir;
+        append_pod<uint32_t>(end_of_central_dir, 0x06054b50);
+        append_pod<uint16_t>(end_of_central_dir, 0); //disk number
+        append_pod<uint16_t>(end_of_central_dir, 0); //disk with the central dir
+        append_pod<uint16_t>(end_of_central_dir, m_entries.size()); //entries on this disk
+        append_pod<uint16_t>(end_of_central_dir, m_entries.size());
+        append_pod<uint32_t>(end_of_central_dir, central_dir.size());
+        append_pod<uint32_t>(end_of_central_dir, offset);
+        append_pod<uint16_t>(end_of_central_dir, 0); //comment length
+        file.write(central_dir.data(), central_dir.size());
+        file.write(end_of_central_dir.data(), end_of_central_dir.size());
+
+        if(!file.good()){
+            file.close();
+            std::remove(tmp_path.c_str());
+            return false;
+        }
+    }
+
+    if(std::rename(tmp_path.c_str(), file_path.c_str())!=0){
+        std::remove(tmp_path.c_str());
+        return false;
+    }
+    return true;
+}
+
+void NpzWriter::clear(){
+    m_entries.clear();
+}
+
+} //namespace easy_pbr
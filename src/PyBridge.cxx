@@ -11,18 +11,22 @@
 // #include "pybind11_tests.h"
 // #include "constructor_stats.h"
 #include <pybind11/operators.h>
+#include <pybind11/functional.h> //for the callback of Mesh.load_from_file_async
 #include <functional>
 
 //my stuff
 #include "easy_pbr/Viewer.h"
 #include "easy_pbr/Gui.h"
 #include "easy_pbr/Mesh.h"
+#include "easy_pbr/MeshGL.h"
 #include "easy_pbr/Scene.h"
 #include "easy_pbr/LabelMngr.h"
 #include "easy_pbr/Recorder.h"
+#include "easy_pbr/NpzWriter.h"
 #include "easy_pbr/Camera.h"
 #include "easy_pbr/SpotLight.h"
 #include "easy_pbr/Frame.h"
+#include "easy_pbr/FrameLoader.h"
 #include "easy_gl/UtilsGL.h"
 #include "Profiler.h"
 
@@ -279,9 +283,11 @@ PYBIND11_MODULE(easypbr, m) {
     .def("subsample", &Frame::subsample, py::arg().noconvert(), py::arg("subsample_imgs") = true )
     .def("upsample", &Frame::upsample, py::arg().noconvert(), py::arg("upsample_imgs") = true )
     .def("depth2world_xyz_mat", &Frame::depth2world_xyz_mat )
-    .def("depth2world_xyz_mesh", &Frame::depth2world_xyz_mesh )
+    .def("depth2world_xyz_mesh", &Frame::depth2world_xyz_mesh, py::arg("remove_zero_depth") = false )
     .def("pixels2dirs_mesh", &Frame::pixels2dirs_mesh )
     .def("pixels2_euler_angles_mesh", &Frame::pixels2_euler_angles_mesh )
+    .def("pixels2dirs", &Frame::pixels2dirs )
+    .def("pixels2_euler_angles", &Frame::pixels2_euler_angles )
     .def("pixels2coords", &Frame::pixels2coords )
     .def("unproject", &Frame::unproject )
     .def("project", &Frame::project )
@@ -295,12 +301,12 @@ PYBIND11_MODULE(easypbr, m) {
     // .def("backproject_depth", &Frame::backproject_depth )
     .def("rotate_clockwise_90", &Frame::rotate_clockwise_90 )
     .def("from_camera", &Frame::from_camera, py::arg().noconvert(), py::arg().noconvert(), py::arg().noconvert(), py::arg("flip_z_axis")=true, py::arg("flip_y_axis")=true )
-    .def("assign_color", &Frame::assign_color )
+    .def("assign_color", &Frame::assign_color, py::arg("cloud"), py::arg("check_occlusion") = false, py::arg("depth_tolerance") = 0.01 )
     // .def("pixel_world_direction", &Frame::pixel_world_direction )
     // .def("pixel_world_direction_euler_angles", &Frame::pixel_world_direction_euler_angles )
     .def("rgb_with_valid_depth", &Frame::rgb_with_valid_depth )
-    .def("compute_uv", &Frame::compute_uv )
-    .def("naive_splat", &Frame::naive_splat )
+    .def("compute_uv", &Frame::compute_uv, py::arg("cloud"), py::arg("check_occlusion") = false, py::arg("depth_tolerance") = 0.01 )
+    .def("naive_splat", &Frame::naive_splat, py::arg("cloud"), py::arg("values"), py::arg("bilinear") = false, py::arg("depth_tolerance") = 0.01 )
     .def("pos_in_world", &Frame::pos_in_world )
     .def("look_dir", &Frame::look_dir )
     .def("name", &Frame::name )
@@ -374,6 +380,7 @@ PYBIND11_MODULE(easypbr, m) {
     .def_readwrite("m_use_offscreen", &Viewer::m_use_offscreen )
     .def_readwrite("m_kernel_radius", &Viewer::m_kernel_radius )
     .def_readwrite("m_enable_culling", &Viewer::m_enable_culling )
+    .def_readwrite("m_packed_vertex_buffers", &Viewer::m_packed_vertex_buffers )
     .def_readwrite("m_enable_edl_lighting", &Viewer::m_enable_edl_lighting )
     .def_readwrite("m_enable_ssao", &Viewer::m_enable_ssao )
     // .def("print_pointers", &Viewer::print_pointers )
@@ -458,10 +465,17 @@ PYBIND11_MODULE(easypbr, m) {
     .def_static("show_all",  &Scene::show_all )
     .def_static("get_mesh_with_idx",  &Scene::get_mesh_with_idx )
     .def_static("get_mesh_with_name",  &Scene::get_mesh_with_name )
+    .def_static("get_mesh_with_id",  &Scene::get_mesh_with_id )
+    .def_static("get_idx_for_name",  &Scene::get_idx_for_name )
+    .def_static("get_id_for_name",  &Scene::get_id_for_name )
+    .def_static("get_meshes",  &Scene::get_meshes )
     .def_static("get_scale", &Scene::get_scale, py::arg("use_mutex") = true )
     .def_static("does_mesh_with_name_exist",  &Scene::does_mesh_with_name_exist)
+    .def_static("does_mesh_with_id_exist",  &Scene::does_mesh_with_id_exist)
     .def_static("remove_meshes_starting_with_name",  &Scene::remove_meshes_starting_with_name)
     .def_static("add_mesh",  &Scene::add_mesh)
+    .def_static("show_when_ready",  &Scene::show_when_ready)
+    .def_static("nr_pending_meshes",  &Scene::nr_pending_meshes)
     .def_static("set_floor_visible",  &Scene::set_floor_visible)
     .def_static("nr_meshes",  &Scene::nr_meshes)
     ;
@@ -518,12 +532,36 @@ PYBIND11_MODULE(easypbr, m) {
 
 
     //Mesh
+    //future of a mesh that is being loaded with Mesh.load_from_file_async
+    py::class_<std::shared_future<std::shared_ptr<Mesh>>> (m, "MeshFuture")
+    .def("get", [](const std::shared_future<std::shared_ptr<Mesh>>& future){ return future.get(); }, py::call_guard<py::gil_scoped_release>() )
+    .def("wait", &std::shared_future<std::shared_ptr<Mesh>>::wait, py::call_guard<py::gil_scoped_release>() )
+    .def("is_ready", [](const std::shared_future<std::shared_ptr<Mesh>>& future){ return future.wait_for(std::chrono::seconds(0))==std::future_status::ready; } )
+    ;
+
     py::class_<Mesh, std::shared_ptr<Mesh>> (m, "Mesh")
     .def(py::init<>())
     .def(py::init<std::string>())
-    .def("load_from_file", &Mesh::load_from_file )
+    .def("load_from_file", &Mesh::load_from_file, py::arg("file_path"), py::arg("use_cache") = true )
+    .def_readwrite_static("m_load_cache_enabled", &Mesh::m_load_cache_enabled )
+    .def_readwrite_static("m_load_cache_dir", &Mesh::m_load_cache_dir )
+    .def_static("load_cache_path", &Mesh::load_cache_path )
+    .def_static("invalidate_load_cache", &Mesh::invalidate_load_cache )
+    .def("read_ply", &Mesh::read_ply, py::arg("file_path"), py::call_guard<py::gil_scoped_release>() )
+    .def("read_ply_tinyply", &Mesh::read_ply_tinyply, py::arg("file_path"), py::call_guard<py::gil_scoped_release>() )
+    .def_static("load_from_file_async", &Mesh::load_from_file_async, py::arg("file_path"), py::arg("callback") = nullptr )
+    .def_static("load_many", &Mesh::load_many )
+    .def_static("set_load_nr_threads", &Mesh::set_load_nr_threads, py::call_guard<py::gil_scoped_release>() ) //waits for the loads queued on the old pool whose callbacks may need the GIL
+    .def("load_out_of_core", &Mesh::load_out_of_core, py::arg("file_path"), py::arg("points_per_chunk") = 1000000, py::arg("max_resident_chunks") = 32 )
+    .def("is_out_of_core", &Mesh::is_out_of_core )
+    .def("nr_chunks", &Mesh::nr_chunks )
+    .def("update_resident_chunks", py::overload_cast<const Eigen::Vector3d&>(&Mesh::update_resident_chunks) )
+    .def("update_resident_chunks", py::overload_cast<const Eigen::Vector3d&, const Eigen::Vector3d&>(&Mesh::update_resident_chunks) )
+    .def("wait_for_resident_chunks", &Mesh::wait_for_resident_chunks, py::call_guard<py::gil_scoped_release>() )
+    .def_readwrite("m_max_resident_chunks", &Mesh::m_max_resident_chunks )
     .def("read_obj", &Mesh::read_obj, py::arg().noconvert(), py::arg("load_vti") = false, py::arg("load_vni") = false   )
     .def("save_to_file", &Mesh::save_to_file )
+    .def("write_pcd", &Mesh::write_pcd, py::arg("file_path"), py::arg("data_format") = "binary" )
     .def("sanity_check", &Mesh::sanity_check )
     .def("clone", &Mesh::clone )
     // .def("add", &Mesh::add )
@@ -555,15 +593,21 @@ PYBIND11_MODULE(easypbr, m) {
     .def("get_extra_field_matrixXf", &Mesh::get_extra_field<Eigen::MatrixXf> )
     .def("get_extra_field_matrixXd", &Mesh::get_extra_field<Eigen::MatrixXd> )
     .def_readwrite("id", &Mesh::id)
+    .def_readonly("scene_id", &Mesh::scene_id)
     .def_readwrite("name", &Mesh::name)
     .def_readwrite("m_width", &Mesh::m_width)
     .def_readwrite("m_height", &Mesh::m_height)
     .def_readwrite("m_vis", &Mesh::m_vis)
     .def_readwrite("m_force_vis_update", &Mesh::m_force_vis_update)
     .def_readwrite("m_is_dirty", &Mesh::m_is_dirty)
+    .def("set_dirty", py::overload_cast<const std::string>(&Mesh::set_dirty) )
+    .def("set_dirty_rows", py::overload_cast<const std::string, const int, const int>(&Mesh::set_dirty_rows) )
+    .def("is_any_attribute_dirty", &Mesh::is_any_attribute_dirty )
+    .def("bytes_uploaded", [](const Mesh& m, const std::string attrib_name) { auto mesh_gl=m.m_mesh_gpu.lock(); return mesh_gl? mesh_gl->bytes_uploaded(attrib_name) : (size_t)0; } ) //bytes sent to the gpu for that matrix since the mesh was first shown, 0 if it was never uploaded
     .def_readwrite("m_is_shadowmap_dirty", &Mesh::m_is_shadowmap_dirty)
-    .def_readwrite("V", &Mesh::V)
-    .def_readwrite("F", &Mesh::F)
+    //assigning V or F from python copies into the existing buffer when the size matches, so the setter bumps the geometry version for the kd-tree and the AABB tree to notice
+    .def_property("V", [](const Mesh& m) -> const MeshMatrixX& { return m.V; }, [](Mesh& m, const MeshMatrixX& V) { m.V=V; m.set_dirty(MeshAttribute::V); } )
+    .def_property("F", [](const Mesh& m) -> const Eigen::MatrixXi& { return m.F; }, [](Mesh& m, const Eigen::MatrixXi& F) { m.F=F; m.set_dirty(MeshAttribute::F); } )
     .def_readwrite("C", &Mesh::C)
     .def_readwrite("E", &Mesh::E)
     .def_readwrite("D", &Mesh::D)
@@ -612,7 +656,7 @@ PYBIND11_MODULE(easypbr, m) {
     // .def("model_matrix_as_xyz_and_rpy", &Mesh::model_matrix_as_xyz_and_rpy )
     // .def("premultiply_model_matrix", &Mesh::premultiply_model_matrix )
     // .def("postmultiply_model_matrix", &Mesh::postmultiply_model_matrix )
-    .def("recalculate_normals", &Mesh::recalculate_normals )
+    .def("recalculate_normals", &Mesh::recalculate_normals, py::arg("use_libigl") = false )
     .def("flip_normals", &Mesh::flip_normals )
     .def("recalculate_min_max_height", &Mesh::recalculate_min_max_height )
     .def("decimate", &Mesh::decimate )
@@ -622,13 +666,15 @@ PYBIND11_MODULE(easypbr, m) {
     .def("to_3D", &Mesh::to_3D )
     .def("to_2D", &Mesh::to_2D )
     .def("remove_vertices_at_zero", &Mesh::remove_vertices_at_zero )
-    .def("remove_duplicate_vertices", &Mesh::remove_duplicate_vertices )
+    .def("remove_duplicate_vertices", &Mesh::remove_duplicate_vertices, py::arg("tolerance") = 1e-7 )
+    .def("voxel_grid_subsample", &Mesh::voxel_grid_subsample, py::arg("voxel_size") )
+    .def("poisson_disk_subsample", &Mesh::poisson_disk_subsample, py::arg("radius") )
+    .def("set_duplicate_verts_to_zero", &Mesh::set_duplicate_verts_to_zero, py::arg("tolerance") = 1e-7 )
     .def("undo_remove_duplicate_vertices", &Mesh::undo_remove_duplicate_vertices )
     .def("compute_tangents", &Mesh::compute_tangents, py::arg("tangent_length") = 1.0)
-    #ifdef EASYPBR_WITH_PCL
-    .def("estimate_normals_from_neighbourhood", &Mesh::estimate_normals_from_neighbourhood )
-    #endif
+    .def("estimate_normals_from_neighbourhood", &Mesh::estimate_normals_from_neighbourhood, py::arg("radius"), py::arg("max_nr_neighbours")=-1, py::arg("orient_towards_cur_pose")=true )
     .def("compute_distance_to_mesh", &Mesh::compute_distance_to_mesh )
+    .def("closest_points", &Mesh::closest_points, py::arg("query_points") )
     .def("fix_oversplit_due_to_blender_uv", &Mesh::fix_oversplit_due_to_blender_uv )
 
     // .def("compute_tangents", py::overload_cast<const float>(&Mesh::compute_tangents), py::arg("tangent_length") = 1.0)
@@ -642,7 +688,10 @@ PYBIND11_MODULE(easypbr, m) {
     // .def("move_in_y", &Mesh::move_in_y )
     // .def("move_in_z", &Mesh::move_in_z )
     .def("add_child", &Mesh::add_child )
-    .def("radius_search", &Mesh::radius_search )
+    .def("radius_search", py::overload_cast<const Eigen::Vector3d&, const double>(&Mesh::radius_search), py::arg("query_point"), py::arg("radius") )
+    .def("radius_search", py::overload_cast<const Eigen::MatrixXd&, const double, const int>(&Mesh::radius_search), py::arg("query_points"), py::arg("radius"), py::arg("max_nr_neighbours")=-1 )
+    .def("knn", &Mesh::knn, py::arg("query_points"), py::arg("k") )
+    .def("ball_query", &Mesh::ball_query, py::arg("query_points"), py::arg("radius"), py::arg("max_nr_neighbours") )
     .def("color_from_label_indices", &Mesh::color_from_label_indices )
     .def("set_diffuse_tex",  py::overload_cast<const std::string, const int, const bool> (&Mesh::set_diffuse_tex), py::arg().noconvert(),  py::arg("subsample") = 1, py::arg("read_alpha") = false   )  //https://github.com/pybind/pybind11/issues/876
     .def("set_metalness_tex", py::overload_cast<const std::string, const int, const bool> (&Mesh::set_metalness_tex), py::arg().noconvert(),  py::arg("subsample") = 1, py::arg("read_alpha") = false   )
@@ -657,6 +706,15 @@ PYBIND11_MODULE(easypbr, m) {
     ;
 
     //Recorder
+    //NpzWriter, mostly so that the files of capture_gbuffer can be checked against numpy
+    py::class_<NpzWriter> (m, "NpzWriter")
+    .def(py::init<>())
+    .def("add", &NpzWriter::add, py::arg("name"), py::arg("mat"), py::arg("flip_vertically") = false )
+    .def("write", &NpzWriter::write, py::arg("file_path") )
+    .def("clear", &NpzWriter::clear )
+    .def("nr_layers", &NpzWriter::nr_layers )
+    ;
+
     py::class_<Recorder, std::shared_ptr<Recorder>> (m, "Recorder")
     // .def(py::init<>())
     .def("record", py::overload_cast<const std::string, const std::string >(&Recorder::record) )
@@ -664,6 +722,45 @@ PYBIND11_MODULE(easypbr, m) {
     .def("write_without_buffering", &Recorder::write_without_buffering )
     .def("is_finished", &Recorder::is_finished )
     .def("nr_images_recorded", &Recorder::nr_images_recorded )
+    .def("flush", &Recorder::flush, py::call_guard<py::gil_scoped_release>() )
+    .def("set_nr_writer_threads", &Recorder::set_nr_writer_threads, py::call_guard<py::gil_scoped_release>() )
+    .def("nr_writer_threads", &Recorder::nr_writer_threads )
+    .def("set_backpressure", py::overload_cast<const std::string, const int >(&Recorder::set_backpressure), py::arg("policy"), py::arg("max_queued_images") = 100 )
+    .def("nr_images_queued", &Recorder::nr_images_queued )
+    .def("nr_images_dropped", &Recorder::nr_images_dropped )
+    .def("start_video", &Recorder::start_video, py::arg("file_path"), py::arg("fps") = 30, py::arg("codec") = "libx264", py::arg("crf") = 18 )
+    .def("stop_video", &Recorder::stop_video, py::call_guard<py::gil_scoped_release>() )
+    .def("is_recording_video", &Recorder::is_recording_video )
+    .def("set_image_format", py::overload_cast<const std::string, const int, const int >(&Recorder::set_image_format), py::arg("format"), py::arg("png_compression") = 1, py::arg("jpeg_quality") = 95 )
+    .def("capture_gbuffer", &Recorder::capture_gbuffer, py::arg("name"), py::arg("path") )
+    .def("poll_captures", &Recorder::poll_captures )
+    .def("render_poses", py::overload_cast<const std::vector<std::shared_ptr<Camera>>&, const std::string >(&Recorder::render_poses) )
+    .def("render_poses", py::overload_cast<const std::vector<Eigen::Matrix4f, Eigen::aligned_allocator<Eigen::Matrix4f>>&, const std::string >(&Recorder::render_poses) )
+    .def("render_poses_to_mats", &Recorder::render_poses_to_mats )
+    .def("last_batch_images_per_sec", &Recorder::last_batch_images_per_sec )
+    ;
+
+    //FrameLoader
+    py::class_<FrameLoader, std::shared_ptr<FrameLoader>> (m, "FrameLoader")
+    //the loader gets destroyed when python drops it, while holding the gil. The destructor waits for the running loads and those may need the gil to run a load_images defined in python, so the gil gets released around it
+    .def_static("create", [](const std::vector<std::shared_ptr<Frame>>& frames, const int nr_threads, const int read_ahead, const float cache_budget_mb){
+        std::shared_ptr<FrameLoader> loader=FrameLoader::create(frames, nr_threads, read_ahead, cache_budget_mb);
+        return std::shared_ptr<FrameLoader>(loader.get(), [loader](FrameLoader*) mutable {
+            if(PyGILState_Check()){
+                py::gil_scoped_release release;
+                loader.reset();
+            }else{
+                loader.reset();
+            }
+        });
+    }, py::arg("frames"), py::arg("nr_threads") = 4, py::arg("read_ahead") = 8, py::arg("cache_budget_mb") = 2048 )
+    .def("get_frame", &FrameLoader::get_frame, py::call_guard<py::gil_scoped_release>() ) //the workers may need the gil to run a load_images defined in python
+    .def("prefetch", &FrameLoader::prefetch )
+    .def("clear", &FrameLoader::clear )
+    .def("nr_frames", &FrameLoader::nr_frames )
+    .def("nr_cached", &FrameLoader::nr_cached )
+    .def("cache_bytes", &FrameLoader::cache_bytes )
+    .def("cache_budget_bytes", &FrameLoader::cache_budget_bytes )
     ;
 
     //Profiler
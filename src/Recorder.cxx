@@ -8,10 +8,34 @@
 //my stuff
 #include "easy_pbr/Viewer.h"
 #include "easy_pbr/Camera.h"
+#include "easy_pbr/NpzWriter.h"
+#include "string_utils.h"
 // #include "opencv_utils.h" //only for debugging
 #define ENABLE_GL_PROFILING 1
 #include "Profiler.h"
 
+//configuru
+#define CONFIGURU_WITH_EIGEN 1
+#define CONFIGURU_IMPLICIT_CONVERSIONS 1
+#include <configuru.hpp>
+using namespace configuru;
+
+//c++
+#include <cstdio>
+#include <cstring>
+#include <chrono>
+#include <set>
+#include <future>
+#include <cerrno>
+
+//posix
+#include <spawn.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <fcntl.h>
+extern char **environ;
+
 //boost
 #include <boost/filesystem.hpp>
 namespace fs = boost::filesystem;
@@ -20,55 +44,133 @@ namespace fs = boost::filesystem;
 
 namespace easy_pbr{
 
-Recorder::Recorder(Viewer* view):
-    m_is_recording(false),
+//the gl textures are upside down and in rgb(a) order while opencv wants them top down and in bgr(a). This does the flip and the channel swap in one pass over the pixels instead of a cv::flip and a cvtColor. The dst can have 3 channels when src has 4 in which case the alpha is dropped
+template <typename T>
+static void flip_and_swap_rb(const cv::Mat& src, cv::Mat& dst){
+    const int in_channels=src.channels();
+    const int out_channels=dst.channels();
+    const size_t row_bytes=src.cols*src.elemSize();
+    for(int y=0; y<src.rows; y++){
+        const T* src_row=src.ptr<T>(src.rows-1-y);
+        T* dst_row=dst.ptr<T>(y);
+        if(in_channels<3){
+            std::memcpy(dst_row, src_row, row_bytes);
+            continue;
+        }
+        for(int x=0; x<src.cols; x++){
+            const T* s=src_row+x*in_channels;
+            T* d=dst_row+x*out_channels;
+            d[0]=s[2];
+            d[1]=s[1];
+            d[2]=s[0];
+            if(out_channels==4){
+                d[3]=s[3];
+            }
+        }
+    }
+}
+
+static void flip_and_swap_rb(const cv::Mat& src, cv::Mat& dst){
+    switch(src.depth()){
+        case CV_8U: flip_and_swap_rb<unsigned char>(src, dst); break;
+        case CV_16U: flip_and_swap_rb<unsigned short>(src, dst); break;
+        case CV_32F: flip_and_swap_rb<float>(src, dst); break;
+        default: LOG(FATAL) << "Recording images of depth " << src.depth() << " is not supported";
+    }
+}
+
+Recorder::Recorder(Viewer* view, const std::string config_file):
     m_view(view),
+    m_cv_mats_queue(100),
+    m_video_queue(100),
+    m_is_recording_video(false),
+    m_video_fps(30),
+    m_video_crf(18),
+    m_mat_pool(new MatPool(256)),
+    m_writer_generation(0),
+    m_image_format(ImageFormat::Auto),
+    m_png_compression(1),
+    m_jpeg_quality(95),
+    m_last_batch_images_per_sec(0),
+    m_is_recording(false),
     m_nr_images_recorded(0)
     // m_recording_path("./recordings/"),
     // m_snapshot_name("img.png")
 {
 
+    init_params(config_file);
 
-    // //initialize the pbo used for reading the default framebuffer
-    // m_pbo_storages_initialized.resize(m_nr_pbos,false);
-    // m_pbo_ids.resize(m_nr_pbos);
-    // m_full_paths.resize(m_nr_pbos);
-    // glGenBuffers(m_nr_pbos, m_pbo_ids.data());
-    // m_idx_pbo_write=0;
-    // m_idx_pbo_read=1; //just one in front of the writing one so it will take one full loop of all pbos for it to catch up
+}
 
-    m_writer_threads.resize(8);
-    m_threads_are_running=true;
-    for(size_t i = 0; i < m_writer_threads.size(); i++){
-        m_writer_threads[i]=std::thread( &Recorder::write_to_file_threaded, this);
+Recorder::~Recorder(){
+    //the writers finish all the images that are still queued before they exit
+    release_gl_resources(); //normally the viewer did it already, while the context was still alive
+    if(m_is_recording_video){
+        stop_video();
     }
-
+    stop_writer_threads();
 }
 
-Recorder::~Recorder(){
-    //wait for the threads to write all the rest of the images
-    while(m_cv_mats_queue.size_approx()!=0){
-        VLOG(1) << "waiting for recording to finish";
-        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+void Recorder::init_params(const std::string config_file){
+    std::string config_file_trim=radu::utils::trim_copy(config_file);
+    std::string config_file_abs;
+    if (fs::path(config_file_trim).is_relative()){
+        config_file_abs=(fs::path(PROJECT_SOURCE_DIR) / config_file_trim).string();
+    }else{
+        config_file_abs=config_file_trim;
     }
-    std::this_thread::sleep_for(std::chrono::milliseconds(1000));
 
+    //get the default config and if the section is not available in the current one, fallback to the default
+    Config default_cfg = configuru::parse_file(std::string(DEFAULT_CONFIG), CFG);
+    Config default_vis_cfg=default_cfg["visualization"];
+    Config default_recorder_cfg=default_cfg["visualization"]["recorder"];
+    Config cfg = configuru::parse_file(config_file_abs, CFG);
+    Config vis_cfg=cfg.get_or("visualization", default_cfg);
+    Config recorder_cfg=vis_cfg.get_or("recorder", default_vis_cfg);
+
+    int nr_writer_threads = recorder_cfg.get_or("nr_writer_threads", default_recorder_cfg);
+    int max_queued_images = recorder_cfg.get_or("max_queued_images", default_recorder_cfg);
+    std::string backpressure = (std::string)recorder_cfg.get_or("backpressure", default_recorder_cfg);
+    std::string image_format = (std::string)recorder_cfg.get_or("image_format", default_recorder_cfg);
+    int png_compression = recorder_cfg.get_or("png_compression", default_recorder_cfg);
+    int jpeg_quality = recorder_cfg.get_or("jpeg_quality", default_recorder_cfg);
+
+    set_backpressure(backpressure, max_queued_images);
+    set_image_format(image_format, png_compression, jpeg_quality);
+    start_writer_threads(nr_writer_threads);
+}
 
-    m_threads_are_running=false;
+void Recorder::start_writer_threads(const int nr_threads){
+    CHECK(nr_threads>0) << "The recorder needs at least one writer thread but got " << nr_threads;
+    std::lock_guard<std::mutex> lock(m_writer_threads_mutex);
+    CHECK(m_writer_threads.empty()) << "The writer threads are already running";
+    m_cv_mats_queue.reopen();
+    m_writer_threads.resize(nr_threads);
+    for(size_t i = 0; i < m_writer_threads.size(); i++){
+        m_writer_threads[i]=std::thread( &Recorder::write_to_file_threaded, this, m_writer_generation.load());
+    }
+}
+
+void Recorder::stop_writer_threads(){
+    std::lock_guard<std::mutex> lock(m_writer_threads_mutex);
+    m_cv_mats_queue.close();
     for(size_t i = 0; i < m_writer_threads.size(); i++){
         m_writer_threads[i].join();
     }
+    m_writer_threads.clear();
+}
+
+void Recorder::enqueue(const MatWithFilePath& mat_with_file){
+    bool queued=m_cv_mats_queue.push(mat_with_file);
+    CHECK(queued) << "The writer threads of the recorder are stopped";
 }
 
 bool Recorder::record(gl::Texture2D& tex, const std::string name, const std::string path){
     GL_C( tex.download_to_pbo() );
 
-    if( m_cv_mats_queue.size_approx()>100)
-        VLOG(1) << "Enqueued too many cv_mats approx mats in queue: " << m_cv_mats_queue.size_approx();
-
     if(tex.cur_pbo_download().storage_initialized() ){
         int cv_type=gl_internal_format2cv_type(tex.internal_format());
-        cv::Mat cv_mat = cv::Mat::zeros(cv::Size(tex.cur_pbo_download().width(), tex.cur_pbo_download().height()), cv_type); //the size of the texture is not the same as the pbo we ae downloading from because the pbo is delayed a couple of frames so a resizing of texture takes a while to take effect
+        cv::Mat cv_mat = m_mat_pool->acquire(tex.cur_pbo_download().height(), tex.cur_pbo_download().width(), cv_type); //the size of the texture is not the same as the pbo we ae downloading from because the pbo is delayed a couple of frames so a resizing of texture takes a while to take effect. No need to zero it since the download overwrites all of it
         // VLOG(1) <<"writing mat of type " << easy_pbr::utils::type2string(cv_mat.type());
 
         tex.download_from_oldest_pbo(cv_mat.data);
@@ -83,10 +185,15 @@ bool Recorder::record(gl::Texture2D& tex, const std::string name, const std::str
         //     m_times_written_for_tex[name]++;
         // }
 
-        MatWithFilePath mat_with_file;
-        mat_with_file.cv_mat=cv_mat;
-        mat_with_file.file_path= ( fs::path(path)/name ).string();
-        m_cv_mats_queue.enqueue(mat_with_file);
+        if(m_is_recording_video){
+            bool queued=m_video_queue.push(cv_mat); //depending on the backpressure policy this may wait for the video writer to make space
+            CHECK(queued) << "The video writer is stopped";
+        }else{
+            MatWithFilePath mat_with_file;
+            mat_with_file.cv_mat=cv_mat;
+            mat_with_file.file_path= ( fs::path(path)/name ).string();
+            enqueue(mat_with_file); //depending on the backpressure policy this may wait for the writers to make space
+        }
 
         if (is_recording()){
             m_nr_images_recorded++;
@@ -98,10 +205,6 @@ bool Recorder::record(gl::Texture2D& tex, const std::string name, const std::str
         return false;
     }
 
-    if( m_cv_mats_queue.size_approx()>100){
-        LOG(FATAL) << "Enqueued too many cv_mats and couldn't write all of them in time. Consider adding more threads for writing or slowing down the enqueueing";
-    }
-
 }
 
 void Recorder::write_without_buffering(gl::Texture2D& tex, const std::string name, const std::string path){
@@ -113,11 +216,7 @@ void Recorder::write_without_buffering(gl::Texture2D& tex, const std::string nam
     MatWithFilePath mat_with_file;
     mat_with_file.cv_mat=cv_mat;
     mat_with_file.file_path= ( fs::path(path)/name ).string();
-    m_cv_mats_queue.enqueue(mat_with_file);
-
-    if( m_cv_mats_queue.size_approx()>100){
-        LOG(FATAL) << "Enqueued too many cv_mats and couldn't write all of them in time. Consider adding more threads for writing or slowing down the enqueueing";
-    }
+    enqueue(mat_with_file);
 
 }
 
@@ -134,20 +233,15 @@ void Recorder::snapshot(const std::string name, const std::string path){
 
 void Recorder::record_orbit(const std::string path){
     int nr_images=360;
-    float angle_increment=360/nr_images; //each segment needs to have this many angles
-    m_view->m_show_gui=false; //this function is usually called by the gui, if we do again a view->update, it will try to make another frame for the gui and that will fail
-    for(int i=0; i<360; i++){
-        m_view->m_camera->orbit_y(angle_increment);
-        m_view->update();
-        std::string snapshot_name=std::to_string(i)+".png";
-        //record
-        if (m_view->m_record_with_transparency){
-            write_without_buffering(m_view->m_final_fbo_no_gui.tex_with_name("color_with_transparency_gtex"), snapshot_name, path);
-        }else{
-            write_without_buffering(m_view->m_final_fbo_no_gui.tex_with_name("color_without_transparency_gtex"), snapshot_name, path);
-        }
+    float angle_increment=360.0/nr_images; //each segment needs to have this many angles
+    //the orbit is rendered as a batch of cameras so it doesn't go through update() and the gui of the window
+    std::vector<std::shared_ptr<Camera>> cameras;
+    std::shared_ptr<Camera> cam=m_view->m_camera->clone();
+    for(int i=0; i<nr_images; i++){
+        cam->orbit_y(angle_increment);
+        cameras.push_back(cam->clone());
     }
-    m_view->m_show_gui=true;
+    render_poses(cameras, path);
 }
 
 
@@ -262,15 +356,18 @@ void Recorder::record_orbit(const std::string path){
 
 // }
 
-void Recorder::write_to_file_threaded(){
+void Recorder::write_to_file_threaded(const int generation){
 
 
-    while(m_threads_are_running){
+    //sleeps until there is something to write and exits once the queue is closed and empty, or once set_nr_writer_threads replaced this generation of writers
+    auto retired=[this, generation]{ return m_writer_generation!=generation; };
+    MatWithFilePath mat_with_file;
+    while(m_cv_mats_queue.pop(mat_with_file, retired)){
 
-        MatWithFilePath mat_with_file;
-        bool found = m_cv_mats_queue.try_dequeue(mat_with_file);
-        if(!found){
-            std::this_thread::sleep_for(std::chrono::milliseconds(3));
+        if(!mat_with_file.layers.empty()){
+            write_layers(mat_with_file);
+            mat_with_file.batch_token.reset();
+            m_cv_mats_queue.task_done();
             continue;
         }
 
@@ -278,29 +375,57 @@ void Recorder::write_to_file_threaded(){
         TIME_START("write_to_file");
 
 
-        //create folder
-        fs::path folder=fs::path(mat_with_file.file_path).parent_path();
-        if (!fs::exists(folder)){
-            fs::create_directories(folder);
+        const ImageFormat format=ImageFormat::_from_integral(m_image_format);
+        const cv::Mat& src=mat_with_file.cv_mat;
+
+        //the extension decides the encoder of imwrite
+        fs::path file_path(mat_with_file.file_path);
+        switch(format){
+            case ImageFormat::Png: file_path.replace_extension(".png"); break;
+            case ImageFormat::Jpeg: file_path.replace_extension(".jpg"); break;
+            case ImageFormat::Ppm: file_path.replace_extension(src.channels()==1 ? ".pgm" : ".ppm"); break;
+            case ImageFormat::Pfm: file_path.replace_extension(".pfm"); break;
+            case ImageFormat::Exr: file_path.replace_extension(".exr"); break;
+            default: break;
+        }
+        create_folder_once(file_path.parent_path().string());
+
+        //jpeg, ppm and pfm can't store alpha so we drop it already in the flip
+        const bool drop_alpha= src.channels()==4 && (format==+ImageFormat::Jpeg || format==+ImageFormat::Ppm || format==+ImageFormat::Pfm);
+        cv::Mat flipped=m_mat_pool->acquire(src.rows, src.cols, CV_MAKETYPE(src.depth(), drop_alpha ? 3 : src.channels()) );
+        flip_and_swap_rb(src, flipped);
+        m_mat_pool->release(mat_with_file.cv_mat);
+
+        //ppm is 8 bit while pfm and exr are float
+        cv::Mat to_write=flipped;
+        if(format==+ImageFormat::Ppm && flipped.depth()==CV_32F){
+            flipped.convertTo(to_write, CV_8U, 255.0);
+        }else if( (format==+ImageFormat::Pfm || format==+ImageFormat::Exr) && flipped.depth()!=CV_32F){
+            flipped.convertTo(to_write, CV_32F, flipped.depth()==CV_16U ? 1.0/65535.0 : 1.0/255.0);
         }
 
-        cv::Mat cv_mat_flipped;
-        cv::flip(mat_with_file.cv_mat, cv_mat_flipped, 0);
-        if(cv_mat_flipped.channels()==4){
-            cv::cvtColor(cv_mat_flipped, cv_mat_flipped, cv::COLOR_BGRA2RGBA);
-        }else if(cv_mat_flipped.channels()==3){
-            cv::cvtColor(cv_mat_flipped, cv_mat_flipped, cv::COLOR_BGR2RGB);
+        std::vector<int> params;
+        if(format==+ImageFormat::Png || (format==+ImageFormat::Auto && file_path.extension()==".png") ){
+            params={cv::IMWRITE_PNG_COMPRESSION, m_png_compression};
+        }else if(format==+ImageFormat::Jpeg || (format==+ImageFormat::Auto && (file_path.extension()==".jpg" || file_path.extension()==".jpeg")) ){
+            params={cv::IMWRITE_JPEG_QUALITY, m_jpeg_quality};
+        }else if(format==+ImageFormat::Ppm){
+            params={cv::IMWRITE_PXM_BINARY, 1};
         }
-        VLOG(1) << "writen image to " << mat_with_file.file_path;
+
+        VLOG(1) << "writen image to " << file_path.string();
         bool result;
         try{
-            result=cv::imwrite(mat_with_file.file_path, cv_mat_flipped);
+            result=cv::imwrite(file_path.string(), to_write, params);
         }catch (const cv::Exception& ex){
             LOG(FATAL) << "Exception saving image " << ex.what();
         }
         CHECK(result) << "Something went wrong when writing image";
+        m_mat_pool->release(flipped);
         TIME_END("write_to_file");
 
+        mat_with_file.batch_token.reset(); //otherwise it would only be released when the next image is popped
+        m_cv_mats_queue.task_done();
     }
 
 }
@@ -323,17 +448,420 @@ int Recorder::nr_images_recorded(){
     return m_nr_images_recorded;
 }
 bool Recorder::is_finished(){
-    // MatWithFilePath mat_with_file;
-    // bool found = m_cv_mats_queue.try_dequeue(mat_with_file);
-    bool is_empty= m_cv_mats_queue.size_approx() == 0;
+    //nothing downloading, nothing queued and nothing being written right now
+    bool captures_finished= !m_gbuffer_reader || m_gbuffer_reader->nr_pending()==0;
+    return captures_finished && m_cv_mats_queue.nr_unfinished() == 0 && m_video_queue.nr_unfinished() == 0;
+}
+void Recorder::flush(){
+    if(m_gbuffer_reader){
+        m_gbuffer_reader->finish();
+    }
+    m_cv_mats_queue.wait_until_done();
+    m_video_queue.wait_until_done();
+}
+void Recorder::set_nr_writer_threads(const int nr_threads){
+    CHECK(nr_threads>0) << "The recorder needs at least one writer thread but got " << nr_threads;
+    //closing the queue to stop the writers would make a record() from another thread fail meanwhile, so the new writers are started on the open queue and the old ones are told to exit after their current image
+    std::lock_guard<std::mutex> lock(m_writer_threads_mutex);
+    std::vector<std::thread> old_threads;
+    old_threads.swap(m_writer_threads);
+    const int generation=++m_writer_generation;
+    m_writer_threads.resize(nr_threads);
+    for(size_t i = 0; i < m_writer_threads.size(); i++){
+        m_writer_threads[i]=std::thread( &Recorder::write_to_file_threaded, this, generation);
+    }
+    m_cv_mats_queue.notify_consumers(); //wakes the old writers that are waiting for an image so they see they are retired
+    for(size_t i = 0; i < old_threads.size(); i++){
+        old_threads[i].join();
+    }
+}
+int Recorder::nr_writer_threads(){
+    std::lock_guard<std::mutex> lock(m_writer_threads_mutex);
+    return m_writer_threads.size();
+}
+void Recorder::set_backpressure(const QueueFullPolicy policy, const int max_queued_images){
+    CHECK(max_queued_images>0) << "max_queued_images should be at least 1 but it is " << max_queued_images;
+    m_cv_mats_queue.set_capacity(max_queued_images);
+    m_cv_mats_queue.set_policy(policy);
+    m_video_queue.set_capacity(max_queued_images);
+    m_video_queue.set_policy(policy);
+}
+void Recorder::set_backpressure(const std::string policy, const int max_queued_images){
+    bool found_policy=false;
+    for (size_t n = 0; n < QueueFullPolicy::_size(); n++) {
+        if(QueueFullPolicy::_names()[n] == policy){
+            set_backpressure(QueueFullPolicy::_values()[n], max_queued_images);
+            found_policy=true;
+        }
+    }
+    CHECK(found_policy) << "Backpressure policy " << policy << " not known. Use Block, DropOldest or Grow";
+}
+int Recorder::nr_images_queued(){
+    return m_cv_mats_queue.size() + m_video_queue.size();
+}
+int Recorder::nr_images_dropped(){
+    return m_cv_mats_queue.nr_dropped() + m_video_queue.nr_dropped();
+}
 
-    return is_empty;
+void Recorder::set_image_format(const ImageFormat format, const int png_compression, const int jpeg_quality){
+    CHECK(png_compression>=0 && png_compression<=9) << "png_compression should be in range [0,9] but it is " << png_compression;
+    CHECK(jpeg_quality>=0 && jpeg_quality<=100) << "jpeg_quality should be in range [0,100] but it is " << jpeg_quality;
+    m_image_format=format._to_integral();
+    m_png_compression=png_compression;
+    m_jpeg_quality=jpeg_quality;
+}
+void Recorder::set_image_format(const std::string format, const int png_compression, const int jpeg_quality){
+    bool found_format=false;
+    for (size_t n = 0; n < ImageFormat::_size(); n++) {
+        if(ImageFormat::_names()[n] == format){
+            set_image_format(ImageFormat::_values()[n], png_compression, jpeg_quality);
+            found_format=true;
+        }
+    }
+    CHECK(found_format) << "Image format " << format << " not known. Use Auto, Png, Jpeg, Ppm, Pfm or Exr";
+}
 
-    // if (found){
-    //     return
-    // }
+void Recorder::create_folder_once(const std::string& folder){
+    if(folder.empty()){
+        return;
+    }
+    std::lock_guard<std::mutex> lock(m_created_folders_mutex);
+    if(m_created_folders.count(folder)){
+        return;
+    }
+    if (!fs::exists(folder)){
+        fs::create_directories(folder);
+    }
+    m_created_folders.insert(folder);
+}
 
+void Recorder::start_video(const std::string file_path, const int fps, const std::string codec, const int crf){
+    CHECK(!m_is_recording_video) << "A video is already being recorded to " << m_video_path << ". Call stop_video first";
+    CHECK(fps>0) << "fps should be positive but it is " << fps;
+    CHECK(std::system("ffmpeg -version > /dev/null 2>&1")==0) << "Recording a video needs the ffmpeg executable but it was not found";
+
+    create_folder_once(fs::path(file_path).parent_path().string());
+
+    m_video_path=file_path;
+    m_video_fps=fps;
+    m_video_codec=codec;
+    m_video_crf=crf;
+    m_video_queue.reopen();
+    m_video_thread=std::thread( &Recorder::write_to_video_threaded, this);
+    m_is_recording_video=true;
 }
 
+void Recorder::stop_video(){
+    if(!m_is_recording_video){
+        return;
+    }
+    m_is_recording_video=false;
+    m_video_queue.close();
+    m_video_thread.join();
+}
+
+bool Recorder::is_recording_video(){
+    return m_is_recording_video;
+}
+
+//starts ffmpeg with the arguments given directly to exec, so nothing in them goes through a shell, and returns a stream to its stdin. Returns nullptr if it could not be started
+static FILE* spawn_ffmpeg(const std::vector<std::string>& args, pid_t& pid){
+    int fds[2];
+    if(pipe2(fds, O_CLOEXEC)!=0){
+        return nullptr;
+    }
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, fds[0], STDIN_FILENO); //dup2 clears the close on exec flag of the new descriptor
+    std::vector<char*> argv;
+    for(size_t i=0; i<args.size(); i++){
+        argv.push_back( const_cast<char*>(args[i].c_str()) );
+    }
+    argv.push_back(nullptr);
+    int err=posix_spawnp(&pid, argv[0], &actions, nullptr, argv.data(), environ);
+    posix_spawn_file_actions_destroy(&actions);
+    close(fds[0]);
+    if(err!=0){
+        close(fds[1]);
+        return nullptr;
+    }
+    return fdopen(fds[1], "w");
+}
+
+//the constant rate factor is only understood by some encoders, passing it to others like mpeg4 or rawvideo makes ffmpeg fail
+static bool codec_supports_crf(const std::string& codec){
+    static const std::set<std::string> codecs={"libx264", "libx264rgb", "libx265", "libvpx", "libvpx-vp9", "libaom-av1", "libsvtav1"};
+    return codecs.count(codec);
+}
+
+void Recorder::write_to_video_threaded(){
+
+    //if ffmpeg exits early, writing into its pipe raises SIGPIPE which would kill the whole program. We block it for this thread so the write just fails with EPIPE instead. A blocked SIGPIPE stays pending on this thread and goes away with it
+    sigset_t sigpipe_set;
+    sigemptyset(&sigpipe_set);
+    sigaddset(&sigpipe_set, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &sigpipe_set, nullptr);
+
+    //ffmpeg gets started with the first frame because only then we know the size and format of the video
+    FILE* ffmpeg_pipe=nullptr;
+    pid_t ffmpeg_pid=-1;
+    bool failed=false; //after a failed write the rest of the frames are dropped but still taken from the queue so that stop_video doesn't wait forever
+    int video_width=0, video_height=0, video_type=-1;
+    int nr_frames_written=0;
+
+    cv::Mat cv_mat;
+    while(m_video_queue.pop(cv_mat)){
+        TIME_START("write_to_video");
+
+        if(!ffmpeg_pipe && !failed){
+            video_width=cv_mat.cols;
+            video_height=cv_mat.rows;
+            video_type=cv_mat.type();
+            //the pixels are in the order of the gl texture, so rgb(a) and upside down. ffmpeg flips them and yuv420p needs even sizes so we pad by one pixel if necessary
+            std::string pix_fmt;
+            if(cv_mat.channels()==4){
+                pix_fmt="rgba";
+            }else if(cv_mat.channels()==3){
+                pix_fmt="rgb24";
+            }else if(cv_mat.channels()==1){
+                pix_fmt="gray";
+            }else{
+                LOG(FATAL) << "Cannot write a video from images with " << cv_mat.channels() << " channels";
+            }
+            std::vector<std::string> args={"ffmpeg", "-y", "-loglevel", "error", "-f", "rawvideo", "-pix_fmt", pix_fmt,
+                "-s", std::to_string(video_width) + "x" + std::to_string(video_height),
+                "-r", std::to_string(m_video_fps), "-i", "-", "-vf", "vflip,pad=ceil(iw/2)*2:ceil(ih/2)*2",
+                "-c:v", m_video_codec};
+            if(codec_supports_crf(m_video_codec)){
+                args.insert(args.end(), {"-crf", std::to_string(m_video_crf)});
+            }
+            args.insert(args.end(), {"-pix_fmt", "yuv420p", m_video_path});
+            std::string cmd;
+            for(size_t i=0; i<args.size(); i++){
+                cmd+= (i? " " : "") + args[i];
+            }
+            VLOG(1) << "Starting video with: " << cmd;
+            ffmpeg_pipe=spawn_ffmpeg(args, ffmpeg_pid);
+            if(!ffmpeg_pipe){
+                LOG(ERROR) << "Could not start ffmpeg for writing the video " << m_video_path << ". The frames will be dropped";
+                failed=true;
+            }
+        }
+
+        if(failed){
+            //drop it
+        }else if(cv_mat.cols!=video_width || cv_mat.rows!=video_height || cv_mat.type()!=video_type){
+            LOG(WARNING) << "Skipping frame of size " << cv_mat.cols << "x" << cv_mat.rows << " because the video has size " << video_width << "x" << video_height;
+        }else{
+            //rawvideo is 8 bit so floating point textures get converted first
+            cv::Mat mat_8u;
+            if(cv_mat.depth()==CV_8U){
+                mat_8u=cv_mat;
+            }else{
+                cv_mat.convertTo(mat_8u, CV_8U, 255.0);
+            }
+            if(!mat_8u.isContinuous()){
+                mat_8u=mat_8u.clone();
+            }
+            size_t nr_bytes=mat_8u.total()*mat_8u.elemSize();
+            size_t nr_written=fwrite(mat_8u.data, 1, nr_bytes, ffmpeg_pipe);
+            if(nr_written!=nr_bytes){
+                LOG(ERROR) << "Could not write frame " << nr_frames_written << " to ffmpeg: " << std::strerror(errno) << ". Check the ffmpeg output above for the reason. The rest of the frames will be dropped";
+                failed=true;
+            }else{
+                nr_frames_written++;
+            }
+        }
+
+        m_mat_pool->release(cv_mat);
+        TIME_END("write_to_video");
+        m_video_queue.task_done();
+    }
+
+    if(ffmpeg_pipe){
+        fclose(ffmpeg_pipe); //ffmpeg sees the end of the input and finishes the file
+        int status=0;
+        while(waitpid(ffmpeg_pid, &status, 0)==-1 && errno==EINTR){}
+        if(!WIFEXITED(status) || WEXITSTATUS(status)!=0){
+            LOG(ERROR) << "ffmpeg failed when writing the video " << m_video_path;
+        }else if(!failed){
+            VLOG(1) << "Wrote " << nr_frames_written << " frames into " << m_video_path;
+        }
+    }
+}
+
+
+void Recorder::capture_gbuffer(const std::string name, const std::string path){
+    m_view->decode_gbuffer();
+
+    std::vector<std::string> layer_names;
+    std::vector<gl::Texture2D*> textures;
+    layer_names.push_back("color");
+    if (m_view->m_record_with_transparency){
+        textures.push_back( &m_view->m_final_fbo_no_gui.tex_with_name("color_with_transparency_gtex") );
+    }else{
+        textures.push_back( &m_view->m_final_fbo_no_gui.tex_with_name("color_without_transparency_gtex") );
+    }
+    layer_names.push_back("albedo");
+    textures.push_back( &m_view->m_decoded_gbuffer.tex_with_name("albedo_gtex") );
+    layer_names.push_back("normal");
+    textures.push_back( &m_view->m_decoded_gbuffer.tex_with_name("normal_gtex") );
+    layer_names.push_back("metalness_and_roughness");
+    textures.push_back( &m_view->m_decoded_gbuffer.tex_with_name("metalness_and_roughness_gtex") );
+    layer_names.push_back("depth");
+    textures.push_back( &m_view->m_decoded_gbuffer.tex_with_name("depth_gtex") );
+    layer_names.push_back("depth_linear");
+    textures.push_back( &m_view->m_decoded_gbuffer.tex_with_name("depth_linear_gtex") );
+    if(m_view->m_enable_ssao && m_view->m_ao_blurred_tex.storage_initialized()){
+        layer_names.push_back("ao");
+        textures.push_back( &m_view->m_ao_blurred_tex );
+    }
+
+    if(!m_gbuffer_reader){
+        m_gbuffer_reader=AsyncTextureReader::create(3, m_mat_pool);
+    }
+    std::string file_path= ( fs::path(path)/name ).string();
+    m_gbuffer_reader->read(textures, [this, layer_names, file_path](std::vector<cv::Mat>& mats){
+        MatWithFilePath mat_with_file;
+        mat_with_file.file_path=file_path;
+        for(size_t i=0; i<mats.size(); i++){
+            mat_with_file.layers.push_back( std::make_pair(layer_names[i], mats[i]) );
+        }
+        enqueue(mat_with_file); //depending on the backpressure policy this may wait for the writers to make space
+    });
+}
+
+void Recorder::release_gl_resources(){
+    m_gbuffer_reader.reset(); //finishes the captures that are still downloading so they also get queued, and deletes the pbos
+    m_batch_reader.reset();
+}
+
+void Recorder::poll_captures(){
+    if(m_gbuffer_reader){
+        m_gbuffer_reader->poll();
+    }
+}
+
+void Recorder::write_layers(MatWithFilePath& mat_with_file){
+    TIME_START("write_layers");
+
+    fs::path file_path(mat_with_file.file_path);
+    file_path.replace_extension(".npz");
+    create_folder_once(file_path.parent_path().string());
+
+    //all the layers are stored as float so they can be used directly, the 8 bit ones get mapped to [0,1]. They stay in rgb order as numpy expects but get flipped since the gl textures are upside down
+    //the ao is computed at a lower resolution when ssao is downsampled so it gets upsampled to the size of the color, that way all the layers have the same height and width
+    const cv::Size full_size=mat_with_file.layers[0].second.size();
+    NpzWriter npz;
+    for(size_t i=0; i<mat_with_file.layers.size(); i++){
+        cv::Mat& mat=mat_with_file.layers[i].second;
+        if(mat.size()!=full_size){
+            cv::Mat upsampled;
+            cv::resize(mat, upsampled, full_size, 0, 0, cv::INTER_LINEAR);
+            m_mat_pool->release(mat);
+            mat=upsampled;
+        }
+        if(mat.depth()==CV_32F){
+            npz.add(mat_with_file.layers[i].first, mat, true);
+        }else{
+            cv::Mat mat_float=m_mat_pool->acquire(mat.rows, mat.cols, CV_MAKETYPE(CV_32F, mat.channels()) );
+            mat.convertTo(mat_float, CV_32F, mat.depth()==CV_16U ? 1.0/65535.0 : 1.0/255.0);
+            npz.add(mat_with_file.layers[i].first, mat_float, true);
+            m_mat_pool->release(mat_float);
+        }
+        m_mat_pool->release(mat);
+    }
+
+    bool result=npz.write(file_path.string());
+    CHECK(result) << "Something went wrong when writing the layers to " << file_path.string();
+    VLOG(1) << "writen " << npz.nr_layers() << " layers to " << file_path.string();
+    TIME_END("write_layers");
+}
+
+void Recorder::render_batch(const std::vector<std::shared_ptr<Camera>>& cameras, const std::function<void(const int idx, cv::Mat& mat)>& on_image){
+    //with a few images in flight the gpu can already draw the next pose while the previous ones are being copied
+    if(!m_batch_reader){
+        m_batch_reader=AsyncTextureReader::create(4, m_mat_pool);
+    }
+
+    std::shared_ptr<Camera> old_camera=m_view->m_camera;
+    for(size_t i=0; i<cameras.size(); i++){
+        CHECK(cameras[i]) << "Camera " << i << " is null";
+        m_view->m_camera=cameras[i];
+
+        gl::Texture2D* tex;
+        if (m_view->m_record_with_transparency){
+            tex=&m_view->m_final_fbo_no_gui.tex_with_name("color_with_transparency_gtex");
+        }else{
+            tex=&m_view->m_final_fbo_no_gui.tex_with_name("color_without_transparency_gtex");
+        }
+        //only the draw, without the events, gui, blitting to the window and swapping of update(). The draw binds and clears the framebuffer it gets, so we give it the offscreen one we read from instead of the default one which still shows the last frame of the window
+        m_view->draw(tex->fbo_id());
+
+        const int idx=i;
+        m_batch_reader->read( {tex}, [&on_image, idx](std::vector<cv::Mat>& mats){ on_image(idx, mats[0]); } );
+    }
+    m_batch_reader->finish(); //on_image is only valid during this call
+    m_view->m_camera=old_camera;
+}
+
+float Recorder::render_poses(const std::vector<std::shared_ptr<Camera>>& cameras, const std::string path){
+    CHECK(!cameras.empty()) << "There are no cameras to render";
+
+    //flush() would also wait for whatever else is queued, like recorded frames or gbuffer captures, so the images of this batch share a token that signals once the last of them is written or dropped
+    std::promise<void> batch_done;
+    std::future<void> batch_done_future=batch_done.get_future();
+    auto start=std::chrono::steady_clock::now();
+    {
+        std::shared_ptr<void> batch_token(nullptr, [&batch_done](void*){ batch_done.set_value(); });
+        render_batch(cameras, [this, &path, &batch_token](const int idx, cv::Mat& mat){
+            MatWithFilePath mat_with_file;
+            mat_with_file.cv_mat=mat;
+            mat_with_file.file_path= ( fs::path(path)/(std::to_string(idx)+".png") ).string(); //the writers replace the extension if an image format is set
+            mat_with_file.batch_token=batch_token;
+            enqueue(mat_with_file); //depending on the backpressure policy this may wait for the writers to make space
+        });
+    }
+    batch_done_future.wait();
+    float elapsed_s=std::chrono::duration<float>(std::chrono::steady_clock::now()-start).count();
+
+    m_last_batch_images_per_sec=cameras.size()/elapsed_s;
+    VLOG(1) << "Rendered and wrote " << cameras.size() << " images in " << elapsed_s << "s which is " << m_last_batch_images_per_sec << " images/s";
+    return m_last_batch_images_per_sec;
+}
+
+float Recorder::render_poses(const std::vector<Eigen::Matrix4f, Eigen::aligned_allocator<Eigen::Matrix4f>>& tf_world_cam_poses, const std::string path){
+    std::vector<std::shared_ptr<Camera>> cameras(tf_world_cam_poses.size());
+    for(size_t i=0; i<tf_world_cam_poses.size(); i++){
+        cameras[i]=m_view->m_camera->clone();
+        cameras[i]->set_model_matrix( Eigen::Affine3f(tf_world_cam_poses[i]) );
+        //so that the viewer doesn't move them to look at the scene in case the camera was not used yet
+        cameras[i]->m_position_initialized=true;
+        cameras[i]->m_lookat_initialized=true;
+    }
+    return render_poses(cameras, path);
+}
+
+std::vector<cv::Mat> Recorder::render_poses_to_mats(const std::vector<std::shared_ptr<Camera>>& cameras){
+    CHECK(!cameras.empty()) << "There are no cameras to render";
+
+    std::vector<cv::Mat> mats(cameras.size());
+    auto start=std::chrono::steady_clock::now();
+    render_batch(cameras, [this, &mats](const int idx, cv::Mat& mat){
+        //not from the pool since they are given away
+        mats[idx]=cv::Mat(mat.rows, mat.cols, mat.type());
+        flip_and_swap_rb(mat, mats[idx]);
+        m_mat_pool->release(mat);
+    });
+    float elapsed_s=std::chrono::duration<float>(std::chrono::steady_clock::now()-start).count();
+
+    m_last_batch_images_per_sec=cameras.size()/elapsed_s;
+    VLOG(1) << "Rendered " << cameras.size() << " images in " << elapsed_s << "s which is " << m_last_batch_images_per_sec << " images/s";
+    return mats;
+}
+
+float Recorder::last_batch_images_per_sec(){
+    return m_last_batch_images_per_sec;
+}
 
 } //namespace easy_pbr
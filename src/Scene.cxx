@@ -12,9 +12,14 @@ namespace easy_pbr{
 //redeclared things here so we can use them from this file even though they are static
 std::vector<MeshSharedPtr>  Scene::m_meshes;
 std::mutex Scene::m_mesh_mutex;
+std::vector< std::pair<std::shared_future<std::shared_ptr<Mesh>>, std::string> > Scene::m_pending_meshes;
+std::mutex Scene::m_pending_mutex;
 bool Scene::m_floor_visible =true;
 bool Scene::m_floor_metric =false;
 bool Scene::m_automatic_normal_calculation =true;
+std::unordered_map<std::string, int> Scene::m_name2id;
+std::unordered_map<int, size_t> Scene::m_id2idx;
+int Scene::m_next_id=0;
 
 
 Scene::Scene()
@@ -32,23 +37,20 @@ void Scene::show(const std::shared_ptr<Mesh> mesh, const std::string name){
     }
 
     //check if there is already a mesh with the same name
-    bool found=false;
-    int idx_found=-1;
-    for(size_t i = 0; i < m_meshes.size(); i++){
-        if(m_meshes[i]->name==name){
-            found=true;
-            idx_found=i;
-        }
-    }
+    auto found=m_name2id.find(name);
 
-    if(found){
+    if(found!=m_name2id.end()){
+        const size_t idx_found=m_id2idx.at(found->second);
         m_meshes[idx_found]=mesh; //it's a shared ptr so it just gets asigned to this one and the previous one dissapears
         m_meshes[idx_found]->name=name;
+        m_meshes[idx_found]->scene_id=found->second; //the new mesh takes over the id so the viewer reuses the same MeshGL
         // m_meshes[idx_found]->recalculate_normals();
     }else{
         m_meshes.push_back(mesh);
         m_meshes.back()->name=name;
-        if(m_meshes.back()->V.rows()!=m_meshes.back()->NV.rows() && Scene::m_automatic_normal_calculation){
+        m_meshes.back()->scene_id=m_next_id++;
+        add_to_index(m_meshes.size()-1);
+        if(m_meshes.back()->F.size() && m_meshes.back()->V.rows()!=m_meshes.back()->NV.rows() && Scene::m_automatic_normal_calculation){ //meshes from Mesh::load_from_file_async already have them
             m_meshes.back()->recalculate_normals();
         }
     }
@@ -56,20 +58,7 @@ void Scene::show(const std::shared_ptr<Mesh> mesh, const std::string name){
 
     //if that was the first mesh that was added, add also a grid for the ground
     if(m_meshes.size()==1 && !m_meshes.back()->is_empty()){
-
-        MeshSharedPtr mesh_grid=Mesh::create();
-        // mesh_grid->create_grid(8, mesh->V.col(1).minCoeff(), get_scale());
-        // mesh_grid->create_grid(8, 0.0, get_scale(false));
-        // mesh_grid->create_grid(8, 0.0, 1.0 );
-        if(m_floor_metric){
-            mesh_grid->create_grid(m_grid_nr_segments, 0.0, m_grid_nr_segments/2.0 ); //we create a grid with a scale that is the same as the nr_segments/2 so that every square has and edge size of 1
-        }else{
-            mesh_grid->create_grid(m_grid_nr_segments, 0.0, get_scale(false));
-        }
-        mesh_grid->m_vis.m_is_visible=m_floor_visible;
-        // m_meshes.push_back(mesh_grid);
-        m_meshes.insert(m_meshes.begin(), mesh_grid); //we insert it at the begginng of the vector so the mesh we added with show would appear as the last one we added
-
+        add_grid_floor();
     }
 
 }
@@ -85,29 +74,90 @@ void Scene::add_mesh(const std::shared_ptr<Mesh> mesh, const std::string name){
 
     m_meshes.push_back(mesh);
     m_meshes.back()->name=name;
+    m_meshes.back()->scene_id=m_next_id++;
+    add_to_index(m_meshes.size()-1);
     if(m_meshes.back()->V.rows()!=m_meshes.back()->NV.rows()){
         m_meshes.back()->recalculate_normals();
     }
 
     //if that was the first mesh that was added, add also a grid for the ground
     if(m_meshes.size()==1 && !m_meshes.back()->is_empty()){
+        add_grid_floor();
+    }
 
-        MeshSharedPtr mesh_grid=Mesh::create();
-        if(m_floor_metric){
-            mesh_grid->create_grid(m_grid_nr_segments, 0.0, m_grid_nr_segments/2.0 ); //we create a grid with a scale that is the same as the nr_segments/2 so that every square has and edge size of 1
-        }else{
-            mesh_grid->create_grid(m_grid_nr_segments, 0.0, get_scale(false));
+}
+
+void Scene::add_grid_floor(){
+    MeshSharedPtr mesh_grid=Mesh::create();
+    // mesh_grid->create_grid(8, mesh->V.col(1).minCoeff(), get_scale());
+    // mesh_grid->create_grid(8, 0.0, get_scale(false));
+    // mesh_grid->create_grid(8, 0.0, 1.0 );
+    if(m_floor_metric){
+        mesh_grid->create_grid(m_grid_nr_segments, 0.0, m_grid_nr_segments/2.0 ); //we create a grid with a scale that is the same as the nr_segments/2 so that every square has and edge size of 1
+    }else{
+        mesh_grid->create_grid(m_grid_nr_segments, 0.0, get_scale(false));
+    }
+    mesh_grid->m_vis.m_is_visible=m_floor_visible;
+    mesh_grid->scene_id=m_next_id++;
+    // m_meshes.push_back(mesh_grid);
+    m_meshes.insert(m_meshes.begin(), mesh_grid); //we insert it at the begginng of the vector so the mesh we added with show would appear as the last one we added
+    rebuild_index(); //all the meshes moved one position
+}
+
+void Scene::add_to_index(const size_t idx){
+    const MeshSharedPtr& mesh=m_meshes[idx];
+    m_id2idx[mesh->scene_id]=idx;
+    m_name2id.emplace(mesh->name, mesh->scene_id); //doesn't overwrite so that the name keeps pointing to the first mesh with it
+}
+
+void Scene::rebuild_index(){
+    m_name2id.clear();
+    m_id2idx.clear();
+    for(size_t i=0; i<m_meshes.size(); i++){
+        add_to_index(i);
+    }
+}
+
+void Scene::show_when_ready(const std::shared_future<std::shared_ptr<Mesh>> mesh_future, const std::string name){
+    std::lock_guard<std::mutex> lock(m_pending_mutex);
+    m_pending_meshes.push_back( std::make_pair(mesh_future, name) );
+}
+
+void Scene::show_ready_meshes(){
+    //grab the ones that are ready while holding the lock but show them after releasing it, so a slow show() doesn't block the loaders that want to add more
+    std::vector< std::pair<std::shared_future<std::shared_ptr<Mesh>>, std::string> > ready;
+    {
+        std::lock_guard<std::mutex> lock(m_pending_mutex);
+        std::vector< std::pair<std::shared_future<std::shared_ptr<Mesh>>, std::string> > still_pending;
+        for(size_t i=0; i<m_pending_meshes.size(); i++){
+            const std::shared_future<std::shared_ptr<Mesh>>& future=m_pending_meshes[i].first;
+            if(future.wait_for(std::chrono::seconds(0))==std::future_status::ready){
+                ready.push_back(m_pending_meshes[i]);
+            }else{
+                still_pending.push_back(m_pending_meshes[i]);
+            }
         }
-        // m_meshes.push_back(mesh_grid);
-        m_meshes.insert(m_meshes.begin(), mesh_grid); //we insert it at the begginng of the vector so the mesh we added with show would appear as the last one we added
+        m_pending_meshes.swap(still_pending);
+    }
 
+    for(size_t i=0; i<ready.size(); i++){
+        try{
+            show(ready[i].first.get(), ready[i].second);
+        }catch(const std::exception& e){
+            LOG(WARNING) << "Could not show mesh " << ready[i].second << " because its loading failed: " << e.what();
+        }
     }
+}
 
+int Scene::nr_pending_meshes(){
+    std::lock_guard<std::mutex> lock(m_pending_mutex);
+    return m_pending_meshes.size();
 }
 
 void Scene::clear(){
     std::lock_guard<std::mutex> lock(m_mesh_mutex);  // so that accesed to the map are thread safe
     m_meshes.clear();
+    rebuild_index();
 }
 
 void Scene::hide_all(){
@@ -156,10 +206,9 @@ int Scene::nr_faces(){
 
 std::shared_ptr<Mesh> Scene::get_mesh_with_name(const std::string name){
     std::lock_guard<std::mutex> lock(m_mesh_mutex);  // so that accesed to the map are thread safe
-    for (size_t i = 0; i < m_meshes.size(); i++) {
-        if(m_meshes[i]->name==name){
-            return m_meshes[i];
-        }
+    auto found=m_name2id.find(name);
+    if(found!=m_name2id.end()){
+        return m_meshes[m_id2idx.at(found->second)];
     }
     LOG_S(FATAL) << "No mesh with name " << name;
     return m_meshes[0]; //HACK because this line will never occur because the previous line will kill it but we just put it to shut up the compiler warning
@@ -175,25 +224,49 @@ std::shared_ptr<Mesh> Scene::get_mesh_with_idx(const unsigned int idx){
     }
 }
 
+std::shared_ptr<Mesh> Scene::get_mesh_with_id(const int scene_id){
+    std::lock_guard<std::mutex> lock(m_mesh_mutex);  // so that accesed to the map are thread safe
+    auto found=m_id2idx.find(scene_id);
+    if(found!=m_id2idx.end()){
+        return m_meshes[found->second];
+    }
+    LOG_S(FATAL) << "No mesh with id " << scene_id;
+    return m_meshes[0]; //HACK because this line will never occur because the previous line will kill it but we just put it to shut up the compiler warning
+}
+
 int Scene::get_idx_for_name(const std::string name){
     std::lock_guard<std::mutex> lock(m_mesh_mutex);  // so that accesed to the map are thread safe
-    for (size_t i = 0; i < m_meshes.size(); i++) {
-        if(m_meshes[i]->name==name){
-            return i;
-        }
+    auto found=m_name2id.find(name);
+    if(found!=m_name2id.end()){
+        return m_id2idx.at(found->second);
     }
     LOG_S(FATAL) << "No mesh with name " << name;
     return -1; //HACK because this line will never occur because the previous line will kill it but we just put it to shut up the compiler warning
 }
 
-bool Scene::does_mesh_with_name_exist(const std::string name){
+int Scene::get_id_for_name(const std::string name){
     std::lock_guard<std::mutex> lock(m_mesh_mutex);  // so that accesed to the map are thread safe
-    for (size_t i = 0; i < m_meshes.size(); i++) {
-        if(m_meshes[i]->name==name){
-            return true;
-        }
+    auto found=m_name2id.find(name);
+    if(found!=m_name2id.end()){
+        return found->second;
     }
-    return false;
+    LOG_S(FATAL) << "No mesh with name " << name;
+    return -1; //HACK because this line will never occur because the previous line will kill it but we just put it to shut up the compiler warning
+}
+
+bool Scene::does_mesh_with_name_exist(const std::string name){
+    std::lock_guard<std::mutex> lock(m_mesh_mutex);  // so that accesed to the map are thread safe
+    return m_name2id.find(name)!=m_name2id.end();
+}
+
+bool Scene::does_mesh_with_id_exist(const int scene_id){
+    std::lock_guard<std::mutex> lock(m_mesh_mutex);  // so that accesed to the map are thread safe
+    return m_id2idx.find(scene_id)!=m_id2idx.end();
+}
+
+std::vector< std::shared_ptr<Mesh> > Scene::get_meshes(){
+    std::lock_guard<std::mutex> lock(m_mesh_mutex);  // so that accesed to the map are thread safe
+    return m_meshes;
 }
 
 void Scene::remove_mesh_with_idx(const unsigned int idx)
@@ -206,6 +279,7 @@ void Scene::remove_mesh_with_idx(const unsigned int idx)
         if ( i != idx )
             meshes_filtered.push_back(m_meshes[i]);
     m_meshes=meshes_filtered;
+    rebuild_index();
 }
 
 void Scene::remove_meshes_starting_with_name(const std::string name_prefix){
@@ -226,6 +300,7 @@ void Scene::remove_meshes_starting_with_name(const std::string name_prefix){
     }
 
     m_meshes=meshes_filtered;
+    rebuild_index();
 
 }
 
@@ -262,8 +337,8 @@ Eigen::Vector3f Scene::get_centroid(const bool use_mutex){
     max_point_per_mesh.setZero();
     for(size_t i=0; i<m_meshes.size(); i++){
         if(m_meshes[i]->is_empty()){ continue; }
-        min_point_per_mesh.row(i) = m_meshes[i]->V.colwise().minCoeff();
-        max_point_per_mesh.row(i) = m_meshes[i]->V.colwise().maxCoeff();
+        min_point_per_mesh.row(i) = m_meshes[i]->V.colwise().minCoeff().cast<double>();
+        max_point_per_mesh.row(i) = m_meshes[i]->V.colwise().maxCoeff().cast<double>();
     }
 
     //absolute minimum between all meshes
@@ -305,8 +380,8 @@ float Scene::get_scale(const bool use_mutex){
         if(m_meshes[i]->name=="grid_floor"){
             continue;
         }
-        min_point_per_mesh.row(i) = m_meshes[i]->model_matrix()*Eigen::Vector3d(m_meshes[i]->V.colwise().minCoeff());
-        max_point_per_mesh.row(i) = m_meshes[i]->model_matrix()*Eigen::Vector3d(m_meshes[i]->V.colwise().maxCoeff());
+        min_point_per_mesh.row(i) = m_meshes[i]->model_matrix()*Eigen::Vector3d(m_meshes[i]->V.colwise().minCoeff().transpose().cast<double>());
+        max_point_per_mesh.row(i) = m_meshes[i]->model_matrix()*Eigen::Vector3d(m_meshes[i]->V.colwise().maxCoeff().transpose().cast<double>());
     }
 
     //absolute minimum between all meshes
@@ -64,7 +64,7 @@ void SpotLight::render_mesh_to_shadow_map(MeshGLSharedPtr& mesh){
 
 
     // Set attributes that the vao will pulll from buffers
-    GL_C( mesh->vao.vertex_attribute(m_shadow_map_shader, "position", mesh->V_buf, 3) );
+    GL_C( mesh->vertex_attribute(m_shadow_map_shader, "position", mesh->V_buf, 3) );
     GL_C( mesh->vao.indices(mesh->F_buf) ); //Says the indices with we refer to vertices, this gives us the triangles
 
     //matrices setup
@@ -83,7 +83,7 @@ void SpotLight::render_mesh_to_shadow_map(MeshGLSharedPtr& mesh){
 
     // draw
     GL_C( mesh->vao.bind() );
-    GL_C( glDrawElements(GL_TRIANGLES, mesh->m_core->F.size(), GL_UNSIGNED_INT, 0) );
+    GL_C( glDrawElements(GL_TRIANGLES, mesh->m_core->F.size(), mesh->m_index_type, 0) );
 
     GL_C( glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0) );
     GL_C( glBindFramebuffer(GL_FRAMEBUFFER, 0) );
@@ -105,7 +105,7 @@ void SpotLight::render_points_to_shadow_map(MeshGLSharedPtr& mesh){
 
 
     // Set attributes that the vao will pulll from buffers
-    GL_C( mesh->vao.vertex_attribute(m_shadow_map_shader, "position", mesh->V_buf, 3) );
+    GL_C( mesh->vertex_attribute(m_shadow_map_shader, "position", mesh->V_buf, 3) );
     GL_C( mesh->vao.indices(mesh->F_buf) ); //Says the indices with we refer to vertices, this gives us the triangles
 
     //matrices setup
@@ -10,6 +10,7 @@
 
 #include <string> //find_last_of
 #include <limits> //signaling_nan
+#include <unordered_set>
 
 // #include <glad/glad.h>
 // #include <GLFW/glfw3.h> //glfw3.h after our OpenGL definitions
@@ -77,7 +78,7 @@ Viewer::Viewer(const std::string config_file):
     m_debug(false),
     m_scene(new Scene),
     // m_gui(new Gui(this, m_window )),
-    m_recorder(new Recorder( this )),
+    m_recorder(new Recorder( this, config_file )),
     m_rand_gen(new RandGenerator()),
     m_timer(new Timer()),
     m_nr_drawn_frames(0),
@@ -145,6 +146,7 @@ Viewer::Viewer(const std::string config_file):
 
 Viewer::~Viewer(){
     // LOG(WARNING) << "Destroying viewer";
+    m_recorder->release_gl_resources(); //the pbos of the recorder need the context which may be gone by the time the recorder itself is destroyed
 }
 
 bool Viewer::init_params_nongl(const std::string config_file){
@@ -192,6 +194,7 @@ bool Viewer::init_params_nongl(const std::string config_file){
     m_subsample_factor = vis_cfg.get_or("subsample_factor", default_vis_cfg);
     m_enable_culling = vis_cfg.get_or("enable_culling", default_vis_cfg);
     m_render_uv_to_gbuffer= vis_cfg.get_or("render_uv_to_gbuffer", default_vis_cfg);
+    m_packed_vertex_buffers= vis_cfg.get_or("packed_vertex_buffers", default_vis_cfg);
     std::string tonemap_string= (std::string)vis_cfg.get_or("tonemap", default_vis_cfg);
     //go through the tonemapper and see if we find the one
     bool found_tonemapper=false;
@@ -943,6 +946,7 @@ void Viewer::post_draw(){
             }
 
     }
+    m_recorder->poll_captures(); //the gbuffer captures whose download finished go to the writers
 }
 
 
@@ -1140,38 +1144,50 @@ void Viewer::draw(const GLuint fbo_id){
 void Viewer::upload_single_mesh_to_gpu(const std::shared_ptr<Mesh>& mesh_core, const bool is_meshgl_sticky){
 
     auto possible_mesh_gl= mesh_core->m_mesh_gpu.lock(); //check if we have a mesh gl
+    bool scene_id_changed= possible_mesh_gl && mesh_core->scene_id>=0 && possible_mesh_gl->m_scene_id!=mesh_core->scene_id; //the mesh was removed and shown again so the old mesh_gl will be discarded and it needs a new one
 
-    if(mesh_core->m_vis.m_is_visible && (mesh_core->m_is_dirty || mesh_core->is_any_texture_dirty()  || !possible_mesh_gl)) { //the mesh gl needs updating
+    if(mesh_core->m_vis.m_is_visible && (mesh_core->m_is_dirty || mesh_core->is_any_attribute_dirty() || mesh_core->is_any_texture_dirty()  || !possible_mesh_gl || scene_id_changed || possible_mesh_gl->is_packed()!=m_packed_vertex_buffers)) { //the mesh gl needs updating
 
         // VLOG(1) << "mesh with name " << mesh_core->name << " needs updating is dirty is " << mesh_core->m_is_dirty << "texture dirty is " << mesh_core->is_any_texture_dirty();
 
-        //find the meshgl  with the same name
-        bool found=false;
-        int idx_found=-1;
-        for(size_t gl_idx = 0; gl_idx < m_meshes_gl.size(); gl_idx++){
-            if(m_meshes_gl[gl_idx]->m_core->name==mesh_core->name){
-                found=true;
-                idx_found=gl_idx;
-                break;
+        //find the meshgl of this mesh. Meshes in the scene are found by their id, the rest (like the sticky ones) by name
+        MeshGLSharedPtr mesh_gl_found;
+        if(mesh_core->scene_id>=0){
+            auto it=m_id2mesh_gl.find(mesh_core->scene_id);
+            if(it!=m_id2mesh_gl.end()){
+                mesh_gl_found=it->second;
+            }
+        }else{
+            for(size_t gl_idx = 0; gl_idx < m_meshes_gl.size(); gl_idx++){
+                if(m_meshes_gl[gl_idx]->m_core->name==mesh_core->name){
+                    mesh_gl_found=m_meshes_gl[gl_idx];
+                    break;
+                }
             }
         }
 
 
-        if(found){
+        if(mesh_gl_found){
             // VLOG(1) << "found";
-            m_meshes_gl[idx_found]->assign_core(mesh_core);
-            mesh_core->assign_mesh_gpu(m_meshes_gl[idx_found]); // cpu data points to the gpu implementation
-            m_meshes_gl[idx_found]->upload_to_gpu();
-            m_meshes_gl[idx_found]->sanity_check(); //check that we have for sure all the normals for all the vertices and faces and that everything is correct
+            mesh_gl_found->assign_core(mesh_core);
+            mesh_core->assign_mesh_gpu(mesh_gl_found); // cpu data points to the gpu implementation
+            mesh_gl_found->set_packed(m_packed_vertex_buffers);
+            mesh_gl_found->upload_to_gpu();
+            mesh_gl_found->sanity_check(); //check that we have for sure all the normals for all the vertices and faces and that everything is correct
         }else{
             // VLOG(1) << "not found";
             MeshGLSharedPtr mesh_gpu=MeshGL::create();
             // VLOG(1) << " mesh_gpu has adress " << mesh_gpu;
             mesh_gpu->assign_core(mesh_core); //GPU implementation points to the cpu data
             mesh_core->assign_mesh_gpu(mesh_gpu); // cpu data points to the gpu implementation
+            mesh_gpu->set_packed(m_packed_vertex_buffers);
             mesh_gpu->upload_to_gpu();
             mesh_gpu->sanity_check(); //check that we have for sure all the normals for all the vertices and faces and that everything is correct
             m_meshes_gl.push_back(mesh_gpu);
+            if(mesh_core->scene_id>=0){
+                mesh_gpu->m_scene_id=mesh_core->scene_id;
+                m_id2mesh_gl[mesh_core->scene_id]=mesh_gpu;
+            }
         }
 
 
@@ -1197,35 +1213,43 @@ void Viewer::update_meshes_gl(){
 
 
 
+    //meshes that were loading asynchronously get added to the scene as soon as they are ready
+    m_scene->show_ready_meshes();
+
     //Check if we need to upload to gpu
-    for(int i=0; i<m_scene->nr_meshes(); i++){
-        MeshSharedPtr mesh_core=m_scene->get_mesh_with_idx(i);
+    std::vector<MeshSharedPtr> meshes_core=m_scene->get_meshes();
+    for(size_t i=0; i<meshes_core.size(); i++){
+        const MeshSharedPtr& mesh_core=meshes_core[i];
+        //out of core clouds keep resident the chunks closest to the camera. They are read in the background and this only swaps in the ones that are ready, which makes the mesh dirty so it gets uploaded below
+        if(mesh_core->is_out_of_core() && mesh_core->m_vis.m_is_visible){
+            Eigen::Vector3d cam_pos_obj=mesh_core->model_matrix().inverse() * m_camera->position().cast<double>();
+            mesh_core->update_resident_chunks(cam_pos_obj);
+        }
         upload_single_mesh_to_gpu(mesh_core, /*ism_meshgl sticky*/ false);
     }
 
 
     //check if any of the mesh in the scene got deleted, in which case we should also delete the corresponding mesh_gl
     //need to do it after updating first the meshes_gl with the new meshes in the scene a some of them may have been added newly just now
-    //we check if we have any mesh_gl which has no corresponding mesh_core in the scene with the same name
+    //we check if we have any mesh_gl which has no corresponding mesh_core in the scene with the same id. We use the id with which the mesh_gl was indexed because a mesh that was removed and shown again keeps the same core but gets a new id and a new mesh_gl
+    std::unordered_set<int> scene_ids;
+    for(size_t i=0; i<meshes_core.size(); i++){
+        scene_ids.insert(meshes_core[i]->scene_id);
+    }
     std::vector< std::shared_ptr<MeshGL> > meshes_gl_filtered;
     for(size_t gl_idx=0; gl_idx<m_meshes_gl.size(); gl_idx++){
-        // MeshSharedPtr mesh_core=m_scene->get_mesh_with_idx(i);
-
-        //find the mesh in the scene with the same name
-        bool found=false;
-        for(int i = 0; i<m_scene->nr_meshes(); i++){
-            MeshSharedPtr mesh_core=m_scene->get_mesh_with_idx(i);
-            if(m_meshes_gl[gl_idx]->m_core->name==mesh_core->name){
-                found=true;
-                break;
-            }
-        }
+        const int scene_id=m_meshes_gl[gl_idx]->m_scene_id;
+        bool found= scene_id>=0 && scene_ids.count(scene_id);
 
         //we found it in the scene and in the gpu so we keep it, OR if the meshgl is sticky and we dont care if the mesh core is not in the scene
         if(found || m_meshes_gl[gl_idx]->m_sticky){
             meshes_gl_filtered.push_back(m_meshes_gl[gl_idx]);
         }else{
             //the mesh_gl has no corresponding mesh_core in the scene which means we discard this mesh_gl which will in turn also garbage collect whatever shared ptr if has over the mesh_core
+            auto it=m_id2mesh_gl.find(scene_id);
+            if(it!=m_id2mesh_gl.end() && it->second==m_meshes_gl[gl_idx]){
+                m_id2mesh_gl.erase(it);
+            }
         }
     }
     m_meshes_gl=meshes_gl_filtered;
@@ -1253,19 +1277,19 @@ void Viewer::render_points_to_gbuffer(const MeshGLSharedPtr mesh){
 
     // Set attributes that the vao will pulll from buffers
     if(mesh->m_core->V.size()){
-        mesh->vao.vertex_attribute(shader, "position", mesh->V_buf, 3);
+        mesh->vertex_attribute(shader, "position", mesh->V_buf, 3);
     }
     if(mesh->m_core->NV.size()){
-        mesh->vao.vertex_attribute(shader, "normal", mesh->NV_buf, 3);
+        mesh->vertex_attribute(shader, "normal", mesh->NV_buf, 3);
         shader.uniform_bool(true, "has_normals");
     }else{
         shader.uniform_bool(false, "has_normals");
     }
     if(mesh->m_core->C.size()){
-        GL_C(mesh->vao.vertex_attribute(shader, "color_per_vertex", mesh->C_buf, 3) );
+        GL_C(mesh->vertex_attribute(shader, "color_per_vertex", mesh->C_buf, 3) );
     }
     if(mesh->m_core->UV.size()){
-        GL_C(mesh->vao.vertex_attribute(shader, "uv", mesh->UV_buf, 2) );
+        GL_C(mesh->vertex_attribute(shader, "uv", mesh->UV_buf, 2) );
     }
     if(mesh->m_core->I.size()){
         GL_C(mesh->vao.vertex_attribute(shader, "intensity_per_vertex", mesh->I_buf, 1) );
@@ -1351,10 +1375,10 @@ void Viewer::render_lines(const MeshGLSharedPtr mesh){
 
     // Set attributes that the vao will pulll from buffers
     if(mesh->m_core->V.size()){
-        mesh->vao.vertex_attribute(m_draw_lines_shader, "position", mesh->V_buf, 3);
+        mesh->vertex_attribute(m_draw_lines_shader, "position", mesh->V_buf, 3);
     }
     if(mesh->m_core->C.size()){
-        mesh->vao.vertex_attribute(m_draw_lines_shader, "color_per_vertex", mesh->C_buf, 3);
+        mesh->vertex_attribute(m_draw_lines_shader, "color_per_vertex", mesh->C_buf, 3);
     }
     if(mesh->m_core->E.size()){
         mesh->vao.indices(mesh->E_buf); //Says the indices with we refer to vertices, this gives us the triangles
@@ -1389,7 +1413,7 @@ void Viewer::render_lines(const MeshGLSharedPtr mesh){
     if(mesh->m_core->m_vis.m_overlay_lines){
         glDepthFunc(GL_ALWAYS);
     }
-    glDrawElements(GL_LINES, mesh->m_core->E.size(), GL_UNSIGNED_INT, 0);
+    glDrawElements(GL_LINES, mesh->m_core->E.size(), mesh->m_index_type, 0);
 
     glLineWidth( 1.0f );
     glDepthFunc(GL_LESS);
@@ -1405,10 +1429,10 @@ void Viewer::render_normals(const MeshGLSharedPtr mesh){
     gl::Shader& shader = m_draw_normals_shader;
 
     if(mesh->m_core->V.size()){
-        mesh->vao.vertex_attribute(shader, "position", mesh->V_buf, 3);
+        mesh->vertex_attribute(shader, "position", mesh->V_buf, 3);
     }
     if(mesh->m_core->NV.size()){
-        mesh->vao.vertex_attribute(shader, "normal", mesh->NV_buf, 3);
+        mesh->vertex_attribute(shader, "normal", mesh->NV_buf, 3);
     }
 
 
@@ -1452,7 +1476,7 @@ void Viewer::render_wireframe(const MeshGLSharedPtr mesh){
 
      // Set attributes that the vao will pulll from buffers
     if(mesh->m_core->V.size()){
-        mesh->vao.vertex_attribute(m_draw_wireframe_shader, "position", mesh->V_buf, 3);
+        mesh->vertex_attribute(m_draw_wireframe_shader, "position", mesh->V_buf, 3);
     }
     if(mesh->m_core->F.size()){
         mesh->vao.indices(mesh->F_buf); //Says the indices with we refer to vertices, this gives us the triangles
@@ -1479,7 +1503,7 @@ void Viewer::render_wireframe(const MeshGLSharedPtr mesh){
 
     // draw
     mesh->vao.bind();
-    glDrawElements(GL_TRIANGLES, mesh->m_core->F.size(), GL_UNSIGNED_INT, 0);
+    glDrawElements(GL_TRIANGLES, mesh->m_core->F.size(), mesh->m_index_type, 0);
 
 
     //revert to previous openglstat
@@ -1501,19 +1525,19 @@ void Viewer::render_mesh_to_gbuffer(const MeshGLSharedPtr mesh){
 
     // Set attributes that the vao will pulll from buffers
     if(mesh->m_core->V.size()){
-        mesh->vao.vertex_attribute(m_draw_mesh_shader, "position", mesh->V_buf, 3);
+        mesh->vertex_attribute(m_draw_mesh_shader, "position", mesh->V_buf, 3);
     }
     if(mesh->m_core->NV.size()){
-        mesh->vao.vertex_attribute(m_draw_mesh_shader, "normal", mesh->NV_buf, 3);
+        mesh->vertex_attribute(m_draw_mesh_shader, "normal", mesh->NV_buf, 3);
     }
     if(mesh->m_core->UV.size()){
-        GL_C(mesh->vao.vertex_attribute(m_draw_mesh_shader, "uv", mesh->UV_buf, 2) );
+        GL_C(mesh->vertex_attribute(m_draw_mesh_shader, "uv", mesh->UV_buf, 2) );
     }
     if(mesh->m_core->V_tangent_u.size()){
         GL_C(mesh->vao.vertex_attribute(m_draw_mesh_shader, "tangent", mesh->V_tangent_u_buf, 3) );
     }
     if(mesh->m_core->C.size()){
-        GL_C(mesh->vao.vertex_attribute(m_draw_mesh_shader, "color_per_vertex", mesh->C_buf, 3) );
+        GL_C(mesh->vertex_attribute(m_draw_mesh_shader, "color_per_vertex", mesh->C_buf, 3) );
     }
     if(mesh->m_core->I.size()){
         GL_C(mesh->vao.vertex_attribute(m_draw_mesh_shader, "intensity_per_vertex", mesh->I_buf, 1) );
@@ -1586,7 +1610,7 @@ void Viewer::render_mesh_to_gbuffer(const MeshGLSharedPtr mesh){
 
     // draw
     mesh->vao.bind();
-    glDrawElements(GL_TRIANGLES, mesh->m_core->F.size(), GL_UNSIGNED_INT, 0);
+    glDrawElements(GL_TRIANGLES, mesh->m_core->F.size(), mesh->m_index_type, 0);
 
 
     GL_C( glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0) );
@@ -1628,10 +1652,10 @@ void Viewer::render_surfels_to_gbuffer(const MeshGLSharedPtr mesh){
 
      // Set attributes that the vao will pulll from buffers
     if(mesh->m_core->V.size()){
-        mesh->vao.vertex_attribute(m_draw_surfels_shader, "position", mesh->V_buf, 3);
+        mesh->vertex_attribute(m_draw_surfels_shader, "position", mesh->V_buf, 3);
     }
     if(mesh->m_core->NV.size()){
-        mesh->vao.vertex_attribute(m_draw_surfels_shader, "normal", mesh->NV_buf, 3);
+        mesh->vertex_attribute(m_draw_surfels_shader, "normal", mesh->NV_buf, 3);
     }
     if(mesh->m_core->V_tangent_u.size()){
         mesh->vao.vertex_attribute(m_draw_surfels_shader, "tangent_u", mesh->V_tangent_u_buf, 3);
@@ -1640,7 +1664,7 @@ void Viewer::render_surfels_to_gbuffer(const MeshGLSharedPtr mesh){
         mesh->vao.vertex_attribute(m_draw_surfels_shader, "lenght_v", mesh->V_lenght_v_buf, 1);
     }
     if(mesh->m_core->C.size()){
-        mesh->vao.vertex_attribute(m_draw_surfels_shader, "color_per_vertex", mesh->C_buf, 3);
+        mesh->vertex_attribute(m_draw_surfels_shader, "color_per_vertex", mesh->C_buf, 3);
     }
     if(mesh->m_core->L_pred.size()){
         mesh->vao.vertex_attribute(m_draw_surfels_shader, "label_pred_per_vertex", mesh->L_pred_buf, 1);
@@ -2802,21 +2826,17 @@ void Viewer::integrate_brdf(gl::Texture2D& brdf_lut_tex){
 //     VLOG(1) << "C++ object with ptr "  <<m_spot_lights[i]<< "has position " << m_spot_lights[i]->position().transpose();
 // }
 
-void Viewer::write_gbuffer_to_folder(){
-    //read the normals and dencode them for writing to file
-    // gl::Texture2D normals_deencoded_debugging;
-    // gl::Texture2D metalness_roughness_triple_channel_debugging; //metalness and roughness are stored as a RG but Opencv Cannot write rg so we make a rgb texture
-    // gl::Texture2D depth_float_debugging;  //the depth is type depth component
-    // normals_deencoded_debugging.allocate_or_resize(GL_RGB32F, GL_RGB, GL_FLOAT, m_gbuffer.width(), m_gbuffer.height());
-    // metalness_roughness_triple_channel_debugging.allocate_or_resize(GL_RGB32F, GL_RGB, GL_FLOAT, m_gbuffer.width(), m_gbuffer.height());
-    // depth_float_debugging.allocate_or_resize(GL_R32F, GL_RED, GL_FLOAT, m_gbuffer.width(), m_gbuffer.height());
-
-    gl::GBuffer debug_gbuffer;
-    GL_C( debug_gbuffer.set_size(m_gbuffer.width(), m_gbuffer.height() ) ); //established what will be the size of the textures attached to this framebuffer
-    GL_C( debug_gbuffer.add_texture("normals_debug_gtex", GL_RGB32F, GL_RGB, GL_FLOAT) );
-    GL_C( debug_gbuffer.add_texture("metalness_and_roughness_debug_gtex", GL_RGB32F, GL_RGB, GL_FLOAT) ); //metalness and roughness are stored as a RG but Opencv Cannot write rg so we make a rgb texture
-    GL_C( debug_gbuffer.add_texture("depth_debug_gtex", GL_R32F, GL_RED, GL_FLOAT) ); //the depth is stored as depth_component which cannot be easily convertible to opencv so we record it here as R32F
-    debug_gbuffer.sanity_check();
+void Viewer::decode_gbuffer(){
+    //the textures are allocated only the first time and after that just resized together with the gbuffer
+    GL_C( m_decoded_gbuffer.set_size(m_gbuffer.width(), m_gbuffer.height() ) ); //established what will be the size of the textures attached to this framebuffer
+    if(!m_decoded_gbuffer.has_tex_with_name("normal_gtex")){
+        GL_C( m_decoded_gbuffer.add_texture("normal_gtex", GL_RGB32F, GL_RGB, GL_FLOAT) );
+        GL_C( m_decoded_gbuffer.add_texture("albedo_gtex", GL_RGB32F, GL_RGB, GL_FLOAT) );
+        GL_C( m_decoded_gbuffer.add_texture("metalness_and_roughness_gtex", GL_RG32F, GL_RG, GL_FLOAT) );
+        GL_C( m_decoded_gbuffer.add_texture("depth_gtex", GL_R32F, GL_RED, GL_FLOAT) ); //the depth is stored as depth_component which cannot be easily convertible to opencv so we record it here as R32F
+        GL_C( m_decoded_gbuffer.add_texture("depth_linear_gtex", GL_R32F, GL_RED, GL_FLOAT) );
+        m_decoded_gbuffer.sanity_check();
+    }
 
 
     glViewport(0.0f , 0.0f, m_gbuffer.width(), m_gbuffer.height() );
@@ -2834,14 +2854,20 @@ void Viewer::write_gbuffer_to_folder(){
     //shader setup
     GL_C( shader.use() );
     shader.bind_texture(m_gbuffer.tex_with_name("normal_gtex"), "normals_encoded_tex");
+    shader.bind_texture(m_gbuffer.tex_with_name("diffuse_gtex"), "diffuse_tex");
     shader.bind_texture(m_gbuffer.tex_with_name("metalness_and_roughness_gtex"), "metalness_and_roughness_tex");
     shader.bind_texture(m_gbuffer.tex_with_name("depth_gtex"), "depth_tex");
-    debug_gbuffer.bind_for_draw();
-    shader.draw_into(debug_gbuffer,
+    shader.uniform_bool(m_using_fat_gbuffer , "using_fat_gbuffer");
+    shader.uniform_float( m_camera->m_far / (m_camera->m_far - m_camera->m_near), "projection_a"); // according to the formula at the bottom of article https://mynameismjp.wordpress.com/2010/09/05/position-from-depth-3/
+    shader.uniform_float( (-m_camera->m_far * m_camera->m_near) / (m_camera->m_far - m_camera->m_near) , "projection_b");
+    m_decoded_gbuffer.bind_for_draw();
+    shader.draw_into(m_decoded_gbuffer,
                     {
-                    std::make_pair("normal_out", "normals_debug_gtex"),
-                    std::make_pair("metalness_and_roughness_out", "metalness_and_roughness_debug_gtex"),
-                    std::make_pair("depth_out", "depth_debug_gtex"),
+                    std::make_pair("normal_out", "normal_gtex"),
+                    std::make_pair("albedo_out", "albedo_gtex"),
+                    std::make_pair("metalness_and_roughness_out", "metalness_and_roughness_gtex"),
+                    std::make_pair("depth_out", "depth_gtex"),
+                    std::make_pair("depth_linear_out", "depth_linear_gtex"),
                     }
                     ); //makes the shaders draw into the buffers we defines in the gbuffer
     // draw
@@ -2851,43 +2877,7 @@ void Viewer::write_gbuffer_to_folder(){
     //restore the state
     glDepthMask(true);
     glEnable(GL_DEPTH_TEST);
-
-
-
-
-    // glFinish();
-    //get all the textures as cv::mats
-    cv::Mat mat, normal_mat, diffuse_mat, depth_mat, metalness_and_roughness_mat, ao_blurred_mat;
-    //normal
-    mat=debug_gbuffer.tex_with_name("normals_debug_gtex").download_to_cv_mat();
-    cv::flip(mat, normal_mat, 0);
-    cv::cvtColor(normal_mat, normal_mat, cv::COLOR_BGR2RGB);
-    normal_mat*=255;
-    //diffuse
-    mat=m_gbuffer.tex_with_name("diffuse_gtex").download_to_cv_mat();
-    cv::flip(mat, diffuse_mat, 0);
-    cv::cvtColor(diffuse_mat, diffuse_mat, cv::COLOR_BGR2RGB);
-    //depth
-    mat=debug_gbuffer.tex_with_name("depth_debug_gtex").download_to_cv_mat();
-    cv::flip(mat, depth_mat, 0);
-    depth_mat*=255;
-    //metalness_and_roughness
-    mat=debug_gbuffer.tex_with_name("metalness_and_roughness_debug_gtex").download_to_cv_mat();
-    cv::flip(mat, metalness_and_roughness_mat, 0);
-    cv::cvtColor(metalness_and_roughness_mat, metalness_and_roughness_mat, cv::COLOR_BGR2RGB);
-    metalness_and_roughness_mat*=255;
-    //ao
-    mat=m_ao_blurred_tex.download_to_cv_mat();
-    cv::flip(mat, ao_blurred_mat, 0);
-
-    fs::path path = "./debug";
-    fs::create_directories(path);
-    VLOG(1) << "Writing debug images in " << path;
-    cv::imwrite( (path/"./g_normal.png").string(), normal_mat );
-    cv::imwrite( (path/"./g_diffuse.png").string(), diffuse_mat );
-    cv::imwrite( (path/"./depth.png").string(), depth_mat );
-    cv::imwrite( (path/"./g_metalness_and_roughness.png").string(), metalness_and_roughness_mat );
-    cv::imwrite( (path/"./ao_blurred.png").string(), ao_blurred_mat );
+    GL_C( glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0) );
 
 }
 